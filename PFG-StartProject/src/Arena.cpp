@@ -0,0 +1,65 @@
+#include "Arena.h"
+#include <stdint.h>
+
+/*! \brief Brief description.
+*  FrameArena hands out step-long memory from one block that grows to fit the largest step.
+*
+*/
+FrameArena::FrameArena(size_t capacity)
+{
+	_capacity = capacity;
+	_block = new char[_capacity];
+	_used = 0;
+	_overflowBytes = 0;
+}
+
+FrameArena::~FrameArena()
+{
+	delete[] _block;
+	for (size_t i = 0; i < _overflow.size(); i++)
+	{
+		delete[] _overflow[i];
+	}
+}
+
+void* FrameArena::Allocate(size_t bytes, size_t alignment)
+{
+	// Round the offset up against the block's address, new[] only promises the alignment of the largest scalar
+	uintptr_t address = (uintptr_t)(_block + _used);
+	size_t padding = (size_t)((alignment - (address & (alignment - 1))) & (alignment - 1));
+	if (_used + padding + bytes <= _capacity)
+	{
+		void* memory = _block + _used + padding;
+		_used += padding + bytes;
+		return memory;
+	}
+
+	// Out of room for this step, borrow a block of its own and remember to make the main one big enough
+	char* extra = new char[bytes + alignment];
+	_overflow.push_back(extra);
+	_overflowBytes += bytes + alignment;
+	address = (uintptr_t)extra;
+	padding = (size_t)((alignment - (address & (alignment - 1))) & (alignment - 1));
+	return extra + padding;
+}
+
+void FrameArena::Reset()
+{
+	if (!_overflow.empty())
+	{
+		for (size_t i = 0; i < _overflow.size(); i++)
+		{
+			delete[] _overflow[i];
+		}
+		_overflow.clear();
+
+		// Grow with some headroom so a step that is slightly larger doesn't overflow again
+		size_t capacity = _used + _overflowBytes;
+		capacity += capacity / 2;
+		delete[] _block;
+		_block = new char[capacity];
+		_capacity = capacity;
+		_overflowBytes = 0;
+	}
+	_used = 0;
+}
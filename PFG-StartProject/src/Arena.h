@@ -0,0 +1,63 @@
+#ifndef _Arena_H_
+#define _Arena_H_
+
+#include <vector>
+#include <stddef.h>
+
+/*! \brief Brief description.
+*  FrameArena hands out memory for data that only lives for one step, like scratch orderings and per-step lists,
+*  by moving an offset along one block. Nothing is freed on its own, the whole arena is reset at the start of the
+*  next step.
+*
+*  If a step asks for more than the block holds, the rest comes from extra blocks, and on the next reset they are
+*  freed and the block is regrown to hold all of it. After a few steps the block fits the largest step and the
+*  arena stops touching the heap.
+*
+*  Objects aren't constructed or destroyed, so only plain data should go in it.
+*
+*/
+class FrameArena
+{
+public:
+
+	/** FrameArena constructor
+	* @param size_t capacity bytes in the first block
+	*/
+	explicit FrameArena(size_t capacity = 64 * 1024);
+	/** FrameArena destructor, frees every block
+	*/
+	~FrameArena();
+
+	/** Memory for bytes, aligned to alignment, which must be a power of two
+	*/
+	void* Allocate(size_t bytes, size_t alignment);
+	/** An uninitialised array of count T
+	*/
+	template <typename T>
+	T* AllocateArray(size_t count) { return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T))); }
+
+	/** Free everything handed out since the last reset, growing the block if it overflowed
+	*/
+	void Reset();
+
+	/** Bytes handed out since the last reset
+	*/
+	size_t GetUsed() const { return _used + _overflowBytes; }
+	size_t GetCapacity() const { return _capacity; }
+
+private:
+
+	FrameArena(const FrameArena&);
+	FrameArena& operator=(const FrameArena&);
+
+	char* _block;
+	size_t _capacity;
+	size_t _used;
+
+	/** Blocks taken this step once the main one was full, freed on reset
+	*/
+	std::vector<char*> _overflow;
+	size_t _overflowBytes;
+};
+
+#endif //!_Arena_H_
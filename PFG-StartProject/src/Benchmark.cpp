@@ -0,0 +1,993 @@
+#include "Benchmark.h"
+#include "Integrators.h"
+#include "DynamicObject.h"
+#include "Fluid.h"
+#include "Gravity.h"
+#include "Particles.h"
+#include "PlaneColliders.h"
+#include "QueryTree.h"
+#include "Transforms.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+/*! \brief Brief description.
+*  Benchmarks for the physics code, writing CSV.
+*
+*/
+
+namespace
+{
+	// The same start for every integrator: a grid of bodies at rest under gravity
+	void ResetBodies(BodyArrays& bodies)
+	{
+		for (size_t i = 0; i < bodies.Size(); i++)
+		{
+			bodies.position[0][i] = (float)(i % 100);
+			bodies.position[1][i] = 20.0f;
+			bodies.position[2][i] = (float)(i / 100);
+			bodies.invMass[i] = 1.0f / (1.0f + (i % 7));
+			bodies.stepSize[i] = 0.0f;
+			bodies.clockSpan[i] = 0.0f;
+			for (int k = 0; k < 3; k++)
+			{
+				bodies.velocity[k][i] = 0.0f;
+				bodies.force[k][i] = 0.0f;
+			}
+			bodies.force[1][i] = -0.98f / bodies.invMass[i];
+		}
+	}
+
+	// Same gravity as DynamicObject::ComputeForces
+	const float WP_GRAVITY = 0.98f;
+	// Every scene is run on this many independent copies so the wall time is big enough to measure
+	const size_t WP_COPIES = 256;
+	// Step lengths for each scene, halving each time
+	const float WP_STEP_LENGTHS[] = { 0.2f, 0.1f, 0.05f, 0.025f, 0.0125f };
+	const int WP_STEP_LENGTH_COUNT = sizeof(WP_STEP_LENGTHS) / sizeof(WP_STEP_LENGTHS[0]);
+
+	// One run of one scene with one integrator and step length
+	struct WorkPrecisionResult
+	{
+		const char* scene;
+		const char* integrator;
+		float deltaTs;
+		int steps;
+		size_t bodies;
+		double wallMs;
+		double positionError; /*!< Distance from the analytic position at the end of the run */
+		double energyDrift; /*!< |E(T) - E(0)| / |E(0)| */
+		double angularMomentumError; /*!< |L(T) - L_exact(T)| / |L_exact(T)|, or absolute if L_exact is zero */
+	};
+
+	// Mutual gravity between bodies 2i and 2i + 1
+	struct PairGravity
+	{
+		float G;
+
+		void operator()(const BodyArrays& bodies, const std::vector<float>* position, size_t begin, size_t end, std::vector<float>* acceleration) const
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				size_t j = i ^ 1;
+				float dx = position[0][j] - position[0][i];
+				float dy = position[1][j] - position[1][i];
+				float dz = position[2][j] - position[2][i];
+				float r2 = dx * dx + dy * dy + dz * dz;
+				float s = G / (bodies.invMass[j] * r2 * std::sqrt(r2));
+				acceleration[0][i] = s * dx;
+				acceleration[1][i] = s * dy;
+				acceleration[2][i] = s * dz;
+			}
+		}
+	};
+
+	glm::dvec3 BodyPosition(const BodyArrays& bodies, size_t i)
+	{
+		return glm::dvec3(bodies.position[0][i], bodies.position[1][i], bodies.position[2][i]);
+	}
+
+	glm::dvec3 BodyVelocity(const BodyArrays& bodies, size_t i)
+	{
+		return glm::dvec3(bodies.velocity[0][i], bodies.velocity[1][i], bodies.velocity[2][i]);
+	}
+
+	void SetBody(BodyArrays& bodies, size_t i, const glm::vec3& position, const glm::vec3& velocity, float mass)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			bodies.position[k][i] = position[k];
+			bodies.velocity[k][i] = velocity[k];
+			bodies.force[k][i] = 0.0f;
+		}
+		bodies.invMass[i] = 1.0f / mass;
+	}
+
+	double Relative(double error, double reference)
+	{
+		return std::fabs(reference) > 1.0e-12 ? error / std::fabs(reference) : error;
+	}
+
+	double ElapsedMs(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// A projectile under constant gravity: x(t) = x0 + v0 t + g t^2 / 2
+	WorkPrecisionResult FreeFall(IntegratorType type, float deltaTs)
+	{
+		const glm::vec3 x0(0.0f, 10.0f, 0.0f);
+		const glm::vec3 v0(1.0f, 2.0f, 0.5f);
+		const glm::dvec3 g(0.0, -WP_GRAVITY, 0.0);
+		const float duration = 5.0f;
+
+		BodyArrays bodies;
+		bodies.Resize(WP_COPIES);
+		for (size_t i = 0; i < WP_COPIES; i++)
+		{
+			SetBody(bodies, i, x0, v0, 1.0f);
+			bodies.force[1][i] = -WP_GRAVITY;
+		}
+
+		WorkPrecisionResult result;
+		result.deltaTs = deltaTs;
+		result.steps = (int)std::lround(duration / deltaTs);
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int step = 0; step < result.steps; step++)
+		{
+			PFG::IntegrateBodies(type, bodies, AccumulatedForce(), 0, WP_COPIES, deltaTs);
+		}
+		result.wallMs = ElapsedMs(start);
+
+		double t = (double)result.steps * deltaTs;
+		glm::dvec3 exactX = glm::dvec3(x0) + glm::dvec3(v0) * t + 0.5 * g * t * t;
+		glm::dvec3 exactV = glm::dvec3(v0) + g * t;
+		glm::dvec3 x = BodyPosition(bodies, 0);
+		glm::dvec3 v = BodyVelocity(bodies, 0);
+
+		double e0 = 0.5 * glm::dot(glm::dvec3(v0), glm::dvec3(v0)) + WP_GRAVITY * x0.y;
+		double e1 = 0.5 * glm::dot(v, v) + WP_GRAVITY * x.y;
+		glm::dvec3 exactL = glm::cross(exactX, exactV);
+
+		result.positionError = glm::length(x - exactX);
+		result.energyDrift = Relative(std::fabs(e1 - e0), e0);
+		result.angularMomentumError = Relative(glm::length(glm::cross(x, v) - exactL), glm::length(exactL));
+		return result;
+	}
+
+	// A ball dropped from rest onto the ground with no energy loss, bouncing back to the same height forever
+	WorkPrecisionResult BouncingBall(IntegratorType type, float deltaTs)
+	{
+		const float height = 10.0f;
+		const float radius = 0.5f;
+		const float duration = 20.0f;
+
+		BodyArrays bodies;
+		bodies.Resize(WP_COPIES);
+		for (size_t i = 0; i < WP_COPIES; i++)
+		{
+			SetBody(bodies, i, glm::vec3(0.0f, height, 0.0f), glm::vec3(0.0f), 1.0f);
+			bodies.force[1][i] = -WP_GRAVITY;
+		}
+
+		WorkPrecisionResult result;
+		result.deltaTs = deltaTs;
+		result.steps = (int)std::lround(duration / deltaTs);
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int step = 0; step < result.steps; step++)
+		{
+			PFG::IntegrateBodies(type, bodies, AccumulatedForce(), 0, WP_COPIES, deltaTs);
+
+			// Reflect anything that went through the ground back out
+			float* y = bodies.position[1].data();
+			float* vy = bodies.velocity[1].data();
+			for (size_t i = 0; i < WP_COPIES; i++)
+			{
+				if (y[i] < radius && vy[i] < 0.0f)
+				{
+					y[i] = 2.0f * radius - y[i];
+					vy[i] = -vy[i];
+				}
+			}
+		}
+		result.wallMs = ElapsedMs(start);
+
+		// Time since the last time the ball was at the top of its bounce
+		double t = (double)result.steps * deltaTs;
+		double fallTime = std::sqrt(2.0 * (height - radius) / WP_GRAVITY);
+		double tau = std::fmod(t + fallTime, 2.0 * fallTime) - fallTime;
+		double exactY = height - 0.5 * WP_GRAVITY * tau * tau;
+
+		glm::dvec3 x = BodyPosition(bodies, 0);
+		glm::dvec3 v = BodyVelocity(bodies, 0);
+		double e0 = WP_GRAVITY * height;
+		double e1 = 0.5 * glm::dot(v, v) + WP_GRAVITY * x.y;
+
+		result.positionError = glm::length(x - glm::dvec3(0.0, exactY, 0.0));
+		result.energyDrift = Relative(std::fabs(e1 - e0), e0);
+		// Straight up and down through the origin, the exact angular momentum is zero
+		result.angularMomentumError = glm::length(glm::cross(x, v));
+		return result;
+	}
+
+	// Two equal masses on a circular orbit around their centre of mass
+	WorkPrecisionResult OrbitingPair(IntegratorType type, float deltaTs)
+	{
+		const float G = 1.0f;
+		const float mass = 1.0f;
+		const float separation = 2.0f;
+		const float duration = 20.0f;
+		// Angular speed of a circular orbit
+		const double omega = std::sqrt(G * 2.0 * mass / (separation * separation * separation));
+		const float speed = (float)(omega * 0.5 * separation);
+
+		BodyArrays bodies;
+		bodies.Resize(WP_COPIES);
+		for (size_t i = 0; i < WP_COPIES; i += 2)
+		{
+			SetBody(bodies, i, glm::vec3(-0.5f * separation, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -speed), mass);
+			SetBody(bodies, i + 1, glm::vec3(0.5f * separation, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, speed), mass);
+		}
+
+		PairGravity gravity;
+		gravity.G = G;
+
+		WorkPrecisionResult result;
+		result.deltaTs = deltaTs;
+		result.steps = (int)std::lround(duration / deltaTs);
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int step = 0; step < result.steps; step++)
+		{
+			PFG::IntegrateBodies(type, bodies, gravity, 0, WP_COPIES, deltaTs);
+		}
+		result.wallMs = ElapsedMs(start);
+
+		double t = (double)result.steps * deltaTs;
+		glm::dvec3 exactB = 0.5 * separation * glm::dvec3(std::cos(omega * t), 0.0, std::sin(omega * t));
+
+		glm::dvec3 xa = BodyPosition(bodies, 0);
+		glm::dvec3 xb = BodyPosition(bodies, 1);
+		glm::dvec3 va = BodyVelocity(bodies, 0);
+		glm::dvec3 vb = BodyVelocity(bodies, 1);
+
+		double e0 = mass * speed * speed - G * mass * mass / separation;
+		double e1 = 0.5 * (double)mass * (glm::dot(va, va) + glm::dot(vb, vb)) - G * mass * mass / glm::length(xb - xa);
+		glm::dvec3 l0 = glm::dvec3(0.0, -2.0 * mass * 0.5 * separation * speed, 0.0);
+		glm::dvec3 l1 = (double)mass * (glm::cross(xa, va) + glm::cross(xb, vb));
+
+		result.positionError = glm::max(glm::length(xa + exactB), glm::length(xb - exactB));
+		result.energyDrift = Relative(std::fabs(e1 - e0), e0);
+		result.angularMomentumError = Relative(glm::length(l1 - l0), glm::length(l0));
+		return result;
+	}
+
+	// A free sphere spinning with constant angular momentum, integrated by DynamicObject's quaternion update
+	WorkPrecisionResult SpinningBody(float deltaTs)
+	{
+		const float mass = 1.0f;
+		const float radius = 1.0f;
+		const glm::vec3 momentum(0.2f, 0.8f, 0.3f);
+		const float duration = 10.0f;
+
+		std::vector<DynamicObject> bodies(WP_COPIES);
+		for (size_t i = 0; i < bodies.size(); i++)
+		{
+			bodies[i].SetMass(mass);
+			bodies[i].SetBoundingRadius(radius);
+			bodies[i].SetAngularMomentum(momentum);
+			bodies[i].StartSimulation(true);
+		}
+
+		WorkPrecisionResult result;
+		result.deltaTs = deltaTs;
+		result.steps = (int)std::lround(duration / deltaTs);
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int step = 0; step < result.steps; step++)
+		{
+			for (size_t i = 0; i < bodies.size(); i++)
+			{
+				bodies[i].IntegrateRotation(deltaTs);
+			}
+		}
+		result.wallMs = ElapsedMs(start);
+
+		// A sphere spins about its angular momentum at a constant rate
+		double t = (double)result.steps * deltaTs;
+		glm::dvec3 omega = glm::dvec3(momentum) / (0.4 * mass * radius * radius);
+		glm::dquat exact = glm::angleAxis(glm::length(omega) * t, glm::normalize(omega));
+		glm::dquat q = glm::dquat(bodies[0].GetRotation());
+
+		// Track a point on the surface
+		glm::dvec3 surfacePoint(radius, 0.0, 0.0);
+		glm::dvec3 l1 = glm::dvec3(bodies[0].GetAngularMomentum());
+		double e0 = 0.5 * glm::dot(omega, glm::dvec3(momentum));
+		double e1 = 0.5 * glm::dot(glm::dvec3(bodies[0].GetAngularVelocity()), l1);
+
+		result.positionError = glm::length(q * surfacePoint - exact * surfacePoint);
+		result.energyDrift = Relative(std::fabs(e1 - e0), e0);
+		result.angularMomentumError = Relative(glm::length(l1 - glm::dvec3(momentum)), glm::length(glm::dvec3(momentum)));
+		return result;
+	}
+
+	/*
+	Bodies of equal mass scattered like a Plummer sphere of unit scale radius and unit total mass,
+	dense in the middle with a long tail, which is what makes the tree uneven
+	*/
+	void PlummerSphere(size_t count, unsigned seed, std::vector<float> position[3], std::vector<float>& mass)
+	{
+		std::mt19937 random(seed);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+		for (int k = 0; k < 3; k++)
+		{
+			position[k].resize(count);
+		}
+		mass.assign(count, 1.0f / count);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			// Invert the cumulative mass, cutting off the few bodies that would land very far out
+			float u = std::max(uniform(random), 1.0e-6f);
+			float r = std::min(1.0f / std::sqrt(std::pow(u, -2.0f / 3.0f) - 1.0f), 20.0f);
+			float z = 2.0f * uniform(random) - 1.0f;
+			float phi = 6.2831853f * uniform(random);
+			float s = std::sqrt(1.0f - z * z);
+			position[0][i] = r * s * std::cos(phi);
+			position[1][i] = r * s * std::sin(phi);
+			position[2][i] = r * z;
+		}
+	}
+
+	/*
+	Root mean square and largest error of each acceleration relative to its size
+	*/
+	void AccelerationError(const std::vector<float> acceleration[3], const std::vector<float> reference[3], double& rms, double& largest)
+	{
+		const size_t count = reference[0].size();
+		double sum = 0.0;
+		largest = 0.0;
+		for (size_t i = 0; i < count; i++)
+		{
+			glm::dvec3 a(acceleration[0][i], acceleration[1][i], acceleration[2][i]);
+			glm::dvec3 b(reference[0][i], reference[1][i], reference[2][i]);
+			double error = Relative(glm::length(a - b), glm::length(b));
+			sum += error * error;
+			largest = std::max(largest, error);
+		}
+		rms = count > 0 ? std::sqrt(sum / count) : 0.0;
+	}
+
+	/*
+	Spheres of one radius scattered evenly through a cube, with the cube sized to keep the same number per volume
+	*/
+	float ScatterSpheres(size_t count, float radius, float density, unsigned seed, std::vector<float> position[3], std::vector<float>& radii)
+	{
+		std::mt19937 random(seed);
+		float side = std::cbrt((float)count / density);
+		std::uniform_real_distribution<float> uniform(0.0f, side);
+
+		for (int k = 0; k < 3; k++)
+		{
+			position[k].resize(count);
+			for (size_t i = 0; i < count; i++)
+			{
+				position[k][i] = uniform(random);
+			}
+		}
+		radii.assign(count, radius);
+		return side;
+	}
+
+	/*
+	Rays through a square grid of pixels from a camera in front of the cube looking into it, neighbouring rays
+	start together and point nearly the same way
+	*/
+	void CameraCasts(size_t width, float side, float radius, std::vector<QueryCast>& casts)
+	{
+		casts.clear();
+		glm::vec3 eye(0.5f * side, 0.5f * side, -0.5f * side);
+		for (size_t y = 0; y < width; y++)
+		{
+			for (size_t x = 0; x < width; x++)
+			{
+				// About a 60 degree field of view
+				glm::vec3 direction((x + 0.5f) / width - 0.5f, (y + 0.5f) / width - 0.5f, 0.866f);
+				casts.push_back(QueryCast(eye, direction, 2.0f * side, radius));
+			}
+		}
+	}
+
+	/*
+	Rays starting anywhere in the cube and pointing anywhere, so no two in a packet share much of their path
+	*/
+	void RandomCasts(size_t count, float side, unsigned seed, std::vector<QueryCast>& casts)
+	{
+		std::mt19937 random(seed);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+		casts.clear();
+		for (size_t i = 0; i < count; i++)
+		{
+			glm::vec3 origin(uniform(random) * side, uniform(random) * side, uniform(random) * side);
+			float z = 2.0f * uniform(random) - 1.0f;
+			float phi = 6.2831853f * uniform(random);
+			float s = std::sqrt(1.0f - z * z);
+			casts.push_back(QueryCast(origin, glm::vec3(s * std::cos(phi), s * std::sin(phi), z), side));
+		}
+	}
+
+	/*
+	Nearest hit of each cast found by testing it against every sphere, the baseline for the tree.
+	Returns the number of casts that hit anything
+	*/
+	size_t LinearCast(const std::vector<QueryCast>& casts, const std::vector<float> position[3], const std::vector<float>& radius)
+	{
+		size_t hits = 0;
+		for (size_t q = 0; q < casts.size(); q++)
+		{
+			const QueryCast& cast = casts[q];
+			glm::vec3 unit = glm::normalize(cast.direction);
+			float nearest = cast.maxDistance;
+			bool found = false;
+			for (size_t i = 0; i < radius.size(); i++)
+			{
+				glm::vec3 oc = cast.origin - glm::vec3(position[0][i], position[1][i], position[2][i]);
+				float sum = cast.radius + radius[i];
+				float b = glm::dot(oc, unit);
+				float c = glm::dot(oc, oc) - sum * sum;
+				float discriminant = b * b - c;
+				if (discriminant < 0.0f)
+				{
+					continue;
+				}
+				float t = c < 0.0f ? 0.0f : -b - std::sqrt(discriminant);
+				if (t >= 0.0f && t <= nearest)
+				{
+					nearest = t;
+					found = true;
+				}
+			}
+			hits += found ? 1 : 0;
+		}
+		return hits;
+	}
+
+	/*
+	Squared distances to the k nearest centres of each point, found by testing every sphere, the baseline for
+	the tree's nearest queries. Only the last point's are kept in best
+	*/
+	void LinearNearest(const std::vector<glm::vec3>& points, size_t k, const std::vector<float> position[3], std::vector<float>& best)
+	{
+		for (size_t q = 0; q < points.size(); q++)
+		{
+			best.assign(k, 1.0e30f);
+			for (size_t i = 0; i < position[0].size(); i++)
+			{
+				glm::vec3 offset = glm::vec3(position[0][i], position[1][i], position[2][i]) - points[q];
+				float distance = glm::dot(offset, offset);
+				if (distance >= best[k - 1])
+				{
+					continue;
+				}
+				size_t slot = k - 1;
+				while (slot > 0 && best[slot - 1] > distance)
+				{
+					best[slot] = best[slot - 1];
+					slot--;
+				}
+				best[slot] = distance;
+			}
+		}
+	}
+}
+
+namespace PFG
+{
+	void BenchmarkIntegrators(size_t bodyCount, int steps, std::ostream& out)
+	{
+		const float deltaTs = 0.1f;
+		const int forceEvaluations[INTEGRATOR_COUNT] = {
+			EulerIntegrator::forceEvaluations,
+			VerletIntegrator::forceEvaluations,
+			RungeKutta2Integrator::forceEvaluations,
+			RungeKutta4Integrator::forceEvaluations,
+			BogackiShampineIntegrator::forceEvaluations };
+
+		BodyArrays bodies;
+		bodies.Resize(bodyCount);
+
+		out << "integrator,force_evaluations,bodies,steps,total_ms,ns_per_body_step\n";
+
+		for (int type = 0; type < INTEGRATOR_COUNT; type++)
+		{
+			ResetBodies(bodies);
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (int step = 0; step < steps; step++)
+			{
+				IntegrateBodies((IntegratorType)type, bodies, AccumulatedForce(), 0, bodyCount, deltaTs);
+			}
+			std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+			double totalNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+			double bodySteps = (double)bodyCount * steps;
+
+			out << GetIntegratorName((IntegratorType)type) << ","
+				<< forceEvaluations[type] << ","
+				<< bodyCount << ","
+				<< steps << ","
+				<< totalNs / 1.0e6 << ","
+				<< (bodySteps > 0.0 ? totalNs / bodySteps : 0.0) << "\n";
+		}
+	}
+
+	void BenchmarkWorkPrecision(std::ostream& csv, std::ostream& json)
+	{
+		std::vector<WorkPrecisionResult> results;
+
+		for (int d = 0; d < WP_STEP_LENGTH_COUNT; d++)
+		{
+			const float deltaTs = WP_STEP_LENGTHS[d];
+
+			for (int type = 0; type < INTEGRATOR_COUNT; type++)
+			{
+				WorkPrecisionResult result;
+
+				result = FreeFall((IntegratorType)type, deltaTs);
+				result.scene = "FreeFall";
+				result.integrator = GetIntegratorName((IntegratorType)type);
+				results.push_back(result);
+
+				result = BouncingBall((IntegratorType)type, deltaTs);
+				result.scene = "BouncingBall";
+				result.integrator = GetIntegratorName((IntegratorType)type);
+				results.push_back(result);
+
+				result = OrbitingPair((IntegratorType)type, deltaTs);
+				result.scene = "OrbitingPair";
+				result.integrator = GetIntegratorName((IntegratorType)type);
+				results.push_back(result);
+			}
+
+			// Orientation is integrated the same way whatever the linear integrator, so it is run once
+			WorkPrecisionResult result = SpinningBody(deltaTs);
+			result.scene = "SpinningBody";
+			result.integrator = "Quaternion";
+			results.push_back(result);
+		}
+
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			results[i].bodies = WP_COPIES;
+		}
+
+		csv << "scene,integrator,dt,steps,bodies,wall_ms,position_error,energy_drift,angular_momentum_error\n";
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const WorkPrecisionResult& r = results[i];
+			csv << r.scene << "," << r.integrator << "," << r.deltaTs << "," << r.steps << "," << r.bodies << ","
+				<< r.wallMs << "," << r.positionError << "," << r.energyDrift << "," << r.angularMomentumError << "\n";
+		}
+
+		json << "[\n";
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const WorkPrecisionResult& r = results[i];
+			json << "  {\"scene\": \"" << r.scene << "\", \"integrator\": \"" << r.integrator << "\", \"dt\": " << r.deltaTs
+				<< ", \"steps\": " << r.steps << ", \"bodies\": " << r.bodies << ", \"wall_ms\": " << r.wallMs
+				<< ", \"position_error\": " << r.positionError << ", \"energy_drift\": " << r.energyDrift
+				<< ", \"angular_momentum_error\": " << r.angularMomentumError << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+		}
+		json << "]\n";
+	}
+
+	void BenchmarkGravity(JobSystem& jobs, std::ostream& out)
+	{
+		const size_t bodyCounts[] = { 1000, 4000, 16000, 32000 };
+		const float openingAngles[] = { 0.3f, 0.5f, 0.7f, 1.0f };
+		const float softening = 0.01f;
+		const int repeats = 3;
+
+		JobSystem serial(1);
+		JobSystem* threads[2] = { &serial, &jobs };
+
+		std::vector<float> position[3];
+		std::vector<float> mass;
+		std::vector<float> reference[3];
+		std::vector<float> acceleration[3];
+
+		GravityTree tree;
+		tree.SetSoftening(softening);
+
+		out << "bodies,method,opening_angle,multipole,threads,build_ms,force_ms,speedup,rms_error,max_error\n";
+
+		for (size_t n = 0; n < sizeof(bodyCounts) / sizeof(bodyCounts[0]); n++)
+		{
+			PlummerSphere(bodyCounts[n], 7, position, mass);
+
+			for (int t = 0; t < 2; t++)
+			{
+				JobSystem& pool = *threads[t];
+				if (t > 0 && pool.GetThreadCount() == 1)
+				{
+					// Same as the serial run
+					continue;
+				}
+
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				PFG::DirectGravity(position, mass, 1.0f, softening, reference, pool);
+				double directMs = ElapsedMs(start);
+
+				out << bodyCounts[n] << ",direct,0,none," << pool.GetThreadCount() << ",0," << directMs << ",1,0,0\n";
+
+				for (size_t a = 0; a < sizeof(openingAngles) / sizeof(openingAngles[0]); a++)
+				{
+					for (int quadrupole = 0; quadrupole < 2; quadrupole++)
+					{
+						tree.SetOpeningAngle(openingAngles[a]);
+						tree.SetQuadrupole(quadrupole != 0);
+
+						// Best of a few runs, the first one also pays for growing the tree's arrays
+						double buildMs = 0.0;
+						double forceMs = 0.0;
+						for (int r = 0; r < repeats; r++)
+						{
+							start = std::chrono::steady_clock::now();
+							tree.Build(position, mass);
+							double ms = ElapsedMs(start);
+							buildMs = r == 0 ? ms : std::min(buildMs, ms);
+
+							start = std::chrono::steady_clock::now();
+							tree.ComputeAccelerations(acceleration, pool);
+							ms = ElapsedMs(start);
+							forceMs = r == 0 ? ms : std::min(forceMs, ms);
+						}
+
+						double rms, largest;
+						AccelerationError(acceleration, reference, rms, largest);
+
+						out << bodyCounts[n] << ",tree," << openingAngles[a] << "," << (quadrupole ? "quadrupole" : "monopole") << ","
+							<< pool.GetThreadCount() << "," << buildMs << "," << forceMs << "," << directMs / (buildMs + forceMs) << ","
+							<< rms << "," << largest << "\n";
+					}
+				}
+			}
+		}
+	}
+
+	void BenchmarkParticles(JobSystem& jobs, std::ostream& out)
+	{
+		const size_t particleCounts[] = { 10000, 100000, 1000000 };
+		const size_t rigidCounts[] = { 10000, 100000 };
+		const int steps = 100;
+		const float deltaTs = 0.016f;
+		const glm::vec3 gravity(0.0f, -9.8f * 0.1f, 0.0f);
+
+		// A floor and four walls for everything to pile up in
+		std::vector<GameObject*> walls;
+		const glm::vec3 wallPositions[5] = { glm::vec3(0, 0, 0), glm::vec3(-20, 0, 0), glm::vec3(20, 0, 0), glm::vec3(0, 0, -20), glm::vec3(0, 0, 20) };
+		const glm::vec3 wallRotations[5] = { glm::vec3(0, 0, 0), glm::vec3(0, 0, -1.5707963f), glm::vec3(0, 0, 1.5707963f), glm::vec3(1.5707963f, 0, 0), glm::vec3(-1.5707963f, 0, 0) };
+		for (int w = 0; w < 5; w++)
+		{
+			GameObject* wall = new GameObject();
+			wall->SetType(SHAPE_HALFSPACE);
+			wall->SetPosition(wallPositions[w]);
+			wall->SetRotation(wallRotations[w].x, wallRotations[w].y, wallRotations[w].z);
+			walls.push_back(wall);
+		}
+		PlaneColliderSet planes;
+		planes.Build(walls);
+
+		// A few heavy spheres rolling through the particles
+		std::vector<DynamicObject*> spheres;
+		for (int s = 0; s < 4; s++)
+		{
+			DynamicObject* sphere = new DynamicObject();
+			sphere->SetPosition(glm::vec3(-10.0f + 6.0f * s, 1.0f, 0.0f));
+			sphere->SetVelocity(glm::vec3(1.0f, 0.0f, 0.5f));
+			sphere->SetMass(50.0f);
+			sphere->SetBoundingRadius(1.0f);
+			spheres.push_back(sphere);
+		}
+
+		std::mt19937 random(11);
+		std::uniform_real_distribution<float> uniform(-19.0f, 19.0f);
+		std::uniform_real_distribution<float> height(0.5f, 20.0f);
+
+		out << "body_type,bodies,threads,steps,ms_per_step,ns_per_body_step\n";
+
+		for (size_t n = 0; n < sizeof(particleCounts) / sizeof(particleCounts[0]); n++)
+		{
+			ParticleSystem particles;
+			particles.SetGravity(gravity);
+			for (size_t i = 0; i < particleCounts[n]; i++)
+			{
+				particles.Add(glm::vec3(uniform(random), height(random), uniform(random)), glm::vec3(0.0f), 0.01f, 0.05f);
+			}
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (int step = 0; step < steps; step++)
+			{
+				particles.Step(deltaTs, planes, spheres, jobs);
+			}
+			double ms = ElapsedMs(start);
+
+			out << "particle," << particleCounts[n] << "," << jobs.GetThreadCount() << "," << steps << "," << ms / steps << ","
+				<< ms * 1.0e6 / ((double)steps * particleCounts[n]) << "\n";
+		}
+
+		// The same bodies as full rigid spheres through the scene's batched path
+		for (size_t n = 0; n < sizeof(rigidCounts) / sizeof(rigidCounts[0]); n++)
+		{
+			const size_t count = rigidCounts[n];
+			std::vector<DynamicObject> bodies(count);
+			for (size_t i = 0; i < count; i++)
+			{
+				bodies[i].SetPosition(glm::vec3(uniform(random), height(random), uniform(random)));
+				bodies[i].SetMass(0.01f);
+				bodies[i].SetBoundingRadius(0.05f);
+				bodies[i].SetScale(glm::vec3(0.05f));
+				bodies[i].SetIntegrator(INTEGRATOR_EULER);
+				bodies[i].StartSimulation(true);
+			}
+
+			BodyArrays arrays;
+			arrays.Resize(count);
+			SweptSphereBatch swept;
+			std::vector<PlaneContact> contacts;
+			TransformBatch transforms;
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (int step = 0; step < steps; step++)
+			{
+				swept.Clear();
+				for (size_t i = 0; i < count; i++)
+				{
+					bodies[i].ComputeForces();
+					swept.Add(bodies[i].GetPosition(), bodies[i].GetPosition() + bodies[i].GetVelocity() * deltaTs, bodies[i].GetBoundingRadius());
+				}
+				planes.FindContacts(swept, contacts);
+				for (size_t c = 0; c < contacts.size(); c++)
+				{
+					bodies[contacts[c].sphere].PlaneCollisionResponse(planes.GetNormal(contacts[c].plane), contacts[c].contactPoint, glm::vec3(0.0f), deltaTs);
+				}
+
+				for (size_t i = 0; i < count; i++)
+				{
+					bodies[i].StoreLinearState(arrays, i);
+				}
+				PFG::IntegrateBodies(INTEGRATOR_EULER, arrays, AccumulatedForce(), 0, count, deltaTs);
+
+				transforms.Clear();
+				for (size_t i = 0; i < count; i++)
+				{
+					bodies[i].LoadLinearState(arrays, i);
+					bodies[i].IntegrateRotation(deltaTs);
+					transforms.Add(bodies[i].GetPosition(), bodies[i].GetRotation(), bodies[i].GetScale());
+				}
+				PFG::ComposeTransforms(transforms);
+			}
+			double ms = ElapsedMs(start);
+
+			out << "rigid," << count << ",1," << steps << "," << ms / steps << "," << ms * 1.0e6 / ((double)steps * count) << "\n";
+		}
+
+		for (size_t s = 0; s < spheres.size(); s++)
+		{
+			delete spheres[s];
+		}
+		for (size_t w = 0; w < walls.size(); w++)
+		{
+			delete walls[w];
+		}
+	}
+
+	void BenchmarkDamBreak(JobSystem& jobs, std::ostream& out)
+	{
+		const float spacings[] = { 0.04f, 0.02f, 0.0125f };
+		const int subSteps = 300;
+		const float tankLength = 1.6f;
+		const float tankWidth = 0.2f;
+		const glm::vec3 column(0.4f, 0.8f, 0.2f);
+		// Ten times the fastest flow, the speed of water that falls the height of the column
+		const float soundSpeed = 10.0f * std::sqrt(2.0f * 9.8f * column.y);
+
+		// A floor and four walls around a long narrow tank
+		std::vector<GameObject*> walls;
+		const glm::vec3 wallPositions[5] = { glm::vec3(0, 0, 0), glm::vec3(0, 0, 0), glm::vec3(tankLength, 0, 0), glm::vec3(0, 0, 0), glm::vec3(0, 0, tankWidth) };
+		const glm::vec3 wallRotations[5] = { glm::vec3(0, 0, 0), glm::vec3(0, 0, -1.5707963f), glm::vec3(0, 0, 1.5707963f), glm::vec3(1.5707963f, 0, 0), glm::vec3(-1.5707963f, 0, 0) };
+		for (int w = 0; w < 5; w++)
+		{
+			GameObject* wall = new GameObject();
+			wall->SetType(SHAPE_HALFSPACE);
+			wall->SetPosition(wallPositions[w]);
+			wall->SetRotation(wallRotations[w].x, wallRotations[w].y, wallRotations[w].z);
+			walls.push_back(wall);
+		}
+		PlaneColliderSet planes;
+		planes.Build(walls);
+		std::vector<DynamicObject*> spheres;
+
+		out << "particles,threads,sub_steps,sub_step_s,ms,particle_steps_per_sec,mean_compression,max_compression,front\n";
+
+		for (size_t n = 0; n < sizeof(spacings) / sizeof(spacings[0]); n++)
+		{
+			// The column of water at the near end of the tank
+			FluidSystem fluid;
+			fluid.SetParticleSpacing(spacings[n]);
+			fluid.SetSoundSpeed(soundSpeed);
+			fluid.SetGravity(glm::vec3(0.0f, -9.8f, 0.0f));
+			fluid.AddBlock(glm::vec3(0.0f), (int)(column.x / spacings[n]), (int)(column.y / spacings[n]), (int)(column.z / spacings[n]));
+
+			// Fixed sub-steps at the CFL limit of the still column, so every size does the same work per particle
+			const float deltaTs = fluid.StableTimeStep();
+			int taken = 0;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			while (taken < subSteps)
+			{
+				taken += fluid.Step(deltaTs, planes, spheres, jobs);
+			}
+			double ms = ElapsedMs(start);
+
+			// How far the fluid is squeezed above its rest density, and how far it has run along the tank
+			double compression = 0.0;
+			double maxCompression = 0.0;
+			float front = 0.0f;
+			for (size_t i = 0; i < fluid.Size(); i++)
+			{
+				double error = std::max(fluid.GetDensity(i) / fluid.GetRestDensity() - 1.0f, 0.0f);
+				compression += error;
+				maxCompression = std::max(maxCompression, error);
+				front = std::max(front, fluid.GetParticles().GetPosition(i).x);
+			}
+
+			out << fluid.Size() << "," << jobs.GetThreadCount() << "," << taken << "," << deltaTs << "," << ms << ","
+				<< (double)fluid.Size() * taken * 1000.0 / ms << "," << compression / fluid.Size() << "," << maxCompression << "," << front << "\n";
+		}
+
+		for (size_t w = 0; w < walls.size(); w++)
+		{
+			delete walls[w];
+		}
+	}
+
+	void BenchmarkQueries(JobSystem& jobs, std::ostream& out)
+	{
+		const size_t sphereCounts[] = { 1000, 10000, 100000 };
+		const float sphereRadius = 0.5f;
+		const float density = 0.05f;
+		const size_t width = 256;
+		const size_t linearLimit = 10000;
+		const size_t nearestCount = 8;
+		const float queryRadius = 2.0f;
+		const size_t radiusCapacity = 64;
+
+		JobSystem serial(1);
+		JobSystem* threads[2] = { &serial, &jobs };
+
+		std::vector<float> position[3];
+		std::vector<float> radius;
+		std::vector<uint32_t> category;
+		std::vector<QueryCast> casts[3];
+		const char* names[3] = { "camera_rays", "random_rays", "camera_spheres" };
+
+		QueryTree tree;
+		QueryResults results;
+
+		out << "spheres,query,method,threads,casts,ms,rays_per_sec,hits\n";
+
+		for (size_t n = 0; n < sizeof(sphereCounts) / sizeof(sphereCounts[0]); n++)
+		{
+			float side = ScatterSpheres(sphereCounts[n], sphereRadius, density, 11, position, radius);
+			CameraCasts(width, side, 0.0f, casts[0]);
+			RandomCasts(width * width, side, 13, casts[1]);
+			CameraCasts(width, side, 0.1f, casts[2]);
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			tree.Build(position, radius, category, sphereCounts[n]);
+			double buildMs = ElapsedMs(start);
+			out << sphereCounts[n] << ",build,tree,1,0," << buildMs << ",0,0\n";
+
+			for (int q = 0; q < 3; q++)
+			{
+				const double castCount = (double)casts[q].size();
+
+				if (sphereCounts[n] <= linearLimit)
+				{
+					start = std::chrono::steady_clock::now();
+					size_t hits = LinearCast(casts[q], position, radius);
+					double ms = ElapsedMs(start);
+					out << sphereCounts[n] << "," << names[q] << ",linear,1," << casts[q].size() << "," << ms << ","
+						<< castCount / (ms * 1.0e-3) << "," << hits << "\n";
+				}
+
+				for (int t = 0; t < 2; t++)
+				{
+					JobSystem& pool = *threads[t];
+					if (t > 0 && pool.GetThreadCount() == 1)
+					{
+						// Same as the serial run
+						continue;
+					}
+
+					// Nearest hit only, then every hit along the cast. The first closest run also grows the buffers
+					for (int all = 0; all < 2; all++)
+					{
+						double ms = 0.0;
+						for (int r = 0; r < 3; r++)
+						{
+							start = std::chrono::steady_clock::now();
+							tree.Cast(casts[q], all == 0, results, pool);
+							double run = ElapsedMs(start);
+							ms = r == 0 ? run : std::min(ms, run);
+						}
+						out << sphereCounts[n] << "," << names[q] << "," << (all == 0 ? "tree_closest" : "tree_all") << ","
+							<< pool.GetThreadCount() << "," << casts[q].size() << "," << ms << "," << castCount / (ms * 1.0e-3) << ","
+							<< results.hits.size() << "\n";
+					}
+				}
+			}
+
+			// Point queries from the cast origins of the random rays
+			std::vector<glm::vec3> points(casts[1].size());
+			for (size_t i = 0; i < points.size(); i++)
+			{
+				points[i] = casts[1][i].origin;
+			}
+			const double pointCount = (double)points.size();
+			std::vector<uint32_t> bodies(points.size() * radiusCapacity);
+			std::vector<float> distances(points.size() * nearestCount);
+			std::vector<uint32_t> counts(points.size());
+
+			if (sphereCounts[n] <= linearLimit)
+			{
+				std::vector<float> best;
+				start = std::chrono::steady_clock::now();
+				LinearNearest(points, nearestCount, position, best);
+				double ms = ElapsedMs(start);
+				out << sphereCounts[n] << ",nearest_8,linear,1," << points.size() << "," << ms << "," << pointCount / (ms * 1.0e-3) << ","
+					<< points.size() * nearestCount << "\n";
+			}
+
+			for (int t = 0; t < 2; t++)
+			{
+				JobSystem& pool = *threads[t];
+				if (t > 0 && pool.GetThreadCount() == 1)
+				{
+					continue;
+				}
+
+				for (int radiusQuery = 0; radiusQuery < 2; radiusQuery++)
+				{
+					double ms = 0.0;
+					for (int r = 0; r < 3; r++)
+					{
+						start = std::chrono::steady_clock::now();
+						if (radiusQuery)
+						{
+							tree.FindInRadius(points, queryRadius, 0xffffffffu, bodies.data(), radiusCapacity, counts.data(), pool);
+						}
+						else
+						{
+							tree.FindNearest(points, nearestCount, 0xffffffffu, bodies.data(), distances.data(), counts.data(), pool);
+						}
+						double run = ElapsedMs(start);
+						ms = r == 0 ? run : std::min(ms, run);
+					}
+					size_t hits = 0;
+					for (size_t i = 0; i < counts.size(); i++)
+					{
+						hits += counts[i];
+					}
+					out << sphereCounts[n] << "," << (radiusQuery ? "radius_2" : "nearest_8") << ",tree," << pool.GetThreadCount() << ","
+						<< points.size() << "," << ms << "," << pointCount / (ms * 1.0e-3) << "," << hits << "\n";
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,62 @@
+#ifndef _Benchmark_H_
+#define _Benchmark_H_
+
+#include "JobSystem.h"
+#include <ostream>
+
+/*! \brief Brief description.
+*  Benchmarks for the physics code. They are run from the scene when the scene file asks for them
+*  and write their results as CSV, so runs can be compared in a spreadsheet.
+*
+*/
+
+namespace PFG
+{
+	/*
+	Time every integrator on bodyCount free falling bodies for the given number of steps.
+	Writes a header and one CSV line per integrator: name, force evaluations per step, bodies, steps,
+	total milliseconds and nanoseconds per body-step
+	*/
+	void BenchmarkIntegrators(size_t bodyCount, int steps, std::ostream& out);
+
+	/*
+	Run the canonical scenes (free fall, bouncing ball, spinning body, orbiting pair) with every integrator
+	at several step lengths. Each run records its wall time, the position error against the analytic solution,
+	the drift in total energy and the error in angular momentum, all relative, for work-precision plots.
+	The results are written as CSV to csv and as a JSON array to json
+	*/
+	void BenchmarkWorkPrecision(std::ostream& csv, std::ostream& json);
+
+	/*
+	Compare the Barnes-Hut tree with the direct O(N^2) sum on Plummer spheres of increasing size.
+	For each opening angle, with and without quadrupoles, and on one thread and on every thread of jobs,
+	writes the build and force times, the speedup over the direct sum and the RMS and largest relative
+	error in the accelerations
+	*/
+	void BenchmarkGravity(JobSystem& jobs, std::ostream& out);
+
+	/*
+	Time particles falling into a box with a few heavy spheres in it, from ten thousand up to a million,
+	against the same number of full rigid spheres going through the scene's batched path.
+	Writes the milliseconds per step and nanoseconds per body-step of each
+	*/
+	void BenchmarkParticles(JobSystem& jobs, std::ostream& out);
+
+	/*
+	Break a dam of SPH fluid in a long tank at three particle spacings, for a fixed number of CFL sized sub-steps.
+	Writes the particle count, the time, the particle-steps per second, and the mean and largest compression
+	above rest density with how far the front has run, as a check that the speed isn't bought with a blown up fluid
+	*/
+	void BenchmarkDamBreak(JobSystem& jobs, std::ostream& out);
+
+	/*
+	Cast batches of coherent rays from a camera, random rays and coherent sphere casts into a thousand up to a
+	hundred thousand spheres spread at the same density, through a QueryTree on one thread and on all of them,
+	and through a linear search of every sphere for the smaller counts. Then the same for finding the 8 nearest
+	spheres to, and the spheres within a radius of, random points.
+	Writes the time, the queries per second and the number of hits of each
+	*/
+	void BenchmarkQueries(JobSystem& jobs, std::ostream& out);
+}
+
+#endif //!_Benchmark_H_
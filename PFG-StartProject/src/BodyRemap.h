@@ -0,0 +1,23 @@
+#ifndef _BodyRemap_H_
+#define _BodyRemap_H_
+
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+// New index of a body that was removed
+static const uint32_t BODY_REMOVED = 0xffffffffu;
+
+namespace PFG
+{
+	/*
+	New index of a body after the scene removed some and closed up the rest, from a remap holding the new index
+	of each old one. Bodies past the end of the remap were never in it and count as removed
+	*/
+	inline uint32_t RemapBody(const std::vector<uint32_t>& remap, size_t body)
+	{
+		return body < remap.size() ? remap[body] : BODY_REMOVED;
+	}
+}
+
+#endif //!_BodyRemap_H_
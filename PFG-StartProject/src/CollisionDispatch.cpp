@@ -0,0 +1,67 @@
+#include "CollisionDispatch.h"
+#include <array>
+#include <utility>
+
+/*! \brief Brief description.
+*  The collision table holds, for every pair of shapes, the function for a single pair and the function for a bucket
+*  of pairs. It is filled in at compile time from the CollisionKernel specialisations.
+*
+*/
+
+namespace
+{
+	struct CollisionTableEntry
+	{
+		PFG::PairCollisionFunction pair;
+		PFG::BucketCollisionFunction bucket;
+	};
+
+	// A tight loop over one bucket, the kernel is known at compile time so the call can be inlined
+	template <ShapeType A, ShapeType B>
+	void CollideBucket(const std::vector<CollisionPair>& pairs, float deltaTs)
+	{
+		for (size_t i = 0; i < pairs.size(); i++)
+		{
+			CollisionKernel<A, B>::Collide(pairs[i].a, pairs[i].b, deltaTs);
+		}
+	}
+
+	template <size_t I>
+	constexpr CollisionTableEntry MakeTableEntry()
+	{
+		return CollisionKernel<(ShapeType)(I / SHAPE_COUNT), (ShapeType)(I % SHAPE_COUNT)>::exists
+			? CollisionTableEntry{ &CollisionKernel<(ShapeType)(I / SHAPE_COUNT), (ShapeType)(I % SHAPE_COUNT)>::Collide,
+				&CollideBucket<(ShapeType)(I / SHAPE_COUNT), (ShapeType)(I % SHAPE_COUNT)> }
+			: CollisionTableEntry{ nullptr, nullptr };
+	}
+
+	template <size_t... I>
+	constexpr std::array<CollisionTableEntry, sizeof...(I)> MakeTable(std::index_sequence<I...>)
+	{
+		return {{ MakeTableEntry<I>()... }};
+	}
+
+	// One entry per (shape a, shape b), indexed by a * SHAPE_COUNT + b
+	const std::array<CollisionTableEntry, SHAPE_COUNT * SHAPE_COUNT> COLLISION_TABLE = MakeTable(std::make_index_sequence<SHAPE_COUNT * SHAPE_COUNT>());
+}
+
+namespace PFG
+{
+	PairCollisionFunction GetCollisionFunction(ShapeType a, ShapeType b)
+	{
+		if (a >= SHAPE_COUNT || b >= SHAPE_COUNT)
+		{
+			return NULL;
+		}
+		return COLLISION_TABLE[a * SHAPE_COUNT + b].pair;
+	}
+
+	BucketCollisionFunction GetBucketCollisionFunction(ShapeType a, ShapeType b)
+	{
+		if (a >= SHAPE_COUNT || b >= SHAPE_COUNT)
+		{
+			return NULL;
+		}
+		return COLLISION_TABLE[a * SHAPE_COUNT + b].bucket;
+	}
+}
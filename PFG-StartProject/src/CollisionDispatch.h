@@ -0,0 +1,85 @@
+#ifndef _CollisionDispatch_H_
+#define _CollisionDispatch_H_
+
+#include "DynamicObject.h"
+#include <vector>
+
+/*! \brief Brief description.
+*  A pair of objects to run a collision function on, the dynamic object first
+*
+*/
+struct CollisionPair
+{
+	GameObject* a;
+	GameObject* b;
+};
+
+/*! \brief Brief description.
+*  CollisionKernel is the collision function for one pair of shapes, chosen at compile time.
+*  The primary template is for shapes that never collide (two static objects, for example).
+*  To let a new pair of shapes collide, specialise it with exists = true and a Collide function;
+*  the collision table in CollisionDispatch.cpp picks it up from there.
+*
+*/
+template <ShapeType A, ShapeType B>
+struct CollisionKernel
+{
+	static const bool exists = false;
+	static void Collide(GameObject*, GameObject*, float) {}
+};
+
+template <>
+struct CollisionKernel<SHAPE_SPHERE, SHAPE_PLANE>
+{
+	static const bool exists = true;
+	static void Collide(GameObject* a, GameObject* b, float deltaTs) { static_cast<DynamicObject*>(a)->CollideWithPlane(b, deltaTs); }
+};
+
+template <>
+struct CollisionKernel<SHAPE_SPHERE, SHAPE_SPHERE>
+{
+	static const bool exists = true;
+	static void Collide(GameObject* a, GameObject* b, float deltaTs) { static_cast<DynamicObject*>(a)->CollideWithSphere(static_cast<DynamicObject*>(b), deltaTs); }
+};
+
+template <>
+struct CollisionKernel<SHAPE_SPHERE, SHAPE_HALFSPACE>
+{
+	static const bool exists = true;
+	static void Collide(GameObject* a, GameObject* b, float deltaTs) { static_cast<DynamicObject*>(a)->CollideWithHalfSpace(b, deltaTs); }
+};
+
+template <>
+struct CollisionKernel<SHAPE_SPHERE, SHAPE_TRIANGLE_MESH>
+{
+	static const bool exists = true;
+	static void Collide(GameObject* a, GameObject* b, float deltaTs) { static_cast<DynamicObject*>(a)->CollideWithMesh(b, deltaTs); }
+};
+
+namespace PFG
+{
+	/*
+	The collision function for a single pair of objects
+	*/
+	typedef void (*PairCollisionFunction)(GameObject* a, GameObject* b, float deltaTs);
+
+	/*
+	The collision function for a bucket of pairs that all have the same two shapes.
+	Each one is a loop over the pairs calling the shapes' CollisionKernel directly
+	*/
+	typedef void (*BucketCollisionFunction)(const std::vector<CollisionPair>& pairs, float deltaTs);
+
+	/*
+	Look up the collision function for a pair of shapes in the collision table.
+	Returns NULL if the shapes don't collide
+	*/
+	PairCollisionFunction GetCollisionFunction(ShapeType a, ShapeType b);
+
+	/*
+	Look up the function that collides a whole bucket of pairs with the same two shapes.
+	Returns NULL if the shapes don't collide
+	*/
+	BucketCollisionFunction GetBucketCollisionFunction(ShapeType a, ShapeType b);
+}
+
+#endif //!_CollisionDispatch_H_
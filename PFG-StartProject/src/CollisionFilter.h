@@ -0,0 +1,41 @@
+#ifndef _CollisionFilter_H_
+#define _CollisionFilter_H_
+
+#include <stdint.h>
+
+/*! \brief Brief description.
+*  CollisionFilter says which other objects an object can touch, checked on each pair before any narrowphase test.
+*  Every object is in one or more categories, and its mask lists the categories it collides with. A pair only
+*  collides if each object's mask has a bit of the other's category, so debris that leaves its own bit out of
+*  its mask ignores other debris but still lands on the floor.
+*
+*  Objects that share a non-zero group never collide whatever their masks say, for the parts of one compound
+*  object that overlap where they join. The default is category 1, every bit of the mask and no group.
+*
+*/
+struct CollisionFilter
+{
+	CollisionFilter() : category(1u), mask(0xffffffffu), group(0) {}
+	CollisionFilter(uint32_t category, uint32_t mask, int32_t group) : category(category), mask(mask), group(group) {}
+
+	uint32_t category;
+	uint32_t mask;
+	int32_t group;
+};
+
+namespace PFG
+{
+	/*
+	True if two objects with these filters can collide
+	*/
+	inline bool ShouldCollide(const CollisionFilter& a, const CollisionFilter& b)
+	{
+		if (a.group != 0 && a.group == b.group)
+		{
+			return false;
+		}
+		return (a.mask & b.category) != 0 && (b.mask & a.category) != 0;
+	}
+}
+
+#endif //!_CollisionFilter_H_
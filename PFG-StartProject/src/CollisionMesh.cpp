@@ -0,0 +1,456 @@
+#include "CollisionMesh.h"
+#include "Utility.h"
+#include <algorithm>
+#include <cfloat>
+#include <fstream>
+
+/*! \brief Brief description.
+*  CollisionMesh is the CPU side copy of a triangulated mesh used for collision detection,
+*  with a bounding volume hierarchy of 32 byte nodes over its triangles.
+*
+*/
+
+// Leaves are not split below this many triangles
+static const unsigned int MAX_LEAF_TRIANGLES = 4;
+// Median splits halve a node's triangles, so a hierarchy over a 32-bit triangle count is at most 32 levels deep
+// and a traversal never holds more than one node per level plus one
+static const int TRAVERSAL_STACK_SIZE = 64;
+// Identifies a file written by CollisionMesh::Save, the last two characters are the format version
+static const char FILE_MAGIC[8] = { 'P', 'F', 'G', 'B', 'V', 'H', '0', '2' };
+// FNV-1a 64-bit offset basis and prime
+static const uint64_t HASH_OFFSET = 14695981039346656037ull;
+static const uint64_t HASH_PRIME = 1099511628211ull;
+
+static_assert(sizeof(CollisionMesh::Node) == 32, "BVH nodes must stay 32 bytes");
+
+CollisionMesh::CollisionMesh()
+{
+}
+
+void CollisionMesh::SetTriangles(const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& indices)
+{
+	_vertices = vertices;
+	_indices = indices;
+	_indices.resize(indices.size() - indices.size() % 3);
+
+	BuildHierarchy();
+}
+
+void CollisionMesh::BuildHierarchy()
+{
+	_nodes.clear();
+
+	unsigned int triangleCount = GetTriangleCount();
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	std::vector<glm::vec3> centroids(triangleCount);
+	std::vector<unsigned int> order(triangleCount);
+	for (unsigned int i = 0; i < triangleCount; i++)
+	{
+		centroids[i] = (_vertices[_indices[i * 3]] + _vertices[_indices[i * 3 + 1]] + _vertices[_indices[i * 3 + 2]]) / 3.0f;
+		order[i] = i;
+	}
+
+	// A binary tree with one triangle per leaf has at most 2n - 1 nodes
+	_nodes.reserve(triangleCount * 2);
+
+	Node root;
+	root.leftOrFirst = 0;
+	root.count = triangleCount;
+	_nodes.push_back(root);
+	Subdivide(0, centroids, order);
+
+	// Store the triangles in leaf order so each leaf is a contiguous range
+	std::vector<unsigned int> sorted(_indices.size());
+	for (unsigned int i = 0; i < triangleCount; i++)
+	{
+		sorted[i * 3] = _indices[order[i] * 3];
+		sorted[i * 3 + 1] = _indices[order[i] * 3 + 1];
+		sorted[i * 3 + 2] = _indices[order[i] * 3 + 2];
+	}
+	_indices.swap(sorted);
+	_nodes.shrink_to_fit();
+}
+
+void CollisionMesh::Subdivide(uint32_t nodeIndex, const std::vector<glm::vec3>& centroids, std::vector<unsigned int>& order)
+{
+	uint32_t first = _nodes[nodeIndex].leftOrFirst;
+	uint32_t count = _nodes[nodeIndex].count;
+
+	// Fit the bounds around every vertex of the node's triangles, and the centroids for choosing a split
+	glm::vec3 boundsMin = glm::vec3(FLT_MAX);
+	glm::vec3 boundsMax = glm::vec3(-FLT_MAX);
+	glm::vec3 centroidMin = glm::vec3(FLT_MAX);
+	glm::vec3 centroidMax = glm::vec3(-FLT_MAX);
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		unsigned int triangle = order[i];
+		for (int v = 0; v < 3; v++)
+		{
+			const glm::vec3& vertex = _vertices[_indices[triangle * 3 + v]];
+			boundsMin = glm::min(boundsMin, vertex);
+			boundsMax = glm::max(boundsMax, vertex);
+		}
+		centroidMin = glm::min(centroidMin, centroids[triangle]);
+		centroidMax = glm::max(centroidMax, centroids[triangle]);
+	}
+
+	Node& node = _nodes[nodeIndex];
+	node.boundsMin[0] = boundsMin.x; node.boundsMin[1] = boundsMin.y; node.boundsMin[2] = boundsMin.z;
+	node.boundsMax[0] = boundsMax.x; node.boundsMax[1] = boundsMax.y; node.boundsMax[2] = boundsMax.z;
+
+	if (count <= MAX_LEAF_TRIANGLES)
+	{
+		return;
+	}
+
+	// Split at the median centroid along the longest axis
+	glm::vec3 extent = centroidMax - centroidMin;
+	int axis = 0;
+	if (extent.y > extent.x)
+	{
+		axis = 1;
+	}
+	if (extent.z > extent[axis])
+	{
+		axis = 2;
+	}
+	if (extent[axis] <= 0.0f)
+	{
+		// All centroids in the same place, nothing to gain from splitting
+		return;
+	}
+
+	uint32_t leftCount = count / 2;
+	std::nth_element(order.begin() + first, order.begin() + first + leftCount, order.begin() + first + count,
+		[&centroids, axis](unsigned int a, unsigned int b) { return centroids[a][axis] < centroids[b][axis]; });
+
+	uint32_t childIndex = (uint32_t)_nodes.size();
+	Node left;
+	left.leftOrFirst = first;
+	left.count = leftCount;
+	Node right;
+	right.leftOrFirst = first + leftCount;
+	right.count = count - leftCount;
+	_nodes.push_back(left);
+	_nodes.push_back(right);
+
+	_nodes[nodeIndex].leftOrFirst = childIndex;
+	_nodes[nodeIndex].count = 0;
+
+	Subdivide(childIndex, centroids, order);
+	Subdivide(childIndex + 1, centroids, order);
+}
+
+bool CollisionMesh::SphereContacts(const glm::vec3& centre, float radius, std::vector<MeshContact>& contacts) const
+{
+	contacts.clear();
+	if (_nodes.empty())
+	{
+		return false;
+	}
+
+	const float radiusSq = radius * radius;
+	uint32_t stack[TRAVERSAL_STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const Node& node = _nodes[stack[--stackSize]];
+
+		// Skip the node if the sphere doesn't touch its box
+		glm::vec3 boundsMin = glm::vec3(node.boundsMin[0], node.boundsMin[1], node.boundsMin[2]);
+		glm::vec3 boundsMax = glm::vec3(node.boundsMax[0], node.boundsMax[1], node.boundsMax[2]);
+		glm::vec3 closest = glm::clamp(centre, boundsMin, boundsMax);
+		glm::vec3 offset = centre - closest;
+		if (glm::dot(offset, offset) > radiusSq)
+		{
+			continue;
+		}
+
+		if (node.count == 0)
+		{
+			stack[stackSize++] = node.leftOrFirst;
+			stack[stackSize++] = node.leftOrFirst + 1;
+			continue;
+		}
+
+		for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+		{
+			const glm::vec3& a = _vertices[_indices[i * 3]];
+			const glm::vec3& b = _vertices[_indices[i * 3 + 1]];
+			const glm::vec3& c = _vertices[_indices[i * 3 + 2]];
+
+			glm::vec3 point = PFG::ClosestPointOnTriangle(centre, a, b, c);
+			glm::vec3 diff = centre - point;
+			float distSq = glm::dot(diff, diff);
+			if (distSq > radiusSq)
+			{
+				continue;
+			}
+
+			MeshContact contact;
+			contact.point = point;
+			contact.triangle = i;
+			float dist = glm::sqrt(distSq);
+			if (dist > 1e-6f)
+			{
+				contact.normal = diff / dist;
+			}
+			else
+			{
+				// Centre is on the triangle, push out along the face normal
+				contact.normal = glm::normalize(glm::cross(b - a, c - a));
+			}
+			contact.depth = radius - dist;
+			contacts.push_back(contact);
+		}
+	}
+
+	return !contacts.empty();
+}
+
+bool CollisionMesh::RayCast(const glm::vec3& origin, const glm::vec3& direction, float tMax, MeshRayHit& hit) const
+{
+	if (_nodes.empty())
+	{
+		return false;
+	}
+
+	const glm::vec3 invD = 1.0f / direction;
+	float closest = tMax;
+	bool found = false;
+
+	uint32_t stack[TRAVERSAL_STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const Node& node = _nodes[stack[--stackSize]];
+
+		float tEnter;
+		if (!PFG::RayToAABB(origin, invD, glm::vec3(node.boundsMin[0], node.boundsMin[1], node.boundsMin[2]),
+			glm::vec3(node.boundsMax[0], node.boundsMax[1], node.boundsMax[2]), closest, tEnter))
+		{
+			continue;
+		}
+
+		if (node.count == 0)
+		{
+			// Visit the nearer child first so later boxes are culled by the closer hit
+			const Node& left = _nodes[node.leftOrFirst];
+			int axis = 0;
+			float longest = glm::abs(direction.x);
+			if (glm::abs(direction.y) > longest)
+			{
+				axis = 1;
+				longest = glm::abs(direction.y);
+			}
+			if (glm::abs(direction.z) > longest)
+			{
+				axis = 2;
+			}
+			const Node& right = _nodes[node.leftOrFirst + 1];
+			bool leftFirst = (left.boundsMin[axis] + left.boundsMax[axis] < right.boundsMin[axis] + right.boundsMax[axis]) == (direction[axis] >= 0.0f);
+			stack[stackSize++] = leftFirst ? node.leftOrFirst + 1 : node.leftOrFirst;
+			stack[stackSize++] = leftFirst ? node.leftOrFirst : node.leftOrFirst + 1;
+			continue;
+		}
+
+		for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+		{
+			const glm::vec3& a = _vertices[_indices[i * 3]];
+			const glm::vec3& b = _vertices[_indices[i * 3 + 1]];
+			const glm::vec3& c = _vertices[_indices[i * 3 + 2]];
+
+			float t;
+			if (PFG::RayToTriangle(origin, direction, a, b, c, closest, t))
+			{
+				closest = t;
+				found = true;
+				hit.t = t;
+				hit.point = origin + t * direction;
+				hit.normal = glm::normalize(glm::cross(b - a, c - a));
+				hit.triangle = i;
+			}
+		}
+	}
+
+	return found;
+}
+
+glm::vec3 CollisionMesh::GetBoundsMin() const
+{
+	if (_nodes.empty())
+	{
+		return glm::vec3(0.0f);
+	}
+	return glm::vec3(_nodes[0].boundsMin[0], _nodes[0].boundsMin[1], _nodes[0].boundsMin[2]);
+}
+
+glm::vec3 CollisionMesh::GetBoundsMax() const
+{
+	if (_nodes.empty())
+	{
+		return glm::vec3(0.0f);
+	}
+	return glm::vec3(_nodes[0].boundsMax[0], _nodes[0].boundsMax[1], _nodes[0].boundsMax[2]);
+}
+
+uint64_t CollisionMesh::HashTriangles(const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& indices)
+{
+	uint64_t hash = HASH_OFFSET;
+	auto mix = [&hash](const void* data, size_t bytes)
+	{
+		const unsigned char* p = (const unsigned char*)data;
+		for (size_t i = 0; i < bytes; i++)
+		{
+			hash = (hash ^ p[i]) * HASH_PRIME;
+		}
+	};
+
+	// The counts go in too so lists that only differ in where one ends and the next begins don't collide
+	uint32_t vertexCount = (uint32_t)vertices.size();
+	uint32_t indexCount = (uint32_t)indices.size();
+	mix(&vertexCount, sizeof(vertexCount));
+	mix(&indexCount, sizeof(indexCount));
+	if (vertexCount > 0)
+	{
+		mix(&vertices[0], sizeof(glm::vec3) * vertexCount);
+	}
+	if (indexCount > 0)
+	{
+		mix(&indices[0], sizeof(unsigned int) * indexCount);
+	}
+	return hash;
+}
+
+bool CollisionMesh::Save(const std::string& filename, uint64_t sourceHash) const
+{
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	uint32_t vertexCount = (uint32_t)_vertices.size();
+	uint32_t indexCount = (uint32_t)_indices.size();
+	uint32_t nodeCount = (uint32_t)_nodes.size();
+
+	file.write(FILE_MAGIC, sizeof(FILE_MAGIC));
+	file.write((const char*)&sourceHash, sizeof(sourceHash));
+	file.write((const char*)&vertexCount, sizeof(vertexCount));
+	file.write((const char*)&indexCount, sizeof(indexCount));
+	file.write((const char*)&nodeCount, sizeof(nodeCount));
+	if (vertexCount > 0)
+	{
+		file.write((const char*)&_vertices[0], sizeof(glm::vec3) * vertexCount);
+	}
+	if (indexCount > 0)
+	{
+		file.write((const char*)&_indices[0], sizeof(unsigned int) * indexCount);
+	}
+	if (nodeCount > 0)
+	{
+		file.write((const char*)&_nodes[0], sizeof(Node) * nodeCount);
+	}
+
+	return file.good();
+}
+
+bool CollisionMesh::Load(const std::string& filename, uint64_t sourceHash)
+{
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+	{
+		return false;
+	}
+	const uint64_t fileSize = (uint64_t)file.tellg();
+	file.seekg(0);
+
+	char magic[sizeof(FILE_MAGIC)];
+	uint64_t hash = 0;
+	uint32_t vertexCount = 0;
+	uint32_t indexCount = 0;
+	uint32_t nodeCount = 0;
+	file.read(magic, sizeof(magic));
+	file.read((char*)&hash, sizeof(hash));
+	file.read((char*)&vertexCount, sizeof(vertexCount));
+	file.read((char*)&indexCount, sizeof(indexCount));
+	file.read((char*)&nodeCount, sizeof(nodeCount));
+	if (!file.good() || !std::equal(magic, magic + sizeof(magic), FILE_MAGIC) || hash != sourceHash)
+	{
+		return false;
+	}
+
+	// Check the counts against the file before allocating anything for them
+	const uint64_t triangleCount = indexCount / 3;
+	const uint64_t headerSize = sizeof(magic) + sizeof(hash) + sizeof(vertexCount) + sizeof(indexCount) + sizeof(nodeCount);
+	const uint64_t expectedSize = headerSize + (uint64_t)sizeof(glm::vec3) * vertexCount
+		+ (uint64_t)sizeof(unsigned int) * indexCount + (uint64_t)sizeof(Node) * nodeCount;
+	if (indexCount % 3 != 0 || fileSize != expectedSize || (nodeCount == 0) != (triangleCount == 0) || nodeCount > triangleCount * 2)
+	{
+		return false;
+	}
+
+	std::vector<glm::vec3> vertices(vertexCount);
+	std::vector<unsigned int> indices(indexCount);
+	std::vector<Node> nodes(nodeCount);
+	if (vertexCount > 0)
+	{
+		file.read((char*)&vertices[0], sizeof(glm::vec3) * vertexCount);
+	}
+	if (indexCount > 0)
+	{
+		file.read((char*)&indices[0], sizeof(unsigned int) * indexCount);
+	}
+	if (nodeCount > 0)
+	{
+		file.read((char*)&nodes[0], sizeof(Node) * nodeCount);
+	}
+	if (!file.good())
+	{
+		return false;
+	}
+
+	for (uint32_t i = 0; i < indexCount; i++)
+	{
+		if (indices[i] >= vertexCount)
+		{
+			return false;
+		}
+	}
+
+	// Subdivide always puts children after their parent, so the depths can be filled in one pass and a file
+	// with a cycle is refused. Leaves must stay inside the triangles, and no node may be deeper than a
+	// traversal's stack can hold.
+	std::vector<uint32_t> depth(nodeCount, 0);
+	for (uint32_t i = 0; i < nodeCount; i++)
+	{
+		const Node& node = nodes[i];
+		if (node.count > 0)
+		{
+			if ((uint64_t)node.leftOrFirst + node.count > triangleCount)
+			{
+				return false;
+			}
+			continue;
+		}
+		if (node.leftOrFirst <= i || (uint64_t)node.leftOrFirst + 1 >= nodeCount || depth[i] + 1 >= (uint32_t)TRAVERSAL_STACK_SIZE)
+		{
+			return false;
+		}
+		depth[node.leftOrFirst] = std::max(depth[node.leftOrFirst], depth[i] + 1);
+		depth[node.leftOrFirst + 1] = std::max(depth[node.leftOrFirst + 1], depth[i] + 1);
+	}
+
+	_vertices.swap(vertices);
+	_indices.swap(indices);
+	_nodes.swap(nodes);
+	return true;
+}
@@ -0,0 +1,131 @@
+#ifndef _CollisionMesh_H_
+#define _CollisionMesh_H_
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/*! \brief Brief description.
+*  A contact between a sphere and a triangle of a CollisionMesh
+*
+*/
+struct MeshContact
+{
+	glm::vec3 point; /*!< Closest point on the triangle to the sphere centre */
+	glm::vec3 normal; /*!< Unit normal pushing the sphere out of the triangle */
+	float depth; /*!< How far the sphere overlaps the triangle along the normal */
+	unsigned int triangle; /*!< Index of the triangle that was hit */
+};
+
+/*! \brief Brief description.
+*  The closest hit of a ray against a CollisionMesh
+*
+*/
+struct MeshRayHit
+{
+	float t; /*!< Distance along the ray direction */
+	glm::vec3 point; /*!< Where the ray hit */
+	glm::vec3 normal; /*!< Face normal of the triangle that was hit */
+	unsigned int triangle; /*!< Index of the triangle that was hit */
+};
+
+/*! \brief Brief description.
+*  CollisionMesh is the CPU side copy of a triangulated mesh used for collision detection.
+*  It keeps an indexed triangle list and a bounding volume hierarchy over the triangles, so sphere contacts
+*  and ray queries only test the few triangles near the query. The hierarchy can be saved to and loaded from
+*  a binary file so large static levels do not have to rebuild it on every load.
+*  All queries are in the mesh's model space.
+*
+*/
+class CollisionMesh
+{
+public:
+
+	/** A node of the bounding volume hierarchy, packed into 32 bytes
+	* Interior nodes have count 0 and their children at leftOrFirst and leftOrFirst + 1.
+	* Leaf nodes hold count triangles starting at leftOrFirst in the triangle order.
+	*/
+	struct Node
+	{
+		float boundsMin[3];
+		uint32_t leftOrFirst;
+		float boundsMax[3];
+		uint32_t count;
+	};
+
+	/** CollisionMesh constructor
+	*/
+	CollisionMesh();
+
+	/** Replace the mesh with an indexed triangle list and build the hierarchy
+	* @param std::vector<glm::vec3> vertices the vertex positions
+	* @param std::vector<unsigned int> indices three vertex indices per triangle
+	*/
+	void SetTriangles(const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& indices);
+
+	/** Find every triangle the sphere overlaps
+	* @param glm::vec3 centre sphere centre in model space
+	* @param float radius sphere radius in model space
+	* @param std::vector<MeshContact> contacts output, cleared first
+	* @return true if there is at least one contact
+	*/
+	bool SphereContacts(const glm::vec3& centre, float radius, std::vector<MeshContact>& contacts) const;
+
+	/** Find the closest triangle hit by the ray 'origin + t * direction'
+	* @param glm::vec3 origin start of the ray in model space
+	* @param glm::vec3 direction direction of the ray, does not need to be unit length
+	* @param float tMax the furthest t that counts as a hit
+	* @param MeshRayHit hit output for the closest hit
+	* @return true if the ray hit the mesh
+	*/
+	bool RayCast(const glm::vec3& origin, const glm::vec3& direction, float tMax, MeshRayHit& hit) const;
+
+	/** Write the triangles and hierarchy to a binary file
+	* @param uint64_t sourceHash HashTriangles of the triangles the mesh was built from, stored so Load can tell a stale file
+	* @return true on success
+	*/
+	bool Save(const std::string& filename, uint64_t sourceHash) const;
+	/** Read the triangles and hierarchy from a binary file written by Save
+	* The file is refused if it was written by another version, from other triangles, or doesn't hold a
+	* hierarchy that can be walked safely.
+	* @param uint64_t sourceHash HashTriangles of the triangles the file should have been built from
+	* @return true on success, the mesh is left unchanged on failure
+	*/
+	bool Load(const std::string& filename, uint64_t sourceHash);
+
+	/** A 64-bit FNV-1a hash of an indexed triangle list, to key saved hierarchies by their source
+	*/
+	static uint64_t HashTriangles(const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& indices);
+
+	/** True if the mesh has no triangles
+	*/
+	bool IsEmpty() const { return _nodes.empty(); }
+	unsigned int GetTriangleCount() const { return (unsigned int)(_indices.size() / 3); }
+	unsigned int GetVertexCount() const { return (unsigned int)_vertices.size(); }
+	/** Bounds of the whole mesh
+	*/
+	glm::vec3 GetBoundsMin() const;
+	glm::vec3 GetBoundsMax() const;
+
+private:
+
+	/** Build the hierarchy over the current triangles
+	*/
+	void BuildHierarchy();
+	/** Fit a node's bounds around its triangles and split it if there are too many
+	*/
+	void Subdivide(uint32_t nodeIndex, const std::vector<glm::vec3>& centroids, std::vector<unsigned int>& order);
+
+	/** Vertex positions
+	*/
+	std::vector<glm::vec3> _vertices;
+	/** Three vertex indices per triangle, in the order the leaves refer to
+	*/
+	std::vector<unsigned int> _indices;
+	/** The hierarchy, node 0 is the root
+	*/
+	std::vector<Node> _nodes;
+};
+
+#endif //!_CollisionMesh_H_
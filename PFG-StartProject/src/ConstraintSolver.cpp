@@ -0,0 +1,680 @@
+#include "ConstraintSolver.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+/*! \brief Brief description.
+*  ConstraintSolver turns joints and contacts into rows, colours them and iterates them four at a time.
+*
+*/
+
+// Overlap a contact may keep without being pushed apart, so resting contacts don't jitter
+static const float SOLVER_CONTACT_SLOP = 0.005f;
+// Rows each joint type makes
+static const int SOLVER_JOINT_ROWS[] = { 3, 5, 1, 6 };
+// Largest number of rows a joint makes, the stride of the warm start impulses
+static const int SOLVER_MAX_JOINT_ROWS = 6;
+// No row, for joints whose bodies aren't in this step
+static const uint32_t SOLVER_NO_ROW = 0xffffffffu;
+// Rows solved together in one SSE batch
+static const int SOLVER_BATCH = 4;
+// Batches handed to a thread at a time
+static const size_t SOLVER_BATCH_GRAIN = 16;
+// Colours tracked per body, rows that can't get one are solved one at a time after the colours
+static const uint32_t SOLVER_MAX_COLOURS = 64;
+
+/** Two unit vectors at right angles to each other and to n, always picked the same way for the same n
+*/
+static void PerpendicularBasis(const glm::vec3& n, glm::vec3& t1, glm::vec3& t2)
+{
+	t1 = std::abs(n.x) < 0.57735f ? glm::vec3(0.0f, n.z, -n.y) : glm::vec3(n.y, -n.x, 0.0f);
+	t1 = glm::normalize(t1);
+	t2 = glm::cross(n, t1);
+}
+
+ConstraintSolver::ConstraintSolver()
+{
+	_iterations = 10;
+	_friction = 0.5f;
+	_restitution = 0.5f;
+	_baumgarte = 0.2f;
+	_restSpeed = 0.5f;
+}
+
+void ConstraintSolver::ClearBodies()
+{
+	_position.clear();
+	_rotation.clear();
+	_invMass.clear();
+	_invInertia.clear();
+	_static.clear();
+	for (int k = 0; k < 6; k++)
+	{
+		_velocity[k].clear();
+	}
+	_contacts.clear();
+}
+
+size_t ConstraintSolver::AddBody(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& velocity, const glm::vec3& angularVelocity, float invMass, const glm::mat3& invInertia)
+{
+	_position.push_back(position);
+	_rotation.push_back(rotation);
+	_invMass.push_back(invMass);
+	_invInertia.push_back(invInertia);
+	_static.push_back(invMass == 0.0f && invInertia == glm::mat3(0.0f));
+	for (int k = 0; k < 3; k++)
+	{
+		_velocity[k].push_back(velocity[k]);
+		_velocity[k + 3].push_back(angularVelocity[k]);
+	}
+	return _position.size() - 1;
+}
+
+void ConstraintSolver::AddContact(uint32_t a, uint32_t b, const glm::vec3& normal, const glm::vec3& point, float separation)
+{
+	Contact contact;
+	contact.a = a;
+	contact.b = b;
+	contact.normal = normal;
+	contact.point = point;
+	contact.separation = separation;
+	_contacts.push_back(contact);
+}
+
+size_t ConstraintSolver::AddJoint(const Joint& joint)
+{
+	_joints.push_back(joint);
+	_jointLambda.resize(_joints.size() * SOLVER_MAX_JOINT_ROWS, 0.0f);
+	return _joints.size() - 1;
+}
+
+void ConstraintSolver::RemapBodies(const std::vector<uint32_t>& remap)
+{
+	size_t kept = 0;
+	for (size_t j = 0; j < _joints.size(); j++)
+	{
+		Joint joint = _joints[j];
+		if (joint.a != SOLVER_WORLD)
+		{
+			joint.a = PFG::RemapBody(remap, joint.a);
+			if (joint.a == BODY_REMOVED)
+			{
+				continue;
+			}
+		}
+		if (joint.b != SOLVER_WORLD)
+		{
+			joint.b = PFG::RemapBody(remap, joint.b);
+			if (joint.b == BODY_REMOVED)
+			{
+				continue;
+			}
+		}
+
+		// The joint keeps its impulses from the last step to start from
+		_joints[kept] = joint;
+		for (int k = 0; k < SOLVER_MAX_JOINT_ROWS; k++)
+		{
+			_jointLambda[kept * SOLVER_MAX_JOINT_ROWS + k] = _jointLambda[j * SOLVER_MAX_JOINT_ROWS + k];
+		}
+		kept++;
+	}
+	_joints.resize(kept);
+	_jointLambda.resize(kept * SOLVER_MAX_JOINT_ROWS);
+}
+
+size_t ConstraintSolver::AddBallJoint(uint32_t a, const glm::vec3& localAnchorA, uint32_t b, const glm::vec3& localAnchorB)
+{
+	Joint joint;
+	joint.type = JOINT_BALL;
+	joint.a = a;
+	joint.b = b;
+	joint.localAnchorA = localAnchorA;
+	joint.localAnchorB = localAnchorB;
+	joint.localAxisA = glm::vec3(0.0f);
+	joint.localAxisB = glm::vec3(0.0f);
+	joint.relativeRotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	joint.length = 0.0f;
+	return AddJoint(joint);
+}
+
+size_t ConstraintSolver::AddHingeJoint(uint32_t a, const glm::vec3& localAnchorA, const glm::vec3& localAxisA, uint32_t b, const glm::vec3& localAnchorB, const glm::vec3& localAxisB)
+{
+	Joint joint;
+	joint.type = JOINT_HINGE;
+	joint.a = a;
+	joint.b = b;
+	joint.localAnchorA = localAnchorA;
+	joint.localAnchorB = localAnchorB;
+	joint.localAxisA = glm::normalize(localAxisA);
+	joint.localAxisB = glm::normalize(localAxisB);
+	joint.relativeRotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	joint.length = 0.0f;
+	return AddJoint(joint);
+}
+
+size_t ConstraintSolver::AddDistanceJoint(uint32_t a, const glm::vec3& localAnchorA, uint32_t b, const glm::vec3& localAnchorB, float length)
+{
+	Joint joint;
+	joint.type = JOINT_DISTANCE;
+	joint.a = a;
+	joint.b = b;
+	joint.localAnchorA = localAnchorA;
+	joint.localAnchorB = localAnchorB;
+	joint.localAxisA = glm::vec3(0.0f);
+	joint.localAxisB = glm::vec3(0.0f);
+	joint.relativeRotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	joint.length = length;
+	return AddJoint(joint);
+}
+
+size_t ConstraintSolver::AddFixedJoint(uint32_t a, const glm::vec3& localAnchorA, uint32_t b, const glm::vec3& localAnchorB, const glm::quat& relativeRotation)
+{
+	Joint joint;
+	joint.type = JOINT_FIXED;
+	joint.a = a;
+	joint.b = b;
+	joint.localAnchorA = localAnchorA;
+	joint.localAnchorB = localAnchorB;
+	joint.localAxisA = glm::vec3(0.0f);
+	joint.localAxisB = glm::vec3(0.0f);
+	joint.relativeRotation = relativeRotation;
+	joint.length = 0.0f;
+	return AddJoint(joint);
+}
+
+uint32_t ConstraintSolver::AddRow(uint32_t a, uint32_t b, const glm::vec3& linearA, const glm::vec3& angularA, const glm::vec3& linearB, const glm::vec3& angularB, float bias, float lower, float upper)
+{
+	const glm::vec3 jacobian[4] = { linearA, angularA, linearB, angularB };
+	const glm::vec3 impulse[4] = { _invMass[a] * linearA, _invInertia[a] * angularA, _invMass[b] * linearB, _invInertia[b] * angularB };
+
+	float inverseEffectiveMass = 0.0f;
+	for (int part = 0; part < 4; part++)
+	{
+		inverseEffectiveMass += glm::dot(jacobian[part], impulse[part]);
+		for (int k = 0; k < 3; k++)
+		{
+			_jacobian[3 * part + k].push_back(jacobian[part][k]);
+			_impulse[3 * part + k].push_back(impulse[part][k]);
+		}
+	}
+
+	_bodyA.push_back(a);
+	_bodyB.push_back(b);
+	_effectiveMass.push_back(inverseEffectiveMass > 0.0f ? 1.0f / inverseEffectiveMass : 0.0f);
+	_bias.push_back(bias);
+	_lambda.push_back(0.0f);
+	_lower.push_back(lower);
+	_upper.push_back(upper);
+	_normalRow.push_back(-1);
+	return (uint32_t)_bias.size() - 1;
+}
+
+float ConstraintSolver::RowVelocity(uint32_t row) const
+{
+	const uint32_t a = _bodyA[row];
+	const uint32_t b = _bodyB[row];
+	float velocity = 0.0f;
+	for (int k = 0; k < 6; k++)
+	{
+		velocity += _jacobian[k][row] * _velocity[k][a] + _jacobian[k + 6][row] * _velocity[k][b];
+	}
+	return velocity;
+}
+
+void ConstraintSolver::ApplyRowImpulse(uint32_t row, float lambda)
+{
+	// Static bodies are shared between the rows of a colour, so they are never written to
+	const uint32_t a = _bodyA[row];
+	const uint32_t b = _bodyB[row];
+	if (!_static[a])
+	{
+		for (int k = 0; k < 6; k++)
+		{
+			_velocity[k][a] += _impulse[k][row] * lambda;
+		}
+	}
+	if (!_static[b])
+	{
+		for (int k = 0; k < 6; k++)
+		{
+			_velocity[k][b] += _impulse[k + 6][row] * lambda;
+		}
+	}
+}
+
+void ConstraintSolver::AddJointRows(const Joint& joint, float deltaTs)
+{
+	const float infinity = std::numeric_limits<float>::infinity();
+	const float feedback = _baumgarte / deltaTs;
+	const uint32_t a = BodyIndex(joint.a);
+	const uint32_t b = BodyIndex(joint.b);
+	const glm::vec3 rA = _rotation[a] * joint.localAnchorA;
+	const glm::vec3 rB = _rotation[b] * joint.localAnchorB;
+	const glm::vec3 separation = (_position[b] + rB) - (_position[a] + rA);
+	const glm::vec3 zero(0.0f);
+
+	if (joint.type == JOINT_DISTANCE)
+	{
+		float length = glm::length(separation);
+		glm::vec3 n = length > 0.0f ? separation / length : glm::vec3(0.0f, 1.0f, 0.0f);
+		AddRow(a, b, -n, -glm::cross(rA, n), n, glm::cross(rB, n), feedback * (length - joint.length), -infinity, infinity);
+		return;
+	}
+
+	// Every other joint holds the anchors together, one row per axis
+	for (int k = 0; k < 3; k++)
+	{
+		glm::vec3 e(0.0f);
+		e[k] = 1.0f;
+		AddRow(a, b, -e, -glm::cross(rA, e), e, glm::cross(rB, e), feedback * separation[k], -infinity, infinity);
+	}
+
+	if (joint.type == JOINT_HINGE)
+	{
+		// Only turning about the hinge axis is free
+		glm::vec3 axisA = _rotation[a] * joint.localAxisA;
+		glm::vec3 axisB = _rotation[b] * joint.localAxisB;
+		glm::vec3 error = glm::cross(axisA, axisB);
+		glm::vec3 t1, t2;
+		PerpendicularBasis(axisA, t1, t2);
+		AddRow(a, b, zero, -t1, zero, t1, feedback * glm::dot(error, t1), -infinity, infinity);
+		AddRow(a, b, zero, -t2, zero, t2, feedback * glm::dot(error, t2), -infinity, infinity);
+	}
+	else if (joint.type == JOINT_FIXED)
+	{
+		// Rotation vector from where b should be turned to where it is
+		glm::quat error = _rotation[b] * glm::conjugate(_rotation[a] * joint.relativeRotation);
+		if (error.w < 0.0f)
+		{
+			error = -error;
+		}
+		glm::vec3 angle = 2.0f * glm::vec3(error.x, error.y, error.z);
+		for (int k = 0; k < 3; k++)
+		{
+			glm::vec3 e(0.0f);
+			e[k] = 1.0f;
+			AddRow(a, b, zero, -e, zero, e, feedback * angle[k], -infinity, infinity);
+		}
+	}
+}
+
+void ConstraintSolver::AddContactRows(size_t index, float deltaTs)
+{
+	const Contact& contact = _contacts[index];
+	const float infinity = std::numeric_limits<float>::infinity();
+	const uint32_t a = BodyIndex(contact.a);
+	const uint32_t b = BodyIndex(contact.b);
+	const glm::vec3 n = contact.normal;
+	const glm::vec3 rA = contact.point - _position[a];
+	const glm::vec3 rB = contact.point - _position[b];
+
+	// A gap may close this step, an overlap beyond the slop is pushed out a fraction at a time
+	float bias = contact.separation > 0.0f ? contact.separation / deltaTs : _baumgarte * std::min(contact.separation + SOLVER_CONTACT_SLOP, 0.0f) / deltaTs;
+	uint32_t normalRow = AddRow(a, b, n, glm::cross(rA, n), -n, -glm::cross(rB, n), 0.0f, 0.0f, infinity);
+
+	// Bounce if the bodies will meet this step
+	float closing = RowVelocity(normalRow);
+	if (closing < -_restSpeed && contact.separation + closing * deltaTs < 0.0f)
+	{
+		bias = std::min(bias, _restitution * closing);
+	}
+	_bias[normalRow] = bias;
+
+	glm::vec3 t1, t2;
+	PerpendicularBasis(n, t1, t2);
+	uint32_t frictionRow = AddRow(a, b, t1, glm::cross(rA, t1), -t1, -glm::cross(rB, t1), 0.0f, 0.0f, 0.0f);
+	_normalRow[frictionRow] = (int32_t)normalRow;
+	frictionRow = AddRow(a, b, t2, glm::cross(rA, t2), -t2, -glm::cross(rB, t2), 0.0f, 0.0f, 0.0f);
+	_normalRow[frictionRow] = (int32_t)normalRow;
+}
+
+template <typename T>
+static void PermuteRows(std::vector<T>& values, const uint32_t* order, size_t count, std::vector<T>& scratch)
+{
+	// Grown with room to spare, so a step with a few more rows than any before doesn't reallocate every array again
+	if (count > values.capacity())
+	{
+		values.reserve(count * 2);
+		scratch.reserve(count * 2);
+	}
+	scratch.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		scratch[i] = values[order[i]];
+	}
+	// Copied back rather than swapped, so every array keeps its own storage and stops reallocating once it has
+	// grown to the most rows a step needs
+	values.resize(count);
+	std::copy(scratch.begin(), scratch.end(), values.begin());
+}
+
+void ConstraintSolver::BuildColours(FrameArena& arena)
+{
+	const size_t bodyCount = _position.size();
+	const size_t rowCount = _bias.size();
+
+	// Greedy colouring, each row takes the lowest colour neither of its dynamic bodies has yet
+	_bodyColours.assign(bodyCount, 0);
+	_rowColour.resize(rowCount);
+	uint32_t colourRows[SOLVER_MAX_COLOURS + 1] = {};
+	for (size_t r = 0; r < rowCount; r++)
+	{
+		const uint32_t a = _bodyA[r];
+		const uint32_t b = _bodyB[r];
+		const uint64_t used = (_static[a] ? 0 : _bodyColours[a]) | (_static[b] ? 0 : _bodyColours[b]);
+		uint32_t colour = 0;
+		while (colour < SOLVER_MAX_COLOURS && (used & ((uint64_t)1 << colour)))
+		{
+			colour++;
+		}
+		if (colour < SOLVER_MAX_COLOURS)
+		{
+			const uint64_t bit = (uint64_t)1 << colour;
+			_bodyColours[a] |= _static[a] ? 0 : bit;
+			_bodyColours[b] |= _static[b] ? 0 : bit;
+		}
+		_rowColour[r] = colour;
+		colourRows[colour]++;
+	}
+
+	// Lay the colours out one after another, each padded to whole batches with an empty row
+	// that only touches the world. Rows that ran out of colours go last and are solved in order
+	const uint32_t padding = AddRow((uint32_t)bodyCount - 1, (uint32_t)bodyCount - 1, glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), 0.0f, 0.0f, 0.0f);
+	uint32_t next[SOLVER_MAX_COLOURS + 1];
+	_colourStart.clear();
+	uint32_t slots = 0;
+	for (uint32_t c = 0; c < SOLVER_MAX_COLOURS; c++)
+	{
+		if (colourRows[c] == 0)
+		{
+			continue;
+		}
+		_colourStart.push_back(slots / SOLVER_BATCH);
+		next[c] = slots;
+		slots += (colourRows[c] + SOLVER_BATCH - 1) / SOLVER_BATCH * SOLVER_BATCH;
+	}
+	_colourStart.push_back(slots / SOLVER_BATCH);
+	_serialStart = slots;
+	next[SOLVER_MAX_COLOURS] = slots;
+	slots += colourRows[SOLVER_MAX_COLOURS];
+
+	uint32_t* order = arena.AllocateArray<uint32_t>(slots);
+	std::fill(order, order + slots, padding);
+	_rowSlot.resize(rowCount);
+	for (size_t r = 0; r < rowCount; r++)
+	{
+		_rowSlot[r] = next[_rowColour[r]]++;
+		order[_rowSlot[r]] = (uint32_t)r;
+	}
+
+	// Move the rows into that order so each batch is four contiguous entries of every array
+	for (int k = 0; k < 12; k++)
+	{
+		PermuteRows(_jacobian[k], order, slots, _scratchFloat);
+		PermuteRows(_impulse[k], order, slots, _scratchFloat);
+	}
+	PermuteRows(_effectiveMass, order, slots, _scratchFloat);
+	PermuteRows(_bias, order, slots, _scratchFloat);
+	PermuteRows(_lambda, order, slots, _scratchFloat);
+	PermuteRows(_lower, order, slots, _scratchFloat);
+	PermuteRows(_upper, order, slots, _scratchFloat);
+	PermuteRows(_bodyA, order, slots, _scratchIndex);
+	PermuteRows(_bodyB, order, slots, _scratchIndex);
+	PermuteRows(_normalRow, order, slots, _scratchSigned);
+	for (size_t i = 0; i < _normalRow.size(); i++)
+	{
+		if (_normalRow[i] >= 0)
+		{
+			_normalRow[i] = (int32_t)_rowSlot[_normalRow[i]];
+		}
+	}
+}
+
+void ConstraintSolver::SolveRow(uint32_t row)
+{
+	float lower = _lower[row];
+	float upper = _upper[row];
+	if (_normalRow[row] >= 0)
+	{
+		upper = _friction * _lambda[_normalRow[row]];
+		lower = -upper;
+	}
+
+	float lambda = _lambda[row] - _effectiveMass[row] * (RowVelocity(row) + _bias[row]);
+	lambda = std::max(lower, std::min(lambda, upper));
+	ApplyRowImpulse(row, lambda - _lambda[row]);
+	_lambda[row] = lambda;
+}
+
+void ConstraintSolver::SolveBatches(size_t first, size_t last)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 friction = _mm_set1_ps(_friction);
+
+	for (size_t batch = first; batch < last; batch++)
+	{
+		const size_t row = batch * SOLVER_BATCH;
+		const uint32_t* a = &_bodyA[row];
+		const uint32_t* b = &_bodyB[row];
+
+		// Gather the velocities of both bodies of the four rows, no dynamic body appears twice in a colour
+		__m128 velocityA[6];
+		__m128 velocityB[6];
+		for (int k = 0; k < 6; k++)
+		{
+			const float* v = &_velocity[k][0];
+			velocityA[k] = _mm_set_ps(v[a[3]], v[a[2]], v[a[1]], v[a[0]]);
+			velocityB[k] = _mm_set_ps(v[b[3]], v[b[2]], v[b[1]], v[b[0]]);
+		}
+
+		__m128 relative = zero;
+		for (int k = 0; k < 6; k++)
+		{
+			relative = _mm_add_ps(relative, _mm_mul_ps(_mm_loadu_ps(&_jacobian[k][row]), velocityA[k]));
+			relative = _mm_add_ps(relative, _mm_mul_ps(_mm_loadu_ps(&_jacobian[k + 6][row]), velocityB[k]));
+		}
+
+		// Friction rows are bounded by their normal row's impulse
+		__m128 lower = _mm_loadu_ps(&_lower[row]);
+		__m128 upper = _mm_loadu_ps(&_upper[row]);
+		float normalLambda[SOLVER_BATCH];
+		float isFriction[SOLVER_BATCH];
+		for (int lane = 0; lane < SOLVER_BATCH; lane++)
+		{
+			int32_t normal = _normalRow[row + lane];
+			normalLambda[lane] = normal >= 0 ? _lambda[normal] : 0.0f;
+			isFriction[lane] = normal >= 0 ? 1.0f : 0.0f;
+		}
+		__m128 frictionMask = _mm_cmpgt_ps(_mm_loadu_ps(isFriction), zero);
+		__m128 bound = _mm_mul_ps(friction, _mm_loadu_ps(normalLambda));
+		lower = PFG::Select(frictionMask, _mm_sub_ps(zero, bound), lower);
+		upper = PFG::Select(frictionMask, bound, upper);
+
+		__m128 oldLambda = _mm_loadu_ps(&_lambda[row]);
+		__m128 lambda = _mm_sub_ps(oldLambda, _mm_mul_ps(_mm_loadu_ps(&_effectiveMass[row]), _mm_add_ps(relative, _mm_loadu_ps(&_bias[row]))));
+		lambda = _mm_max_ps(lower, _mm_min_ps(lambda, upper));
+		_mm_storeu_ps(&_lambda[row], lambda);
+		__m128 delta = _mm_sub_ps(lambda, oldLambda);
+
+		// Scatter back, static bodies are shared between rows and never written
+		float outA[6][SOLVER_BATCH];
+		float outB[6][SOLVER_BATCH];
+		for (int k = 0; k < 6; k++)
+		{
+			_mm_storeu_ps(outA[k], _mm_add_ps(velocityA[k], _mm_mul_ps(_mm_loadu_ps(&_impulse[k][row]), delta)));
+			_mm_storeu_ps(outB[k], _mm_add_ps(velocityB[k], _mm_mul_ps(_mm_loadu_ps(&_impulse[k + 6][row]), delta)));
+		}
+		for (int lane = 0; lane < SOLVER_BATCH; lane++)
+		{
+			for (int k = 0; k < 6; k++)
+			{
+				if (!_static[a[lane]])
+				{
+					_velocity[k][a[lane]] = outA[k][lane];
+				}
+				if (!_static[b[lane]])
+				{
+					_velocity[k][b[lane]] = outB[k][lane];
+				}
+			}
+		}
+	}
+}
+
+void ConstraintSolver::Solve(float deltaTs, JobSystem& jobs, FrameArena& arena)
+{
+	for (int k = 0; k < 12; k++)
+	{
+		_jacobian[k].clear();
+		_impulse[k].clear();
+	}
+	_bodyA.clear();
+	_bodyB.clear();
+	_effectiveMass.clear();
+	_bias.clear();
+	_lambda.clear();
+	_lower.clear();
+	_upper.clear();
+	_normalRow.clear();
+	_colourStart.clear();
+	_serialStart = 0;
+	if (deltaTs <= 0.0f)
+	{
+		return;
+	}
+
+	// The world is a static body at the end while the rows are built and solved
+	const size_t bodyCount = _position.size();
+	AddBody(glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.0f), glm::vec3(0.0f), 0.0f, glm::mat3(0.0f));
+
+	_jointFirstRow.resize(_joints.size());
+	for (size_t j = 0; j < _joints.size(); j++)
+	{
+		const Joint& joint = _joints[j];
+		bool valid = (joint.a < bodyCount || joint.a == SOLVER_WORLD) && (joint.b < bodyCount || joint.b == SOLVER_WORLD);
+		_jointFirstRow[j] = valid ? (uint32_t)_bias.size() : SOLVER_NO_ROW;
+		if (valid)
+		{
+			AddJointRows(joint, deltaTs);
+		}
+	}
+	for (size_t c = 0; c < _contacts.size(); c++)
+	{
+		AddContactRows(c, deltaTs);
+	}
+
+	BuildColours(arena);
+
+	// Start the joints from last step's impulses
+	for (size_t j = 0; j < _joints.size(); j++)
+	{
+		if (_jointFirstRow[j] == SOLVER_NO_ROW)
+		{
+			continue;
+		}
+		for (int k = 0; k < SOLVER_JOINT_ROWS[_joints[j].type]; k++)
+		{
+			uint32_t row = _rowSlot[_jointFirstRow[j] + k];
+			_lambda[row] = _jointLambda[j * SOLVER_MAX_JOINT_ROWS + k];
+			ApplyRowImpulse(row, _lambda[row]);
+		}
+	}
+
+	// The rows of a colour share no dynamic body, so its batches can be solved on any thread in any order
+	for (int iteration = 0; iteration < _iterations; iteration++)
+	{
+		for (size_t c = 0; c + 1 < _colourStart.size(); c++)
+		{
+			const size_t first = _colourStart[c];
+			jobs.ParallelFor(_colourStart[c + 1] - first, SOLVER_BATCH_GRAIN, [this, first](size_t begin, size_t end)
+			{
+				SolveBatches(first + begin, first + end);
+			});
+		}
+		for (uint32_t row = _serialStart; row < (uint32_t)_bias.size(); row++)
+		{
+			SolveRow(row);
+		}
+	}
+
+	for (size_t j = 0; j < _joints.size(); j++)
+	{
+		if (_jointFirstRow[j] == SOLVER_NO_ROW)
+		{
+			continue;
+		}
+		for (int k = 0; k < SOLVER_JOINT_ROWS[_joints[j].type]; k++)
+		{
+			_jointLambda[j * SOLVER_MAX_JOINT_ROWS + k] = _lambda[_rowSlot[_jointFirstRow[j] + k]];
+		}
+	}
+
+	// Take the world back off
+	_position.pop_back();
+	_rotation.pop_back();
+	_invMass.pop_back();
+	_invInertia.pop_back();
+	_static.pop_back();
+	for (int k = 0; k < 6; k++)
+	{
+		_velocity[k].pop_back();
+	}
+}
+
+bool PFG::ParseJoint(const std::string& line, const std::vector<glm::vec3>& positions, ConstraintSolver& solver)
+{
+	std::istringstream in(line);
+	std::string type;
+	int a = 0, b = 0;
+	if (!(in >> type >> a >> b) || a < 0 || a >= (int)positions.size() || b < -1 || b >= (int)positions.size() || a == b)
+	{
+		return false;
+	}
+
+	// The bodies start unrotated, so their own frames line up with the world
+	const uint32_t bodyA = (uint32_t)a;
+	const uint32_t bodyB = b < 0 ? SOLVER_WORLD : (uint32_t)b;
+	const glm::vec3 positionA = positions[a];
+	const glm::vec3 positionB = b < 0 ? glm::vec3(0.0f) : positions[b];
+
+	glm::vec3 anchor;
+	if (type == "ball")
+	{
+		if (!(in >> anchor.x >> anchor.y >> anchor.z))
+		{
+			return false;
+		}
+		solver.AddBallJoint(bodyA, anchor - positionA, bodyB, anchor - positionB);
+	}
+	else if (type == "hinge")
+	{
+		glm::vec3 axis;
+		if (!(in >> anchor.x >> anchor.y >> anchor.z >> axis.x >> axis.y >> axis.z) || glm::length(axis) == 0.0f)
+		{
+			return false;
+		}
+		solver.AddHingeJoint(bodyA, anchor - positionA, axis, bodyB, anchor - positionB, axis);
+	}
+	else if (type == "distance")
+	{
+		// Centre to centre, or to a point in the world
+		glm::vec3 anchorB = positionB;
+		if (b < 0 && !(in >> anchorB.x >> anchorB.y >> anchorB.z))
+		{
+			return false;
+		}
+		solver.AddDistanceJoint(bodyA, glm::vec3(0.0f), bodyB, anchorB - positionB, glm::length(anchorB - positionA));
+	}
+	else if (type == "fixed")
+	{
+		solver.AddFixedJoint(bodyA, glm::vec3(0.0f), bodyB, positionA - positionB, glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
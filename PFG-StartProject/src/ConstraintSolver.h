@@ -0,0 +1,233 @@
+#ifndef _ConstraintSolver_H_
+#define _ConstraintSolver_H_
+
+#include "Arena.h"
+#include "BodyRemap.h"
+#include "JobSystem.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Body index that stands for the static world, for joints that hang off a fixed point and contacts with planes
+static const uint32_t SOLVER_WORLD = 0xffffffffu;
+
+/*! \brief Brief description.
+*  ConstraintSolver resolves joints and contacts together as rows of one velocity level system, with projected
+*  Gauss-Seidel iteration (sequential impulses, Catto 2005). Each row is one equation J v + bias >= 0 or = 0 on the
+*  velocities of two bodies, with its accumulated impulse clamped between a lower and an upper bound.
+*
+*  Ball and socket, hinge, distance and fixed joints are kept between steps in body space and turned into rows
+*  every step: three for a ball and socket, five for a hinge, one for a distance, six for a fixed joint. Contacts
+*  are handed in each step by the caller, each one a normal row that only pushes and two friction rows bounded by
+*  the friction coefficient times the normal impulse. Drift away from a joint or into a contact is fed back as a
+*  fraction of the error per step (Baumgarte).
+*
+*  The rows are stored as structure of arrays, one array for each of the twelve Jacobian entries and for each
+*  entry of the impulse M^-1 J^T. Each step the rows are split by greedy graph colouring so that no two rows of a
+*  colour share a dynamic body, static bodies don't count as they are never written. Each colour is laid out in
+*  batches of four contiguous rows solved together with SSE, and its batches are shared between the job system's
+*  threads, one colour after another. Joint impulses are kept from the last step to start from.
+*
+*/
+class ConstraintSolver
+{
+public:
+
+	/** ConstraintSolver constructor
+	*/
+	ConstraintSolver();
+
+	/** Remove the bodies and contacts, the joints are kept
+	* The scene hands the bodies over again every step
+	*/
+	void ClearBodies();
+	/** Add a body
+	* @param glm::vec3 velocity with this step's forces already added
+	* @param float invMass zero for a body that nothing moves
+	* @param glm::mat3 invInertia world space inverse inertia tensor
+	* @return index of the body
+	*/
+	size_t AddBody(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& velocity, const glm::vec3& angularVelocity, float invMass, const glm::mat3& invInertia);
+	/** Add a contact between two bodies, body b can be SOLVER_WORLD
+	* @param glm::vec3 normal unit normal pointing from b to a
+	* @param glm::vec3 point where the bodies touch, in world space
+	* @param float separation gap along the normal, negative when they overlap. A contact with a small positive
+	* gap stops the bodies closing any further than it this step
+	*/
+	void AddContact(uint32_t a, uint32_t b, const glm::vec3& normal, const glm::vec3& point, float separation);
+
+	/** Joints hold points given in each body's own frame, for SOLVER_WORLD the point is in world space
+	* @return index of the joint
+	*/
+	size_t AddBallJoint(uint32_t a, const glm::vec3& localAnchorA, uint32_t b, const glm::vec3& localAnchorB);
+	/** A ball and socket that also keeps an axis of each body lined up, so they only turn about it
+	*/
+	size_t AddHingeJoint(uint32_t a, const glm::vec3& localAnchorA, const glm::vec3& localAxisA, uint32_t b, const glm::vec3& localAnchorB, const glm::vec3& localAxisB);
+	/** Keep two anchors a fixed distance apart, like a rigid rod with a ball and socket at each end
+	*/
+	size_t AddDistanceJoint(uint32_t a, const glm::vec3& localAnchorA, uint32_t b, const glm::vec3& localAnchorB, float length);
+	/** A ball and socket that also holds the rotation of b relative to a
+	* @param glm::quat relativeRotation conjugate(rotation of a) * rotation of b to hold
+	*/
+	size_t AddFixedJoint(uint32_t a, const glm::vec3& localAnchorA, uint32_t b, const glm::vec3& localAnchorB, const glm::quat& relativeRotation);
+	void ClearJoints() { _joints.clear(); _jointLambda.clear(); }
+	/** Renumber the joints' bodies after the scene removed some, joints on a removed body are dropped
+	* Joint indices after a dropped joint move down. SOLVER_WORLD is left as it is
+	* @param std::vector<uint32_t> remap new index of each old body, or BODY_REMOVED
+	*/
+	void RemapBodies(const std::vector<uint32_t>& remap);
+	size_t GetJointCount() const { return _joints.size(); }
+
+	void SetIterations(int iterations) { _iterations = iterations; }
+	void SetFriction(float friction) { _friction = friction; }
+	void SetRestitution(float restitution) { _restitution = restitution; }
+	/** Bodies closing slower than this don't bounce, it needs to be above a step's worth of gravity so a
+	* resting body doesn't keep hopping
+	*/
+	void SetRestSpeed(float speed) { _restSpeed = speed; }
+	/** Fraction of the joint and contact error fed back each step
+	*/
+	void SetBaumgarte(float baumgarte) { _baumgarte = baumgarte; }
+
+	/** Build the rows for this step and iterate them, changing the bodies' velocities
+	* @param JobSystem jobs each colour's batches are shared between its threads
+	* @param FrameArena arena scratch for the colouring, only used during the call
+	*/
+	void Solve(float deltaTs, JobSystem& jobs, FrameArena& arena);
+
+	size_t Size() const { return _position.size(); }
+	glm::vec3 GetVelocity(size_t body) const { return glm::vec3(_velocity[0][body], _velocity[1][body], _velocity[2][body]); }
+	glm::vec3 GetAngularVelocity(size_t body) const { return glm::vec3(_velocity[3][body], _velocity[4][body], _velocity[5][body]); }
+	/** Rows in the last solve, including the padding that fills out the batches
+	*/
+	size_t GetRowCount() const { return _bias.size(); }
+	size_t GetColourCount() const { return _colourStart.empty() ? 0 : _colourStart.size() - 1; }
+
+private:
+
+	enum JointType
+	{
+		JOINT_BALL,
+		JOINT_HINGE,
+		JOINT_DISTANCE,
+		JOINT_FIXED
+	};
+
+	struct Joint
+	{
+		JointType type;
+		uint32_t a;
+		uint32_t b;
+		glm::vec3 localAnchorA;
+		glm::vec3 localAnchorB;
+		glm::vec3 localAxisA;
+		glm::vec3 localAxisB;
+		glm::quat relativeRotation;
+		float length;
+	};
+
+	size_t AddJoint(const Joint& joint);
+	/** Body index in the arrays, SOLVER_WORLD maps to the static body added at the end
+	*/
+	uint32_t BodyIndex(uint32_t body) const { return body == SOLVER_WORLD ? (uint32_t)_position.size() - 1 : body; }
+	/** Append a row, working out its impulse and effective mass
+	* @return index of the row
+	*/
+	uint32_t AddRow(uint32_t a, uint32_t b, const glm::vec3& linearA, const glm::vec3& angularA, const glm::vec3& linearB, const glm::vec3& angularB, float bias, float lower, float upper);
+	/** Relative velocity of the row, J v
+	*/
+	float RowVelocity(uint32_t row) const;
+	void ApplyRowImpulse(uint32_t row, float lambda);
+	void AddJointRows(const Joint& joint, float deltaTs);
+	void AddContactRows(size_t contact, float deltaTs);
+	/** Colour the rows and reorder every row array into batches of four, colour by colour
+	*/
+	void BuildColours(FrameArena& arena);
+	/** Solve one row on its own, for the rows that didn't get a colour
+	*/
+	void SolveRow(uint32_t row);
+	/** Solve the rows of batches first to last, four at a time
+	*/
+	void SolveBatches(size_t first, size_t last);
+
+	/** Bodies, the world's static body last while solving
+	*/
+	std::vector<glm::vec3> _position;
+	std::vector<glm::quat> _rotation;
+	std::vector<float> _invMass;
+	std::vector<glm::mat3> _invInertia;
+	std::vector<uint8_t> _static;
+	/** Linear then angular velocity, one array per component
+	*/
+	std::vector<float> _velocity[6];
+
+	struct Contact
+	{
+		uint32_t a;
+		uint32_t b;
+		glm::vec3 normal;
+		glm::vec3 point;
+		float separation;
+	};
+	std::vector<Contact> _contacts;
+
+	std::vector<Joint> _joints;
+	/** Impulse of each joint row at the end of the last step, six per joint
+	*/
+	std::vector<float> _jointLambda;
+	std::vector<uint32_t> _jointFirstRow;
+
+	/** Rows, linear A, angular A, linear B, angular B for the Jacobian and for M^-1 J^T
+	*/
+	std::vector<float> _jacobian[12];
+	std::vector<float> _impulse[12];
+	std::vector<uint32_t> _bodyA;
+	std::vector<uint32_t> _bodyB;
+	std::vector<float> _effectiveMass;
+	std::vector<float> _bias;
+	std::vector<float> _lambda;
+	std::vector<float> _lower;
+	std::vector<float> _upper;
+	/** For a friction row, the normal row whose impulse bounds it, otherwise -1
+	*/
+	std::vector<int32_t> _normalRow;
+
+	/** Colour c is batches _colourStart[c] to _colourStart[c + 1], the rows from _serialStart on have no colour
+	*/
+	std::vector<uint32_t> _colourStart;
+	uint32_t _serialStart;
+	/** Where each row was moved to by the colouring, in the order the rows were built
+	*/
+	std::vector<uint32_t> _rowSlot;
+	std::vector<uint32_t> _rowColour;
+	/** Colours each body already has a row in, one bit per colour
+	*/
+	std::vector<uint64_t> _bodyColours;
+	std::vector<float> _scratchFloat;
+	std::vector<uint32_t> _scratchIndex;
+	std::vector<int32_t> _scratchSigned;
+
+	int _iterations;
+	float _friction;
+	float _restitution;
+	float _baumgarte;
+	float _restSpeed;
+};
+
+namespace PFG
+{
+	/*
+	Make a joint from a line of the scene file, the part after 'joint'. Bodies are numbered in the order the scene
+	made them, -1 is the world. Points are in world space, with the bodies where they start. One of
+	  ball <a> <b> <x> <y> <z>
+	  hinge <a> <b> <x> <y> <z> <axisx> <axisy> <axisz>
+	  distance <a> <b>
+	  fixed <a> <b>
+	Returns false if the line can't be read
+	*/
+	bool ParseJoint(const std::string& line, const std::vector<glm::vec3>& positions, ConstraintSolver& solver);
+}
+
+#endif //!_ConstraintSolver_H_
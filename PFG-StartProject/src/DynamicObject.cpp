@@ -3,7 +3,10 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/rotate_vector.hpp>
 #include <iostream>
+#include <cfloat>
 #include "Utility.h"
+#include "CollisionDispatch.h"
+#include "Transforms.h"
 
 DynamicObject::DynamicObject()
 {
@@ -16,13 +19,18 @@ DynamicObject::DynamicObject()
 	_angular_velocity = glm::vec3(0.0f, 0.0f, 0.0f);
 	_angular_momentum = glm::vec3(0.0f, 0.0f, 0.0f);
 
-	_rotationMatrix = glm::mat3(1.0f);
-
 	_rotQuat = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
 
-	_scale = glm::vec3(1.0f, 1.0f, 1.0f);
+	_body_inverse_inertia = glm::vec3(0.0f, 0.0f, 0.0f);
+	_inertia_tensor_inverse = glm::mat3(0.0f);
+	_isotropic_inertia = true;
+
 	_start = false;
 	_stopped = false;
+	_integrator = INTEGRATOR_RUNGE_KUTTA4;
+	_uniformGravity = true;
+
+	m_objectType = SHAPE_SPHERE;
 }
 
 DynamicObject::~DynamicObject()
@@ -32,21 +40,24 @@ DynamicObject::~DynamicObject()
 
 void DynamicObject::StartSimulation(bool start)
 {
+	// The scene calls this every frame, only set up the body when the simulation actually starts
+	if (!start || _start)
+	{
+		_start = start;
+		return;
+	}
 	_start = start;
 
 	_rotQuat = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
 
-	glm::mat3 body_inertia;
+	// Solid sphere, the same about every axis
+	float body_inertia = (2.0f / 5.0f) * _mass * std::pow(_bRadius, 2);
 
-	body_inertia = glm::mat3
-	{
-		(2.0f / 5.0f) * _mass * std::pow(_bRadius, 2),0,0,
-		0, (2.0f / 5.0f) * _mass * std::pow(_bRadius, 2),0,
-		0,0, (2.0f / 5.0f) * _mass * std::pow(_bRadius, 2)
-	};
-
-	_body_inertia_tensor_inverse = glm::inverse(body_inertia);
+	_body_inverse_inertia = glm::vec3(1.0f / body_inertia);
+	_isotropic_inertia = true;
 
+	// An isotropic tensor doesn't change as the body rotates, so it only needs setting once
+	_inertia_tensor_inverse = glm::mat3(1.0f / body_inertia);
 	ComputeInverseInertiaTensor();
 
 	_angular_velocity = _inertia_tensor_inverse * _angular_momentum;
@@ -54,7 +65,51 @@ void DynamicObject::StartSimulation(bool start)
 
 void DynamicObject::ComputeInverseInertiaTensor()
 {
-	_inertia_tensor_inverse = _rotationMatrix * _body_inertia_tensor_inverse * glm::transpose(_rotationMatrix);
+	if (_isotropic_inertia)
+	{
+		// R * I^-1 * R^T is I^-1 for a sphere, nothing to do
+		return;
+	}
+
+	// Closed form R * D * R^T for the diagonal body tensor D: scale the columns of R, then multiply by R^T
+	glm::mat3 rotation = glm::mat3_cast(_rotQuat);
+	glm::mat3 scaled = rotation;
+	scaled[0] *= _body_inverse_inertia.x;
+	scaled[1] *= _body_inverse_inertia.y;
+	scaled[2] *= _body_inverse_inertia.z;
+	_inertia_tensor_inverse = scaled * glm::transpose(rotation);
+}
+
+glm::vec3 DynamicObject::ApplyInverseInertia(const glm::vec3& v) const
+{
+	if (_isotropic_inertia)
+	{
+		return _body_inverse_inertia.x * v;
+	}
+	return _inertia_tensor_inverse * v;
+}
+
+void DynamicObject::SetRotationalState(const glm::quat& rotation, const glm::vec3& angularVelocity)
+{
+	_rotQuat = rotation;
+	ComputeInverseInertiaTensor();
+	_angular_velocity = angularVelocity;
+	if (_isotropic_inertia)
+	{
+		_angular_momentum = angularVelocity / _body_inverse_inertia.x;
+	}
+	else
+	{
+		_angular_momentum = glm::inverse(_inertia_tensor_inverse) * angularVelocity;
+	}
+	_transformDirty = true;
+}
+
+void DynamicObject::IntegrateOrientation(float deltaTs)
+{
+	// dq/dt = 0.5 * (0, w) * q, renormalised so the quaternion stays a pure rotation
+	glm::quat spin = glm::quat(0.0f, _angular_velocity.x, _angular_velocity.y, _angular_velocity.z) * _rotQuat;
+	_rotQuat = glm::normalize(_rotQuat + spin * (0.5f * deltaTs));
 }
 
 void DynamicObject::Update(GameObject* otherObject, float deltaTs)
@@ -62,136 +117,129 @@ void DynamicObject::Update(GameObject* otherObject, float deltaTs)
 
 	if (_start)
 	{
-		// STEP 1: clear forces
-		ClearForces();
-		ClearTorque();
-
-		// STEP 2: Compute forces
-		glm::vec3 gravityForce = glm::vec3(0.0f, -9.8 * _mass * 0.1f, 0.0f);
-		AddForce(gravityForce);
+		// STEP 1 and 2: clear and compute forces
+		ComputeForces();
 
 		// STEP 3: Find collision response
 		CollisionResponse(otherObject, deltaTs);
-
-		// STEP 4: Calculate next position using differential equation
-		RungeKutta4(deltaTs);
 	}
 
+	// STEP 4: Calculate next position using differential equation
+	Integrate(deltaTs);
 	UpdateModelMatrix();
 
 }
 
-void DynamicObject::Euler(float deltaTs)
+void DynamicObject::ComputeForces()
 {
-	float oneOverMass = 1 / _mass;
-
-	_velocity += (_force * oneOverMass) * deltaTs; // Velocity is calced based on previous velocity
-
-	_position += _velocity * deltaTs; // Current position is calced based on previous position
+	// STEP 1: clear forces
+	ClearForces();
+	ClearTorque();
+	_stopped = false;
 
-	if (_stopped == true)
+	// STEP 2: Compute forces
+	if (_uniformGravity)
 	{
-		_velocity.x = 0.0f;
-		_velocity.z = 0.0f;
+		glm::vec3 gravityForce = glm::vec3(0.0f, -9.8 * _mass * 0.1f, 0.0f);
+		AddForce(gravityForce);
 	}
-
-	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-	// ROTATION PHYSICS
-	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-	// STEP 1: Compute current angular momentum
-	_angular_momentum += _torque * deltaTs;
-
-	// STEP 2: Computer inverse inertia tensor
-	ComputeInverseInertiaTensor();
-
-	// STEP 3: Update angular velocity
-	_angular_velocity = _inertia_tensor_inverse * _angular_momentum;
-
-	// STEP 4: Compute skew matrix omega star
-	glm::mat3 omega_star = glm::mat3(0.0f, -_angular_velocity.z, _angular_velocity.y,
-									_angular_velocity.z, 0.0f, -_angular_velocity.x,
-									-_angular_velocity.y, _angular_velocity.x, 0.0f);
-
-	// Update rotation matrix
-	_rotationMatrix += omega_star * _rotationMatrix * deltaTs;
 }
 
-
-void DynamicObject::Verlet(float deltaTs)
+void DynamicObject::Integrate(float deltaTs)
 {
-	glm::vec3 acceleration;
-
-	acceleration = _force / _mass;
-
-	_previousPosition = _position - _velocity * deltaTs + 0.5f * acceleration * deltaTs * deltaTs;
+	BodyArrays bodies;
+	Integrate(deltaTs, bodies);
+}
 
-	_position = -_previousPosition + 2.0f * _position + acceleration * deltaTs * deltaTs;
+void DynamicObject::Integrate(float deltaTs, BodyArrays& bodies)
+{
+	if (!_start)
+	{
+		return;
+	}
 
-	_velocity = (_position - _previousPosition) / (2.0f * deltaTs);
+	// A batch of one body
+	bodies.Resize(1);
+	StoreLinearState(bodies, 0);
+	bodies.syncAtEnd[0] = 1;
+	PFG::IntegrateBodies(_integrator, bodies, AccumulatedForce(), 0, 1, deltaTs);
+	LoadLinearState(bodies, 0);
 
-	_velocity += acceleration * deltaTs;
+	IntegrateRotation(deltaTs);
 }
 
-void DynamicObject::RungeKutta2(float deltaTs)
+void DynamicObject::StoreLinearState(BodyArrays& bodies, size_t index) const
 {
-	glm::vec3 force;
-	glm::vec3 accel;
-	glm::vec3 k0;
-	glm::vec3 k1;
+	for (int k = 0; k < 3; k++)
+	{
+		bodies.position[k][index] = _position[k];
+		bodies.velocity[k][index] = _velocity[k];
+		bodies.force[k][index] = _force[k];
+	}
+	bodies.invMass[index] = 1.0f / _mass;
+	bodies.syncAtEnd[index] = 0;
+	if (_integrator != INTEGRATOR_BOGACKI_SHAMPINE)
+	{
+		return;
+	}
 
-	// Evaluate once at t0
-	force = _force;
-	accel = force / _mass;
-	k0 = deltaTs * accel;
+	const AdaptiveClock& clock = _adaptiveClock;
+	bodies.stepSize[index] = clock.size;
+	bodies.clockSpan[index] = clock.span;
+	bodies.clockElapsed[index] = clock.elapsed;
+	for (int k = 0; k < 3; k++)
+	{
+		bodies.lastForce[k][index] = clock.lastForce[k];
+		bodies.clockForce[k][index] = clock.force[k];
+		bodies.clockRate[k][index] = clock.rate[k];
+		bodies.clockPosition[k][index] = clock.position[k];
+		bodies.clockVelocity[k][index] = clock.velocity[k];
+		for (int s = 0; s < 3; s++)
+		{
+			bodies.clockStart[s][k][index] = clock.start[s][k];
+			bodies.clockEnd[s][k][index] = clock.end[s][k];
+		}
+	}
+}
 
-	// Evaluate once at t0 + deltaT/2 using half of k0
-	force = _force + k0 / 2.0f;
-	accel = force / _mass;
-	k1 = deltaTs * accel;
+void DynamicObject::LoadLinearState(const BodyArrays& bodies, size_t index)
+{
+	for (int k = 0; k < 3; k++)
+	{
+		_position[k] = bodies.position[k][index];
+		_velocity[k] = bodies.velocity[k][index];
+	}
+	if (_integrator != INTEGRATOR_BOGACKI_SHAMPINE)
+	{
+		return;
+	}
 
-	// Evaluate once at t0 + deltaT using k1
-	_velocity += k1;
-	_position += _velocity * deltaTs;
+	AdaptiveClock& clock = _adaptiveClock;
+	clock.size = bodies.stepSize[index];
+	clock.span = bodies.clockSpan[index];
+	clock.elapsed = bodies.clockElapsed[index];
+	for (int k = 0; k < 3; k++)
+	{
+		clock.lastForce[k] = bodies.lastForce[k][index];
+		clock.force[k] = bodies.clockForce[k][index];
+		clock.rate[k] = bodies.clockRate[k][index];
+		clock.position[k] = bodies.clockPosition[k][index];
+		clock.velocity[k] = bodies.clockVelocity[k][index];
+		for (int s = 0; s < 3; s++)
+		{
+			clock.start[s][k] = bodies.clockStart[s][k][index];
+			clock.end[s][k] = bodies.clockEnd[s][k][index];
+		}
+	}
 }
 
-void DynamicObject::RungeKutta4(float deltaTs)
+void DynamicObject::IntegrateRotation(float deltaTs)
 {
-	glm::vec3 force;
-	glm::vec3 acceleration;
 	glm::vec3 k0;
 	glm::vec3 k1;
 	glm::vec3 k2;
 	glm::vec3 k3;
 
-	//Evaluate once at t0
-	force = _force;
-	acceleration = force / _mass;
-	k0 = deltaTs * acceleration;
-
-	//Evaluate twice at t0 + deltaT/2.0 using half of k0 and half of k1
-	force = _force + k0 / 2.0f;
-	acceleration = force / _mass;
-	k1 = deltaTs * acceleration;
-
-	force = _force + k1 / 2.0f;
-	acceleration = force / _mass;
-	k2 = deltaTs * acceleration;
-
-	//Evaluate once at t0 + deltaT using k2
-	force = _force + k2;
-	acceleration = force / _mass;
-	k3 = deltaTs * acceleration;
-
-	//Evaluate at t0 + deltaT using weighted sum of k0, k1, k2 and k3
-	_velocity += (k0 + 2.0f * k1 + 2.0f * k2 + k3) / 6.0f;
-	//Update position 
-	_position += _velocity * deltaTs;
-
-	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-	// ROTATION PHYSICS
-	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
 	// STEP 1: Compute current angular momentum
 	glm::vec3 tempTorque;
 
@@ -218,169 +266,272 @@ void DynamicObject::RungeKutta4(float deltaTs)
 	ComputeInverseInertiaTensor();
 
 	// STEP 3: Update angular velocity
-	_angular_velocity = _inertia_tensor_inverse * _angular_momentum;
-
-	// STEP 4: Compute skew matrix omega star
-	glm::mat3 omega_star = glm::mat3(0.0f, -_angular_velocity.z, _angular_velocity.y,
-		_angular_velocity.z, 0.0f, -_angular_velocity.x,
-		-_angular_velocity.y, _angular_velocity.x, 0.0f);
+	_angular_velocity = ApplyInverseInertia(_angular_momentum);
 
-	// Update rotation matrix
-	_rotationMatrix += omega_star * _rotationMatrix * deltaTs;
+	// STEP 4: Update orientation
+	IntegrateOrientation(deltaTs);
 
+	_transformDirty = true;
 }
 
 void DynamicObject::CollisionResponse(GameObject* otherObject, float deltaTs)
 {
-	// New stuff
+	// Look up the collision function for this pair of shapes
+	PFG::PairCollisionFunction collide = PFG::GetCollisionFunction(GetType(), otherObject->GetType());
+	if (collide != NULL)
+	{
+		collide(this, otherObject, deltaTs);
+	}
+}
+
+void DynamicObject::CollideWithPlane(GameObject* otherObject, float deltaTs)
+{
 	const float r = GetBoundingRadius();
-	const float elasticity = 0.5;
-	int type = otherObject->GetType();
-	_stopped = false;
 
-	// Sphere to plane
-	if (type == 0)
+	// Call moving sphere collision detection
+	glm::vec3 normal = otherObject->GetUpDirection();
+	glm::vec3 centre0 = _position;
+	glm::vec3 centre1 = _position + _velocity * deltaTs;
+	glm::vec3 q = otherObject->GetPosition();
+	glm::vec3 contactPoint;
+
+	// Using DistancetoPlane to detect collision
+	bool collision = PFG::MovingSphereToPlaneCollision(normal, centre0, centre1, q, r, contactPoint);
+
+	// Response to collision if there is one
+	if (collision)
 	{
-		// Call moving sphere collision detection
-		glm::vec3 normal = glm::vec3(0.0f, 1.0f, 0.0f);
-		glm::vec3 centre0 = _position;
-		glm::vec3 centre1 = _position + _velocity * deltaTs;
-		glm::vec3 q = otherObject->GetPosition();
-		glm::vec3 contactPoint;
+		PlaneCollisionResponse(normal, contactPoint, otherObject->GetInitialVelocity(), deltaTs);
+	}
+}
 
-		// Using DistancetoPlane to detect collision
-		bool collision = PFG::MovingSphereToPlaneCollision(normal, centre0, centre1, q, r, contactPoint);
+void DynamicObject::CollideWithHalfSpace(GameObject* otherObject, float deltaTs)
+{
+	const float r = GetBoundingRadius();
 
-		// Response to collision if there is one
-		if (collision)
-		{
-			/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-			// COLLISION RESPONSE
-			/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-			glm::vec3 ColliderVel = otherObject->GetInitialVelocity();
-			glm::vec3 relativeVel = _velocity - ColliderVel;
-			glm::vec3 n = glm::vec3(0.0f, 1.0f, 0.0f); // floor normal up
-			float invColliderMass = 0.0f; // floor doesn't move
-
-			_position = contactPoint;
-
-			// Zero out the 
-			float Jlinear = 0.0f;
-			float Jangular = 0.0f;
-			float elasticity = 0.5f;
-			glm::vec3 r1 = _bRadius * glm::vec3(0.0f, 1.0f, 0.0f); // Lever between the COM and point of contact
-
-			float oneOverMass1 = 1.0f / _mass; // 1/m of object 1
-			float oneOverMass2 = 0.0f;		   // 1/m of object 2
-			glm::vec3 vA = _velocity;		   // Velocity of object 1
-			glm::vec3 vB = glm::vec3(0.0f, 0.0f, 0.0f);
-			glm::vec3 relativeVelocity = vA - vB;
-			glm::vec3 contactNormal = glm::vec3(0.0f, 1.0f, 0.0f);
-
-			float eCof = -(1.0f + elasticity) * glm::dot(relativeVel, contactNormal);
-			// Jlin = (-(1 + e)*va dot cN) / (1 / m1)+ (1 / m2)
-			Jlinear = eCof / oneOverMass1 + oneOverMass2;
-			// Jang = (-(1 + e)*va dot cN) / (1 / m1) + (1 / m2) + (I * r1 * cN) dot cN
-			Jangular = eCof / (oneOverMass1 + oneOverMass2 + glm::dot(_inertia_tensor_inverse * (r1 * contactNormal), contactNormal));
-
-			glm::vec3 impulseForce = (Jangular + Jlinear) * contactNormal; // Fi = (Jang + Jlin) * cN
-			glm::vec3 contactForce = -(_force) * contactNormal;
-
-			AddForce(impulseForce + contactForce);
-			_velocity += (impulseForce / _mass); // Adding the impulse onto the velocity
-
-			/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-			// FRICTION
-			/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-			glm::vec3 forwardRelativeVelocity = relativeVelocity - glm::dot(relativeVelocity, contactNormal) * contactNormal; // Finding relative velocity perpendicular to the contact normal
-
-			glm::vec3 forwardRelativeDirection = glm::vec3(0.0f, 0.0f, 0.0f);
-			if (forwardRelativeVelocity != glm::vec3(0.0f, 0.0f, 0.0f))
-			{
-				forwardRelativeDirection = glm::normalize(forwardRelativeVelocity); // gets a normalized vector of the direction travelled perpendicular to the contact normal
-			}
+	// Call moving sphere collision detection
+	glm::vec3 normal = otherObject->GetUpDirection();
+	glm::vec3 centre0 = _position;
+	glm::vec3 centre1 = _position + _velocity * deltaTs;
+	glm::vec3 q = otherObject->GetPosition();
+	glm::vec3 contactPoint;
 
-			float mu = 0.5f;
-			glm::vec3 frictionDirection = forwardRelativeDirection * -1.0f; // friction direction acts in opposite direction of direction travel
-			glm::vec3 frictonForce = frictionDirection * mu * glm::length(contactForce);
+	// Using DistancetoPlane to detect collision, everything behind the plane is solid
+	bool collision = PFG::MovingSphereToHalfSpaceCollision(normal, centre0, centre1, q, r, contactPoint);
 
-			if (glm::length(forwardRelativeVelocity) - ((glm::length(frictonForce) / _mass) * deltaTs) > 0.0f) // Checks to see if friction force would reverse the direction of travel
-			{
-				AddForce(frictonForce); // Add friction
-			}
-			else
-			{
-				frictonForce = forwardRelativeVelocity * -1.0f; // Adds enough friction to stop the object
-				AddForce(frictonForce);
-				_stopped = true;
-			}
+	// Response to collision if there is one
+	if (collision)
+	{
+		PlaneCollisionResponse(normal, contactPoint, otherObject->GetInitialVelocity(), deltaTs);
+	}
+}
 
-			/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-			// TORQUE
-			/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void DynamicObject::CollideWithMesh(GameObject* otherObject, float deltaTs)
+{
+	if (otherObject->GetMesh() == NULL)
+	{
+		return;
+	}
 
-			glm::vec3 tempTorque = (glm::cross(r1, contactForce)) + (glm::cross(r1, frictonForce)); // Computes torque
+	const float r = GetBoundingRadius();
 
-			tempTorque.x -= _angular_momentum.x * 20.0f;
-			tempTorque -= _angular_momentum.z * 20.0f; // A damper to slow rotation over time
+	const CollisionMesh& mesh = otherObject->GetMesh()->GetCollisionMesh();
+	const glm::mat4& model = otherObject->GetModelMatrix();
+	const glm::mat4& invModel = otherObject->GetInvModelMatrix();
 
-			AddTorque(tempTorque);
-		}
+	glm::vec3 centre0 = _position;
+	glm::vec3 centre1 = _position + _velocity * deltaTs;
+
+	// Query the mesh in its model space with a sphere big enough to cover the whole step. A non-uniformly scaled
+	// mesh turns the swept sphere into an ellipsoid in model space, so divide by the smallest scale to cover it
+	// along the short axes as well
+	float scale = glm::min(glm::length(glm::vec3(model[0])), glm::min(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+	if (scale <= 0.0f)
+	{
+		return;
 	}
+	glm::vec3 localCentre = glm::vec3(invModel * glm::vec4(centre0, 1.0f));
+	float localRadius = (r + glm::length(centre1 - centre0)) / scale;
 
-	// Sphere to sphere
-	if (type == 1)
+	std::vector<MeshContact>& contacts = _meshContacts;
+	if (mesh.SphereContacts(localCentre, localRadius, contacts))
 	{
-		// Cast gameobject into dynamic so we can use sphere to sphere functions
-		DynamicObject* otherDynamObj = dynamic_cast<DynamicObject*>(otherObject);
+		// Each nearby triangle acts as a plane through its closest point, respond to the first one the sphere reaches
+		glm::mat3 normalMatrix = glm::transpose(glm::mat3(invModel));
+		bool collision = false;
+		float closest = FLT_MAX;
+		glm::vec3 contactNormal;
+		glm::vec3 contactPoint;
 
-		glm::vec3 centre0 = otherDynamObj->GetPosition();
-		glm::vec3 centre1 = _position;
-		float radius1 = GetBoundingRadius();
-		float radius2 = otherDynamObj->GetBoundingRadius();
-		glm::vec3 collisionPoint;
+		for (size_t i = 0; i < contacts.size(); i++)
+		{
+			glm::vec3 normal = glm::normalize(normalMatrix * contacts[i].normal);
+			glm::vec3 q = glm::vec3(model * glm::vec4(contacts[i].point, 1.0f));
+			glm::vec3 ci;
 
-		bool collision = PFG::SphereToSphereCollision(centre0, centre1, radius1, radius2, collisionPoint);
+			if (PFG::MovingSphereToPlaneCollision(normal, centre0, centre1, q, r, ci) && glm::length(ci - centre0) < closest)
+			{
+				collision = true;
+				closest = glm::length(ci - centre0);
+				contactNormal = normal;
+				contactPoint = ci;
+			}
+		}
 
 		if (collision)
 		{
-			glm::vec3 ColliderVel = otherDynamObj->GetVelocity();
-			glm::vec3 relativeVel = _velocity - ColliderVel;
-			glm::vec3 normal = glm::normalize(centre0 - centre1);
-			
+			PlaneCollisionResponse(contactNormal, contactPoint, otherObject->GetInitialVelocity(), deltaTs);
+		}
+	}
+}
 
-			glm::vec3 contactPosition = radius1 * normal;
-			float eCof = -(1.0f + elasticity) * glm::dot(relativeVel, normal);
-			float invMass = 1 / GetMass();
-			float invColliderMass = 1 / otherDynamObj->GetMass();
-			float jLin = eCof / (invMass + invColliderMass);
+void DynamicObject::CollideWithSphere(DynamicObject* otherObject, float deltaTs)
+{
+	const float elasticity = 0.5;
 
-			glm::vec3 collision_impulse_force = jLin * normal / deltaTs;
+	glm::vec3 centre0 = otherObject->GetPosition();
+	glm::vec3 centre1 = _position;
+	float radius1 = GetBoundingRadius();
+	float radius2 = otherObject->GetBoundingRadius();
+	glm::vec3 collisionPoint;
 
-			glm::vec3 acceleration = _force / _mass + otherDynamObj->GetMass();
+	bool collision = PFG::SphereToSphereCollision(centre0, centre1, radius1, radius2, collisionPoint);
 
-			glm::vec3 contact_force = _force - _mass * acceleration;
-			glm::vec3 total_force = contact_force + collision_impulse_force;
+	if (collision)
+	{
+		glm::vec3 ColliderVel = otherObject->GetVelocity();
+		glm::vec3 relativeVel = _velocity - ColliderVel;
+		glm::vec3 normal = glm::normalize(centre0 - centre1);
+		
 
-			AddForce(total_force);
-			otherDynamObj->AddForce(-collision_impulse_force);
-		}
+		glm::vec3 contactPosition = radius1 * normal;
+		float eCof = -(1.0f + elasticity) * glm::dot(relativeVel, normal);
+		float invMass = 1 / GetMass();
+		float invColliderMass = 1 / otherObject->GetMass();
+		float jLin = eCof / (invMass + invColliderMass);
+
+		glm::vec3 collision_impulse_force = jLin * normal / deltaTs;
+
+		glm::vec3 acceleration = _force / _mass + otherObject->GetMass();
+
+		glm::vec3 contact_force = _force - _mass * acceleration;
+		glm::vec3 total_force = contact_force + collision_impulse_force;
+
+		AddForce(total_force);
+		otherObject->AddForce(-collision_impulse_force);
 	}
 }
 
+void DynamicObject::PlaneCollisionResponse(const glm::vec3& normal, const glm::vec3& contactPoint, const glm::vec3& colliderVel, float deltaTs)
+{
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// COLLISION RESPONSE
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	glm::vec3 relativeVel = _velocity - colliderVel;
 
-void DynamicObject::UpdateModelMatrix()
+	_position = contactPoint;
+
+	// Zero out the 
+	float Jlinear = 0.0f;
+	float Jangular = 0.0f;
+	float elasticity = 0.5f;
+	glm::vec3 r1 = _bRadius * normal; // Lever between the COM and point of contact
+
+	float oneOverMass1 = 1.0f / _mass; // 1/m of object 1
+	float oneOverMass2 = 0.0f;		   // 1/m of object 2
+	glm::vec3 vA = _velocity;		   // Velocity of object 1
+	glm::vec3 vB = glm::vec3(0.0f, 0.0f, 0.0f);
+	glm::vec3 relativeVelocity = vA - vB;
+	glm::vec3 contactNormal = normal;
+
+	float eCof = -(1.0f + elasticity) * glm::dot(relativeVel, contactNormal);
+	// Jlin = (-(1 + e)*va dot cN) / (1 / m1)+ (1 / m2)
+	Jlinear = eCof / oneOverMass1 + oneOverMass2;
+	// Jang = (-(1 + e)*va dot cN) / (1 / m1) + (1 / m2) + (I * r1 * cN) dot cN
+	Jangular = eCof / (oneOverMass1 + oneOverMass2 + glm::dot(ApplyInverseInertia(r1 * contactNormal), contactNormal));
+
+	glm::vec3 impulseForce = (Jangular + Jlinear) * contactNormal; // Fi = (Jang + Jlin) * cN
+	glm::vec3 contactForce = -glm::dot(_force, contactNormal) * contactNormal; // Cancels the force pushing into the plane
+
+	AddForce(impulseForce + contactForce);
+	_velocity += (impulseForce / _mass); // Adding the impulse onto the velocity
+
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// FRICTION
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	glm::vec3 forwardRelativeVelocity = relativeVelocity - glm::dot(relativeVelocity, contactNormal) * contactNormal; // Finding relative velocity perpendicular to the contact normal
+
+	glm::vec3 forwardRelativeDirection = glm::vec3(0.0f, 0.0f, 0.0f);
+	if (forwardRelativeVelocity != glm::vec3(0.0f, 0.0f, 0.0f))
+	{
+		forwardRelativeDirection = glm::normalize(forwardRelativeVelocity); // gets a normalized vector of the direction travelled perpendicular to the contact normal
+	}
+
+	float mu = 0.5f;
+	glm::vec3 frictionDirection = forwardRelativeDirection * -1.0f; // friction direction acts in opposite direction of direction travel
+	glm::vec3 frictonForce = frictionDirection * mu * glm::length(contactForce);
+
+	if (glm::length(forwardRelativeVelocity) - ((glm::length(frictonForce) / _mass) * deltaTs) > 0.0f) // Checks to see if friction force would reverse the direction of travel
+	{
+		AddForce(frictonForce); // Add friction
+	}
+	else
+	{
+		frictonForce = forwardRelativeVelocity * -1.0f; // Adds enough friction to stop the object
+		AddForce(frictonForce);
+		_stopped = true;
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// TORQUE
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	glm::vec3 tempTorque = (glm::cross(r1, contactForce)) + (glm::cross(r1, frictonForce)); // Computes torque
+
+	tempTorque.x -= _angular_momentum.x * 20.0f;
+	tempTorque -= _angular_momentum.z * 20.0f; // A damper to slow rotation over time
+
+	AddTorque(tempTorque);
+}
+
+void DynamicObject::ImpactResponse(DynamicObject* otherObject)
 {
-	glm::mat4 modelRotation = glm::mat4(_rotationMatrix);
+	const float elasticity = 0.5f;
+
+	glm::vec3 normal = _position - otherObject->GetPosition();
+	if (normal == glm::vec3(0.0f, 0.0f, 0.0f))
+	{
+		return;
+	}
+	normal = glm::normalize(normal);
+
+	glm::vec3 relativeVel = _velocity - otherObject->GetVelocity();
+	float approachSpeed = glm::dot(relativeVel, normal);
 
-	glm::quat rotation = glm::normalize(glm::quat_cast(modelRotation));
+	// Only respond if the spheres are still closing on each other
+	if (approachSpeed >= 0.0f)
+	{
+		return;
+	}
 
-	_rotationMatrix = glm::mat3_cast(rotation);
+	float invMass = 1.0f / _mass;
+	float invColliderMass = 1.0f / otherObject->GetMass();
+	float jLin = -(1.0f + elasticity) * approachSpeed / (invMass + invColliderMass);
 
-	_modelMatrix = glm::translate(glm::mat4(1), _position);
-	_modelMatrix = glm::scale(_modelMatrix, _scale);
-	_modelMatrix = _modelMatrix * glm::mat4_cast(rotation);
-	_invModelMatrix = glm::inverse(_modelMatrix);
+	_velocity += jLin * invMass * normal;
+	otherObject->SetVelocity(otherObject->GetVelocity() - jLin * invColliderMass * normal);
+}
+
+void DynamicObject::UpdateModelMatrix()
+{
+	if (!_transformDirty)
+	{
+		return;
+	}
 
+	glm::mat4 model;
+	glm::mat4 invModel;
+	PFG::ComposeTransform(_position, _rotQuat, _scale, model, invModel);
+	SetModelMatrices(model, invModel);
 }
\ No newline at end of file
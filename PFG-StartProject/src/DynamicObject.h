@@ -2,6 +2,7 @@
 #define _DynamicObject_H_
 
 #include "GameObject.h"
+#include "Integrators.h"
 #include <glm/gtc/quaternion.hpp>
 /*! \brief Brief description.
 *  This physics dynamic object class is derived from the GameObject class, as a one type/class of game objects
@@ -32,6 +33,34 @@ public:
 	*/
 	virtual void Update(GameObject* otherObject, float deltaTs);
 
+	/** Clear the forces from the last step and add the forces that always act on the object (gravity)
+	*   This is the first phase of a simulation step, before any collision response
+	*/
+	void ComputeForces();
+	/** Integrate the object forward on its own with its integrator and mark its model matrix for rebuilding
+	*   Used when the object is sub-stepped to a time of impact. The scene integrates the rest of its objects
+	*   in batches with StoreLinearState, PFG::IntegrateBodies, LoadLinearState and IntegrateRotation
+	*   @param float deltaTs the length of time to integrate over
+	*/
+	void Integrate(float deltaTs);
+	/** The same, with a one body batch kept by the caller so sub-stepping many objects doesn't allocate
+	*/
+	void Integrate(float deltaTs, BodyArrays& scratch);
+
+	/** Copy the position, velocity, force and mass into a batch of bodies
+	*   @param BodyArrays bodies the batch
+	*   @param size_t index where in the batch to put this object
+	*/
+	void StoreLinearState(BodyArrays& bodies, size_t index) const;
+	/** Copy the integrated position and velocity back out of a batch of bodies
+	*/
+	void LoadLinearState(const BodyArrays& bodies, size_t index);
+	/** Integrate the angular momentum and orientation, and mark the model matrix for rebuilding
+	*   This is the part of a step that isn't batched
+	*   @param float deltaTs the length of time to integrate over
+	*/
+	void IntegrateRotation(float deltaTs);
+
 	/** Add force that acts on the object to the total force for physics computation
 	*  
 	*   @param const glm::vec3 force 
@@ -40,20 +69,55 @@ public:
 	void ClearForces() { _force = glm::vec3(0.0f, 0.0f, 0.0f); }
 	void AddTorque(const glm::vec3 torque) { _torque += torque; }
 	void ClearTorque() { _torque = glm::vec3(0.0f, 0.0f, 0.0f); }
+	/** Rotate the body inverse inertia tensor into world space with the current orientation
+	*   Spheres have the same inertia about every axis and skip this
+	*/
 	void ComputeInverseInertiaTensor();
-	/** Numerical integration function to compute the current velocity and the current position
-	* based on the velocity and the position of the previous time step
+	/** Multiply a vector by the world inverse inertia tensor
+	*   @param glm::vec3 v for example the angular momentum
+	*/
+	glm::vec3 ApplyInverseInertia(const glm::vec3& v) const;
+	/** Integrate the orientation quaternion with the current angular velocity
 	*   @param float deltaTs simulation time step length
 	*/
-	 void Euler(float deltaTs);
+	void IntegrateOrientation(float deltaTs);
+	/** Set the numerical integration used to compute the velocity and the position at each step
+	* @param IntegratorType integrator the integrator
+	*/
+	void SetIntegrator(IntegratorType integrator) { _integrator = integrator; }
+	/** Get the numerical integration used for this object
+	*/
+	IntegratorType GetIntegrator() const { return _integrator; }
+	/** Turn the constant downward gravity added by ComputeForces on or off
+	* Bodies that attract each other instead have their gravity added by the scene
+	*/
+	void SetUniformGravity(bool uniformGravity) { _uniformGravity = uniformGravity; }
 
-	 void Verlet(float deltaTs);
+	 void CollisionResponse(GameObject* otherObject, float deltaTs);
 
-	 void RungeKutta2(float deltaTs);
+	/** Collision functions for each shape a sphere can hit
+	*   These are what the collision table calls once it knows both shapes, so no casting or type checks are needed
+	*   @param otherObject the object that may have been hit
+	*   @param float deltaTs simulation time step length
+	*/
+	 void CollideWithPlane(GameObject* otherObject, float deltaTs);
+	 void CollideWithHalfSpace(GameObject* otherObject, float deltaTs);
+	 void CollideWithMesh(GameObject* otherObject, float deltaTs);
+	 void CollideWithSphere(DynamicObject* otherObject, float deltaTs);
 
-	 void RungeKutta4(float deltaTs);
+	/** Respond to touching a static plane or half-space
+	*   @param glm::vec3 normal the unit normal of the plane
+	*   @param glm::vec3 contactPoint where the centre of the sphere touches the plane
+	*   @param glm::vec3 colliderVel the velocity of the plane
+	*   @param float deltaTs simulation time step length
+	*/
+	 void PlaneCollisionResponse(const glm::vec3& normal, const glm::vec3& contactPoint, const glm::vec3& colliderVel, float deltaTs);
 
-	 void CollisionResponse(GameObject* otherObject, float deltaTs);
+	/** Exchange an impulse with another sphere that this object has just touched
+	*   Used by the continuous collision pass once both spheres have been advanced to their time of impact
+	*   @param DynamicObject* otherObject the sphere that was hit
+	*/
+	 void ImpactResponse(DynamicObject* otherObject);
 
 	/** Set force for the object
 	* @param glm::vec3 force a 3D vector for the force acting on the object
@@ -71,7 +135,7 @@ public:
 	/** Set position for the object
 	* @param glm::vec3 pos a 3D vector for the position of the object
 	*/
-	void SetPosition(const glm::vec3 pos) { _position = pos; }
+	void SetPosition(const glm::vec3 pos) { _position = pos; _transformDirty = true; }
 	/** Set velocity for the object
 	* @param glm::vec3 vel a 3D vector for the velocity of the object
 	*/
@@ -79,7 +143,7 @@ public:
 	/** Set scale for the object
 	* @param glm::vec3 vel a 3D vector for the scale of the object
 	*/
-	void SetScale(const glm::vec3 scale) { _scale = scale; }
+	void SetScale(const glm::vec3 scale) { _scale = scale; _transformDirty = true; }
 
 	/** Get the force acting on the object
 	* @return a 3D vector
@@ -100,9 +164,25 @@ public:
 	/** Get the orientation of the object
 	* @return a 4x4 matrix
 	*/
-	const glm::mat4 GetOrientation() const { return _orientation; }
+	const glm::mat4 GetOrientation() const { return glm::mat4_cast(_rotQuat); }
+	/** Get the orientation of the object
+	* @return a unit quaternion
+	*/
+	const glm::quat GetRotation() const { return _rotQuat; }
 
 	const glm::vec3 GetVelocity() const { return _velocity; }
+	/** Set the angular momentum of the object
+	* @param glm::vec3 momentum a 3D vector in world space
+	*/
+	void SetAngularMomentum(const glm::vec3 momentum) { _angular_momentum = momentum; }
+	const glm::vec3 GetAngularMomentum() const { return _angular_momentum; }
+	const glm::vec3 GetAngularVelocity() const { return _angular_velocity; }
+	/** Set the orientation and angular velocity together, for a solver that moves the body itself
+	* The angular momentum is worked back from the angular velocity
+	* @param glm::quat rotation a unit quaternion
+	* @param glm::vec3 angularVelocity in world space
+	*/
+	void SetRotationalState(const glm::quat& rotation, const glm::vec3& angularVelocity);
 
 	/** A boolean variable to control the start of the simulation This matrix is the camera's lens
 	*/
@@ -111,7 +191,7 @@ public:
 private:
 
 	/**Update the model matrix with the current position, orientation and scale
-	*
+	*  Only used when the object is updated on its own rather than by the scene's batched pass
 	*/
 	void UpdateModelMatrix();
 
@@ -121,15 +201,8 @@ private:
 	/** The total force on the object
 	*/
 	glm::vec3 _force;
-	/** Position of the object
-	*/
-	glm::vec3 _position;
 	/** Velocity of the object
-
 	*/
-
-	glm::vec3 _previousPosition;
-
 	glm::vec3 _velocity;
 	/** The mass of the object
 	*/
@@ -139,13 +212,6 @@ private:
 	/** The radius of a bounding sphere of the object
 	*/
 	float _bRadius;
-	/** Scale of the object
-	*/
-	glm::vec3 _scale;
-	/** Orientation of the object
-	*/
-	glm::mat4 _orientation;
-
 	glm::vec3 _torque;
 	/** Angular dynamics angular velocity
 	*/
@@ -156,13 +222,13 @@ private:
 	/** Angular dynamics inverse inertia tensor
 	*/
 	glm::mat3 _inertia_tensor_inverse;
-	/** Angular dynamics inverse body inertia tensor
+	/** Angular dynamics inverse body inertia tensor, the diagonal in the body's principal axes
 	*/
-	glm::mat3 _body_inertia_tensor_inverse;
-	/** Angular dynamics rotation matrix
+	glm::vec3 _body_inverse_inertia;
+	/** True if the body inertia is the same about every axis, so the world tensor never changes
 	*/
-	glm::mat3 _rotationMatrix;
-	/** Quaterion
+	bool _isotropic_inertia;
+	/** Orientation of the object, integrated directly from the angular velocity
 	*/
 	glm::quat _rotQuat;
 
@@ -181,6 +247,22 @@ private:
 	/** A boolean variable to control the start of the simulation This matrix is the camera's lens
 	*/
 	bool _start;
+
+	/** Integrator for the position and velocity
+	*/
+	IntegratorType _integrator;
+
+	/** The adaptive integrator's step and clock for this object, so it doesn't start over every scene step
+	*/
+	AdaptiveClock _adaptiveClock;
+
+	/** True if ComputeForces adds the constant downward gravity
+	*/
+	bool _uniformGravity;
+
+	/** Triangles found near the object by the last mesh collision, kept so the next one doesn't allocate
+	*/
+	std::vector<MeshContact> _meshContacts;
 };
 
 #endif //!_DynamicObject_H_
@@ -0,0 +1,650 @@
+#include "EventDriven.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+/*! \brief Brief description.
+*  EventDrivenWorld jumps from one predicted collision to the next instead of stepping the bodies.
+*
+*/
+
+// A bounce slower than this along the normal brings the sphere to rest on the plane
+static const float EVENT_REST_SPEED = 0.05f;
+// Pairs that aren't moving in a straight line relative to each other are only searched this far ahead,
+// then predicted again
+static const double EVENT_HORIZON = 1.0;
+// Bisection steps when narrowing down a root of the contact polynomial, enough to shrink the horizon to
+// double precision
+static const int EVENT_ROOT_ITERATIONS = 50;
+// Advance gives up after this many collisions in one call so a jammed scene can't hang the frame
+static const int EVENT_MAX_PER_ADVANCE = 100000;
+// Cells are this much wider than the largest sphere, so touching spheres are always in neighbouring cells even
+// with the rounding at the faces
+static const float EVENT_CELL_SCALE = 1.1f;
+// No sphere, the end of a bucket's list
+static const uint32_t EVENT_NO_SPHERE = 0xffffffffu;
+
+/* Value of the polynomial c[0] + c[1] t + ... + c[degree] t^degree
+*/
+static double EvaluatePolynomial(const double* c, int degree, double t)
+{
+	double value = c[degree];
+	for (int i = degree - 1; i >= 0; i--)
+	{
+		value = value * t + c[i];
+	}
+	return value;
+}
+
+/* Time until a distance s(t) = s0 + sv t + sa t^2 / 2, which starts at zero or more, falls to zero while still
+* falling, false if it never does
+*/
+static bool ApproachTime(double s0, double sv, double sa, double& dt)
+{
+	if (s0 <= 0.0 && (sv < 0.0 || (sv == 0.0 && sa < 0.0)))
+	{
+		dt = 0.0;
+		return true;
+	}
+
+	if (std::fabs(sa) < 1.0e-12)
+	{
+		if (sv >= 0.0)
+		{
+			return false;
+		}
+		dt = -s0 / sv;
+		return true;
+	}
+
+	double disc = sv * sv - 2.0 * sa * s0;
+	if (disc < 0.0)
+	{
+		return false;
+	}
+	double root = std::sqrt(disc);
+	double t1 = (-sv - root) / sa;
+	double t2 = (-sv + root) / sa;
+	if (t1 > t2)
+	{
+		std::swap(t1, t2);
+	}
+	if (t1 >= 0.0 && sv + sa * t1 < 0.0)
+	{
+		dt = t1;
+		return true;
+	}
+	if (t2 >= 0.0 && sv + sa * t2 < 0.0)
+	{
+		dt = t2;
+		return true;
+	}
+	return false;
+}
+
+/* Every root of a polynomial of degree 4 or less in (lo, hi] where it changes sign, in increasing order
+* The polynomial is monotone between consecutive roots of its derivative, so each of those stretches holds at
+* most one root and bisecting it can't miss one however briefly the sign changes.
+* The root returned is the end of the final bracket on the side of hi, so it is never before the sign change.
+*/
+static int PolynomialRoots(const double* c, int degree, double lo, double hi, double* roots)
+{
+	while (degree > 0 && c[degree] == 0.0)
+	{
+		degree--;
+	}
+	if (degree == 0)
+	{
+		return 0;
+	}
+
+	// Ends of the monotone stretches
+	double stops[5];
+	int stopCount = 0;
+	stops[stopCount++] = lo;
+	if (degree > 1)
+	{
+		double derivative[4];
+		for (int i = 0; i < degree; i++)
+		{
+			derivative[i] = (i + 1) * c[i + 1];
+		}
+		stopCount += PolynomialRoots(derivative, degree - 1, lo, hi, stops + 1);
+	}
+	stops[stopCount++] = hi;
+
+	int count = 0;
+	for (int s = 0; s + 1 < stopCount; s++)
+	{
+		double t0 = stops[s];
+		double t1 = stops[s + 1];
+		bool above0 = EvaluatePolynomial(c, degree, t0) > 0.0;
+		if (above0 == (EvaluatePolynomial(c, degree, t1) > 0.0))
+		{
+			continue;
+		}
+		for (int i = 0; i < EVENT_ROOT_ITERATIONS; i++)
+		{
+			double tm = 0.5 * (t0 + t1);
+			if ((EvaluatePolynomial(c, degree, tm) > 0.0) == above0)
+			{
+				t0 = tm;
+			}
+			else
+			{
+				t1 = tm;
+			}
+		}
+		roots[count++] = t1;
+	}
+	return count;
+}
+
+EventDrivenWorld::EventDrivenWorld()
+{
+	_gravity = glm::vec3(0.0f, -9.8f, 0.0f);
+	_restitution = 1.0f;
+	_time = 0.0;
+	_collisionCount = 0;
+	_cellSize = 1.0f;
+	_bucketMask = 0;
+}
+
+void EventDrivenWorld::Clear()
+{
+	_bodies.clear();
+	_planeNormals.clear();
+	_planeOffsets.clear();
+	_planeFilters.clear();
+	_bucketHead.clear();
+	_events = std::priority_queue<Event, std::vector<Event>, std::greater<Event> >();
+	_time = 0.0;
+	_collisionCount = 0;
+}
+
+size_t EventDrivenWorld::AddSphere(const glm::vec3& position, const glm::vec3& velocity, float radius, float mass, const CollisionFilter& filter)
+{
+	Body body;
+	body.position = position;
+	body.velocity = velocity;
+	body.acceleration = _gravity;
+	body.time = _time;
+	body.radius = radius;
+	body.invMass = 1.0f / mass;
+	body.restingPlane = -1;
+	body.filter = filter;
+	body.eventCount = 0;
+	_bodies.push_back(body);
+	return _bodies.size() - 1;
+}
+
+void EventDrivenWorld::AddPlane(const glm::vec3& normal, float offset, const CollisionFilter& filter)
+{
+	_planeNormals.push_back(normal);
+	_planeOffsets.push_back(offset);
+	_planeFilters.push_back(filter);
+}
+
+void EventDrivenWorld::Start()
+{
+	_events = std::priority_queue<Event, std::vector<Event>, std::greater<Event> >();
+
+	// Cells at least a little wider than the largest sphere, and wide enough to hold about one sphere each where
+	// they start, so a dilute gas isn't mostly crossing empty cells. The table is about twice the number of spheres
+	float largestRadius = 0.0f;
+	glm::vec3 lower(FLT_MAX);
+	glm::vec3 upper(-FLT_MAX);
+	for (size_t i = 0; i < _bodies.size(); i++)
+	{
+		largestRadius = std::max(largestRadius, _bodies[i].radius);
+		lower = glm::min(lower, _bodies[i].position);
+		upper = glm::max(upper, _bodies[i].position);
+	}
+	_cellSize = largestRadius > 0.0f ? 2.0f * largestRadius * EVENT_CELL_SCALE : 1.0f;
+	if (_bodies.size() > 1)
+	{
+		glm::vec3 extent = glm::max(upper - lower, glm::vec3(_cellSize));
+		_cellSize = std::max(_cellSize, std::cbrt(extent.x * extent.y * extent.z / _bodies.size()));
+	}
+	uint32_t tableSize = 1;
+	while (tableSize < 2 * _bodies.size())
+	{
+		tableSize *= 2;
+	}
+	_bucketMask = tableSize - 1;
+	_bucketHead.assign(tableSize, EVENT_NO_SPHERE);
+
+	for (size_t i = 0; i < _bodies.size(); i++)
+	{
+		Body& body = _bodies[i];
+		body.acceleration = _gravity;
+		for (int k = 0; k < 3; k++)
+		{
+			body.cell[k] = (int32_t)std::floor(body.position[k] / _cellSize);
+		}
+		LinkCell((uint32_t)i);
+	}
+	for (size_t i = 0; i < _bodies.size(); i++)
+	{
+		Predict((uint32_t)i);
+	}
+}
+
+void EventDrivenWorld::Advance(float deltaTs)
+{
+	const double target = _time + deltaTs;
+
+	int processed = 0;
+	while (!_events.empty() && _events.top().time <= target)
+	{
+		if (processed == EVENT_MAX_PER_ADVANCE)
+		{
+			// Out of budget with collisions still due, stop the clock at the last one so none of them are skipped,
+			// the rest of the frame is picked up by the next call
+			for (size_t i = 0; i < _bodies.size(); i++)
+			{
+				Drift(_bodies[i], _time);
+			}
+			return;
+		}
+
+		Event event = _events.top();
+		_events.pop();
+
+		// Skip predictions made before one of the spheres changed course
+		Body& a = _bodies[event.a];
+		if (a.eventCount != event.countA || (event.type == EVENT_SPHERE && _bodies[event.b].eventCount != event.countB))
+		{
+			continue;
+		}
+
+		_time = std::max(_time, event.time);
+		processed++;
+
+		switch (event.type)
+		{
+		case EVENT_SPHERE:
+			ResolveSpheres(a, _bodies[event.b]);
+			Predict(event.a);
+			Predict(event.b);
+			break;
+		case EVENT_PLANE:
+			ResolvePlane(a, event.b);
+			Predict(event.a);
+			break;
+		case EVENT_RECHECK:
+			PredictCollisions(event.a);
+			break;
+		case EVENT_CELL:
+			// Not a collision, the path is the same so the sphere's other events still stand
+			CrossCell(event.a, event.b);
+			break;
+		}
+	}
+
+	// Bring every sphere up to the end of the frame, this doesn't change their paths so no events go stale
+	_time = target;
+	for (size_t i = 0; i < _bodies.size(); i++)
+	{
+		Drift(_bodies[i], _time);
+	}
+}
+
+void EventDrivenWorld::Drift(Body& body, double t) const
+{
+	float dt = (float)(t - body.time);
+	body.position += body.velocity * dt + 0.5f * body.acceleration * dt * dt;
+	body.velocity += body.acceleration * dt;
+	body.time = t;
+}
+
+void EventDrivenWorld::Predict(uint32_t sphere)
+{
+	PredictCollisions(sphere);
+	PredictCellExit(sphere);
+}
+
+void EventDrivenWorld::PredictCollisions(uint32_t sphere)
+{
+	Body& body = _bodies[sphere];
+	Drift(body, _time);
+
+	bool recheck = false;
+	double dt;
+
+	int32_t lower[3];
+	int32_t upper[3];
+	for (int k = 0; k < 3; k++)
+	{
+		lower[k] = body.cell[k] - 1;
+		upper[k] = body.cell[k] + 1;
+	}
+	PredictCells(sphere, lower, upper, recheck);
+
+	for (uint32_t p = 0; p < _planeNormals.size(); p++)
+	{
+		if (PFG::ShouldCollide(body.filter, _planeFilters[p]) && PlaneTime(body, p, dt))
+		{
+			Event event = { _time + dt, sphere, p, EVENT_PLANE, body.eventCount, 0 };
+			_events.push(event);
+		}
+	}
+
+	if (recheck)
+	{
+		Event event = { _time + EVENT_HORIZON, sphere, sphere, EVENT_RECHECK, body.eventCount, 0 };
+		_events.push(event);
+	}
+}
+
+void EventDrivenWorld::PredictCells(uint32_t sphere, const int32_t lower[3], const int32_t upper[3], bool& recheck)
+{
+	Body& body = _bodies[sphere];
+
+	// Different cells can share a bucket, each bucket is searched once
+	uint32_t buckets[27];
+	int bucketCount = 0;
+	int32_t cell[3];
+	for (cell[0] = lower[0]; cell[0] <= upper[0]; cell[0]++)
+	{
+		for (cell[1] = lower[1]; cell[1] <= upper[1]; cell[1]++)
+		{
+			for (cell[2] = lower[2]; cell[2] <= upper[2]; cell[2]++)
+			{
+				uint32_t bucket = HashCell(cell);
+				if (std::find(buckets, buckets + bucketCount, bucket) == buckets + bucketCount)
+				{
+					buckets[bucketCount++] = bucket;
+				}
+			}
+		}
+	}
+
+	double dt;
+	for (int n = 0; n < bucketCount; n++)
+	{
+		for (uint32_t j = _bucketHead[buckets[n]]; j != EVENT_NO_SPHERE; j = _bodies[j].next)
+		{
+			if (j == sphere || !PFG::ShouldCollide(body.filter, _bodies[j].filter))
+			{
+				continue;
+			}
+
+			Drift(_bodies[j], _time);
+			if (SphereTime(body, _bodies[j], dt))
+			{
+				Event event = { _time + dt, sphere, j, EVENT_SPHERE, body.eventCount, _bodies[j].eventCount };
+				_events.push(event);
+			}
+			else if (body.acceleration != _bodies[j].acceleration)
+			{
+				// Only searched up to the horizon
+				recheck = true;
+			}
+		}
+	}
+}
+
+void EventDrivenWorld::PredictCellExit(uint32_t sphere)
+{
+	const Body& body = _bodies[sphere];
+
+	// The first time the centre reaches a face of its cell while moving out through it. The centre is kept
+	// inside the cell, it can be a rounding error past a face it has just crossed
+	double exitTime = 0.0;
+	uint32_t exitFace = 0;
+	bool exits = false;
+	for (int k = 0; k < 3; k++)
+	{
+		double lower = (double)body.cell[k] * _cellSize;
+		double upper = lower + _cellSize;
+		double x = std::min(std::max((double)body.position[k], lower), upper);
+		double dt;
+		if (ApproachTime(x - lower, body.velocity[k], body.acceleration[k], dt) && (!exits || dt < exitTime))
+		{
+			exitTime = dt;
+			exitFace = 2 * k;
+			exits = true;
+		}
+		if (ApproachTime(upper - x, -body.velocity[k], -body.acceleration[k], dt) && (!exits || dt < exitTime))
+		{
+			exitTime = dt;
+			exitFace = 2 * k + 1;
+			exits = true;
+		}
+	}
+
+	if (exits)
+	{
+		Event event = { body.time + exitTime, sphere, exitFace, EVENT_CELL, body.eventCount, 0 };
+		_events.push(event);
+	}
+}
+
+void EventDrivenWorld::CrossCell(uint32_t sphere, uint32_t face)
+{
+	Body& body = _bodies[sphere];
+	Drift(body, _time);
+
+	const int axis = face / 2;
+	const int32_t step = (face % 2 == 1) ? 1 : -1;
+	UnlinkCell(sphere);
+	body.cell[axis] += step;
+	LinkCell(sphere);
+
+	// Only the slab of cells on the far side is new to the neighbourhood, the rest were predicted already
+	int32_t lower[3];
+	int32_t upper[3];
+	for (int k = 0; k < 3; k++)
+	{
+		lower[k] = body.cell[k] - 1;
+		upper[k] = body.cell[k] + 1;
+	}
+	lower[axis] = upper[axis] = body.cell[axis] + step;
+
+	bool recheck = false;
+	PredictCells(sphere, lower, upper, recheck);
+	if (recheck)
+	{
+		Event event = { _time + EVENT_HORIZON, sphere, sphere, EVENT_RECHECK, body.eventCount, 0 };
+		_events.push(event);
+	}
+
+	PredictCellExit(sphere);
+}
+
+uint32_t EventDrivenWorld::HashCell(const int32_t cell[3]) const
+{
+	// The same primes as SpatialHash
+	return ((uint32_t)cell[0] * 73856093u ^ (uint32_t)cell[1] * 19349663u ^ (uint32_t)cell[2] * 83492791u) & _bucketMask;
+}
+
+void EventDrivenWorld::LinkCell(uint32_t sphere)
+{
+	Body& body = _bodies[sphere];
+	body.bucket = HashCell(body.cell);
+	body.previous = EVENT_NO_SPHERE;
+	body.next = _bucketHead[body.bucket];
+	if (body.next != EVENT_NO_SPHERE)
+	{
+		_bodies[body.next].previous = sphere;
+	}
+	_bucketHead[body.bucket] = sphere;
+}
+
+void EventDrivenWorld::UnlinkCell(uint32_t sphere)
+{
+	Body& body = _bodies[sphere];
+	if (body.previous != EVENT_NO_SPHERE)
+	{
+		_bodies[body.previous].next = body.next;
+	}
+	else
+	{
+		_bucketHead[body.bucket] = body.next;
+	}
+	if (body.next != EVENT_NO_SPHERE)
+	{
+		_bodies[body.next].previous = body.previous;
+	}
+}
+
+bool EventDrivenWorld::SphereTime(const Body& a, const Body& b, double& dt) const
+{
+	// Relative motion d(t) = d0 + dv t + da t^2 / 2, the spheres touch when |d(t)| = R
+	glm::dvec3 d0 = glm::dvec3(a.position - b.position);
+	glm::dvec3 dv = glm::dvec3(a.velocity - b.velocity);
+	glm::dvec3 da = glm::dvec3(a.acceleration - b.acceleration);
+	double r = (double)a.radius + b.radius;
+
+	double c = glm::dot(d0, d0) - r * r;
+	double approach = glm::dot(d0, dv);
+
+	if (c <= 0.0)
+	{
+		// Already touching, only an event if they are still closing
+		dt = 0.0;
+		return approach < 0.0;
+	}
+
+	if (glm::dot(da, da) == 0.0)
+	{
+		// Same acceleration, so the relative motion is a straight line and this is a quadratic
+		if (approach >= 0.0)
+		{
+			return false;
+		}
+		double A = glm::dot(dv, dv);
+		double B = 2.0 * approach;
+		double disc = B * B - 4.0 * A * c;
+		if (disc < 0.0)
+		{
+			return false;
+		}
+		dt = (-B - std::sqrt(disc)) / (2.0 * A);
+		return true;
+	}
+
+	// Otherwise |d(t)|^2 - R^2 is a quartic in t, and the first time it drops to zero within the horizon is the contact
+	glm::dvec3 q = 0.5 * da;
+	double quartic[5];
+	quartic[0] = c;
+	quartic[1] = 2.0 * approach;
+	quartic[2] = glm::dot(dv, dv) + 2.0 * glm::dot(d0, q);
+	quartic[3] = 2.0 * glm::dot(dv, q);
+	quartic[4] = glm::dot(q, q);
+
+	double roots[4];
+	if (PolynomialRoots(quartic, 4, 0.0, EVENT_HORIZON, roots) == 0)
+	{
+		return false;
+	}
+	dt = roots[0];
+	return true;
+}
+
+bool EventDrivenWorld::PlaneTime(const Body& body, size_t plane, double& dt) const
+{
+	if (body.restingPlane == (int)plane)
+	{
+		return false;
+	}
+
+	// Height of the sphere's surface above the plane, s(t) = s0 + sv t + sa t^2 / 2
+	const glm::vec3& n = _planeNormals[plane];
+	double s0 = (double)glm::dot(n, body.position) - _planeOffsets[plane] - body.radius;
+	double sv = glm::dot(n, body.velocity);
+	double sa = glm::dot(n, body.acceleration);
+
+	if (s0 < -body.radius)
+	{
+		// Centre is behind a one sided plane
+		return false;
+	}
+	if (s0 <= 0.0)
+	{
+		if (sv < 0.0)
+		{
+			dt = 0.0;
+			return true;
+		}
+		// Touching but leaving, it can still come back down
+		s0 = 0.0;
+	}
+
+	// Earliest time the sphere reaches the plane moving towards it
+	return ApproachTime(s0, sv, sa, dt);
+}
+
+void EventDrivenWorld::ResolveSpheres(Body& a, Body& b)
+{
+	Drift(a, _time);
+	Drift(b, _time);
+
+	glm::vec3 normal = a.position - b.position;
+	if (normal != glm::vec3(0.0f, 0.0f, 0.0f))
+	{
+		normal = glm::normalize(normal);
+
+		float approachSpeed = glm::dot(a.velocity - b.velocity, normal);
+		if (approachSpeed < 0.0f)
+		{
+			float j = -(1.0f + _restitution) * approachSpeed / (a.invMass + b.invMass);
+			a.velocity += j * a.invMass * normal;
+			b.velocity -= j * b.invMass * normal;
+		}
+	}
+
+	UpdateResting(a);
+	UpdateResting(b);
+
+	a.eventCount++;
+	b.eventCount++;
+	_collisionCount++;
+}
+
+void EventDrivenWorld::ResolvePlane(Body& body, size_t plane)
+{
+	Drift(body, _time);
+
+	const glm::vec3& n = _planeNormals[plane];
+	float normalSpeed = glm::dot(body.velocity, n);
+	if (normalSpeed < 0.0f)
+	{
+		body.velocity -= (1.0f + _restitution) * normalSpeed * n;
+	}
+
+	// Too slow to bounce again, settle on the plane if gravity holds it there
+	if (glm::dot(body.velocity, n) < EVENT_REST_SPEED && glm::dot(_gravity, n) < 0.0f)
+	{
+		body.velocity -= glm::dot(body.velocity, n) * n;
+		body.position += (_planeOffsets[plane] + body.radius - glm::dot(n, body.position)) * n;
+		body.acceleration = _gravity - glm::dot(_gravity, n) * n;
+		body.restingPlane = (int)plane;
+	}
+
+	body.eventCount++;
+	_collisionCount++;
+}
+
+void EventDrivenWorld::UpdateResting(Body& body)
+{
+	if (body.restingPlane < 0)
+	{
+		return;
+	}
+
+	const glm::vec3& n = _planeNormals[body.restingPlane];
+	float normalSpeed = glm::dot(body.velocity, n);
+	if (normalSpeed > 0.0f)
+	{
+		// Knocked off the plane, back to falling freely
+		body.restingPlane = -1;
+		body.acceleration = _gravity;
+	}
+	else
+	{
+		// Pushed into the plane, which holds it up
+		body.velocity -= normalSpeed * n;
+	}
+}
@@ -0,0 +1,185 @@
+#ifndef _EventDriven_H_
+#define _EventDriven_H_
+
+#include "CollisionFilter.h"
+#include <glm/glm.hpp>
+#include <queue>
+#include <vector>
+#include <stdint.h>
+
+/*! \brief Brief description.
+*  EventDrivenWorld simulates spheres that only interact through collisions, under constant gravity.
+*  Between collisions every sphere follows a parabola, so instead of stepping the bodies it predicts when each
+*  sphere will next hit another sphere or a plane, keeps those predictions in a priority queue, and jumps straight
+*  from one collision to the next. After a collision only the two bodies involved are predicted again.
+*  Each body has its own clock and is only moved to the current time when something needs its position.
+*
+*  Spheres are only predicted against the ones in the 3x3x3 cells around them, in a grid of cells wider than the
+*  largest sphere and about as wide as the spacing of the spheres at the start. The cells' coordinates are hashed into a table of linked lists, so the grid is
+*  unbounded. Leaving a cell is an event of its own, at which the sphere is predicted against the cells that
+*  have just come into its neighbourhood, so the cost of an event follows the local density, not the scene size.
+*
+*  Spheres that stop bouncing on a plane come to rest on it and slide along it under the part of gravity
+*  parallel to the plane, until something knocks them off. This keeps a bouncing ball from generating an
+*  endless run of ever smaller bounces.
+*
+*/
+class EventDrivenWorld
+{
+public:
+
+	/** EventDrivenWorld constructor
+	*/
+	EventDrivenWorld();
+
+	/** Remove every sphere, plane and predicted event, and set the clock back to zero
+	*/
+	void Clear();
+
+	/** Acceleration of every sphere that isn't resting on a plane
+	*/
+	void SetGravity(const glm::vec3& gravity) { _gravity = gravity; }
+	/** Coefficient of restitution used for every collision
+	*/
+	void SetRestitution(float restitution) { _restitution = restitution; }
+
+	/** Add a sphere
+	* @param CollisionFilter filter which spheres and planes it can hit
+	* @return the index of the sphere
+	*/
+	size_t AddSphere(const glm::vec3& position, const glm::vec3& velocity, float radius, float mass, const CollisionFilter& filter = CollisionFilter());
+	/** Add a one sided plane, spheres in front of it bounce off it
+	* @param glm::vec3 normal unit normal pointing out of the plane
+	* @param float offset dot(normal, x) for any point x on the plane
+	* @param CollisionFilter filter which spheres can hit it
+	*/
+	void AddPlane(const glm::vec3& normal, float offset, const CollisionFilter& filter = CollisionFilter());
+
+	/** Sort the spheres into cells and predict the first events of every sphere
+	* Call once after adding the spheres and planes
+	*/
+	void Start();
+
+	/** Process every collision before now + deltaTs and move all spheres to that time
+	* If a jammed scene has more collisions due than one call is allowed to process, the clock stops at the last
+	* one processed instead, so the simulation falls behind rather than skipping collisions.
+	* @param float deltaTs how far to advance the clock
+	*/
+	void Advance(float deltaTs);
+
+	/** Number of spheres
+	*/
+	size_t Size() const { return _bodies.size(); }
+	/** Position and velocity of a sphere at the current time
+	*/
+	glm::vec3 GetPosition(size_t sphere) const { return _bodies[sphere].position; }
+	glm::vec3 GetVelocity(size_t sphere) const { return _bodies[sphere].velocity; }
+	/** Number of collisions resolved since Start
+	*/
+	uint64_t GetCollisionCount() const { return _collisionCount; }
+	/** Time the spheres have been advanced to, behind the sum of the deltaTs passed to Advance if it ran out of budget
+	*/
+	double GetTime() const { return _time; }
+
+private:
+
+	/** A sphere on its parabola, position and velocity are at the body's own time
+	*/
+	struct Body
+	{
+		glm::vec3 position;
+		glm::vec3 velocity;
+		glm::vec3 acceleration;
+		double time;
+		float radius;
+		float invMass;
+		int restingPlane; /*!< Plane the sphere is sliding on, or -1 */
+		CollisionFilter filter;
+		uint32_t eventCount; /*!< Incremented every time the sphere's motion changes, to spot stale events */
+		int32_t cell[3];	/*!< Grid cell the centre is in */
+		uint32_t bucket;	/*!< Hash table bucket of the cell */
+		uint32_t next;		/*!< Next and previous spheres in the bucket's list */
+		uint32_t previous;
+	};
+
+	/** What happens at an event
+	*/
+	enum EventType
+	{
+		EVENT_SPHERE,	/*!< Sphere a hits sphere b */
+		EVENT_PLANE,	/*!< Sphere a hits plane b */
+		EVENT_RECHECK,	/*!< Nothing found within the prediction horizon, predict sphere a again */
+		EVENT_CELL		/*!< Sphere a leaves its cell through face b, 2 * axis plus 1 for the upper face */
+	};
+
+	struct Event
+	{
+		double time;
+		uint32_t a;
+		uint32_t b;
+		EventType type;
+		uint32_t countA; /*!< eventCount of each sphere when the event was predicted */
+		uint32_t countB;
+
+		bool operator>(const Event& other) const { return time > other.time; }
+	};
+
+	/** Move a sphere along its parabola to time t
+	*/
+	void Drift(Body& body, double t) const;
+	/** Predict the next events of one sphere against the spheres around it and every plane its filter lets it
+	* hit, and when it leaves its cell. Called whenever the sphere's path changes
+	*/
+	void Predict(uint32_t sphere);
+	/** Predict the collisions of one sphere against the spheres in its neighbourhood and the planes
+	*/
+	void PredictCollisions(uint32_t sphere);
+	/** Predict the collisions of one sphere against the spheres in a box of cells, at most 3x3x3
+	* @param bool recheck set if a pair has to be predicted again at the horizon
+	*/
+	void PredictCells(uint32_t sphere, const int32_t lower[3], const int32_t upper[3], bool& recheck);
+	/** Predict when a sphere leaves its cell
+	*/
+	void PredictCellExit(uint32_t sphere);
+	/** Move a sphere into the next cell along an axis and predict it against the cells that are new neighbours
+	*/
+	void CrossCell(uint32_t sphere, uint32_t face);
+	/** Time from now until two spheres touch, false if they don't before the horizon
+	*/
+	bool SphereTime(const Body& a, const Body& b, double& dt) const;
+	/** Time from now until a sphere touches a plane, false if it doesn't
+	*/
+	bool PlaneTime(const Body& body, size_t plane, double& dt) const;
+
+	void ResolveSpheres(Body& a, Body& b);
+	void ResolvePlane(Body& body, size_t plane);
+	/** Knock a resting sphere off its plane if its velocity now points away from it
+	*/
+	void UpdateResting(Body& body);
+
+	uint32_t HashCell(const int32_t cell[3]) const;
+	/** Put a sphere in the bucket list of the cell it is in, or take it out
+	*/
+	void LinkCell(uint32_t sphere);
+	void UnlinkCell(uint32_t sphere);
+
+	std::vector<Body> _bodies;
+	std::vector<glm::vec3> _planeNormals;
+	std::vector<float> _planeOffsets;
+	std::vector<CollisionFilter> _planeFilters;
+
+	float _cellSize;
+	/** First sphere in each bucket of the cell hash, the table is a power of two
+	*/
+	std::vector<uint32_t> _bucketHead;
+	uint32_t _bucketMask;
+
+	std::priority_queue<Event, std::vector<Event>, std::greater<Event> > _events;
+
+	glm::vec3 _gravity;
+	float _restitution;
+	double _time;
+	uint64_t _collisionCount;
+};
+
+#endif //!_EventDriven_H_
@@ -0,0 +1,334 @@
+#include "Fluid.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cmath>
+
+// Particles handed to a thread at a time
+static const size_t FLUID_GRAIN = 256;
+// Fraction of a smoothing length the fastest wave may cross in one sub-step
+static const float FLUID_CFL = 0.4f;
+// Exponent of the Tait equation of state
+static const float FLUID_TAIT_EXPONENT = 7.0f;
+static const float FLUID_PI = 3.14159265f;
+// Entries in the wall tables, spread over one smoothing length from the wall
+static const int FLUID_WALL_TABLE_SIZE = 32;
+
+FluidSystem::FluidSystem()
+{
+	_restDensity = 1000.0f;
+	_soundSpeed = 20.0f;
+	_viscosity = 0.1f;
+	_maxSubSteps = 100;
+	SetParticleSpacing(0.1f);
+
+	// Liquid doesn't bounce off walls
+	_particles.SetRestitution(0.0f);
+	_particles.SetFriction(0.01f);
+}
+
+void FluidSystem::SetParticleSpacing(float spacing)
+{
+	_spacing = spacing;
+	_smoothingLength = 2.0f * spacing;
+	BuildWallTables();
+}
+
+void FluidSystem::BuildWallTables()
+{
+	const float h = _smoothingLength;
+	const int reach = (int)std::ceil(h / _spacing);
+
+	// Kernel weight of a particle inside the lattice, counting itself
+	_latticeWeight = 0.0f;
+	for (int a = -reach; a <= reach; a++)
+	{
+		for (int b = -reach; b <= reach; b++)
+		{
+			for (int c = -reach; c <= reach; c++)
+			{
+				float r2 = (a * a + b * b + c * c) * _spacing * _spacing;
+				if (r2 < h * h)
+				{
+					_latticeWeight += (h * h - r2) * (h * h - r2) * (h * h - r2);
+				}
+			}
+		}
+	}
+
+	_wallDensity.assign(FLUID_WALL_TABLE_SIZE, 0.0f);
+	_wallGradient.assign(FLUID_WALL_TABLE_SIZE, 0.0f);
+	for (int t = 0; t < FLUID_WALL_TABLE_SIZE; t++)
+	{
+		const float distance = h * t / (FLUID_WALL_TABLE_SIZE - 1);
+
+		// Layers of particles behind the wall, spaced as the fluid rests against it with its centres half a spacing out
+		for (int layer = 0; (layer + 0.5f) * _spacing < h; layer++)
+		{
+			const float normal = distance + (layer + 0.5f) * _spacing;
+			for (int a = -reach; a <= reach; a++)
+			{
+				for (int b = -reach; b <= reach; b++)
+				{
+					float r2 = normal * normal + (a * a + b * b) * _spacing * _spacing;
+					if (r2 >= h * h)
+					{
+						continue;
+					}
+					float r = std::sqrt(r2);
+					float t2 = h * h - r2;
+					_wallDensity[t] += t2 * t2 * t2;
+					_wallGradient[t] += (h - r) * (h - r) * normal / r;
+				}
+			}
+		}
+	}
+}
+
+float FluidSystem::WallContribution(const glm::vec3& position, glm::vec3& gradient) const
+{
+	float weight = 0.0f;
+	gradient = glm::vec3(0.0f);
+	for (size_t p = 0; p < _walls.size(); p += 4)
+	{
+		glm::vec3 normal(_walls[p], _walls[p + 1], _walls[p + 2]);
+		float distance = glm::dot(normal, position) - _walls[p + 3];
+		// Only fluid in front of the wall and within reach of it
+		if (distance < 0.0f || distance >= _smoothingLength)
+		{
+			continue;
+		}
+
+		float f = distance / _smoothingLength * (FLUID_WALL_TABLE_SIZE - 1);
+		int t = std::min((int)f, FLUID_WALL_TABLE_SIZE - 2);
+		f -= t;
+		weight += _wallDensity[t] + f * (_wallDensity[t + 1] - _wallDensity[t]);
+		gradient += normal * (_wallGradient[t] + f * (_wallGradient[t + 1] - _wallGradient[t]));
+	}
+	return weight;
+}
+
+void FluidSystem::AddBlock(const glm::vec3& lower, int nx, int ny, int nz)
+{
+	// The mass that gives a particle inside the starting lattice exactly the rest density, a cube of fluid a
+	// spacing wide comes out a few percent heavy, which the stiff equation of state turns into a burst at the start
+	const float poly6 = 315.0f / (64.0f * FLUID_PI * std::pow(_smoothingLength, 9.0f));
+	_particleMass = _restDensity / (poly6 * _latticeWeight);
+
+	for (int z = 0; z < nz; z++)
+	{
+		for (int y = 0; y < ny; y++)
+		{
+			for (int x = 0; x < nx; x++)
+			{
+				glm::vec3 position = lower + _spacing * glm::vec3(x + 0.5f, y + 0.5f, z + 0.5f);
+				_particles.Add(position, glm::vec3(0.0f), _particleMass, 0.5f * _spacing);
+			}
+		}
+	}
+
+	_density.assign(_particles.GetPositions(0).size(), 0.0f);
+	_pressure.assign(_particles.GetPositions(0).size(), 0.0f);
+}
+
+float FluidSystem::StableTimeStep() const
+{
+	float maxSpeedSq = 0.0f;
+	const std::vector<float>& vx = _particles.GetVelocities(0);
+	const std::vector<float>& vy = _particles.GetVelocities(1);
+	const std::vector<float>& vz = _particles.GetVelocities(2);
+	for (size_t i = 0; i < _particles.Size(); i++)
+	{
+		maxSpeedSq = std::max(maxSpeedSq, vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i]);
+	}
+	return FLUID_CFL * _smoothingLength / (_soundSpeed + std::sqrt(maxSpeedSq));
+}
+
+int FluidSystem::Step(float deltaTs, const PlaneColliderSet& planes, const std::vector<DynamicObject*>& spheres, JobSystem& jobs)
+{
+	if (_particles.Size() == 0)
+	{
+		return 0;
+	}
+
+	_walls.resize(planes.Size() * 4);
+	for (size_t p = 0; p < planes.Size(); p++)
+	{
+		glm::vec3 normal = planes.GetNormal(p);
+		_walls[p * 4] = normal.x;
+		_walls[p * 4 + 1] = normal.y;
+		_walls[p * 4 + 2] = normal.z;
+		_walls[p * 4 + 3] = planes.GetOffset(p);
+	}
+
+	int subSteps = (int)std::ceil(deltaTs / StableTimeStep());
+	subSteps = std::min(std::max(subSteps, 1), _maxSubSteps);
+
+	for (int s = 0; s < subSteps; s++)
+	{
+		SubStep(deltaTs / subSteps, planes, spheres, jobs);
+	}
+	return subSteps;
+}
+
+void FluidSystem::SubStep(float deltaTs, const PlaneColliderSet& planes, const std::vector<DynamicObject*>& spheres, JobSystem& jobs)
+{
+	// Sort by cell so every particle's neighbours are a few contiguous runs
+	_hash.Build(_particles.GetPositions(), _particles.Size(), _smoothingLength);
+	_particles.Reorder(_hash.GetOrder());
+
+	ComputeDensities(jobs);
+	ComputeForces(jobs);
+
+	_particles.Step(deltaTs, planes, spheres, jobs);
+}
+
+void FluidSystem::ComputeDensities(JobSystem& jobs)
+{
+	const float* px = _particles.GetPositions(0).data();
+	const float* py = _particles.GetPositions(1).data();
+	const float* pz = _particles.GetPositions(2).data();
+
+	const float h2 = _smoothingLength * _smoothingLength;
+	const float poly6 = 315.0f / (64.0f * FLUID_PI * std::pow(_smoothingLength, 9.0f));
+	const float stiffness = _restDensity * _soundSpeed * _soundSpeed / FLUID_TAIT_EXPONENT;
+
+	jobs.ParallelFor(_particles.Size(), FLUID_GRAIN, [&](size_t begin, size_t end)
+	{
+		uint32_t buckets[27];
+		const __m128 radiusSq = _mm_set1_ps(h2);
+		const __m128 zero = _mm_setzero_ps();
+
+		for (size_t i = begin; i < end; i++)
+		{
+			const __m128 xi = _mm_set1_ps(px[i]);
+			const __m128 yi = _mm_set1_ps(py[i]);
+			const __m128 zi = _mm_set1_ps(pz[i]);
+			__m128 sum = _mm_setzero_ps();
+
+			int bucketCount = _hash.GetNeighbourBuckets(px[i], py[i], pz[i], buckets);
+			for (int b = 0; b < bucketCount; b++)
+			{
+				uint32_t first, last;
+				_hash.GetBucketRange(buckets[b], first, last);
+				for (uint32_t j = first; j < last; j += 4)
+				{
+					__m128 dx = _mm_sub_ps(_mm_loadu_ps(px + j), xi);
+					__m128 dy = _mm_sub_ps(_mm_loadu_ps(py + j), yi);
+					__m128 dz = _mm_sub_ps(_mm_loadu_ps(pz + j), zi);
+					__m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+					__m128 t = _mm_max_ps(_mm_sub_ps(radiusSq, r2), zero);
+					__m128 w = _mm_mul_ps(_mm_mul_ps(t, t), t);
+					sum = _mm_add_ps(sum, _mm_and_ps(PFG::ValidLanes(last - j), w));
+				}
+			}
+
+			glm::vec3 wallGradient;
+			float wallWeight = WallContribution(glm::vec3(px[i], py[i], pz[i]), wallGradient);
+			float density = _particleMass * poly6 * (PFG::HorizontalSum(sum) + wallWeight);
+			_density[i] = density;
+			// Tait equation, a stretched fluid has no pressure rather than pulling itself together
+			_pressure[i] = std::max(stiffness * (std::pow(density / _restDensity, FLUID_TAIT_EXPONENT) - 1.0f), 0.0f);
+		}
+	});
+}
+
+void FluidSystem::ComputeForces(JobSystem& jobs)
+{
+	const float* px = _particles.GetPositions(0).data();
+	const float* py = _particles.GetPositions(1).data();
+	const float* pz = _particles.GetPositions(2).data();
+	const float* vx = _particles.GetVelocities(0).data();
+	const float* vy = _particles.GetVelocities(1).data();
+	const float* vz = _particles.GetVelocities(2).data();
+	float* ax = _particles.GetAccelerations(0).data();
+	float* ay = _particles.GetAccelerations(1).data();
+	float* az = _particles.GetAccelerations(2).data();
+	const float* density = _density.data();
+	const float* pressure = _pressure.data();
+
+	const float h = _smoothingLength;
+	// Constant of the spiky kernel gradient
+	const float kernel = 45.0f / (FLUID_PI * std::pow(h, 6.0f));
+
+	jobs.ParallelFor(_particles.Size(), FLUID_GRAIN, [&](size_t begin, size_t end)
+	{
+		uint32_t buckets[27];
+		const __m128 smoothing = _mm_set1_ps(h);
+		const __m128 radiusSq = _mm_set1_ps(h * h);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 pressureScale = _mm_set1_ps(_particleMass * kernel);
+		// Artificial viscosity, 2 alpha h c, and the softening that keeps it finite for particles on top of each other
+		const __m128 viscosityScale = _mm_set1_ps(2.0f * _viscosity * h * _soundSpeed);
+		const __m128 softening = _mm_set1_ps(0.01f * h * h);
+
+		for (size_t i = begin; i < end; i++)
+		{
+			const __m128 xi = _mm_set1_ps(px[i]);
+			const __m128 yi = _mm_set1_ps(py[i]);
+			const __m128 zi = _mm_set1_ps(pz[i]);
+			const __m128 ui = _mm_set1_ps(vx[i]);
+			const __m128 vi = _mm_set1_ps(vy[i]);
+			const __m128 wi = _mm_set1_ps(vz[i]);
+			const __m128 densityI = _mm_set1_ps(density[i]);
+			const __m128 pressureOverDensitySq = _mm_set1_ps(pressure[i] / (density[i] * density[i]));
+
+			__m128 sumX = _mm_setzero_ps();
+			__m128 sumY = _mm_setzero_ps();
+			__m128 sumZ = _mm_setzero_ps();
+
+			int bucketCount = _hash.GetNeighbourBuckets(px[i], py[i], pz[i], buckets);
+			for (int b = 0; b < bucketCount; b++)
+			{
+				uint32_t first, last;
+				_hash.GetBucketRange(buckets[b], first, last);
+				for (uint32_t j = first; j < last; j += 4)
+				{
+					__m128 dx = _mm_sub_ps(_mm_loadu_ps(px + j), xi);
+					__m128 dy = _mm_sub_ps(_mm_loadu_ps(py + j), yi);
+					__m128 dz = _mm_sub_ps(_mm_loadu_ps(pz + j), zi);
+					__m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+					// Neighbours inside the smoothing length, leaving out the particle itself
+					__m128 inside = _mm_and_ps(PFG::ValidLanes(last - j), _mm_and_ps(_mm_cmplt_ps(r2, radiusSq), _mm_cmpgt_ps(r2, zero)));
+					if (_mm_movemask_ps(inside) == 0)
+					{
+						continue;
+					}
+
+					__m128 r = _mm_sqrt_ps(PFG::Select(inside, r2, one));
+					__m128 gap = _mm_sub_ps(smoothing, r);
+					__m128 densityJ = PFG::Select(inside, _mm_loadu_ps(density + j), one);
+					__m128 pressureJ = _mm_loadu_ps(pressure + j);
+
+					// Viscosity only between particles closing on each other, it damps the sound waves the stiff
+					// equation of state would otherwise keep ringing until the fluid boils
+					__m128 closing = _mm_add_ps(_mm_add_ps(
+						_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(vx + j), ui), dx),
+						_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(vy + j), vi), dy)),
+						_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(vz + j), wi), dz));
+					closing = _mm_max_ps(_mm_sub_ps(zero, closing), zero);
+					__m128 viscosity = _mm_div_ps(_mm_mul_ps(viscosityScale, closing), _mm_mul_ps(_mm_add_ps(densityI, densityJ), _mm_add_ps(r2, softening)));
+
+					// Pressure and viscosity push i away from j along d = xj - xi
+					__m128 term = _mm_add_ps(_mm_add_ps(pressureOverDensitySq, _mm_div_ps(pressureJ, _mm_mul_ps(densityJ, densityJ))), viscosity);
+					term = _mm_div_ps(_mm_mul_ps(_mm_mul_ps(pressureScale, term), _mm_mul_ps(gap, gap)), r);
+					term = _mm_and_ps(inside, term);
+
+					sumX = _mm_sub_ps(sumX, _mm_mul_ps(term, dx));
+					sumY = _mm_sub_ps(sumY, _mm_mul_ps(term, dy));
+					sumZ = _mm_sub_ps(sumZ, _mm_mul_ps(term, dz));
+				}
+			}
+
+			// The fluid behind the walls has the particle's own pressure
+			glm::vec3 wallGradient;
+			WallContribution(glm::vec3(px[i], py[i], pz[i]), wallGradient);
+			wallGradient *= _particleMass * kernel * 2.0f * pressure[i] / (density[i] * density[i]);
+
+			ax[i] = PFG::HorizontalSum(sumX) + wallGradient.x;
+			ay[i] = PFG::HorizontalSum(sumY) + wallGradient.y;
+			az[i] = PFG::HorizontalSum(sumZ) + wallGradient.z;
+		}
+	});
+}
@@ -0,0 +1,130 @@
+#ifndef _Fluid_H_
+#define _Fluid_H_
+
+#include "Particles.h"
+#include "SpatialHash.h"
+#include "JobSystem.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+/*! \brief Brief description.
+*  FluidSystem is a weakly compressible SPH liquid (WCSPH). The fluid is a ParticleSystem whose particles also feel
+*  pressure and viscosity from their neighbours, so the liquid is integrated, and collides with the planes and pushes
+*  on the rigid spheres, with the same kernels as the debris particles.
+*
+*  Every sub-step the particles are sorted by their cell in a SpatialHash with cells one smoothing length wide,
+*  so each particle's neighbours sit in a few contiguous runs of the arrays. The density and force passes read those
+*  runs four particles at a time with SSE and are split over the job system's threads, each particle only writing its
+*  own density and acceleration.
+*
+*  Density uses the poly6 kernel, pressure comes from the Tait equation with negative pressure clamped to zero,
+*  pressure forces use the spiky kernel gradient (Muller et al. 2003). Viscosity is Monaghan's artificial viscosity
+*  between particles closing on each other, which damps the sound waves of the stiff fluid (Becker and Teschner 2007).
+*  The sub-step length follows the CFL condition on the speed of sound.
+*
+*  Without particles behind them the planes would leave the fluid next to them short of neighbours, so it
+*  would crowd against the walls until it burst. Each plane instead adds the density and pressure push of a
+*  lattice of still fluid behind it, read from tables of distance built when the spacing is set.
+*
+*/
+class FluidSystem
+{
+public:
+
+	/** FluidSystem constructor
+	*/
+	FluidSystem();
+
+	/** Distance between particles when the fluid is at rest
+	* The smoothing length is twice this, and each particle has about the mass of a cube of fluid this wide.
+	* Set before adding particles
+	*/
+	void SetParticleSpacing(float spacing);
+	/** Density of the fluid at rest, set before adding particles
+	*/
+	void SetRestDensity(float density) { _restDensity = density; }
+	/** Speed of sound, about ten times the fastest flow keeps the density within one percent of rest
+	*/
+	void SetSoundSpeed(float speed) { _soundSpeed = speed; }
+	/** Artificial viscosity coefficient, around 0.1 keeps water calm without making it look like syrup
+	*/
+	void SetViscosity(float viscosity) { _viscosity = viscosity; }
+	void SetGravity(const glm::vec3& gravity) { _particles.SetGravity(gravity); }
+	/** Most sub-steps in one Step, the sub-steps get longer than the CFL limit past this
+	*/
+	void SetMaxSubSteps(int subSteps) { _maxSubSteps = subSteps; }
+
+	/** Fill a box with particles at rest
+	* @param glm::vec3 lower corner of the box
+	* @param int nx, ny, nz number of particles along each side
+	*/
+	void AddBlock(const glm::vec3& lower, int nx, int ny, int nz);
+
+	/** Advance the fluid by deltaTs in as many sub-steps as the CFL condition needs
+	* @param PlaneColliderSet planes the static planes, already built for this step
+	* @param spheres the dynamic spheres, pushed by the fluid and pushing back
+	* @param JobSystem jobs the passes over the particles are split over its threads
+	* @return the number of sub-steps taken
+	*/
+	int Step(float deltaTs, const PlaneColliderSet& planes, const std::vector<DynamicObject*>& spheres, JobSystem& jobs);
+
+	/** Number of fluid particles
+	*/
+	size_t Size() const { return _particles.Size(); }
+	const ParticleSystem& GetParticles() const { return _particles; }
+	/** Density of a particle at the last sub-step
+	*/
+	float GetDensity(size_t i) const { return _density[i]; }
+	float GetRestDensity() const { return _restDensity; }
+
+	/** Longest sub-step the CFL condition allows for the current velocities
+	*/
+	float StableTimeStep() const;
+
+private:
+
+	void SubStep(float deltaTs, const PlaneColliderSet& planes, const std::vector<DynamicObject*>& spheres, JobSystem& jobs);
+	/** Density and pressure of every particle
+	*/
+	void ComputeDensities(JobSystem& jobs);
+	/** Pressure and viscosity acceleration of every particle
+	*/
+	void ComputeForces(JobSystem& jobs);
+	/** Tabulate the density and pressure gradient of the fluid behind a wall, and the weight inside the lattice
+	*/
+	void BuildWallTables();
+	/** Add up the wall tables for a particle over every plane within a smoothing length of it
+	* @param glm::vec3 gradient output, summed kernel gradients pointing away from the walls
+	* @return summed kernel weights
+	*/
+	float WallContribution(const glm::vec3& position, glm::vec3& gradient) const;
+
+	ParticleSystem _particles;
+	SpatialHash _hash;
+
+	/** Density and pressure of each particle, padded like the particle arrays
+	*/
+	std::vector<float> _density;
+	std::vector<float> _pressure;
+
+	/** Planes for the current step, nx ny nz offset each
+	*/
+	std::vector<float> _walls;
+	/** Kernel weight and gradient summed over a wall's lattice at distances 0 to h from it
+	*/
+	std::vector<float> _wallDensity;
+	std::vector<float> _wallGradient;
+	/** Kernel weight summed over a particle's neighbours inside the rest lattice
+	*/
+	float _latticeWeight;
+
+	float _spacing;
+	float _smoothingLength;
+	float _particleMass;
+	float _restDensity;
+	float _soundSpeed;
+	float _viscosity;
+	int _maxSubSteps;
+};
+
+#endif //!_Fluid_H_
@@ -0,0 +1,390 @@
+#include "ForceGenerators.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <sstream>
+
+// Keeps the attractor's pull finite at its centre
+static const float ATTRACTOR_SOFTENING = 0.01f;
+static const float FORCE_PI = 3.14159265f;
+
+void ForceBodies::Resize(size_t count)
+{
+	for (int k = 0; k < 3; k++)
+	{
+		position[k].resize(count);
+		velocity[k].resize(count);
+		force[k].resize(count);
+	}
+	mass.resize(count);
+	radius.resize(count);
+}
+
+DragForce::DragForce(float linear, float quadratic)
+{
+	_linear = linear;
+	_quadratic = quadratic;
+}
+
+void DragForce::Apply(ForceBodies& bodies, size_t begin, size_t end) const
+{
+	const float* vx = bodies.velocity[0].data();
+	const float* vy = bodies.velocity[1].data();
+	const float* vz = bodies.velocity[2].data();
+	float* fx = bodies.force[0].data();
+	float* fy = bodies.force[1].data();
+	float* fz = bodies.force[2].data();
+
+	for (size_t i = begin; i < end; i++)
+	{
+		float speed = std::sqrt(vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i]);
+		float k = _linear + _quadratic * speed;
+		fx[i] -= k * vx[i];
+		fy[i] -= k * vy[i];
+		fz[i] -= k * vz[i];
+	}
+}
+
+WindForce::WindForce(const glm::vec3& velocity, float strength, const glm::vec3& lower, const glm::vec3& upper)
+{
+	_velocity = velocity;
+	_strength = strength;
+	_lower = lower;
+	_upper = upper;
+}
+
+void WindForce::Apply(ForceBodies& bodies, size_t begin, size_t end) const
+{
+	for (int k = 0; k < 3; k++)
+	{
+		const float* v = bodies.velocity[k].data();
+		float* f = bodies.force[k].data();
+		const float wind = _velocity[k];
+		for (size_t i = begin; i < end; i++)
+		{
+			f[i] += _strength * (wind - v[i]);
+		}
+	}
+}
+
+bool WindForce::GetBounds(glm::vec3& lower, glm::vec3& upper) const
+{
+	lower = _lower;
+	upper = _upper;
+	return true;
+}
+
+AttractorForce::AttractorForce(const glm::vec3& centre, float strength, float radius)
+{
+	_centre = centre;
+	_strength = strength;
+	_radius = radius;
+}
+
+void AttractorForce::Apply(ForceBodies& bodies, size_t begin, size_t end) const
+{
+	const float* px = bodies.position[0].data();
+	const float* py = bodies.position[1].data();
+	const float* pz = bodies.position[2].data();
+	const float* mass = bodies.mass.data();
+	float* fx = bodies.force[0].data();
+	float* fy = bodies.force[1].data();
+	float* fz = bodies.force[2].data();
+	const float radiusSq = _radius * _radius;
+
+	for (size_t i = begin; i < end; i++)
+	{
+		float dx = _centre.x - px[i];
+		float dy = _centre.y - py[i];
+		float dz = _centre.z - pz[i];
+		float d2 = dx * dx + dy * dy + dz * dz;
+		float inv = 1.0f / std::sqrt(d2 + ATTRACTOR_SOFTENING);
+		// Zero outside the radius without a branch
+		float s = d2 < radiusSq ? _strength * mass[i] * inv * inv * inv : 0.0f;
+		fx[i] += s * dx;
+		fy[i] += s * dy;
+		fz[i] += s * dz;
+	}
+}
+
+bool AttractorForce::GetBounds(glm::vec3& lower, glm::vec3& upper) const
+{
+	lower = _centre - glm::vec3(_radius);
+	upper = _centre + glm::vec3(_radius);
+	return true;
+}
+
+BuoyancyForce::BuoyancyForce(float surface, float density, float gravity, float drag, const glm::vec3& lower, const glm::vec3& upper)
+{
+	_surface = std::min(surface, upper.y);
+	_density = density;
+	_gravity = gravity;
+	_drag = drag;
+	_lower = lower;
+	_upper = upper;
+	_upper.y = _surface;
+}
+
+void BuoyancyForce::Apply(ForceBodies& bodies, size_t begin, size_t end) const
+{
+	const float* py = bodies.position[1].data();
+	const float* vx = bodies.velocity[0].data();
+	const float* vy = bodies.velocity[1].data();
+	const float* vz = bodies.velocity[2].data();
+	const float* radius = bodies.radius.data();
+	float* fx = bodies.force[0].data();
+	float* fy = bodies.force[1].data();
+	float* fz = bodies.force[2].data();
+
+	for (size_t i = begin; i < end; i++)
+	{
+		// Volume of the spherical cap below the surface, and drag in proportion to the submerged fraction
+		float r = radius[i];
+		float depth = std::min(std::max(_surface - (py[i] - r), 0.0f), 2.0f * r);
+		float cap = depth * depth * (3.0f * r - depth);
+		float volume = FORCE_PI * cap / 3.0f;
+		float drag = r > 0.0f ? _drag * cap / (4.0f * r * r * r) : 0.0f;
+		fx[i] -= drag * vx[i];
+		fy[i] += _density * _gravity * volume - drag * vy[i];
+		fz[i] -= drag * vz[i];
+	}
+}
+
+bool BuoyancyForce::GetBounds(glm::vec3& lower, glm::vec3& upper) const
+{
+	lower = _lower;
+	upper = _upper;
+	return true;
+}
+
+SpringForce::SpringForce()
+{
+}
+
+void SpringForce::AddSpring(size_t a, size_t b, float stiffness, float damping, float restLength)
+{
+	Spring spring;
+	spring.a = a;
+	spring.b = b;
+	spring.stiffness = stiffness;
+	spring.damping = damping;
+	spring.restLength = restLength;
+	_springs.push_back(spring);
+}
+
+void SpringForce::Apply(ForceBodies& bodies, size_t begin, size_t end) const
+{
+	const size_t count = bodies.Size();
+	for (size_t s = 0; s < _springs.size(); s++)
+	{
+		const Spring& spring = _springs[s];
+		if (spring.a < begin || spring.a >= end || spring.b >= count)
+		{
+			continue;
+		}
+
+		glm::vec3 d, dv;
+		for (int k = 0; k < 3; k++)
+		{
+			d[k] = bodies.position[k][spring.b] - bodies.position[k][spring.a];
+			dv[k] = bodies.velocity[k][spring.b] - bodies.velocity[k][spring.a];
+		}
+		float length = glm::length(d);
+		if (length == 0.0f)
+		{
+			continue;
+		}
+
+		glm::vec3 direction = d / length;
+		float tension = spring.stiffness * (length - spring.restLength) + spring.damping * glm::dot(dv, direction);
+		for (int k = 0; k < 3; k++)
+		{
+			bodies.force[k][spring.a] += tension * direction[k];
+			bodies.force[k][spring.b] -= tension * direction[k];
+		}
+	}
+}
+
+void SpringForce::RemapBodies(const std::vector<uint32_t>& remap)
+{
+	size_t kept = 0;
+	for (size_t s = 0; s < _springs.size(); s++)
+	{
+		Spring spring = _springs[s];
+		uint32_t a = PFG::RemapBody(remap, spring.a);
+		uint32_t b = PFG::RemapBody(remap, spring.b);
+		if (a == BODY_REMOVED || b == BODY_REMOVED)
+		{
+			continue;
+		}
+		spring.a = a;
+		spring.b = b;
+		_springs[kept++] = spring;
+	}
+	_springs.resize(kept);
+}
+
+ForceRegistry::ForceRegistry()
+{
+}
+
+ForceRegistry::~ForceRegistry()
+{
+	Clear();
+}
+
+void ForceRegistry::Add(ForceGenerator* generator)
+{
+	_generators.push_back(generator);
+}
+
+void ForceRegistry::Clear()
+{
+	for (size_t g = 0; g < _generators.size(); g++)
+	{
+		delete _generators[g];
+	}
+	_generators.clear();
+}
+
+void ForceRegistry::Apply(ForceBodies& bodies)
+{
+	const size_t count = bodies.Size();
+	if (count == 0 || _generators.empty())
+	{
+		return;
+	}
+
+	// Box around every body, so generators that miss all of them are skipped without a pass over the bodies
+	glm::vec3 bodyLower(FLT_MAX);
+	glm::vec3 bodyUpper(-FLT_MAX);
+	for (int k = 0; k < 3; k++)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			bodyLower[k] = std::min(bodyLower[k], bodies.position[k][i] - bodies.radius[i]);
+			bodyUpper[k] = std::max(bodyUpper[k], bodies.position[k][i] + bodies.radius[i]);
+		}
+	}
+
+	_inside.resize(count);
+
+	for (size_t g = 0; g < _generators.size(); g++)
+	{
+		const ForceGenerator* generator = _generators[g];
+
+		glm::vec3 lower, upper;
+		if (!generator->GetBounds(lower, upper))
+		{
+			generator->Apply(bodies, 0, count);
+			continue;
+		}
+
+		if (glm::any(glm::lessThan(upper, bodyLower)) || glm::any(glm::greaterThan(lower, bodyUpper)))
+		{
+			continue;
+		}
+		if (glm::all(glm::lessThanEqual(lower, bodyLower)) && glm::all(glm::greaterThanEqual(upper, bodyUpper)))
+		{
+			generator->Apply(bodies, 0, count);
+			continue;
+		}
+
+		// Flag the spheres that overlap the box, then hand the generator each run of flagged bodies
+		const float* px = bodies.position[0].data();
+		const float* py = bodies.position[1].data();
+		const float* pz = bodies.position[2].data();
+		const float* radius = bodies.radius.data();
+		for (size_t i = 0; i < count; i++)
+		{
+			float r = radius[i];
+			_inside[i] = (unsigned char)((px[i] + r >= lower.x) & (px[i] - r <= upper.x) &
+				(py[i] + r >= lower.y) & (py[i] - r <= upper.y) &
+				(pz[i] + r >= lower.z) & (pz[i] - r <= upper.z));
+		}
+
+		size_t i = 0;
+		while (i < count)
+		{
+			while (i < count && !_inside[i])
+			{
+				i++;
+			}
+			size_t begin = i;
+			while (i < count && _inside[i])
+			{
+				i++;
+			}
+			if (begin < i)
+			{
+				generator->Apply(bodies, begin, i);
+			}
+		}
+	}
+}
+
+void ForceRegistry::RemapBodies(const std::vector<uint32_t>& remap)
+{
+	for (size_t g = 0; g < _generators.size(); g++)
+	{
+		_generators[g]->RemapBodies(remap);
+	}
+}
+
+namespace PFG
+{
+	ForceGenerator* ParseForceGenerator(const std::string& line)
+	{
+		std::istringstream in(line);
+		std::string type;
+		in >> type;
+
+		if (type == "drag")
+		{
+			float linear, quadratic;
+			if (in >> linear >> quadratic)
+			{
+				return new DragForce(linear, quadratic);
+			}
+		}
+		else if (type == "wind")
+		{
+			glm::vec3 velocity, lower, upper;
+			float strength;
+			if (in >> velocity.x >> velocity.y >> velocity.z >> strength >> lower.x >> lower.y >> lower.z >> upper.x >> upper.y >> upper.z)
+			{
+				return new WindForce(velocity, strength, lower, upper);
+			}
+		}
+		else if (type == "attractor")
+		{
+			glm::vec3 centre;
+			float strength, radius;
+			if (in >> centre.x >> centre.y >> centre.z >> strength >> radius)
+			{
+				return new AttractorForce(centre, strength, radius);
+			}
+		}
+		else if (type == "buoyancy")
+		{
+			float surface, density, gravity, drag;
+			glm::vec3 lower, upper;
+			if (in >> surface >> density >> gravity >> drag >> lower.x >> lower.y >> lower.z >> upper.x >> upper.y >> upper.z)
+			{
+				return new BuoyancyForce(surface, density, gravity, drag, lower, upper);
+			}
+		}
+		else if (type == "spring")
+		{
+			size_t a, b;
+			float stiffness, damping, restLength;
+			if (in >> a >> b >> stiffness >> damping >> restLength)
+			{
+				SpringForce* spring = new SpringForce();
+				spring->AddSpring(a, b, stiffness, damping, restLength);
+				return spring;
+			}
+		}
+		return NULL;
+	}
+}
@@ -0,0 +1,225 @@
+#ifndef _ForceGenerators_H_
+#define _ForceGenerators_H_
+
+#include "BodyRemap.h"
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+/*! \brief Brief description.
+*  ForceBodies holds what the force generators need to know about every dynamic body, one float array per
+*  quantity, so a generator runs one tight loop over a span of bodies instead of a virtual call per body.
+*
+*/
+struct ForceBodies
+{
+	/** Set the number of bodies, keeping the memory when shrinking
+	*/
+	void Resize(size_t count);
+	/** Number of bodies
+	*/
+	size_t Size() const { return mass.size(); }
+
+	std::vector<float> position[3];
+	std::vector<float> velocity[3];
+	std::vector<float> force[3]; /*!< Generators add to this */
+	std::vector<float> mass;
+	std::vector<float> radius;
+};
+
+/*! \brief Brief description.
+*  A force generator adds one kind of force to a span of bodies, for example drag or a wind field.
+*  A generator that only acts inside part of the world returns that part from GetBounds, and the registry
+*  then only hands it the runs of bodies that touch it.
+*
+*/
+class ForceGenerator
+{
+public:
+
+	virtual ~ForceGenerator() {}
+
+	/** Add the force on bodies [begin, end) to bodies.force
+	*/
+	virtual void Apply(ForceBodies& bodies, size_t begin, size_t end) const = 0;
+
+	/** The box outside which the generator has no effect
+	* @return false if it acts everywhere, which is the default
+	*/
+	virtual bool GetBounds(glm::vec3&, glm::vec3&) const { return false; }
+
+	/** Renumber the bodies the generator holds by index after the scene removed some
+	* Most generators act on every body and hold none, which is the default
+	* @param std::vector<uint32_t> remap new index of each old body, or BODY_REMOVED
+	*/
+	virtual void RemapBodies(const std::vector<uint32_t>&) {}
+};
+
+/*! \brief Brief description.
+*  Air resistance, F = -v (linear + quadratic |v|)
+*
+*/
+class DragForce : public ForceGenerator
+{
+public:
+	DragForce(float linear, float quadratic);
+	virtual void Apply(ForceBodies& bodies, size_t begin, size_t end) const;
+
+private:
+	float _linear;
+	float _quadratic;
+};
+
+/*! \brief Brief description.
+*  Wind blowing at a constant velocity inside a box, pushing bodies towards the wind's velocity,
+*  F = strength (wind - v)
+*
+*/
+class WindForce : public ForceGenerator
+{
+public:
+	WindForce(const glm::vec3& velocity, float strength, const glm::vec3& lower, const glm::vec3& upper);
+	virtual void Apply(ForceBodies& bodies, size_t begin, size_t end) const;
+	virtual bool GetBounds(glm::vec3& lower, glm::vec3& upper) const;
+
+private:
+	glm::vec3 _velocity;
+	float _strength;
+	glm::vec3 _lower;
+	glm::vec3 _upper;
+};
+
+/*! \brief Brief description.
+*  Pulls bodies towards a point with an acceleration of strength / d^2, out to a radius of influence
+*
+*/
+class AttractorForce : public ForceGenerator
+{
+public:
+	AttractorForce(const glm::vec3& centre, float strength, float radius);
+	virtual void Apply(ForceBodies& bodies, size_t begin, size_t end) const;
+	virtual bool GetBounds(glm::vec3& lower, glm::vec3& upper) const;
+
+private:
+	glm::vec3 _centre;
+	float _strength;
+	float _radius;
+};
+
+/*! \brief Brief description.
+*  A pool of still fluid with a flat surface. Spheres are pushed up by the weight of the fluid they displace
+*  and slowed by linear drag in proportion to how much of them is under the surface
+*
+*/
+class BuoyancyForce : public ForceGenerator
+{
+public:
+	/**
+	* @param float surface height of the fluid's surface
+	* @param float density mass of fluid per unit volume
+	* @param float gravity size of the gravitational acceleration
+	* @param float drag linear drag on a fully submerged body
+	* @param glm::vec3 lower, upper the pool, the surface is clamped to the top of it
+	*/
+	BuoyancyForce(float surface, float density, float gravity, float drag, const glm::vec3& lower, const glm::vec3& upper);
+	virtual void Apply(ForceBodies& bodies, size_t begin, size_t end) const;
+	virtual bool GetBounds(glm::vec3& lower, glm::vec3& upper) const;
+
+private:
+	float _surface;
+	float _density;
+	float _gravity;
+	float _drag;
+	glm::vec3 _lower;
+	glm::vec3 _upper;
+};
+
+/*! \brief Brief description.
+*  Damped springs between pairs of bodies. A spring is applied by the span holding its first body
+*  and pushes on both ends
+*
+*/
+class SpringForce : public ForceGenerator
+{
+public:
+	SpringForce();
+	/** Connect bodies a and b
+	*/
+	void AddSpring(size_t a, size_t b, float stiffness, float damping, float restLength);
+	virtual void Apply(ForceBodies& bodies, size_t begin, size_t end) const;
+	/** Springs with a removed end are dropped
+	*/
+	virtual void RemapBodies(const std::vector<uint32_t>& remap);
+
+private:
+	struct Spring
+	{
+		size_t a;
+		size_t b;
+		float stiffness;
+		float damping;
+		float restLength;
+	};
+	std::vector<Spring> _springs;
+};
+
+/*! \brief Brief description.
+*  ForceRegistry owns the force generators of a scene and applies them all to a set of bodies.
+*  Bounded generators are only run over the runs of consecutive bodies that overlap their box,
+*  and not at all when the box misses every body.
+*
+*/
+class ForceRegistry
+{
+public:
+
+	ForceRegistry();
+	/** Deletes every generator
+	*/
+	~ForceRegistry();
+
+	/** Add a generator, the registry deletes it
+	*/
+	void Add(ForceGenerator* generator);
+	/** Delete every generator
+	*/
+	void Clear();
+	/** Number of generators
+	*/
+	size_t Size() const { return _generators.size(); }
+
+	/** Add the force of every generator to bodies.force
+	*/
+	void Apply(ForceBodies& bodies);
+
+	/** Renumber the bodies every generator holds by index after the scene removed some
+	*/
+	void RemapBodies(const std::vector<uint32_t>& remap);
+
+private:
+
+	ForceRegistry(const ForceRegistry&);
+	ForceRegistry& operator=(const ForceRegistry&);
+
+	std::vector<ForceGenerator*> _generators;
+
+	/** Per body flag for the bounded generator being applied, kept to avoid reallocating
+	*/
+	std::vector<unsigned char> _inside;
+};
+
+namespace PFG
+{
+	/*
+	Make a force generator from a line of the scene file, the part after 'force'. One of
+	  drag <linear> <quadratic>
+	  wind <vx> <vy> <vz> <strength> <minx> <miny> <minz> <maxx> <maxy> <maxz>
+	  attractor <x> <y> <z> <strength> <radius>
+	  buoyancy <surface> <density> <gravity> <drag> <minx> <miny> <minz> <maxx> <maxy> <maxz>
+	  spring <a> <b> <stiffness> <damping> <restLength>
+	Returns NULL if the line can't be read
+	*/
+	ForceGenerator* ParseForceGenerator(const std::string& line);
+}
+
+#endif //!_ForceGenerators_H_
@@ -1,6 +1,7 @@
 #include <GLM/gtc/type_ptr.hpp>
 #include <GLM/gtc/matrix_transform.hpp>
 #include "GameObject.h"
+#include "Transforms.h"
 
 /*! \brief Brief description.
 *  GameObject class contains a mesh, a material, a position and an orientation information
@@ -13,7 +14,12 @@ GameObject::GameObject()
 	_mesh = NULL;
 	_material = NULL;
 	// Set default value
+	_position = glm::vec3(0.0f, 0.0f, 0.0f);
 	_scale = glm::vec3(1.0f, 1.0f, 1.0f);
+	_rotation = glm::vec3(0.0f, 0.0f, 0.0f);
+	initial_Velocity = glm::vec3(0.0f, 0.0f, 0.0f);
+	m_objectType = SHAPE_NONE;
+	_transformDirty = true;
 }
 
 GameObject::~GameObject()
@@ -24,25 +30,21 @@ GameObject::~GameObject()
 void GameObject::Update( float deltaTs )
 {
 	// Put any update code here
-	// Make sure matrices are up to date (if you don't change them elsewhere, you can put this in the update function)
-	//_modelMatrix = glm::rotate(_modelMatrix, _rotation.y, glm::vec3(0,1,0) );
-	//_invModelMatrix = glm::rotate(glm::mat4(1.0f), -_rotation.y, glm::vec3(0,1,0) );
-	_modelMatrix = glm::translate(glm::mat4(1.0f), _position);
-	_modelMatrix = glm::scale(_modelMatrix, _scale);
-
-	_modelMatrix = glm::rotate(_modelMatrix, _rotation.x, glm::vec3(1, 0, 0));
-	_invModelMatrix = glm::rotate(glm::mat4(1.0f), -_rotation.x, glm::vec3(1, 0, 0));
-
-	_modelMatrix = glm::rotate(_modelMatrix, _rotation.y, glm::vec3(0, 1, 0));
-	_invModelMatrix = glm::rotate(glm::mat4(1.0f), -_rotation.y, glm::vec3(0, 1, 0));
-
-	_modelMatrix = glm::rotate(_modelMatrix, _rotation.z, glm::vec3(0, 0, 1));
-	_invModelMatrix = glm::rotate(glm::mat4(1.0f), -_rotation.z, glm::vec3(0, 0, 1));
-
-
-	_invModelMatrix = glm::inverse(_modelMatrix);
+	// Static objects only rebuild their matrices when they have been moved, rotated or scaled
+	if (!_transformDirty)
+	{
+		return;
+	}
 
+	// Same rotation order as before: X, then Y, then Z
+	glm::quat rotation = glm::angleAxis(_rotation.x, glm::vec3(1, 0, 0))
+		* glm::angleAxis(_rotation.y, glm::vec3(0, 1, 0))
+		* glm::angleAxis(_rotation.z, glm::vec3(0, 0, 1));
 
+	glm::mat4 model;
+	glm::mat4 invModel;
+	PFG::ComposeTransform(_position, rotation, _scale, model, invModel);
+	SetModelMatrices(model, invModel);
 }
 
 void GameObject::Draw(glm::mat4 &viewMatrix, glm::mat4 &projMatrix)
@@ -65,12 +67,19 @@ void GameObject::Draw(glm::mat4 &viewMatrix, glm::mat4 &projMatrix)
 	}
 }
 
-void GameObject::SetType(int type)
+glm::vec3 GameObject::GetUpDirection()
 {
-	m_objectType = type;
+	// Same rotation order as the model matrix: X, then Y, then Z
+	glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), _rotation.x, glm::vec3(1, 0, 0));
+	rotation = glm::rotate(rotation, _rotation.y, glm::vec3(0, 1, 0));
+	rotation = glm::rotate(rotation, _rotation.z, glm::vec3(0, 0, 1));
+
+	// Normals are scaled by the inverse of the scale so they stay perpendicular to the surface
+	glm::vec3 up = glm::vec3(rotation * glm::vec4(0.0f, 1.0f, 0.0f, 0.0f));
+	return glm::normalize(up / _scale);
 }
 
-int GameObject::GetType()
+void GameObject::SetType(ShapeType type)
 {
-	return m_objectType;
+	m_objectType = type;
 }
\ No newline at end of file
@@ -3,6 +3,21 @@
 
 #include "Mesh.h"
 #include "Material.h"
+#include "CollisionFilter.h"
+
+/** Collision shape of a game object
+* The collision function for a pair of objects is looked up from the pair of shapes,
+* with the dynamic object's shape first
+*/
+enum ShapeType
+{
+	SHAPE_PLANE = 0, /*!< One sided infinite plane through the object's position */
+	SHAPE_SPHERE = 1, /*!< Bounding sphere of a dynamic object */
+	SHAPE_HALFSPACE = 2, /*!< Infinite plane with everything behind it solid */
+	SHAPE_TRIANGLE_MESH = 3, /*!< Static triangle mesh built from the object's mesh */
+	SHAPE_COUNT, /*!< Number of shapes that can collide */
+	SHAPE_NONE = SHAPE_COUNT /*!< Doesn't collide with anything */
+};
 
 /*! \brief Brief description.
 *  GameObject class contains a mesh, a material, a position and an orientation information
@@ -25,6 +40,10 @@ public:
 	* @param *input  a pointer to a mesh object
 	*/
 	void SetMesh(Mesh *input) {_mesh = input;}
+	/** Function for getting the mesh geometry of the game object
+	* @return a pointer to the mesh, or NULL if it has none
+	*/
+	Mesh* GetMesh() {return _mesh;}
 	/** Function for setting material for the game object
 	* @param *input  a pointer to a material object
 	*/
@@ -34,23 +53,23 @@ public:
 	* @param float posY y position
 	* @param float posZ z position
 	*/
-	void SetPosition( float posX, float posY, float posZ ) {_position.x = posX; _position.y = posY; _position.z = posZ;}
+	void SetPosition( float posX, float posY, float posZ ) {_position.x = posX; _position.y = posY; _position.z = posZ; _transformDirty = true;}
 	/** Function for setting position for the game object
 	* @param glm::vec3 value  a position 3D vector
 	*/
-	void SetPosition( glm::vec3 value) {_position = value;}
+	void SetPosition( glm::vec3 value) {_position = value; _transformDirty = true;}
 	/** Function for setting rotation for the game object
 	* @param float rotX x rotation
 	* @param float rotY y rotation
 	* @param float rotZ z rotation
 	*/
-	void SetRotation( float rotX, float rotY, float rotZ ) {_rotation.x = rotX; _rotation.y = rotY; _rotation.z = rotZ;}
+	void SetRotation( float rotX, float rotY, float rotZ ) {_rotation.x = rotX; _rotation.y = rotY; _rotation.z = rotZ; _transformDirty = true;}
 	/** Function for setting scale for the game object
 	* @param float sX x scale
 	* @param float sY y scale
 	* @param float sZ z scale
 	*/
-	void SetScale(float sX, float sY, float sZ) { _scale.x = sX; _scale.y = sY; _scale.z = sZ; }
+	void SetScale(float sX, float sY, float sZ) { _scale.x = sX; _scale.y = sY; _scale.z = sZ; _transformDirty = true; }
 
 	void SetInitialVelocity(glm::vec3 val) { initial_Velocity = val; }
 
@@ -60,6 +79,32 @@ public:
 	* @return The result
 	*/
 	glm::vec3 GetPosition() {return _position;}
+	/** Function for getting scale of the game object
+	* @return The result
+	*/
+	glm::vec3 GetScale() const {return _scale;}
+
+	/** Function for getting the world space direction of the object's local +Y axis
+	* This is the normal of planes and half-spaces, built from the rotation and scale the same way as the model matrix
+	* @return a unit 3D vector
+	*/
+	glm::vec3 GetUpDirection();
+
+	/** Function for getting the matrix that takes model space to world space
+	*/
+	const glm::mat4& GetModelMatrix() const {return _modelMatrix;}
+	/** Function for getting the matrix that takes world space to model space
+	*/
+	const glm::mat4& GetInvModelMatrix() const {return _invModelMatrix;}
+
+	/** True if the position, rotation or scale changed since the model matrix was last built
+	*/
+	bool IsTransformDirty() const {return _transformDirty;}
+	/** Function for setting the model matrix and its inverse once they have been rebuilt, clears the dirty flag
+	* @param glm::mat4 model model space to world space
+	* @param glm::mat4 invModel world space to model space
+	*/
+	void SetModelMatrices(const glm::mat4& model, const glm::mat4& invModel) {_modelMatrix = model; _invModelMatrix = invModel; _transformDirty = false;}
 	
 	/** A virtual function for updating the simulation result at each time frame
 	*   You need to expand this function 
@@ -73,13 +118,31 @@ public:
 	*/
 	virtual void Draw(glm::mat4 &viewMatrix, glm::mat4 &projMatrix);
 
-	void SetType(int type);
+	/** Function for setting the collision shape of the game object
+	* @param ShapeType type the collision shape
+	*/
+	void SetType(ShapeType type);
 
-	int GetType();
+	/** Function for getting the collision shape of the game object
+	* @return The result
+	*/
+	ShapeType GetType() const { return m_objectType; }
+
+	/** Set which objects this one collides with, it can be changed at any time and takes effect on the next step
+	* @param CollisionFilter filter category, mask and group
+	*/
+	void SetCollisionFilter(const CollisionFilter& filter) { _collisionFilter = filter; }
+	const CollisionFilter& GetCollisionFilter() const { return _collisionFilter; }
+	void SetCollisionCategory(uint32_t category) { _collisionFilter.category = category; }
+	void SetCollisionMask(uint32_t mask) { _collisionFilter.mask = mask; }
+	void SetCollisionGroup(int32_t group) { _collisionFilter.group = group; }
 
 protected:
 
-	int m_objectType;
+	ShapeType m_objectType;
+	/** Which objects this one collides with
+	*/
+	CollisionFilter _collisionFilter;
 
 	/** The model geometry
 	*/
@@ -109,6 +172,10 @@ protected:
 	*/
 	glm::vec3 _scale;
 
+	/** Set when the position, rotation or scale changes, so unchanged objects don't rebuild their matrices
+	*/
+	bool _transformDirty;
+
 	glm::vec3 initial_Velocity;
 
 };
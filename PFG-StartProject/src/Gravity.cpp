@@ -0,0 +1,399 @@
+#include "Gravity.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// Nodes with this many bodies or fewer are not split
+static const uint32_t GRAVITY_LEAF_SIZE = 8;
+// Bodies on top of each other would split forever, stop at this depth
+static const int GRAVITY_MAX_DEPTH = 32;
+// Enough for a walk down the deepest tree, each level leaves at most seven siblings on the stack
+static const int GRAVITY_STACK_SIZE = 8 * GRAVITY_MAX_DEPTH + 8;
+// Bodies handed to a thread at a time, neighbours in tree order walk mostly the same nodes
+static const size_t GRAVITY_GRAIN = 128;
+
+GravityTree::GravityTree()
+{
+	_g = 1.0f;
+	_theta = 0.5f;
+	_softening = 0.01f;
+	_quadrupole = false;
+}
+
+void GravityTree::Build(const std::vector<float> position[3], const std::vector<float>& mass)
+{
+	const size_t count = mass.size();
+	_nodes.clear();
+	_order.resize(count);
+	_scratch.resize(count);
+	_octant.resize(count);
+	_x = position[0];
+	_y = position[1];
+	_z = position[2];
+	_mass = mass;
+
+	if (count == 0)
+	{
+		return;
+	}
+
+	float lower[3] = { _x[0], _y[0], _z[0] };
+	float upper[3] = { _x[0], _y[0], _z[0] };
+	for (size_t i = 0; i < count; i++)
+	{
+		_order[i] = (uint32_t)i;
+		lower[0] = std::min(lower[0], _x[i]);
+		lower[1] = std::min(lower[1], _y[i]);
+		lower[2] = std::min(lower[2], _z[i]);
+		upper[0] = std::max(upper[0], _x[i]);
+		upper[1] = std::max(upper[1], _y[i]);
+		upper[2] = std::max(upper[2], _z[i]);
+	}
+
+	// The root is a cube around every body
+	Node root;
+	float extent = 0.0f;
+	for (int k = 0; k < 3; k++)
+	{
+		root.centre[k] = 0.5f * (lower[k] + upper[k]);
+		extent = std::max(extent, upper[k] - lower[k]);
+	}
+	root.halfSize = 0.5f * extent * 1.0001f + FLT_MIN;
+	root.childCount = 0;
+	root.begin = 0;
+	root.end = (uint32_t)count;
+	_nodes.push_back(root);
+
+	Subdivide(0, 0);
+
+	// Put the bodies in tree order, each leaf then reads a contiguous range
+	std::vector<float>* arrays[4] = { &_x, &_y, &_z, &_mass };
+	_sorted.resize(count);
+	for (int a = 0; a < 4; a++)
+	{
+		const std::vector<float>& source = *arrays[a];
+		for (size_t i = 0; i < count; i++)
+		{
+			_sorted[i] = source[_order[i]];
+		}
+		arrays[a]->swap(_sorted);
+	}
+
+	// Children always come after their parent, so going backwards fills in the leaves first
+	for (size_t n = _nodes.size(); n-- > 0;)
+	{
+		ComputeMoments(_nodes[n]);
+	}
+}
+
+void GravityTree::Subdivide(uint32_t node, int depth)
+{
+	const uint32_t begin = _nodes[node].begin;
+	const uint32_t end = _nodes[node].end;
+	if (end - begin <= GRAVITY_LEAF_SIZE || depth >= GRAVITY_MAX_DEPTH)
+	{
+		return;
+	}
+
+	const float cx = _nodes[node].centre[0];
+	const float cy = _nodes[node].centre[1];
+	const float cz = _nodes[node].centre[2];
+	const float quarter = 0.5f * _nodes[node].halfSize;
+
+	// Counting sort of the node's bodies by octant
+	uint32_t counts[8] = {};
+	for (uint32_t i = begin; i < end; i++)
+	{
+		uint32_t body = _order[i];
+		uint8_t octant = (uint8_t)((_x[body] >= cx ? 1 : 0) | (_y[body] >= cy ? 2 : 0) | (_z[body] >= cz ? 4 : 0));
+		_octant[i] = octant;
+		counts[octant]++;
+	}
+
+	uint32_t next[8];
+	uint32_t start = begin;
+	for (int o = 0; o < 8; o++)
+	{
+		next[o] = start;
+		start += counts[o];
+	}
+	for (uint32_t i = begin; i < end; i++)
+	{
+		_scratch[next[_octant[i]]++] = _order[i];
+	}
+	std::copy(_scratch.begin() + begin, _scratch.begin() + end, _order.begin() + begin);
+
+	// Only the octants with bodies in them get a node, all siblings side by side
+	const uint32_t firstChild = (uint32_t)_nodes.size();
+	uint32_t childCount = 0;
+	start = begin;
+	for (int o = 0; o < 8; o++)
+	{
+		if (counts[o] == 0)
+		{
+			continue;
+		}
+
+		Node child;
+		child.centre[0] = cx + ((o & 1) ? quarter : -quarter);
+		child.centre[1] = cy + ((o & 2) ? quarter : -quarter);
+		child.centre[2] = cz + ((o & 4) ? quarter : -quarter);
+		child.halfSize = quarter;
+		child.childCount = 0;
+		child.begin = start;
+		child.end = start + counts[o];
+		_nodes.push_back(child);
+
+		start += counts[o];
+		childCount++;
+	}
+
+	_nodes[node].firstChild = firstChild;
+	_nodes[node].childCount = childCount;
+
+	for (uint32_t c = 0; c < childCount; c++)
+	{
+		Subdivide(firstChild + c, depth + 1);
+	}
+}
+
+void GravityTree::ComputeMoments(Node& node)
+{
+	float mass = 0.0f;
+	float weighted[3] = { 0.0f, 0.0f, 0.0f };
+
+	if (node.childCount == 0)
+	{
+		for (uint32_t j = node.begin; j < node.end; j++)
+		{
+			mass += _mass[j];
+			weighted[0] += _mass[j] * _x[j];
+			weighted[1] += _mass[j] * _y[j];
+			weighted[2] += _mass[j] * _z[j];
+		}
+	}
+	else
+	{
+		for (uint32_t c = 0; c < node.childCount; c++)
+		{
+			const Node& child = _nodes[node.firstChild + c];
+			mass += child.mass;
+			for (int k = 0; k < 3; k++)
+			{
+				weighted[k] += child.mass * child.com[k];
+			}
+		}
+	}
+
+	node.mass = mass;
+	for (int k = 0; k < 3; k++)
+	{
+		node.com[k] = mass > 0.0f ? weighted[k] / mass : node.centre[k];
+	}
+
+	// Quadrupole Q = sum of m (3 d d^T - |d|^2 I) about the centre of mass, children add their own Q on top
+	for (int k = 0; k < 6; k++)
+	{
+		node.quadrupole[k] = 0.0f;
+	}
+	if (_quadrupole)
+	{
+		uint32_t count = node.childCount == 0 ? node.end - node.begin : node.childCount;
+		for (uint32_t c = 0; c < count; c++)
+		{
+			float m, d[3];
+			if (node.childCount == 0)
+			{
+				uint32_t j = node.begin + c;
+				m = _mass[j];
+				d[0] = _x[j] - node.com[0];
+				d[1] = _y[j] - node.com[1];
+				d[2] = _z[j] - node.com[2];
+			}
+			else
+			{
+				const Node& child = _nodes[node.firstChild + c];
+				m = child.mass;
+				for (int k = 0; k < 3; k++)
+				{
+					d[k] = child.com[k] - node.com[k];
+				}
+				for (int k = 0; k < 6; k++)
+				{
+					node.quadrupole[k] += child.quadrupole[k];
+				}
+			}
+
+			float d2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+			node.quadrupole[0] += m * (3.0f * d[0] * d[0] - d2);
+			node.quadrupole[1] += m * (3.0f * d[1] * d[1] - d2);
+			node.quadrupole[2] += m * (3.0f * d[2] * d[2] - d2);
+			node.quadrupole[3] += m * 3.0f * d[0] * d[1];
+			node.quadrupole[4] += m * 3.0f * d[0] * d[2];
+			node.quadrupole[5] += m * 3.0f * d[1] * d[2];
+		}
+	}
+
+	// s / theta plus how far the centre of mass is off centre, so a lopsided node isn't accepted too early
+	if (_theta > 0.0f)
+	{
+		float offset[3] = { node.com[0] - node.centre[0], node.com[1] - node.centre[1], node.com[2] - node.centre[2] };
+		float radius = 2.0f * node.halfSize / _theta + std::sqrt(offset[0] * offset[0] + offset[1] * offset[1] + offset[2] * offset[2]);
+		node.openRadiusSq = radius * radius;
+	}
+	else
+	{
+		node.openRadiusSq = FLT_MAX;
+	}
+}
+
+void GravityTree::Walk(uint32_t i, float acceleration[3]) const
+{
+	const float px = _x[i];
+	const float py = _y[i];
+	const float pz = _z[i];
+	const float softeningSq = _softening * _softening;
+
+	float ax = 0.0f, ay = 0.0f, az = 0.0f;
+
+	uint32_t stack[GRAVITY_STACK_SIZE];
+	int top = 0;
+	stack[top++] = 0;
+
+	while (top > 0)
+	{
+		const Node& node = _nodes[stack[--top]];
+		float dx = node.com[0] - px;
+		float dy = node.com[1] - py;
+		float dz = node.com[2] - pz;
+		float d2 = dx * dx + dy * dy + dz * dz;
+
+		if (d2 > node.openRadiusSq)
+		{
+			// Far enough to treat the whole node as its moments
+			float inv = 1.0f / std::sqrt(d2 + softeningSq);
+			float inv3 = inv * inv * inv;
+			ax += node.mass * inv3 * dx;
+			ay += node.mass * inv3 * dy;
+			az += node.mass * inv3 * dz;
+
+			if (_quadrupole)
+			{
+				// With b from the centre of mass to the body, a = Q b / r^5 - 5/2 (b.Q b) b / r^7
+				const float* q = node.quadrupole;
+				float bx = -dx, by = -dy, bz = -dz;
+				float qbx = q[0] * bx + q[3] * by + q[4] * bz;
+				float qby = q[3] * bx + q[1] * by + q[5] * bz;
+				float qbz = q[4] * bx + q[5] * by + q[2] * bz;
+				float bqb = bx * qbx + by * qby + bz * qbz;
+				float inv5 = inv3 * inv * inv;
+				float radial = 2.5f * bqb * inv5 * inv * inv;
+				ax += qbx * inv5 - radial * bx;
+				ay += qby * inv5 - radial * by;
+				az += qbz * inv5 - radial * bz;
+			}
+		}
+		else if (node.childCount == 0)
+		{
+			// Too close, sum over the leaf's bodies one by one
+			for (uint32_t j = node.begin; j < node.end; j++)
+			{
+				float rx = _x[j] - px;
+				float ry = _y[j] - py;
+				float rz = _z[j] - pz;
+				float r2 = rx * rx + ry * ry + rz * rz + softeningSq;
+				if (j == i || r2 == 0.0f)
+				{
+					continue;
+				}
+				float inv = 1.0f / std::sqrt(r2);
+				float s = _mass[j] * inv * inv * inv;
+				ax += s * rx;
+				ay += s * ry;
+				az += s * rz;
+			}
+		}
+		else
+		{
+			for (uint32_t c = 0; c < node.childCount; c++)
+			{
+				stack[top++] = node.firstChild + c;
+			}
+		}
+	}
+
+	acceleration[0] = _g * ax;
+	acceleration[1] = _g * ay;
+	acceleration[2] = _g * az;
+}
+
+void GravityTree::ComputeAccelerations(std::vector<float> acceleration[3], JobSystem& jobs) const
+{
+	const size_t count = _order.size();
+	for (int k = 0; k < 3; k++)
+	{
+		acceleration[k].resize(count);
+	}
+
+	// Walk in tree order so each thread gets bodies that are close together
+	jobs.ParallelFor(count, GRAVITY_GRAIN, [this, acceleration](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			float a[3];
+			Walk((uint32_t)i, a);
+			uint32_t body = _order[i];
+			acceleration[0][body] = a[0];
+			acceleration[1][body] = a[1];
+			acceleration[2][body] = a[2];
+		}
+	});
+}
+
+namespace PFG
+{
+	void DirectGravity(const std::vector<float> position[3], const std::vector<float>& mass, float g, float softening, std::vector<float> acceleration[3], JobSystem& jobs)
+	{
+		const size_t count = mass.size();
+		for (int k = 0; k < 3; k++)
+		{
+			acceleration[k].resize(count);
+		}
+		const double softeningSq = (double)softening * softening;
+
+		jobs.ParallelFor(count, 64, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				double a[3] = { 0.0, 0.0, 0.0 };
+				for (size_t j = 0; j < count; j++)
+				{
+					if (j == i)
+					{
+						continue;
+					}
+					double r[3];
+					for (int k = 0; k < 3; k++)
+					{
+						r[k] = (double)position[k][j] - position[k][i];
+					}
+					double r2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2] + softeningSq;
+					if (r2 == 0.0)
+					{
+						continue;
+					}
+					double inv = 1.0 / std::sqrt(r2);
+					double s = mass[j] * inv * inv * inv;
+					for (int k = 0; k < 3; k++)
+					{
+						a[k] += s * r[k];
+					}
+				}
+				for (int k = 0; k < 3; k++)
+				{
+					acceleration[k][i] = (float)(g * a[k]);
+				}
+			}
+		});
+	}
+}
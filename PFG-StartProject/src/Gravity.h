@@ -0,0 +1,112 @@
+#ifndef _Gravity_H_
+#define _Gravity_H_
+
+#include "JobSystem.h"
+#include <vector>
+#include <stdint.h>
+
+/*! \brief Brief description.
+*  GravityTree computes the mutual gravitational pull between every pair of bodies with the Barnes-Hut method.
+*  An octree is built over the body positions, and each node keeps the total mass, centre of mass and optionally
+*  the quadrupole moment of the bodies inside it. When a node is far enough from a body compared to its size,
+*  its bodies are treated as one, so the accelerations cost O(N log N) instead of O(N^2).
+*
+*  The opening angle theta decides what is far enough: a node of width s is only opened when the body is closer
+*  than s / theta plus the distance from the node's centre to its centre of mass. Smaller angles are more accurate
+*  and slower, 0 gives the direct sum.
+*
+*/
+class GravityTree
+{
+public:
+
+	/** GravityTree constructor
+	*/
+	GravityTree();
+
+	/** Gravitational constant G
+	*/
+	void SetGravitationalConstant(float g) { _g = g; }
+	/** Opening angle theta, see the class description. Takes effect on the next Build
+	*/
+	void SetOpeningAngle(float theta) { _theta = theta; }
+	/** Plummer softening length, stops close pairs from getting an unbounded kick
+	*/
+	void SetSoftening(float softening) { _softening = softening; }
+	/** Use the quadrupole moment of each node as well as its mass, more accurate for the same opening angle
+	*/
+	void SetQuadrupole(bool quadrupole) { _quadrupole = quadrupole; }
+
+	/** Build the tree over a set of bodies
+	* @param position x, y and z of each body
+	* @param std::vector<float> mass mass of each body
+	*/
+	void Build(const std::vector<float> position[3], const std::vector<float>& mass);
+
+	/** Gravitational acceleration of every body built into the tree
+	* @param acceleration x, y and z output, resized to the number of bodies, in the order they were given to Build
+	* @param JobSystem jobs the bodies are split between its threads
+	*/
+	void ComputeAccelerations(std::vector<float> acceleration[3], JobSystem& jobs) const;
+
+	/** Number of nodes in the last tree built
+	*/
+	size_t GetNodeCount() const { return _nodes.size(); }
+
+private:
+
+	/** A cube of space and the bodies inside it
+	* Children are stored next to each other, and the bodies of a node are a contiguous range in tree order
+	*/
+	struct Node
+	{
+		float centre[3];
+		float halfSize;
+		float com[3];			/*!< Centre of mass */
+		float mass;
+		float quadrupole[6];	/*!< Traceless quadrupole about the centre of mass, xx yy zz xy xz yz */
+		float openRadiusSq;		/*!< Bodies closer than this to the centre of mass open the node */
+		uint32_t firstChild;
+		uint32_t childCount;	/*!< 0 for a leaf */
+		uint32_t begin;			/*!< Bodies in tree order */
+		uint32_t end;
+	};
+
+	void Subdivide(uint32_t node, int depth);
+	/** Mass, centre of mass, quadrupole and opening radius of a node whose children are already done
+	*/
+	void ComputeMoments(Node& node);
+	/** Acceleration of the body at tree index i
+	*/
+	void Walk(uint32_t i, float acceleration[3]) const;
+
+	std::vector<Node> _nodes;
+
+	/** Original index of each body in tree order
+	*/
+	std::vector<uint32_t> _order;
+	/** Body positions and masses copied in tree order so leaves read contiguous memory
+	*/
+	std::vector<float> _x, _y, _z, _mass;
+	/** Scratch for sorting bodies into octants while building
+	*/
+	std::vector<uint32_t> _scratch;
+	std::vector<uint8_t> _octant;
+	std::vector<float> _sorted;
+
+	float _g;
+	float _theta;
+	float _softening;
+	bool _quadrupole;
+};
+
+namespace PFG
+{
+	/*
+	Gravitational acceleration of every body by summing over every other body, accumulated in double precision.
+	This is the O(N^2) reference the tree is checked against
+	*/
+	void DirectGravity(const std::vector<float> position[3], const std::vector<float>& mass, float g, float softening, std::vector<float> acceleration[3], JobSystem& jobs);
+}
+
+#endif //!_Gravity_H_
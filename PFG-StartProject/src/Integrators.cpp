@@ -0,0 +1,72 @@
+#include "Integrators.h"
+
+/*! \brief Brief description.
+*  The integrator policies themselves are templates in Integrators.h, this file holds the body arrays
+*  and the names used to pick an integrator in the scene file.
+*
+*/
+
+namespace
+{
+	const char* INTEGRATOR_NAMES[INTEGRATOR_COUNT] = { "Euler", "Verlet", "RungeKutta2", "RungeKutta4", "BogackiShampine" };
+}
+
+void BodyArrays::Resize(size_t count)
+{
+	for (int k = 0; k < 3; k++)
+	{
+		position[k].resize(count);
+		velocity[k].resize(count);
+		force[k].resize(count);
+		stagePosition[k].resize(count);
+		stageVelocity[k].resize(count);
+		acceleration[k].resize(count);
+		sumPosition[k].resize(count);
+		sumVelocity[k].resize(count);
+		forceRate[k].resize(count);
+		lastForce[k].resize(count);
+		clockForce[k].resize(count);
+		clockRate[k].resize(count);
+		clockPosition[k].resize(count);
+		clockVelocity[k].resize(count);
+		for (int s = 0; s < 3; s++)
+		{
+			stageAcceleration[s][k].resize(count);
+			clockStart[s][k].resize(count);
+			clockEnd[s][k].resize(count);
+		}
+	}
+	invMass.resize(count);
+	stepSize.resize(count);
+	stepLength.resize(count);
+	timeLeft.resize(count);
+	stepError.resize(count);
+	syncAtEnd.resize(count);
+	clockSpan.resize(count);
+	clockElapsed.resize(count);
+}
+
+namespace PFG
+{
+	const char* GetIntegratorName(IntegratorType type)
+	{
+		if (type >= INTEGRATOR_COUNT)
+		{
+			return "";
+		}
+		return INTEGRATOR_NAMES[type];
+	}
+
+	bool ParseIntegrator(const std::string& name, IntegratorType& type)
+	{
+		for (int i = 0; i < INTEGRATOR_COUNT; i++)
+		{
+			if (name == INTEGRATOR_NAMES[i])
+			{
+				type = (IntegratorType)i;
+				return true;
+			}
+		}
+		return false;
+	}
+}
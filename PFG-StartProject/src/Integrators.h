@@ -0,0 +1,723 @@
+#ifndef _Integrators_H_
+#define _Integrators_H_
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+// Largest scaled local error the adaptive integrator accepts, relative to 1 + |x| and 1 + |v|
+static const float ADAPTIVE_TOLERANCE = 1.0e-4f;
+// The adaptive integrator never takes a step smaller than this fraction of the scene step
+static const float ADAPTIVE_MIN_STEP_FRACTION = 1.0e-3f;
+// Nor one longer than this many scene steps, so a body in free flight still looks at its force now and then
+static const float ADAPTIVE_MAX_STEP_MULTIPLE = 16.0f;
+// After this many attempts in one scene step the adaptive integrator accepts whatever it has
+static const int ADAPTIVE_MAX_ATTEMPTS = 200;
+
+/** Numerical integrator used to advance a body's position and velocity
+* Chosen per scene or per group of bodies in the scene file
+*/
+enum IntegratorType
+{
+	INTEGRATOR_EULER = 0, /*!< Semi-implicit Euler, one force evaluation */
+	INTEGRATOR_VERLET = 1, /*!< Velocity Verlet, two force evaluations */
+	INTEGRATOR_RUNGE_KUTTA2 = 2, /*!< Midpoint Runge-Kutta, two force evaluations */
+	INTEGRATOR_RUNGE_KUTTA4 = 3, /*!< Classic Runge-Kutta, four force evaluations */
+	INTEGRATOR_BOGACKI_SHAMPINE = 4, /*!< Adaptive embedded Runge-Kutta 3(2), each body picks its own step */
+	INTEGRATOR_COUNT /*!< Number of integrators */
+};
+
+/*! \brief Brief description.
+*  BodyArrays holds the linear state of a batch of bodies as one float array per axis, so the integrators
+*  can run tight loops over many bodies at once. The scene copies its dynamic objects in, integrates each group
+*  of bodies that share an integrator, and copies them back out.
+*
+*/
+struct BodyArrays
+{
+	/** Resize every array to hold count bodies
+	*/
+	void Resize(size_t count);
+	/** Number of bodies
+	*/
+	size_t Size() const { return invMass.size(); }
+
+	std::vector<float> position[3]; /*!< Position, one array per axis */
+	std::vector<float> velocity[3]; /*!< Velocity, one array per axis */
+	std::vector<float> force[3]; /*!< Total force accumulated for the step */
+	std::vector<float> invMass; /*!< One over the mass */
+
+	/** Scratch arrays the integrators use between force evaluations
+	*/
+	std::vector<float> stagePosition[3];
+	std::vector<float> stageVelocity[3];
+	std::vector<float> acceleration[3];
+	std::vector<float> sumPosition[3];
+	std::vector<float> sumVelocity[3];
+	/** Accelerations at the first three stages of the adaptive integrator, one array per axis each
+	*/
+	std::vector<float> stageAcceleration[3][3];
+
+	/** Step control for the adaptive integrator
+	*/
+	std::vector<float> stepSize; /*!< Step each body will try next, kept between scene steps. 0 means not chosen yet */
+	std::vector<float> stepLength; /*!< Step each body is trying now, 0 if it isn't trying one */
+	std::vector<float> timeLeft; /*!< Time each body still has to go in this scene step */
+	std::vector<float> stepError; /*!< Scaled local error of the step being tried */
+	std::vector<float> forceRate[3]; /*!< How fast the accumulated force changed over the last scene step */
+	std::vector<unsigned char> syncAtEnd; /*!< 1 if the body's clock has to agree with the scene's at the end of this step */
+
+	/** Each adaptive body's own clock, kept between scene steps in an AdaptiveClock.
+	* A body's step can run on past the end of the scene step, the body is then where the step's cubic puts it
+	*/
+	std::vector<float> clockSpan; /*!< Length of the step the body is part way through, 0 if none */
+	std::vector<float> clockElapsed; /*!< How far the body is into that step */
+	std::vector<float> clockStart[3][3]; /*!< Position, velocity and acceleration at the start of the step, one array per axis each */
+	std::vector<float> clockEnd[3][3]; /*!< Position, velocity and acceleration at the end of the step */
+	std::vector<float> clockForce[3]; /*!< Accumulated force the step started with */
+	std::vector<float> clockRate[3]; /*!< The rate the step carried it along at */
+	std::vector<float> lastForce[3]; /*!< Accumulated force at the last scene step */
+	std::vector<float> clockPosition[3]; /*!< Where the integrator left the body, so anything else that moves it in between is noticed */
+	std::vector<float> clockVelocity[3];
+};
+
+/*! \brief Brief description.
+*  The part of the adaptive integrator's state a body carries from one scene step to the next, copied in and out
+*  of a BodyArrays with the rest of its linear state.
+*
+*/
+struct AdaptiveClock
+{
+	AdaptiveClock() : size(0.0f), span(0.0f), elapsed(0.0f)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			lastForce[k] = 0.0f;
+			force[k] = 0.0f;
+			rate[k] = 0.0f;
+			position[k] = 0.0f;
+			velocity[k] = 0.0f;
+			for (int s = 0; s < 3; s++)
+			{
+				start[s][k] = 0.0f;
+				end[s][k] = 0.0f;
+			}
+		}
+	}
+
+	float size; /*!< Step to try next, 0 until the body has taken one */
+	float span;
+	float elapsed;
+	float start[3][3];
+	float end[3][3];
+	float force[3];
+	float rate[3];
+	float lastForce[3];
+	float position[3];
+	float velocity[3];
+};
+
+/*! \brief Brief description.
+*  Force models give the acceleration of bodies [begin, end) when the bodies are at the given positions.
+*  AccumulatedForce is the one the scene uses: the force summed up by gravity and the collision responses,
+*  held constant over the step.
+*
+*/
+struct AccumulatedForce
+{
+	void operator()(const BodyArrays& bodies, const std::vector<float>*, size_t begin, size_t end, std::vector<float>* acceleration) const
+	{
+		const float* invMass = bodies.invMass.data();
+		for (int k = 0; k < 3; k++)
+		{
+			const float* f = bodies.force[k].data();
+			float* a = acceleration[k].data();
+			for (size_t i = begin; i < end; i++)
+			{
+				a[i] = f[i] * invMass[i];
+			}
+		}
+	}
+};
+
+/*! \brief Brief description.
+*  Integrator policies. Each one advances bodies [begin, end) of a BodyArrays by one step with a force model,
+*  and is instantiated for that force model at compile time so the loops have no calls or branches per body.
+*
+*/
+
+/** Semi-implicit Euler: v += a * dt, then x += v * dt with the new velocity
+*/
+struct EulerIntegrator
+{
+	static const int forceEvaluations = 1;
+
+	template <class Forces>
+	static void Step(BodyArrays& bodies, const Forces& forces, size_t begin, size_t end, float dt)
+	{
+		forces(bodies, bodies.position, begin, end, bodies.acceleration);
+
+		for (int k = 0; k < 3; k++)
+		{
+			float* x = bodies.position[k].data();
+			float* v = bodies.velocity[k].data();
+			const float* a = bodies.acceleration[k].data();
+			for (size_t i = begin; i < end; i++)
+			{
+				v[i] += a[i] * dt;
+				x[i] += v[i] * dt;
+			}
+		}
+	}
+};
+
+/** Velocity Verlet: move with the start velocity and acceleration, then average the start and end accelerations
+*/
+struct VerletIntegrator
+{
+	static const int forceEvaluations = 2;
+
+	template <class Forces>
+	static void Step(BodyArrays& bodies, const Forces& forces, size_t begin, size_t end, float dt)
+	{
+		forces(bodies, bodies.position, begin, end, bodies.acceleration);
+
+		for (int k = 0; k < 3; k++)
+		{
+			float* x = bodies.position[k].data();
+			float* v = bodies.velocity[k].data();
+			const float* a = bodies.acceleration[k].data();
+			for (size_t i = begin; i < end; i++)
+			{
+				x[i] += v[i] * dt + 0.5f * a[i] * dt * dt;
+				v[i] += 0.5f * a[i] * dt;
+			}
+		}
+
+		forces(bodies, bodies.position, begin, end, bodies.acceleration);
+
+		for (int k = 0; k < 3; k++)
+		{
+			float* v = bodies.velocity[k].data();
+			const float* a = bodies.acceleration[k].data();
+			for (size_t i = begin; i < end; i++)
+			{
+				v[i] += 0.5f * a[i] * dt;
+			}
+		}
+	}
+};
+
+/** Midpoint Runge-Kutta: evaluate at the start, step to the middle, and use the middle derivatives for the full step
+*/
+struct RungeKutta2Integrator
+{
+	static const int forceEvaluations = 2;
+
+	template <class Forces>
+	static void Step(BodyArrays& bodies, const Forces& forces, size_t begin, size_t end, float dt)
+	{
+		const float halfDt = 0.5f * dt;
+
+		forces(bodies, bodies.position, begin, end, bodies.acceleration);
+
+		for (int k = 0; k < 3; k++)
+		{
+			const float* x = bodies.position[k].data();
+			const float* v = bodies.velocity[k].data();
+			const float* a = bodies.acceleration[k].data();
+			float* sx = bodies.stagePosition[k].data();
+			float* sv = bodies.stageVelocity[k].data();
+			for (size_t i = begin; i < end; i++)
+			{
+				sx[i] = x[i] + halfDt * v[i];
+				sv[i] = v[i] + halfDt * a[i];
+			}
+		}
+
+		forces(bodies, bodies.stagePosition, begin, end, bodies.acceleration);
+
+		for (int k = 0; k < 3; k++)
+		{
+			float* x = bodies.position[k].data();
+			float* v = bodies.velocity[k].data();
+			const float* a = bodies.acceleration[k].data();
+			const float* sv = bodies.stageVelocity[k].data();
+			for (size_t i = begin; i < end; i++)
+			{
+				x[i] += dt * sv[i];
+				v[i] += dt * a[i];
+			}
+		}
+	}
+};
+
+/** Classic fourth order Runge-Kutta, weighting the four stage derivatives 1, 2, 2, 1
+*/
+struct RungeKutta4Integrator
+{
+	static const int forceEvaluations = 4;
+
+	template <class Forces>
+	static void Step(BodyArrays& bodies, const Forces& forces, size_t begin, size_t end, float dt)
+	{
+		const float halfDt = 0.5f * dt;
+
+		// k1 at the start of the step
+		forces(bodies, bodies.position, begin, end, bodies.acceleration);
+
+		for (int k = 0; k < 3; k++)
+		{
+			const float* x = bodies.position[k].data();
+			const float* v = bodies.velocity[k].data();
+			const float* a = bodies.acceleration[k].data();
+			float* sx = bodies.stagePosition[k].data();
+			float* sv = bodies.stageVelocity[k].data();
+			float* sumX = bodies.sumPosition[k].data();
+			float* sumV = bodies.sumVelocity[k].data();
+			for (size_t i = begin; i < end; i++)
+			{
+				sumX[i] = v[i];
+				sumV[i] = a[i];
+				sx[i] = x[i] + halfDt * v[i];
+				sv[i] = v[i] + halfDt * a[i];
+			}
+		}
+
+		// k2 and k3 at the middle of the step
+		StageMiddle(bodies, forces, begin, end, halfDt);
+		StageMiddle(bodies, forces, begin, end, dt);
+
+		// k4 at the end of the step
+		forces(bodies, bodies.stagePosition, begin, end, bodies.acceleration);
+
+		const float sixthDt = dt / 6.0f;
+		for (int k = 0; k < 3; k++)
+		{
+			float* x = bodies.position[k].data();
+			float* v = bodies.velocity[k].data();
+			const float* a = bodies.acceleration[k].data();
+			const float* sv = bodies.stageVelocity[k].data();
+			const float* sumX = bodies.sumPosition[k].data();
+			const float* sumV = bodies.sumVelocity[k].data();
+			for (size_t i = begin; i < end; i++)
+			{
+				x[i] += sixthDt * (sumX[i] + sv[i]);
+				v[i] += sixthDt * (sumV[i] + a[i]);
+			}
+		}
+	}
+
+private:
+
+	// Evaluate at the current stage, add it to the sums with weight 2, and set up the next stage nextDt along
+	template <class Forces>
+	static void StageMiddle(BodyArrays& bodies, const Forces& forces, size_t begin, size_t end, float nextDt)
+	{
+		forces(bodies, bodies.stagePosition, begin, end, bodies.acceleration);
+
+		for (int k = 0; k < 3; k++)
+		{
+			const float* x = bodies.position[k].data();
+			const float* v = bodies.velocity[k].data();
+			const float* a = bodies.acceleration[k].data();
+			float* sx = bodies.stagePosition[k].data();
+			float* sv = bodies.stageVelocity[k].data();
+			float* sumX = bodies.sumPosition[k].data();
+			float* sumV = bodies.sumVelocity[k].data();
+			for (size_t i = begin; i < end; i++)
+			{
+				sumX[i] += 2.0f * sv[i];
+				sumV[i] += 2.0f * a[i];
+				sx[i] = x[i] + nextDt * sv[i];
+				sv[i] = v[i] + nextDt * a[i];
+			}
+		}
+	}
+};
+
+/** Bogacki-Shampine 3(2): a third order step with an embedded second order solution to estimate the local error.
+*   Each body runs on its own clock, growing its step while the error stays under ADAPTIVE_TOLERANCE and shrinking it
+*   and trying again when it doesn't. A step can run on for several scene steps, and at each scene step in between
+*   the body is put where the step's cubic says it is, so a body in free flight takes one step every few scene steps
+*   and one in a fast changing force field takes several in one.
+*   The accumulated force is carried along the step at the rate it changed over the last scene step, which is what
+*   gives the error estimate something to measure when the force doesn't depend on position. At each scene step a
+*   step in progress is checked against the accumulated force there, and dropped if the force has moved off the
+*   one the step carried along by more than the tolerance allows over the rest of the step, or if something else
+*   has moved the body since. Bodies marked syncAtEnd, the ones about to touch something,
+*   hold the force constant and cut their steps at the end of the scene step, where the scene handles their contacts.
+*   The last stage's acceleration is the first stage of the next step, so each try costs three force evaluations
+*/
+struct BogackiShampineIntegrator
+{
+	static const int forceEvaluations = 3;
+
+	template <class Forces>
+	static void Step(BodyArrays& bodies, const Forces& forces, size_t begin, size_t end, float dt)
+	{
+		float* size = bodies.stepSize.data();
+		float* h = bodies.stepLength.data();
+		float* left = bodies.timeLeft.data();
+		float* error = bodies.stepError.data();
+		float* span = bodies.clockSpan.data();
+		float* elapsed = bodies.clockElapsed.data();
+		const unsigned char* sync = bodies.syncAtEnd.data();
+		const float minStep = ADAPTIVE_MIN_STEP_FRACTION * dt;
+		const float maxStep = ADAPTIVE_MAX_STEP_MULTIPLE * dt;
+
+		for (int k = 0; k < 3; k++)
+		{
+			const float* f = bodies.force[k].data();
+			float* last = bodies.lastForce[k].data();
+			float* rate = bodies.forceRate[k].data();
+			for (size_t i = begin; i < end; i++)
+			{
+				// A body's first step has no last force to take a rate from
+				rate[i] = sync[i] || size[i] <= 0.0f ? 0.0f : (f[i] - last[i]) / dt;
+				last[i] = f[i];
+			}
+		}
+
+		for (size_t i = begin; i < end; i++)
+		{
+			left[i] = dt;
+			error[i] = 0.0f;
+			if (size[i] <= 0.0f)
+			{
+				size[i] = dt;
+			}
+			size[i] = std::min(size[i], maxStep);
+		}
+
+		// Force off the one the step carried along makes an error that grows over what is left of it.
+		// A body moved by anything else since the last scene step is off by more than any tolerance
+		for (int k = 0; k < 3; k++)
+		{
+			const float* x = bodies.position[k].data();
+			const float* v = bodies.velocity[k].data();
+			const float* f = bodies.force[k].data();
+			const float* invMass = bodies.invMass.data();
+			const float* clockX = bodies.clockPosition[k].data();
+			const float* clockV = bodies.clockVelocity[k].data();
+			const float* clockF = bodies.clockForce[k].data();
+			const float* clockRate = bodies.clockRate[k].data();
+			for (size_t i = begin; i < end; i++)
+			{
+				const float remaining = span[i] - elapsed[i];
+				const float off = std::fabs(f[i] - clockF[i] - clockRate[i] * elapsed[i]) * invMass[i];
+				const float scaled = std::max(0.5f * off * remaining * remaining / (1.0f + std::fabs(x[i])), off * remaining / (1.0f + std::fabs(v[i])));
+				const bool moved = x[i] != clockX[i] || v[i] != clockV[i];
+				error[i] = std::max(error[i], moved ? 2.0f : scaled / ADAPTIVE_TOLERANCE);
+			}
+		}
+
+		bool starting = false;
+		for (size_t i = begin; i < end; i++)
+		{
+			if (error[i] > 1.0f)
+			{
+				span[i] = 0.0f;
+			}
+			starting = starting || span[i] <= 0.0f;
+		}
+
+		// The acceleration where each body is now, the first stage for the bodies starting a step here
+		if (starting)
+		{
+			forces(bodies, bodies.position, begin, end, bodies.stageAcceleration[0]);
+		}
+
+		for (int attempt = 0; ; attempt++)
+		{
+			FollowClocks(bodies, begin, end, minStep);
+
+			// Bodies that have reached the end of the scene step try a step of zero, which leaves them where they are
+			bool active = false;
+			for (size_t i = begin; i < end; i++)
+			{
+				h[i] = left[i] <= 0.0f ? 0.0f : sync[i] ? std::min(size[i], left[i]) : size[i];
+				error[i] = 0.0f;
+				active = active || h[i] > 0.0f;
+			}
+			if (!active || attempt == ADAPTIVE_MAX_ATTEMPTS)
+			{
+				break;
+			}
+
+			// Stage 2 at h / 2, its velocity goes in sumPosition
+			for (int k = 0; k < 3; k++)
+			{
+				const float* x = bodies.position[k].data();
+				const float* v = bodies.velocity[k].data();
+				const float* a1 = bodies.stageAcceleration[0][k].data();
+				float* sx = bodies.stagePosition[k].data();
+				float* v2 = bodies.sumPosition[k].data();
+				for (size_t i = begin; i < end; i++)
+				{
+					sx[i] = x[i] + 0.5f * h[i] * v[i];
+					v2[i] = v[i] + 0.5f * h[i] * a1[i];
+				}
+			}
+			forces(bodies, bodies.stagePosition, begin, end, bodies.stageAcceleration[1]);
+			AddForceDrift(bodies, bodies.stageAcceleration[1], begin, end, dt, 0.5f);
+
+			// Stage 3 at 3h / 4, its velocity goes in sumVelocity
+			for (int k = 0; k < 3; k++)
+			{
+				const float* x = bodies.position[k].data();
+				const float* v = bodies.velocity[k].data();
+				const float* a2 = bodies.stageAcceleration[1][k].data();
+				const float* v2 = bodies.sumPosition[k].data();
+				float* sx = bodies.stagePosition[k].data();
+				float* v3 = bodies.sumVelocity[k].data();
+				for (size_t i = begin; i < end; i++)
+				{
+					sx[i] = x[i] + 0.75f * h[i] * v2[i];
+					v3[i] = v[i] + 0.75f * h[i] * a2[i];
+				}
+			}
+			forces(bodies, bodies.stagePosition, begin, end, bodies.stageAcceleration[2]);
+			AddForceDrift(bodies, bodies.stageAcceleration[2], begin, end, dt, 0.75f);
+
+			// Third order solution
+			for (int k = 0; k < 3; k++)
+			{
+				const float* x = bodies.position[k].data();
+				const float* v = bodies.velocity[k].data();
+				const float* a1 = bodies.stageAcceleration[0][k].data();
+				const float* a2 = bodies.stageAcceleration[1][k].data();
+				const float* a3 = bodies.stageAcceleration[2][k].data();
+				const float* v2 = bodies.sumPosition[k].data();
+				const float* v3 = bodies.sumVelocity[k].data();
+				float* sx = bodies.stagePosition[k].data();
+				float* sv = bodies.stageVelocity[k].data();
+				for (size_t i = begin; i < end; i++)
+				{
+					sx[i] = x[i] + h[i] * (2.0f / 9.0f * v[i] + 1.0f / 3.0f * v2[i] + 4.0f / 9.0f * v3[i]);
+					sv[i] = v[i] + h[i] * (2.0f / 9.0f * a1[i] + 1.0f / 3.0f * a2[i] + 4.0f / 9.0f * a3[i]);
+				}
+			}
+			forces(bodies, bodies.stagePosition, begin, end, bodies.acceleration);
+			AddForceDrift(bodies, bodies.acceleration, begin, end, dt, 1.0f);
+
+			// Difference between the third and second order solutions
+			for (int k = 0; k < 3; k++)
+			{
+				const float* v = bodies.velocity[k].data();
+				const float* a1 = bodies.stageAcceleration[0][k].data();
+				const float* a2 = bodies.stageAcceleration[1][k].data();
+				const float* a3 = bodies.stageAcceleration[2][k].data();
+				const float* a4 = bodies.acceleration[k].data();
+				const float* v2 = bodies.sumPosition[k].data();
+				const float* v3 = bodies.sumVelocity[k].data();
+				const float* sx = bodies.stagePosition[k].data();
+				const float* sv = bodies.stageVelocity[k].data();
+				for (size_t i = begin; i < end; i++)
+				{
+					float ex = h[i] * (5.0f / 72.0f * v[i] - 1.0f / 12.0f * v2[i] - 1.0f / 9.0f * v3[i] + 1.0f / 8.0f * sv[i]);
+					float ev = h[i] * (5.0f / 72.0f * a1[i] - 1.0f / 12.0f * a2[i] - 1.0f / 9.0f * a3[i] + 1.0f / 8.0f * a4[i]);
+					float scaled = std::max(std::fabs(ex) / (1.0f + std::fabs(sx[i])), std::fabs(ev) / (1.0f + std::fabs(sv[i])));
+					error[i] = std::max(error[i], scaled / ADAPTIVE_TOLERANCE);
+				}
+			}
+
+			// Accept or reject each body's step and pick its next step size.
+			// An accepted step becomes the body's clock, the next attempt moves the body along it
+			const bool lastAttempt = attempt + 1 == ADAPTIVE_MAX_ATTEMPTS;
+			for (size_t i = begin; i < end; i++)
+			{
+				if (h[i] <= 0.0f)
+				{
+					continue;
+				}
+
+				const bool accept = error[i] <= 1.0f || h[i] <= minStep || lastAttempt;
+				if (accept)
+				{
+					for (int k = 0; k < 3; k++)
+					{
+						bodies.clockStart[0][k][i] = bodies.position[k][i];
+						bodies.clockStart[1][k][i] = bodies.velocity[k][i];
+						bodies.clockStart[2][k][i] = bodies.stageAcceleration[0][k][i];
+						bodies.clockEnd[0][k][i] = bodies.stagePosition[k][i];
+						bodies.clockEnd[1][k][i] = bodies.stageVelocity[k][i];
+						bodies.clockEnd[2][k][i] = bodies.acceleration[k][i];
+						bodies.clockForce[k][i] = bodies.force[k][i] + bodies.forceRate[k][i] * (dt - left[i]);
+						bodies.clockRate[k][i] = bodies.forceRate[k][i];
+					}
+					span[i] = h[i];
+					elapsed[i] = 0.0f;
+				}
+
+				// Error goes as h^3, aim a little under the tolerance
+				float factor = error[i] > 0.0f ? 0.9f * std::pow(error[i], -1.0f / 3.0f) : 5.0f;
+				factor = std::min(5.0f, std::max(0.2f, factor));
+
+				// A step cut short by the end of the scene step doesn't say the body needs a smaller one
+				if (accept && h[i] < size[i])
+				{
+					size[i] = std::max(size[i], h[i] * factor);
+				}
+				else
+				{
+					size[i] = h[i] * factor;
+				}
+				size[i] = std::min(maxStep, std::max(minStep, size[i]));
+			}
+
+		}
+
+		for (int k = 0; k < 3; k++)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				bodies.clockPosition[k][i] = bodies.position[k][i];
+				bodies.clockVelocity[k][i] = bodies.velocity[k][i];
+			}
+		}
+	}
+
+private:
+
+	// Add the accumulated force's change over the time from the start of the scene step to a stage a fraction of h
+	// into each body's step, the force models only give it as it was at the start
+	static void AddForceDrift(const BodyArrays& bodies, std::vector<float>* acceleration, size_t begin, size_t end, float dt, float fraction)
+	{
+		const float* h = bodies.stepLength.data();
+		const float* left = bodies.timeLeft.data();
+		const float* invMass = bodies.invMass.data();
+		for (int k = 0; k < 3; k++)
+		{
+			const float* rate = bodies.forceRate[k].data();
+			float* a = acceleration[k].data();
+			for (size_t i = begin; i < end; i++)
+			{
+				a[i] += rate[i] * invMass[i] * (dt - left[i] + fraction * h[i]);
+			}
+		}
+	}
+
+	// Move each body with time left along the step it is on, to the end of the scene step if the step goes that
+	// far and to the end of the step if it doesn't. Part way along, the body is put on the cubics through the two
+	// ends' positions and velocities and the two ends' velocities and accelerations
+	static void FollowClocks(BodyArrays& bodies, size_t begin, size_t end, float minStep)
+	{
+		float* left = bodies.timeLeft.data();
+		float* span = bodies.clockSpan.data();
+		float* elapsed = bodies.clockElapsed.data();
+		// Where along its step each body goes, -1 for the ones that stay put
+		float* theta = bodies.stepError.data();
+		for (size_t i = begin; i < end; i++)
+		{
+			theta[i] = -1.0f;
+			if (span[i] <= 0.0f || left[i] <= 0.0f)
+			{
+				continue;
+			}
+			const float remaining = span[i] - elapsed[i];
+			if (remaining > left[i])
+			{
+				elapsed[i] += left[i];
+				left[i] = 0.0f;
+				theta[i] = std::min(elapsed[i] / span[i], 1.0f);
+			}
+			else
+			{
+				elapsed[i] = span[i];
+				left[i] -= remaining;
+				theta[i] = 1.0f;
+				if (left[i] <= minStep * 1.0e-3f)
+				{
+					left[i] = 0.0f;
+				}
+			}
+		}
+
+		for (int k = 0; k < 3; k++)
+		{
+			float* x = bodies.position[k].data();
+			float* v = bodies.velocity[k].data();
+			float* a = bodies.stageAcceleration[0][k].data();
+			const float* x0 = bodies.clockStart[0][k].data();
+			const float* v0 = bodies.clockStart[1][k].data();
+			const float* a0 = bodies.clockStart[2][k].data();
+			const float* x1 = bodies.clockEnd[0][k].data();
+			const float* v1 = bodies.clockEnd[1][k].data();
+			const float* a1 = bodies.clockEnd[2][k].data();
+			for (size_t i = begin; i < end; i++)
+			{
+				const float t = theta[i];
+				if (t < 0.0f)
+				{
+					continue;
+				}
+				const float t2 = t * t;
+				const float t3 = t2 * t;
+				const float h00 = 2.0f * t3 - 3.0f * t2 + 1.0f;
+				const float h10 = (t3 - 2.0f * t2 + t) * span[i];
+				const float h01 = 3.0f * t2 - 2.0f * t3;
+				const float h11 = (t3 - t2) * span[i];
+				x[i] = h00 * x0[i] + h10 * v0[i] + h01 * x1[i] + h11 * v1[i];
+				v[i] = h00 * v0[i] + h10 * a0[i] + h01 * v1[i] + h11 * a1[i];
+				// A body at the end of its step starts the next one from there
+				a[i] = a1[i];
+			}
+		}
+
+		// A finished step is done with, and a body that has to agree with the scene lets go of the rest of its step
+		const unsigned char* sync = bodies.syncAtEnd.data();
+		for (size_t i = begin; i < end; i++)
+		{
+			if (theta[i] >= 1.0f || (theta[i] >= 0.0f && sync[i]))
+			{
+				span[i] = 0.0f;
+			}
+		}
+	}
+};
+
+namespace PFG
+{
+	/*
+	Integrate bodies [begin, end) with the chosen integrator.
+	The integrator is picked once here for the whole range, the loops inside are specialised for it
+	*/
+	template <class Forces>
+	void IntegrateBodies(IntegratorType type, BodyArrays& bodies, const Forces& forces, size_t begin, size_t end, float dt)
+	{
+		switch (type)
+		{
+		case INTEGRATOR_EULER:
+			EulerIntegrator::Step(bodies, forces, begin, end, dt);
+			break;
+		case INTEGRATOR_VERLET:
+			VerletIntegrator::Step(bodies, forces, begin, end, dt);
+			break;
+		case INTEGRATOR_RUNGE_KUTTA2:
+			RungeKutta2Integrator::Step(bodies, forces, begin, end, dt);
+			break;
+		case INTEGRATOR_BOGACKI_SHAMPINE:
+			BogackiShampineIntegrator::Step(bodies, forces, begin, end, dt);
+			break;
+		case INTEGRATOR_RUNGE_KUTTA4:
+		default:
+			RungeKutta4Integrator::Step(bodies, forces, begin, end, dt);
+			break;
+		}
+	}
+
+	/*
+	The name of an integrator as written in the scene file
+	*/
+	const char* GetIntegratorName(IntegratorType type);
+
+	/*
+	Look up an integrator by its scene file name.
+	Returns false and leaves type unchanged if the name isn't known
+	*/
+	bool ParseIntegrator(const std::string& name, IntegratorType& type);
+}
+
+#endif //!_Integrators_H_
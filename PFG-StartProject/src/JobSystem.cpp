@@ -0,0 +1,108 @@
+#include "JobSystem.h"
+#include <algorithm>
+
+JobSystem::JobSystem(unsigned threadCount)
+{
+	if (threadCount == 0)
+	{
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	_job = NULL;
+	_call = NULL;
+	_count = 0;
+	_grain = 1;
+	_nextChunk = 0;
+	_generation = 0;
+	_busyWorkers = 0;
+	_quit = false;
+
+	for (unsigned i = 1; i < threadCount; i++)
+	{
+		_workers.push_back(std::thread(&JobSystem::WorkerLoop, this));
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_quit = true;
+	}
+	_wake.notify_all();
+
+	for (size_t i = 0; i < _workers.size(); i++)
+	{
+		_workers[i].join();
+	}
+}
+
+void JobSystem::Run(size_t count, size_t grain, const void* job, void (*call)(const void*, size_t, size_t))
+{
+	if (count == 0)
+	{
+		return;
+	}
+	grain = std::max<size_t>(grain, 1);
+
+	// Not worth waking anyone for a single chunk
+	if (_workers.empty() || count <= grain)
+	{
+		call(job, 0, count);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_job = job;
+		_call = call;
+		_count = count;
+		_grain = grain;
+		_nextChunk = 0;
+		_busyWorkers = (unsigned)_workers.size();
+		_generation++;
+	}
+	_wake.notify_all();
+
+	RunChunks();
+
+	// Wait for the workers to finish their last chunks before the job goes out of scope
+	std::unique_lock<std::mutex> lock(_mutex);
+	_done.wait(lock, [this] { return _busyWorkers == 0; });
+	_job = NULL;
+}
+
+void JobSystem::WorkerLoop()
+{
+	unsigned seen = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_wake.wait(lock, [this, seen] { return _quit || _generation != seen; });
+			if (_quit)
+			{
+				return;
+			}
+			seen = _generation;
+		}
+
+		RunChunks();
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_busyWorkers--;
+		}
+		_done.notify_one();
+	}
+}
+
+void JobSystem::RunChunks()
+{
+	const size_t chunks = (_count + _grain - 1) / _grain;
+	for (size_t chunk = _nextChunk++; chunk < chunks; chunk = _nextChunk++)
+	{
+		size_t begin = chunk * _grain;
+		_call(_job, begin, std::min(begin + _grain, _count));
+	}
+}
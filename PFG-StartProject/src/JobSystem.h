@@ -0,0 +1,83 @@
+#ifndef _JobSystem_H_
+#define _JobSystem_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*! \brief Brief description.
+*  JobSystem keeps a fixed set of worker threads alive for the whole run and splits loops over them.
+*  The thread that calls ParallelFor works on the loop too, and only returns once every chunk is done,
+*  so a loop can write straight into arrays owned by the caller.
+*
+*/
+class JobSystem
+{
+public:
+
+	/** JobSystem constructor
+	* @param unsigned threadCount total threads including the calling one, 0 for one per hardware thread
+	*/
+	explicit JobSystem(unsigned threadCount = 0);
+	/** JobSystem destructor, stops and joins the workers
+	*/
+	~JobSystem();
+
+	/** Run job over [0, count) in chunks of at most grain items, spread over every thread
+	* @param size_t count number of items
+	* @param size_t grain largest number of items handed to one call of job
+	* @param job called with the begin and end of each chunk, from any thread
+	*/
+	template <typename Job>
+	void ParallelFor(size_t count, size_t grain, const Job& job)
+	{
+		Run(count, grain, &job, &CallJob<Job>);
+	}
+
+	/** Number of threads that share a loop, including the calling one
+	*/
+	unsigned GetThreadCount() const { return (unsigned)_workers.size() + 1; }
+
+private:
+
+	JobSystem(const JobSystem&);
+	JobSystem& operator=(const JobSystem&);
+
+	/** Calls a loop body of type Job through a plain pointer, the loop bodies are taken by reference rather than
+	* wrapped in a std::function, which would allocate once a lambda's captures outgrow its small buffer
+	*/
+	template <typename Job>
+	static void CallJob(const void* job, size_t begin, size_t end) { (*static_cast<const Job*>(job))(begin, end); }
+	/** Share out the loop behind ParallelFor, handing job back to call for each chunk
+	*/
+	void Run(size_t count, size_t grain, const void* job, void (*call)(const void*, size_t, size_t));
+
+	void WorkerLoop();
+	/** Take chunks of the current loop until none are left
+	*/
+	void RunChunks();
+
+	std::vector<std::thread> _workers;
+
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	std::condition_variable _done;
+
+	/** The loop being run, only valid while _busyWorkers is above zero or the caller is inside ParallelFor
+	*/
+	const void* _job;
+	void (*_call)(const void*, size_t, size_t);
+	size_t _count;
+	size_t _grain;
+	std::atomic<size_t> _nextChunk;
+
+	/** Bumped for every loop so sleeping workers can tell a new loop from a spurious wake up
+	*/
+	unsigned _generation;
+	unsigned _busyWorkers;
+	bool _quit;
+};
+
+#endif //!_JobSystem_H_
@@ -1,14 +1,16 @@
-#include <GLM/gtc/type_ptr.hpp>
-#include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtx/rotate_vector.hpp>
-
 #include "KinematicsObject.h"
-#include <iostream>
+#include "Transforms.h"
+#include <cmath>
 
 KinematicsObject::KinematicsObject()
 {
-	_scale = glm::vec3(1.0f, 1.0f, 1.0f);
+	_velocity = glm::vec3(0.0f, 0.0f, 0.0f);
+	_bRadius = 1.0f;
+	_pathVelocity = glm::vec3(0.0f, 0.0f, 0.0f);
+	_pathPeriod = 0.0f;
+	_time = 0.0f;
 	_start = false;
+	m_objectType = SHAPE_SPHERE;
 }
 
 KinematicsObject::~KinematicsObject()
@@ -18,32 +20,43 @@ KinematicsObject::~KinematicsObject()
 
 void KinematicsObject::Update(float deltaTs)
 {
-
 	if (_start == true)
 	{
-		glm::vec3 v;
-
-		v.x = _velocity.x;
-		v.y = _velocity.y + (-9.8f) * deltaTs;
-		v.z = _velocity.z;
-		_position.x += _velocity.x * deltaTs;
-		_position.y += _velocity.y * deltaTs;
-		_position.z += _velocity.z * deltaTs;
-		_velocity = v;
-
-		if (_position.y <= 0.3f)
-		{
-			_position.y = 0.3f;
-			_velocity.y *= -0.8f;
-		}
+		BeginStep(deltaTs);
+		Move(deltaTs);
 	}
 
-	UpdateModelMatrix();
+	if (_transformDirty)
+	{
+		glm::mat4 model;
+		glm::mat4 invModel;
+		PFG::ComposeTransform(_position, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), _scale, model, invModel);
+		SetModelMatrices(model, invModel);
+	}
 }
 
-void KinematicsObject::UpdateModelMatrix()
+void KinematicsObject::BeginStep(float deltaTs)
 {
-	_modelMatrix = glm::translate(glm::mat4(1), _position);
-	_modelMatrix = glm::scale(_modelMatrix, _scale);
-	_invModelMatrix = glm::inverse(_modelMatrix);
-}
\ No newline at end of file
+	// The step's velocity lands the object exactly where the path is at the end of the step
+	if (_pathPeriod > 0.0f && deltaTs > 0.0f)
+	{
+		_velocity = (PathOffset(_time + deltaTs) - PathOffset(_time)) / deltaTs;
+	}
+}
+
+void KinematicsObject::Move(float deltaTs)
+{
+	_time += deltaTs;
+	if (_velocity != glm::vec3(0.0f, 0.0f, 0.0f))
+	{
+		_position += _velocity * deltaTs;
+		_transformDirty = true;
+	}
+}
+
+glm::vec3 KinematicsObject::PathOffset(float time) const
+{
+	// Out along the velocity for half the period and back for the other half
+	float half = 0.5f * _pathPeriod;
+	return _pathVelocity * (half - std::abs(std::fmod(time, _pathPeriod) - half));
+}
@@ -4,11 +4,12 @@
 #include "GameObject.h"
 
 /*! \brief Brief description.
-*  Physics object class is derived from the GameObject class, as a one type/class of game objects
-*  It sets up parameters for physics computation and calls certain physics algorithms.
-*  It returns the position and orientation of the object for the visualisation engine to display.
-*  It is important to not include any graphics drawings in this class. This is the principle of the separation 
-*  of physics computation from graphics
+*  Kinematic object class is derived from the GameObject class, as a one type/class of game objects
+*  A kinematic object is a sphere that moves where its script says, whatever it hits. It has infinite mass, so
+*  dynamic objects that touch it are pushed out of its way and it never feels them.
+*  The scene sets its velocity from the script at the start of each step, so the collision responses and
+*  solvers see how it is moving, and moves it at the end. It is never integrated and never tested against the
+*  static objects.
 *
 */
 
@@ -24,34 +25,42 @@ public:
 	~KinematicsObject();
 
 	/** Update function to override the base class function
-	*   for physics computation
-	*   This function is typically organized that it calls each physics computation procedures/algorithms
-	*   in a sequential order, so that each computational algorithm provides required information for the 
-	*   next procedure.
+	*   Runs the script and moves the object on its own, for objects that aren't stepped by the scene
 	*   @param float deltaTs simulation time step length
 	*/
 	void Update(float deltaTs) override;
 
-	/** Set position for the object
-	* @param glm::vec3 pos a 3D vector for the position of the object
+	/** Set this step's velocity from the script
+	*   @param float deltaTs simulation time step length
+	*/
+	void BeginStep(float deltaTs);
+	/** Move the object along its velocity and advance the script's clock
+	*   @param float deltaTs simulation time step length
+	*/
+	void Move(float deltaTs);
+
+	/** Script the motion as a constant velocity, or as a platform that goes back and forth along it
+	* @param glm::vec3 velocity a 3D vector for the velocity of the object
+	* @param float period time to go out and come back, zero to keep going
 	*/
-	void SetPosition(glm::vec3 pos) { _position = pos; }
-	/** Set velocity for the object
+	void SetPath(const glm::vec3& velocity, float period) { _pathVelocity = velocity; _pathPeriod = period; _velocity = velocity; }
+	/** Set velocity for the object, this replaces the script until SetPath is called again
 	* @param glm::vec3 vel a 3D vector for the velocity of the object
 	*/
-	void SetVelocity(glm::vec3 vel) { _velocity = vel; }
-	/** Set scale for the object
-	* @param glm::vec3 vel a 3D vector for the scale of the object
+	void SetVelocity(const glm::vec3 vel) { _velocity = vel; _pathVelocity = vel; _pathPeriod = 0.0f; }
+	/** Set a sphere bounding volume for the object
+	* @param float r  the radius of the bounding sphere of the object
 	*/
-	void SetScale(glm::vec3 scale) { _scale = scale; }
-	/** Get the position of the object
-	* @return a 3D vector 
+	void SetBoundingRadius(float r) { _bRadius = r; }
+
+	/** Get the velocity of the object in the current step
+	* @return a 3D vector
 	*/
-	glm::vec3 GetPosition() { return _position; }
-	/** Get the orientation of the object
-	* @return a 4x4 matrix
+	const glm::vec3 GetVelocity() const { return _velocity; }
+	/** Get the radius of the bounding sphere of the object
+	* @return the result
 	*/
-	glm::mat4 GetOrientation() { return _orientation; }
+	const float GetBoundingRadius() const { return _bRadius; }
 
 	/** A boolean variable to control the start of the simulation This matrix is the camera's lens
 	*/
@@ -59,27 +68,24 @@ public:
 
 private:
 
-	/**Update the model matrix with the current position, orientation and scale
-	*
+	/** Position along the path at a time since the script started, relative to where it started
 	*/
-	void UpdateModelMatrix();
+	glm::vec3 PathOffset(float time) const;
 
-	/** Set up physics parameters for computation
-	*  Specific parameters are determined by the physics simulation 
-	*/
-	/** Position of the object
-	*/
-	glm::vec3 _position;
-	/** Velocity of the object
+	/** Velocity of the object in the current step
 	*/
 	glm::vec3 _velocity;
-	/** Scale of the object
+	/** The radius of a bounding sphere of the object
 	*/
-	glm::vec3 _scale;
-	/** Orientation of the object
+	float _bRadius;
+	/** Scripted velocity, and the time to go out along it and come back or zero
 	*/
-	glm::mat4 _orientation;
-	
+	glm::vec3 _pathVelocity;
+	float _pathPeriod;
+	/** Time since the script started
+	*/
+	float _time;
+
 	/** A boolean variable to control the start of the simulation This matrix is the camera's lens
 	*/
 	bool _start;
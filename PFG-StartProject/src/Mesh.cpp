@@ -45,6 +45,9 @@ void Mesh::LoadOBJ( std::string filename )
 		std::vector<glm::vec3> orderedPositionData;
 		std::vector<glm::vec3> orderedNormalData;
 
+		// Position indices of each triangle, kept for the collision mesh
+		std::vector<unsigned int> triangleIndices;
+
 		std::string currentLine;
 
 		while( std::getline( inputFile, currentLine ) )
@@ -111,6 +114,7 @@ void Mesh::LoadOBJ( std::string filename )
 						if( posID > 0 )
 						{
 							orderedPositionData.push_back( rawPositionData[posID-1] );
+							triangleIndices.push_back( posID-1 );
 						}
 						if( uvID > 0 )
 						{
@@ -135,6 +139,12 @@ void Mesh::LoadOBJ( std::string filename )
 
 		inputFile.close();
 
+		// Keep the triangles on the CPU in case the mesh is used as a collider, the hierarchy is only built then
+		_filename = filename;
+		_collisionPositions.swap( rawPositionData );
+		_collisionIndices.swap( triangleIndices );
+		_collisionMesh = CollisionMesh();
+
 		_numVertices = orderedPositionData.size();
 
 		if( _numVertices > 0 )
@@ -210,6 +220,27 @@ void Mesh::LoadOBJ( std::string filename )
 	}
 }
 
+void Mesh::BuildCollisionMesh()
+{
+	if( !_collisionMesh.IsEmpty() || _collisionIndices.empty() )
+	{
+		return;
+	}
+
+	// A hierarchy saved next to the OBJ is used if it was built from these triangles, otherwise it is built here and
+	// saved for next time. Saving is only a cache, if the assets can't be written the hierarchy is rebuilt next run
+	uint64_t sourceHash = CollisionMesh::HashTriangles( _collisionPositions, _collisionIndices );
+	if( !_collisionMesh.Load( _filename + ".bvh", sourceHash ) )
+	{
+		_collisionMesh.SetTriangles( _collisionPositions, _collisionIndices );
+		_collisionMesh.Save( _filename + ".bvh", sourceHash );
+	}
+
+	// The collision mesh has its own copy now
+	std::vector<glm::vec3>().swap( _collisionPositions );
+	std::vector<unsigned int>().swap( _collisionIndices );
+}
+
 void Mesh::Draw()
 {
 		// Activate the VAO
@@ -5,6 +5,8 @@
 #include <SDL.h>
 #include "glew.h"
 #include <string>
+#include <vector>
+#include "CollisionMesh.h"
 
 /*! \brief
 *  Mesh class is for loading a triangulated mesh from OBJ file and keeping a reference for it.
@@ -32,6 +34,15 @@ public:
 	*/
 	void Draw();
 
+	/** Build the collision hierarchy from the triangles of the OBJ, only needed for meshes used as colliders
+	*  The hierarchy is cached in a .bvh file next to the OBJ. Calling it again does nothing
+	*/
+	void BuildCollisionMesh();
+
+	/** The CPU side triangles and hierarchy in model space, empty until BuildCollisionMesh is called
+	*/
+	const CollisionMesh& GetCollisionMesh() const { return _collisionMesh; }
+
 protected:
 	
 
@@ -43,6 +54,16 @@ protected:
 	*/
 	unsigned int _numVertices;
 
+	/**Indexed triangle list and hierarchy for collision detection
+	*/
+	CollisionMesh _collisionMesh;
+
+	/**The OBJ the mesh was loaded from, and its triangles until BuildCollisionMesh hands them to _collisionMesh
+	*/
+	std::string _filename;
+	std::vector<glm::vec3> _collisionPositions;
+	std::vector<unsigned int> _collisionIndices;
+
 };
 
 
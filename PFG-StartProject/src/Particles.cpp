@@ -0,0 +1,296 @@
+#include "Particles.h"
+#include "Simd.h"
+#include <algorithm>
+
+// Particles handed to a thread at a time, a multiple of the SIMD width
+static const size_t PARTICLE_GRAIN = 4096;
+
+ParticleSystem::ParticleSystem()
+{
+	_count = 0;
+	_gravity = glm::vec3(0.0f, -9.8f, 0.0f);
+	_restitution = 0.5f;
+	_friction = 0.1f;
+}
+
+void ParticleSystem::Clear()
+{
+	for (int k = 0; k < 3; k++)
+	{
+		_position[k].clear();
+		_velocity[k].clear();
+		_acceleration[k].clear();
+	}
+	_invMass.clear();
+	_radius.clear();
+	_count = 0;
+}
+
+size_t ParticleSystem::Add(const glm::vec3& position, const glm::vec3& velocity, float mass, float radius)
+{
+	// Keep the arrays a whole number of SIMD blocks with at least three spare lanes, so a block of four can start
+	// at any particle. The padding lanes are masked off
+	size_t padded = (_count + 1 + 6) & ~(size_t)3;
+	for (int k = 0; k < 3; k++)
+	{
+		_position[k].resize(padded);
+		_velocity[k].resize(padded);
+		_acceleration[k].resize(padded);
+		_position[k][_count] = position[k];
+		_velocity[k][_count] = velocity[k];
+		_acceleration[k][_count] = 0.0f;
+	}
+	_invMass.resize(padded);
+	_radius.resize(padded);
+	_invMass[_count] = 1.0f / mass;
+	_radius[_count] = radius;
+	return _count++;
+}
+
+void ParticleSystem::Reorder(const std::vector<uint32_t>& order)
+{
+	std::vector<float>* arrays[11] = { &_position[0], &_position[1], &_position[2], &_velocity[0], &_velocity[1], &_velocity[2],
+		&_acceleration[0], &_acceleration[1], &_acceleration[2], &_invMass, &_radius };
+
+	_reorderScratch.resize(_invMass.size());
+	for (int a = 0; a < 11; a++)
+	{
+		const std::vector<float>& source = *arrays[a];
+		for (size_t i = 0; i < _count; i++)
+		{
+			_reorderScratch[i] = source[order[i]];
+		}
+		// Padding lanes keep their values
+		for (size_t i = _count; i < source.size(); i++)
+		{
+			_reorderScratch[i] = source[i];
+		}
+		arrays[a]->swap(_reorderScratch);
+	}
+}
+
+void ParticleSystem::Step(float deltaTs, const PlaneColliderSet& planes, const std::vector<DynamicObject*>& spheres, JobSystem& jobs)
+{
+	if (_count == 0)
+	{
+		return;
+	}
+
+	const size_t sphereCount = spheres.size();
+	_sphereState.resize(sphereCount * 8);
+	if (_sphereContacts.size() != sphereCount)
+	{
+		_sphereContacts.assign(sphereCount, 1.0f);
+	}
+	for (size_t s = 0; s < sphereCount; s++)
+	{
+		DynamicObject* sphere = spheres[s];
+		glm::vec3 position = sphere->GetPosition();
+		glm::vec3 velocity = sphere->GetVelocity();
+		float* state = &_sphereState[s * 8];
+		for (int k = 0; k < 3; k++)
+		{
+			state[k] = position[k];
+			state[3 + k] = velocity[k];
+		}
+		// Mass splitting, each contact sees the sphere as if it were only its share of the sphere's mass
+		state[6] = _sphereContacts[s] / sphere->GetMass();
+		state[7] = sphere->GetBoundingRadius();
+	}
+
+	_planeState.resize(planes.Size() * 5);
+	for (size_t p = 0; p < planes.Size(); p++)
+	{
+		glm::vec3 normal = planes.GetNormal(p);
+		float* state = &_planeState[p * 5];
+		state[0] = normal.x;
+		state[1] = normal.y;
+		state[2] = normal.z;
+		state[3] = planes.GetOffset(p);
+		state[4] = planes.IsHalfSpace(p) ? 1.0f : 0.0f;
+	}
+
+	const size_t chunks = (_count + PARTICLE_GRAIN - 1) / PARTICLE_GRAIN;
+	_sphereChanges.assign(chunks * sphereCount * 7, 0.0f);
+
+	jobs.ParallelFor(_count, PARTICLE_GRAIN, [this, deltaTs](size_t begin, size_t end)
+	{
+		StepChunk(begin, end, begin / PARTICLE_GRAIN, deltaTs);
+	});
+
+	// Each sphere takes the average of what its contacts did to it. With the split mass this is the plain sum for a
+	// few light particles, but many heavy ones, like a fluid, can't throw the sphere further than they move themselves
+	for (size_t s = 0; s < sphereCount; s++)
+	{
+		glm::vec3 velocityChange(0.0f), positionChange(0.0f);
+		float contacts = 0.0f;
+		for (size_t c = 0; c < chunks; c++)
+		{
+			const float* change = &_sphereChanges[(c * sphereCount + s) * 7];
+			velocityChange += glm::vec3(change[0], change[1], change[2]);
+			positionChange += glm::vec3(change[3], change[4], change[5]);
+			contacts += change[6];
+		}
+		velocityChange /= _sphereContacts[s];
+		positionChange /= _sphereContacts[s];
+		// The split for the next step, contacts change little from one step to the next
+		_sphereContacts[s] = std::max(contacts, 1.0f);
+
+		if (velocityChange != glm::vec3(0.0f) || positionChange != glm::vec3(0.0f))
+		{
+			DynamicObject* sphere = spheres[s];
+			sphere->SetVelocity(sphere->GetVelocity() + velocityChange);
+			sphere->SetPosition(sphere->GetPosition() + positionChange);
+		}
+	}
+}
+
+void ParticleSystem::StepChunk(size_t begin, size_t end, size_t chunk, float deltaTs)
+{
+	const size_t sphereCount = _sphereState.size() / 8;
+	const size_t planeCount = _planeState.size() / 5;
+	float* changes = sphereCount > 0 ? &_sphereChanges[chunk * sphereCount * 7] : NULL;
+
+	float* px = _position[0].data();
+	float* py = _position[1].data();
+	float* pz = _position[2].data();
+	float* vx = _velocity[0].data();
+	float* vy = _velocity[1].data();
+	float* vz = _velocity[2].data();
+	const float* ax = _acceleration[0].data();
+	const float* ay = _acceleration[1].data();
+	const float* az = _acceleration[2].data();
+
+	const __m128 dt = _mm_set1_ps(deltaTs);
+	const __m128 gx = _mm_set1_ps(_gravity.x);
+	const __m128 gy = _mm_set1_ps(_gravity.y);
+	const __m128 gz = _mm_set1_ps(_gravity.z);
+	const __m128 bounce = _mm_set1_ps(1.0f + _restitution);
+	const __m128 friction = _mm_set1_ps(_friction);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	for (size_t i = begin; i < end; i += 4)
+	{
+		const __m128 valid = PFG::ValidLanes(end - i);
+
+		__m128 x = _mm_loadu_ps(px + i);
+		__m128 y = _mm_loadu_ps(py + i);
+		__m128 z = _mm_loadu_ps(pz + i);
+		__m128 u = _mm_loadu_ps(vx + i);
+		__m128 v = _mm_loadu_ps(vy + i);
+		__m128 w = _mm_loadu_ps(vz + i);
+		const __m128 invMass = _mm_loadu_ps(&_invMass[i]);
+		const __m128 r = _mm_loadu_ps(&_radius[i]);
+
+		// Semi-implicit Euler, velocity first
+		u = _mm_add_ps(u, _mm_mul_ps(_mm_add_ps(gx, _mm_loadu_ps(ax + i)), dt));
+		v = _mm_add_ps(v, _mm_mul_ps(_mm_add_ps(gy, _mm_loadu_ps(ay + i)), dt));
+		w = _mm_add_ps(w, _mm_mul_ps(_mm_add_ps(gz, _mm_loadu_ps(az + i)), dt));
+		x = _mm_add_ps(x, _mm_mul_ps(u, dt));
+		y = _mm_add_ps(y, _mm_mul_ps(v, dt));
+		z = _mm_add_ps(z, _mm_mul_ps(w, dt));
+
+		// Rigid spheres, the impulse and the push apart are shared by inverse mass
+		for (size_t s = 0; s < sphereCount; s++)
+		{
+			const float* sphere = &_sphereState[s * 8];
+			__m128 dx = _mm_sub_ps(x, _mm_set1_ps(sphere[0]));
+			__m128 dy = _mm_sub_ps(y, _mm_set1_ps(sphere[1]));
+			__m128 dz = _mm_sub_ps(z, _mm_set1_ps(sphere[2]));
+			__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			__m128 reach = _mm_add_ps(r, _mm_set1_ps(sphere[7]));
+
+			__m128 hit = _mm_and_ps(valid, _mm_and_ps(_mm_cmplt_ps(d2, _mm_mul_ps(reach, reach)), _mm_cmpgt_ps(d2, zero)));
+			if (_mm_movemask_ps(hit) == 0)
+			{
+				continue;
+			}
+
+			__m128 length = _mm_sqrt_ps(PFG::Select(hit, d2, one));
+			__m128 nx = _mm_div_ps(dx, length);
+			__m128 ny = _mm_div_ps(dy, length);
+			__m128 nz = _mm_div_ps(dz, length);
+
+			const __m128 sphereInvMass = _mm_set1_ps(sphere[6]);
+			__m128 invSum = _mm_add_ps(invMass, sphereInvMass);
+			__m128 share = _mm_div_ps(invMass, invSum);
+
+			// Only push on lanes that are closing, j is the negative of the usual impulse
+			__m128 closing = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_sub_ps(u, _mm_set1_ps(sphere[3])), nx),
+				_mm_mul_ps(_mm_sub_ps(v, _mm_set1_ps(sphere[4])), ny)),
+				_mm_mul_ps(_mm_sub_ps(w, _mm_set1_ps(sphere[5])), nz));
+			__m128 j = _mm_and_ps(hit, _mm_div_ps(_mm_mul_ps(bounce, _mm_min_ps(closing, zero)), invSum));
+			__m128 depth = _mm_and_ps(hit, _mm_sub_ps(reach, length));
+
+			__m128 dv = _mm_mul_ps(j, invMass);
+			u = _mm_sub_ps(u, _mm_mul_ps(dv, nx));
+			v = _mm_sub_ps(v, _mm_mul_ps(dv, ny));
+			w = _mm_sub_ps(w, _mm_mul_ps(dv, nz));
+			__m128 dp = _mm_mul_ps(depth, share);
+			x = _mm_add_ps(x, _mm_mul_ps(dp, nx));
+			y = _mm_add_ps(y, _mm_mul_ps(dp, ny));
+			z = _mm_add_ps(z, _mm_mul_ps(dp, nz));
+
+			__m128 sphereDv = _mm_mul_ps(j, sphereInvMass);
+			__m128 sphereDp = _mm_sub_ps(depth, dp);
+			float* change = &changes[s * 7];
+			change[0] += PFG::HorizontalSum(_mm_mul_ps(sphereDv, nx));
+			change[1] += PFG::HorizontalSum(_mm_mul_ps(sphereDv, ny));
+			change[2] += PFG::HorizontalSum(_mm_mul_ps(sphereDv, nz));
+			change[3] -= PFG::HorizontalSum(_mm_mul_ps(sphereDp, nx));
+			change[4] -= PFG::HorizontalSum(_mm_mul_ps(sphereDp, ny));
+			change[5] -= PFG::HorizontalSum(_mm_mul_ps(sphereDp, nz));
+			change[6] += (float)PFG::CountLanes(hit);
+		}
+
+		// Static planes, swept from where the particle started the step so fast ones can't tunnel through
+		for (size_t p = 0; p < planeCount; p++)
+		{
+			const float* plane = &_planeState[p * 5];
+			const __m128 nx = _mm_set1_ps(plane[0]);
+			const __m128 ny = _mm_set1_ps(plane[1]);
+			const __m128 nz = _mm_set1_ps(plane[2]);
+
+			__m128 d1 = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, x), _mm_mul_ps(ny, y)), _mm_mul_ps(nz, z)), _mm_set1_ps(plane[3]));
+			__m128 normalSpeed = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, u), _mm_mul_ps(ny, v)), _mm_mul_ps(nz, w));
+
+			__m128 hit = _mm_and_ps(valid, _mm_cmplt_ps(d1, r));
+			if (plane[4] == 0.0f)
+			{
+				// A thin plane only stops particles that started in front of it
+				__m128 d0 = _mm_sub_ps(d1, _mm_mul_ps(normalSpeed, dt));
+				hit = _mm_and_ps(hit, _mm_cmpge_ps(d0, _mm_sub_ps(zero, r)));
+			}
+			if (_mm_movemask_ps(hit) == 0)
+			{
+				continue;
+			}
+
+			__m128 push = _mm_and_ps(hit, _mm_sub_ps(r, d1));
+			x = _mm_add_ps(x, _mm_mul_ps(push, nx));
+			y = _mm_add_ps(y, _mm_mul_ps(push, ny));
+			z = _mm_add_ps(z, _mm_mul_ps(push, nz));
+
+			// Bounce the normal velocity, then take some of the sliding velocity away
+			__m128 reflect = _mm_and_ps(_mm_and_ps(hit, _mm_cmplt_ps(normalSpeed, zero)), _mm_mul_ps(bounce, normalSpeed));
+			u = _mm_sub_ps(u, _mm_mul_ps(reflect, nx));
+			v = _mm_sub_ps(v, _mm_mul_ps(reflect, ny));
+			w = _mm_sub_ps(w, _mm_mul_ps(reflect, nz));
+
+			normalSpeed = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, u), _mm_mul_ps(ny, v)), _mm_mul_ps(nz, w));
+			__m128 slow = _mm_and_ps(hit, friction);
+			u = _mm_sub_ps(u, _mm_mul_ps(slow, _mm_sub_ps(u, _mm_mul_ps(normalSpeed, nx))));
+			v = _mm_sub_ps(v, _mm_mul_ps(slow, _mm_sub_ps(v, _mm_mul_ps(normalSpeed, ny))));
+			w = _mm_sub_ps(w, _mm_mul_ps(slow, _mm_sub_ps(w, _mm_mul_ps(normalSpeed, nz))));
+		}
+
+		_mm_storeu_ps(px + i, x);
+		_mm_storeu_ps(py + i, y);
+		_mm_storeu_ps(pz + i, z);
+		_mm_storeu_ps(vx + i, u);
+		_mm_storeu_ps(vy + i, v);
+		_mm_storeu_ps(vz + i, w);
+	}
+}
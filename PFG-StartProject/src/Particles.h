@@ -0,0 +1,119 @@
+#ifndef _Particles_H_
+#define _Particles_H_
+
+#include "DynamicObject.h"
+#include "PlaneColliders.h"
+#include "JobSystem.h"
+#include <glm/glm.hpp>
+#include <vector>
+#include <stdint.h>
+
+/*! \brief Brief description.
+*  ParticleSystem is the light-weight body type for debris, sand and anything else whose rotation doesn't matter.
+*  A particle is only a position, a velocity, an inverse mass and a radius, kept as flat float arrays, with no
+*  game object, orientation or model matrix of its own.
+*
+*  Each particle can also carry an acceleration on top of gravity, which the fluid solver uses for its pressure
+*  and viscosity forces.
+*
+*  One step runs a single pass over the particles, four at a time with SSE and split over the job system's threads:
+*  each block is integrated with semi-implicit Euler, pushed out of and bounced off the scene's dynamic spheres,
+*  and then off the static planes. Impulses on the spheres are summed per chunk and applied once at the end, so the
+*  particles and rigid spheres push on each other. The sphere's mass is split over its contacts, so a sphere
+*  resting on many particles isn't pushed once for each of them. Particles don't collide with each other.
+*
+*/
+class ParticleSystem
+{
+public:
+
+	/** ParticleSystem constructor
+	*/
+	ParticleSystem();
+
+	/** Remove every particle
+	*/
+	void Clear();
+	/** Add a particle
+	* @return its index
+	*/
+	size_t Add(const glm::vec3& position, const glm::vec3& velocity, float mass, float radius);
+	/** Number of particles
+	*/
+	size_t Size() const { return _count; }
+
+	/** Acceleration of every particle
+	*/
+	void SetGravity(const glm::vec3& gravity) { _gravity = gravity; }
+	/** Coefficient of restitution for every collision
+	*/
+	void SetRestitution(float restitution) { _restitution = restitution; }
+	/** Fraction of the sliding velocity lost in each collision with a plane
+	*/
+	void SetFriction(float friction) { _friction = friction; }
+
+	/** Advance every particle by one step and collide it with the spheres and planes
+	* @param float deltaTs step length
+	* @param PlaneColliderSet planes the static planes, already built for this step
+	* @param spheres the dynamic spheres, their velocities and positions are changed by any particle that hits them
+	* @param JobSystem jobs the particles are split over its threads
+	*/
+	void Step(float deltaTs, const PlaneColliderSet& planes, const std::vector<DynamicObject*>& spheres, JobSystem& jobs);
+
+	/** Position and velocity of a particle
+	*/
+	glm::vec3 GetPosition(size_t i) const { return glm::vec3(_position[0][i], _position[1][i], _position[2][i]); }
+	glm::vec3 GetVelocity(size_t i) const { return glm::vec3(_velocity[0][i], _velocity[1][i], _velocity[2][i]); }
+	float GetRadius(size_t i) const { return _radius[i]; }
+
+	/** The particle arrays for kernels that work on all of them, padded to at least three past Size()
+	* @param int axis 0, 1 or 2 for x, y or z
+	*/
+	const std::vector<float>& GetPositions(int axis) const { return _position[axis]; }
+	const std::vector<float>* GetPositions() const { return _position; }
+	const std::vector<float>& GetVelocities(int axis) const { return _velocity[axis]; }
+	/** Acceleration added to gravity in the next Step, zero unless something writes to it
+	*/
+	std::vector<float>& GetAccelerations(int axis) { return _acceleration[axis]; }
+
+	/** Put the particles in a new order, for example sorted by cell
+	* @param order the old index of the particle that goes at each position
+	*/
+	void Reorder(const std::vector<uint32_t>& order);
+
+private:
+
+	/** Step the particles in [begin, end), begin is a multiple of four
+	* @param size_t chunk index into the per chunk sphere impulses
+	*/
+	void StepChunk(size_t begin, size_t end, size_t chunk, float deltaTs);
+
+	/** Particle state, padded with at least three unused lanes to a multiple of four
+	*/
+	std::vector<float> _position[3];
+	std::vector<float> _velocity[3];
+	std::vector<float> _acceleration[3];
+	std::vector<float> _invMass;
+	std::vector<float> _radius;
+	size_t _count;
+
+	glm::vec3 _gravity;
+	float _restitution;
+	float _friction;
+
+	/** The spheres and planes for the current step
+	*/
+	std::vector<float> _sphereState; /*!< x y z vx vy vz inverse mass radius for each sphere */
+	std::vector<float> _planeState; /*!< nx ny nz offset half-space for each plane */
+
+	/** Velocity and position change of each sphere summed over each chunk, vx vy vz px py pz and the contact count
+	*/
+	std::vector<float> _sphereChanges;
+	/** Contacts on each sphere in the last step, its mass is split between that many contacts
+	*/
+	std::vector<float> _sphereContacts;
+
+	std::vector<float> _reorderScratch;
+};
+
+#endif //!_Particles_H_
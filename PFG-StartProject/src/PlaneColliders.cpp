@@ -0,0 +1,140 @@
+#include "PlaneColliders.h"
+#include "Utility.h"
+#include <xmmintrin.h>
+
+/*! \brief Brief description.
+*  PlaneColliderSet holds every static plane and half-space of the scene as a normal and an offset taken from the
+*  game object's transform, and tests them against batches of moving spheres four at a time with SSE.
+*
+*/
+
+void SweptSphereBatch::Clear()
+{
+	x0.clear(); y0.clear(); z0.clear();
+	x1.clear(); y1.clear(); z1.clear();
+	radius.clear();
+}
+
+void SweptSphereBatch::Add(const glm::vec3& c0, const glm::vec3& c1, float r)
+{
+	x0.push_back(c0.x); y0.push_back(c0.y); z0.push_back(c0.z);
+	x1.push_back(c1.x); y1.push_back(c1.y); z1.push_back(c1.z);
+	radius.push_back(r);
+}
+
+void PlaneColliderSet::Build(const std::vector<GameObject*>& objects)
+{
+	_objects.clear();
+	_normals.clear();
+	_offsets.clear();
+	_halfSpace.clear();
+
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		GameObject* object = objects[i];
+		ShapeType type = object->GetType();
+		if (type != SHAPE_PLANE && type != SHAPE_HALFSPACE)
+		{
+			continue;
+		}
+
+		// The plane passes through the object's origin with the object's up direction as its normal
+		glm::vec3 normal = object->GetUpDirection();
+
+		_objects.push_back(object);
+		_normals.push_back(normal);
+		_offsets.push_back(glm::dot(normal, object->GetPosition()));
+		_halfSpace.push_back(type == SHAPE_HALFSPACE);
+	}
+}
+
+void PlaneColliderSet::FindContacts(const SweptSphereBatch& spheres, std::vector<PlaneContact>& contacts) const
+{
+	contacts.clear();
+
+	const size_t count = spheres.Size();
+	const size_t simdCount = count & ~(size_t)3;
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+
+	for (size_t p = 0; p < _objects.size(); p++)
+	{
+		const __m128 nx = _mm_set1_ps(_normals[p].x);
+		const __m128 ny = _mm_set1_ps(_normals[p].y);
+		const __m128 nz = _mm_set1_ps(_normals[p].z);
+		const __m128 offset = _mm_set1_ps(_offsets[p]);
+		const bool halfSpace = _halfSpace[p];
+
+		// One pass over all spheres for this plane, four at a time
+		for (size_t i = 0; i < simdCount; i += 4)
+		{
+			__m128 d0 = _mm_mul_ps(nx, _mm_loadu_ps(&spheres.x0[i]));
+			d0 = _mm_add_ps(d0, _mm_mul_ps(ny, _mm_loadu_ps(&spheres.y0[i])));
+			d0 = _mm_add_ps(d0, _mm_mul_ps(nz, _mm_loadu_ps(&spheres.z0[i])));
+			d0 = _mm_sub_ps(d0, offset);
+
+			__m128 d1 = _mm_mul_ps(nx, _mm_loadu_ps(&spheres.x1[i]));
+			d1 = _mm_add_ps(d1, _mm_mul_ps(ny, _mm_loadu_ps(&spheres.y1[i])));
+			d1 = _mm_add_ps(d1, _mm_mul_ps(nz, _mm_loadu_ps(&spheres.z1[i])));
+			d1 = _mm_sub_ps(d1, offset);
+
+			const __m128 r = _mm_loadu_ps(&spheres.radius[i]);
+
+			__m128 hit;
+			if (halfSpace)
+			{
+				// Starts inside or touching, or ends inside
+				hit = _mm_or_ps(_mm_cmple_ps(d0, r), _mm_cmplt_ps(d1, r));
+			}
+			else
+			{
+				// Touching either side at the start, or crosses the front surface during the step
+				__m128 absD0 = _mm_andnot_ps(signMask, d0);
+				hit = _mm_or_ps(_mm_cmple_ps(absD0, r), _mm_and_ps(_mm_cmpgt_ps(d0, r), _mm_cmplt_ps(d1, r)));
+			}
+
+			int mask = _mm_movemask_ps(hit);
+			while (mask != 0)
+			{
+				int lane = 0;
+				while ((mask & (1 << lane)) == 0)
+				{
+					lane++;
+				}
+				mask &= ~(1 << lane);
+
+				PlaneContact contact;
+				contact.sphere = i + lane;
+				contact.plane = p;
+				if (SphereContact(spheres, contact.sphere, p, contact.contactPoint))
+				{
+					contacts.push_back(contact);
+				}
+			}
+		}
+
+		// Remaining spheres that don't fill a SIMD lane
+		for (size_t i = simdCount; i < count; i++)
+		{
+			PlaneContact contact;
+			contact.sphere = i;
+			contact.plane = p;
+			if (SphereContact(spheres, i, p, contact.contactPoint))
+			{
+				contacts.push_back(contact);
+			}
+		}
+	}
+}
+
+bool PlaneColliderSet::SphereContact(const SweptSphereBatch& spheres, size_t sphere, size_t plane, glm::vec3& contactPoint) const
+{
+	glm::vec3 c0 = glm::vec3(spheres.x0[sphere], spheres.y0[sphere], spheres.z0[sphere]);
+	glm::vec3 c1 = glm::vec3(spheres.x1[sphere], spheres.y1[sphere], spheres.z1[sphere]);
+	glm::vec3 q = _offsets[plane] * _normals[plane];
+
+	if (_halfSpace[plane])
+	{
+		return PFG::MovingSphereToHalfSpaceCollision(_normals[plane], c0, c1, q, spheres.radius[sphere], contactPoint);
+	}
+	return PFG::MovingSphereToPlaneCollision(_normals[plane], c0, c1, q, spheres.radius[sphere], contactPoint);
+}
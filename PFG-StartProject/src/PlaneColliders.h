@@ -0,0 +1,99 @@
+#ifndef _PlaneColliders_H_
+#define _PlaneColliders_H_
+
+#include "GameObject.h"
+#include <vector>
+
+/*! \brief Brief description.
+*  SweptSphereBatch keeps the start and predicted end centres of every dynamic sphere for one step as plain float arrays,
+*  so that batched collision tests can load four spheres at a time.
+*
+*/
+struct SweptSphereBatch
+{
+	/** Remove all spheres from the batch, keeping the memory
+	*/
+	void Clear();
+	/** Add a sphere moving from c0 to c1 over the step
+	* @param glm::vec3 c0 centre at the start of the step
+	* @param glm::vec3 c1 predicted centre at the end of the step
+	* @param float r radius of the sphere
+	*/
+	void Add(const glm::vec3& c0, const glm::vec3& c1, float r);
+	/** Number of spheres in the batch
+	*/
+	size_t Size() const { return radius.size(); }
+
+	std::vector<float> x0, y0, z0; /*!< Centres at the start of the step */
+	std::vector<float> x1, y1, z1; /*!< Predicted centres at the end of the step */
+	std::vector<float> radius; /*!< Radius of each sphere */
+};
+
+/*! \brief Brief description.
+*  A contact found between a sphere in a SweptSphereBatch and a static plane
+*
+*/
+struct PlaneContact
+{
+	size_t sphere; /*!< Index of the sphere in the batch */
+	size_t plane; /*!< Index of the plane in the PlaneColliderSet */
+	glm::vec3 contactPoint; /*!< Where the centre of the sphere should be when it touches the plane */
+};
+
+/*! \brief Brief description.
+*  PlaneColliderSet holds every static plane and half-space of the scene as a normal and an offset taken from the
+*  game object's transform. All dynamic spheres are tested against one plane per SIMD pass, so an enclosed box
+*  costs six passes over the spheres.
+*
+*/
+class PlaneColliderSet
+{
+public:
+
+	/** Rebuild the set from the game objects that are planes or half-spaces
+	* Planes are cheap to rebuild so rotated or moved objects are picked up every step
+	* @param std::vector<GameObject*> objects the static objects of the scene
+	*/
+	void Build(const std::vector<GameObject*>& objects);
+
+	/** Test every sphere against every plane and return the touching pairs
+	* @param SweptSphereBatch spheres the dynamic spheres for this step
+	* @param std::vector<PlaneContact> contacts output, cleared first
+	*/
+	void FindContacts(const SweptSphereBatch& spheres, std::vector<PlaneContact>& contacts) const;
+
+	/** Number of planes in the set
+	*/
+	size_t Size() const { return _objects.size(); }
+	/** The game object a plane was built from
+	*/
+	GameObject* GetObject(size_t plane) const { return _objects[plane]; }
+	/** The unit normal of a plane
+	*/
+	glm::vec3 GetNormal(size_t plane) const { return _normals[plane]; }
+	/** Signed distance of a plane from the origin along its normal
+	*/
+	float GetOffset(size_t plane) const { return _offsets[plane]; }
+	/** True if everything behind the plane is solid
+	*/
+	bool IsHalfSpace(size_t plane) const { return _halfSpace[plane]; }
+
+private:
+
+	/** Work out the exact contact for a sphere that the SIMD pass flagged
+	*/
+	bool SphereContact(const SweptSphereBatch& spheres, size_t sphere, size_t plane, glm::vec3& contactPoint) const;
+
+	std::vector<GameObject*> _objects;
+	/** Unit plane normal
+	*/
+	std::vector<glm::vec3> _normals;
+	/** Signed distance of the plane from the origin along the normal
+	*/
+	std::vector<float> _offsets;
+	/** True if everything behind the plane is solid
+	*/
+	std::vector<bool> _halfSpace;
+};
+
+#endif //!_PlaneColliders_H_
@@ -0,0 +1,182 @@
+#ifndef _Pool_H_
+#define _Pool_H_
+
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+// Objects in each slab of an ObjectPool, the pool grows a slab at a time
+static const uint32_t POOL_SLAB_OBJECTS = 256;
+// Slot index of a handle that was never given an object
+static const uint32_t POOL_NO_SLOT = 0xffffffffu;
+
+/*! \brief Brief description.
+*  A reference to an object in an ObjectPool of T. It holds the object's slot and the generation the slot was
+*  on when the object was made, so a handle kept after its object is destroyed no longer matches the slot and
+*  is seen to be stale, even once the slot has been reused.
+*
+*/
+template <typename T>
+struct Handle
+{
+	Handle() : index(POOL_NO_SLOT), generation(0) {}
+	Handle(uint32_t index, uint32_t generation) : index(index), generation(generation) {}
+
+	bool operator==(const Handle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const Handle& other) const { return !(*this == other); }
+
+	uint32_t index;
+	uint32_t generation;
+};
+
+/*! \brief Brief description.
+*  ObjectPool keeps objects of one type in slabs of POOL_SLAB_OBJECTS slots instead of a heap allocation each.
+*  Slabs are never moved or freed while the pool lives, so a pointer to an object stays good until the object
+*  is destroyed, and making and destroying objects once the pool has grown allocates nothing. Free slots are
+*  reused last freed first from a list threaded through them.
+*
+*  Each slot counts how many times it has been freed, and handles carry that count. Destroying the pool
+*  destroys any objects still in it.
+*
+*/
+template <typename T>
+class ObjectPool
+{
+public:
+
+	/** ObjectPool constructor
+	*/
+	ObjectPool() : _freeHead(POOL_NO_SLOT), _live(0) {}
+	/** ObjectPool destructor, destroys every object still in the pool and frees the slabs
+	*/
+	~ObjectPool()
+	{
+		for (uint32_t i = 0; i < Capacity(); i++)
+		{
+			Slot& slot = GetSlot(i);
+			if (slot.live)
+			{
+				Object(slot)->~T();
+			}
+		}
+		for (size_t s = 0; s < _slabs.size(); s++)
+		{
+			delete[] _slabs[s];
+		}
+	}
+
+	/** Make an object in a free slot, growing the pool by a slab if there isn't one
+	* @param args passed on to T's constructor
+	*/
+	template <typename... Args>
+	Handle<T> Create(Args&&... args)
+	{
+		if (_freeHead == POOL_NO_SLOT)
+		{
+			AddSlab();
+		}
+		const uint32_t index = _freeHead;
+		Slot& slot = GetSlot(index);
+		new (&slot.storage) T(std::forward<Args>(args)...);
+		_freeHead = slot.nextFree;
+		slot.live = true;
+		_live++;
+		return Handle<T>(index, slot.generation);
+	}
+
+	/** Destroy an object and free its slot, any handles to it become stale
+	* @return false if the handle was already stale
+	*/
+	bool Destroy(Handle<T> handle)
+	{
+		if (!IsValid(handle))
+		{
+			return false;
+		}
+		Slot& slot = GetSlot(handle.index);
+		Object(slot)->~T();
+		slot.live = false;
+		slot.generation++;
+		slot.nextFree = _freeHead;
+		_freeHead = handle.index;
+		_live--;
+		return true;
+	}
+
+	/** The object a handle refers to, or NULL if the handle is stale
+	*/
+	T* Get(Handle<T> handle) const
+	{
+		return IsValid(handle) ? Object(GetSlot(handle.index)) : NULL;
+	}
+
+	bool IsValid(Handle<T> handle) const
+	{
+		if (handle.index >= Capacity())
+		{
+			return false;
+		}
+		const Slot& slot = GetSlot(handle.index);
+		return slot.live && slot.generation == handle.generation;
+	}
+
+	/** Grow the pool up front so that count objects can be made without allocating
+	*/
+	void Reserve(size_t count)
+	{
+		while ((size_t)Capacity() < count)
+		{
+			AddSlab();
+		}
+	}
+
+	/** Number of live objects
+	*/
+	size_t Size() const { return _live; }
+	/** Number of slots in every slab
+	*/
+	uint32_t Capacity() const { return (uint32_t)_slabs.size() * POOL_SLAB_OBJECTS; }
+
+private:
+
+	ObjectPool(const ObjectPool&);
+	ObjectPool& operator=(const ObjectPool&);
+
+	struct Slot
+	{
+		typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type storage;
+		uint32_t generation;
+		/** Next slot on the free list while this one is free
+		*/
+		uint32_t nextFree;
+		bool live;
+	};
+
+	Slot& GetSlot(uint32_t index) { return _slabs[index / POOL_SLAB_OBJECTS][index % POOL_SLAB_OBJECTS]; }
+	const Slot& GetSlot(uint32_t index) const { return _slabs[index / POOL_SLAB_OBJECTS][index % POOL_SLAB_OBJECTS]; }
+	static T* Object(const Slot& slot) { return static_cast<T*>(const_cast<void*>(static_cast<const void*>(&slot.storage))); }
+
+	/** Add a slab and put its slots on the free list, lowest first
+	*/
+	void AddSlab()
+	{
+		const uint32_t first = Capacity();
+		Slot* slab = new Slot[POOL_SLAB_OBJECTS];
+		for (uint32_t i = 0; i < POOL_SLAB_OBJECTS; i++)
+		{
+			slab[i].generation = 0;
+			slab[i].live = false;
+			slab[i].nextFree = i + 1 < POOL_SLAB_OBJECTS ? first + i + 1 : _freeHead;
+		}
+		_slabs.push_back(slab);
+		_freeHead = first;
+	}
+
+	std::vector<Slot*> _slabs;
+	uint32_t _freeHead;
+	size_t _live;
+};
+
+#endif //!_Pool_H_
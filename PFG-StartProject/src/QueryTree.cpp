@@ -0,0 +1,550 @@
+#include "QueryTree.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// Most spheres in a leaf of the hierarchy
+static const uint32_t QUERY_LEAF_SPHERES = 4;
+// Deepest traversal, the median split keeps the tree balanced so this covers billions of spheres
+static const int QUERY_STACK_SIZE = 64;
+// Packets of four casts handed to a thread at a time
+static const size_t QUERY_PACKET_GRAIN = 16;
+// Point queries handed to a thread at a time
+static const size_t QUERY_POINT_GRAIN = 64;
+
+/*! \brief Brief description.
+*  QueryTree builds a sphere hierarchy and casts packets of four rays or swept spheres through it.
+*
+*/
+QueryTree::QueryTree()
+{
+}
+
+void QueryTree::Build(const std::vector<float> position[3], const std::vector<float>& radius, const std::vector<uint32_t>& category, size_t count)
+{
+	_nodes.clear();
+	for (int k = 0; k < 3; k++)
+	{
+		_centre[k].resize(count);
+	}
+	_radius.resize(count);
+	_category.resize(count);
+	_body.resize(count);
+	if (count == 0)
+	{
+		return;
+	}
+
+	_order.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		_order[i] = (uint32_t)i;
+	}
+
+	// A binary tree with at least one sphere per leaf has at most 2n - 1 nodes
+	_nodes.reserve(count * 2);
+	Node root;
+	root.leftOrFirst = 0;
+	root.count = (uint32_t)count;
+	_nodes.push_back(root);
+	Subdivide(0, position, radius, _order);
+
+	// Store the spheres in leaf order so each leaf is a contiguous range
+	for (size_t i = 0; i < count; i++)
+	{
+		const uint32_t body = _order[i];
+		for (int k = 0; k < 3; k++)
+		{
+			_centre[k][i] = position[k][body];
+		}
+		_radius[i] = radius[body];
+		_category[i] = category.empty() ? 0xffffffffu : category[body];
+		_body[i] = body;
+	}
+}
+
+void QueryTree::Subdivide(uint32_t nodeIndex, const std::vector<float> position[3], const std::vector<float>& radius, std::vector<uint32_t>& order)
+{
+	uint32_t first = _nodes[nodeIndex].leftOrFirst;
+	uint32_t count = _nodes[nodeIndex].count;
+
+	// Fit the bounds around every sphere of the node, and the centres for choosing a split
+	glm::vec3 boundsMin = glm::vec3(FLT_MAX);
+	glm::vec3 boundsMax = glm::vec3(-FLT_MAX);
+	glm::vec3 centreMin = glm::vec3(FLT_MAX);
+	glm::vec3 centreMax = glm::vec3(-FLT_MAX);
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		const uint32_t body = order[i];
+		glm::vec3 centre(position[0][body], position[1][body], position[2][body]);
+		boundsMin = glm::min(boundsMin, centre - glm::vec3(radius[body]));
+		boundsMax = glm::max(boundsMax, centre + glm::vec3(radius[body]));
+		centreMin = glm::min(centreMin, centre);
+		centreMax = glm::max(centreMax, centre);
+	}
+
+	Node& node = _nodes[nodeIndex];
+	node.boundsMin[0] = boundsMin.x; node.boundsMin[1] = boundsMin.y; node.boundsMin[2] = boundsMin.z;
+	node.boundsMax[0] = boundsMax.x; node.boundsMax[1] = boundsMax.y; node.boundsMax[2] = boundsMax.z;
+
+	if (count <= QUERY_LEAF_SPHERES)
+	{
+		return;
+	}
+
+	// Split at the median centre along the longest axis
+	glm::vec3 extent = centreMax - centreMin;
+	int axis = 0;
+	if (extent.y > extent.x)
+	{
+		axis = 1;
+	}
+	if (extent.z > extent[axis])
+	{
+		axis = 2;
+	}
+	if (extent[axis] <= 0.0f)
+	{
+		// All centres in the same place, nothing to gain from splitting
+		return;
+	}
+
+	uint32_t leftCount = count / 2;
+	const std::vector<float>& key = position[axis];
+	std::nth_element(order.begin() + first, order.begin() + first + leftCount, order.begin() + first + count,
+		[&key](uint32_t a, uint32_t b) { return key[a] < key[b]; });
+
+	uint32_t childIndex = (uint32_t)_nodes.size();
+	Node child;
+	child.leftOrFirst = first;
+	child.count = leftCount;
+	_nodes.push_back(child);
+	child.leftOrFirst = first + leftCount;
+	child.count = count - leftCount;
+	_nodes.push_back(child);
+
+	// push_back may have moved the nodes
+	_nodes[nodeIndex].leftOrFirst = childIndex;
+	_nodes[nodeIndex].count = 0;
+
+	Subdivide(childIndex, position, radius, order);
+	Subdivide(childIndex + 1, position, radius, order);
+}
+
+void QueryTree::Cast(const std::vector<QueryCast>& casts, bool closestOnly, QueryResults& results, JobSystem& jobs) const
+{
+	results.hits.clear();
+	results.start.assign(casts.size() + 1, 0);
+	if (casts.empty() || _nodes.empty())
+	{
+		return;
+	}
+
+	// Each chunk of packets writes its own list, so the threads never share one
+	const size_t packets = (casts.size() + 3) / 4;
+	_chunkHits.resize((packets + QUERY_PACKET_GRAIN - 1) / QUERY_PACKET_GRAIN);
+	for (size_t c = 0; c < _chunkHits.size(); c++)
+	{
+		_chunkHits[c].clear();
+	}
+
+	jobs.ParallelFor(packets, QUERY_PACKET_GRAIN, [this, &casts, closestOnly](size_t begin, size_t end)
+	{
+		std::vector<QueryHit>& hits = _chunkHits[begin / QUERY_PACKET_GRAIN];
+		for (size_t packet = begin; packet < end; packet++)
+		{
+			CastPacket(casts, packet * 4, closestOnly, hits);
+		}
+	});
+
+	// The chunks cover the casts in order, so joining them keeps the hits in cast order
+	for (size_t c = 0; c < _chunkHits.size(); c++)
+	{
+		results.hits.insert(results.hits.end(), _chunkHits[c].begin(), _chunkHits[c].end());
+	}
+	for (size_t h = 0; h < results.hits.size(); h++)
+	{
+		results.start[results.hits[h].query + 1]++;
+	}
+	for (size_t q = 0; q < casts.size(); q++)
+	{
+		results.start[q + 1] += results.start[q];
+	}
+}
+
+void QueryTree::CastPacket(const std::vector<QueryCast>& casts, size_t first, bool closestOnly, std::vector<QueryHit>& hits) const
+{
+	const size_t lanes = std::min<size_t>(4, casts.size() - first);
+	const size_t packetStart = hits.size();
+
+	// The packet as four lanes, with unit directions. Lanes without a cast, or with no direction, never hit
+	float origin[3][4] = {};
+	float direction[3][4] = {};
+	float inverse[3][4] = {};
+	float reach[4] = {};
+	float radius[4] = {};
+	float active[4] = {};
+	for (size_t lane = 0; lane < lanes; lane++)
+	{
+		const QueryCast& cast = casts[first + lane];
+		float length = glm::length(cast.direction);
+		if (length <= 0.0f || cast.maxDistance < 0.0f)
+		{
+			continue;
+		}
+		glm::vec3 unit = cast.direction / length;
+		for (int k = 0; k < 3; k++)
+		{
+			origin[k][lane] = cast.origin[k];
+			direction[k][lane] = unit[k];
+			inverse[k][lane] = 1.0f / unit[k];
+		}
+		reach[lane] = cast.maxDistance;
+		radius[lane] = cast.radius;
+		active[lane] = 1.0f;
+	}
+
+	__m128 o[3], d[3], invD[3];
+	for (int k = 0; k < 3; k++)
+	{
+		o[k] = _mm_loadu_ps(origin[k]);
+		d[k] = _mm_loadu_ps(direction[k]);
+		invD[k] = _mm_loadu_ps(inverse[k]);
+	}
+	__m128 tMax = _mm_loadu_ps(reach);
+	const __m128 castRadius = _mm_loadu_ps(radius);
+	const __m128 live = _mm_cmpgt_ps(_mm_loadu_ps(active), _mm_setzero_ps());
+	const __m128 zero = _mm_setzero_ps();
+	if (_mm_movemask_ps(live) == 0)
+	{
+		return;
+	}
+
+	// Children are visited nearer first along the first live cast's longest axis
+	int lead = 0;
+	while (active[lead] == 0.0f)
+	{
+		lead++;
+	}
+	int axis = 0;
+	if (std::abs(direction[1][lead]) > std::abs(direction[axis][lead]))
+	{
+		axis = 1;
+	}
+	if (std::abs(direction[2][lead]) > std::abs(direction[axis][lead]))
+	{
+		axis = 2;
+	}
+	const bool positive = direction[axis][lead] >= 0.0f;
+
+	// Nearest hit of each lane so far, when only that is kept
+	QueryHit nearest[4];
+	bool found[4] = { false, false, false, false };
+
+	uint32_t stack[QUERY_STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const Node& node = _nodes[stack[--stackSize]];
+
+		// Slab test of the four casts against the box grown by each cast's radius
+		__m128 tNear = zero;
+		__m128 tFar = tMax;
+		for (int k = 0; k < 3; k++)
+		{
+			__m128 lower = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin[k]), castRadius), o[k]), invD[k]);
+			__m128 upper = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_set1_ps(node.boundsMax[k]), castRadius), o[k]), invD[k]);
+			tNear = _mm_max_ps(tNear, _mm_min_ps(lower, upper));
+			tFar = _mm_min_ps(tFar, _mm_max_ps(lower, upper));
+		}
+		if (_mm_movemask_ps(_mm_and_ps(live, _mm_cmple_ps(tNear, tFar))) == 0)
+		{
+			continue;
+		}
+
+		if (node.count == 0)
+		{
+			const Node& left = _nodes[node.leftOrFirst];
+			const Node& right = _nodes[node.leftOrFirst + 1];
+			bool leftFirst = (left.boundsMin[axis] + left.boundsMax[axis] < right.boundsMin[axis] + right.boundsMax[axis]) == positive;
+			stack[stackSize++] = leftFirst ? node.leftOrFirst + 1 : node.leftOrFirst;
+			stack[stackSize++] = leftFirst ? node.leftOrFirst : node.leftOrFirst + 1;
+			continue;
+		}
+
+		for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+		{
+			// |o + t d - c| = R, taking the first root, or t = 0 if the cast starts inside
+			const __m128 sum = _mm_add_ps(castRadius, _mm_set1_ps(_radius[i]));
+			__m128 oc[3];
+			for (int k = 0; k < 3; k++)
+			{
+				oc[k] = _mm_sub_ps(o[k], _mm_set1_ps(_centre[k][i]));
+			}
+			__m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(oc[0], d[0]), _mm_mul_ps(oc[1], d[1])), _mm_mul_ps(oc[2], d[2]));
+			__m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(oc[0], oc[0]), _mm_mul_ps(oc[1], oc[1])), _mm_mul_ps(oc[2], oc[2])), _mm_mul_ps(sum, sum));
+			__m128 discriminant = _mm_sub_ps(_mm_mul_ps(b, b), c);
+			__m128 inside = _mm_cmplt_ps(c, zero);
+			__m128 t = _mm_sub_ps(_mm_sub_ps(zero, b), _mm_sqrt_ps(_mm_max_ps(discriminant, zero)));
+			t = PFG::Select(inside, zero, t);
+
+			__m128 hit = _mm_and_ps(live, _mm_cmpge_ps(discriminant, zero));
+			hit = _mm_and_ps(hit, _mm_or_ps(inside, _mm_cmpge_ps(t, zero)));
+			hit = _mm_and_ps(hit, _mm_cmple_ps(t, tMax));
+			int mask = _mm_movemask_ps(hit);
+			if (mask == 0)
+			{
+				continue;
+			}
+
+			float distance[4];
+			_mm_storeu_ps(distance, t);
+			for (int lane = 0; lane < 4; lane++)
+			{
+				if ((mask & (1 << lane)) == 0 || (casts[first + lane].mask & _category[i]) == 0)
+				{
+					continue;
+				}
+
+				QueryHit result;
+				result.query = (uint32_t)(first + lane);
+				result.body = _body[i];
+				result.distance = distance[lane];
+				glm::vec3 centre(_centre[0][i], _centre[1][i], _centre[2][i]);
+				glm::vec3 unit(direction[0][lane], direction[1][lane], direction[2][lane]);
+				glm::vec3 swept = glm::vec3(origin[0][lane], origin[1][lane], origin[2][lane]) + unit * result.distance;
+				result.normal = swept - centre;
+				float length = glm::length(result.normal);
+				result.normal = length > 0.0f ? result.normal / length : -unit;
+				result.point = centre + result.normal * _radius[i];
+
+				if (closestOnly)
+				{
+					// Anything further along this cast can now be skipped
+					nearest[lane] = result;
+					found[lane] = true;
+					reach[lane] = result.distance;
+					tMax = _mm_loadu_ps(reach);
+				}
+				else
+				{
+					hits.push_back(result);
+				}
+			}
+		}
+	}
+
+	if (closestOnly)
+	{
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if (found[lane])
+			{
+				hits.push_back(nearest[lane]);
+			}
+		}
+		return;
+	}
+
+	// Every hit of the packet, by cast and then nearest first
+	std::sort(hits.begin() + packetStart, hits.end(), [](const QueryHit& a, const QueryHit& b)
+	{
+		return a.query != b.query ? a.query < b.query : a.distance < b.distance;
+	});
+}
+
+float QueryTree::BoxDistanceSquared(const Node& node, const glm::vec3& point) const
+{
+	float distance = 0.0f;
+	for (int k = 0; k < 3; k++)
+	{
+		float outside = std::max(std::max(node.boundsMin[k] - point[k], point[k] - node.boundsMax[k]), 0.0f);
+		distance += outside * outside;
+	}
+	return distance;
+}
+
+size_t QueryTree::FindNearest(const glm::vec3& point, size_t k, uint32_t mask, uint32_t* bodies, float* distances) const
+{
+	if (k == 0 || _nodes.empty())
+	{
+		return 0;
+	}
+
+	// The best so far are kept sorted in the caller's buffers, with squared distances until the end
+	size_t found = 0;
+	uint32_t stack[QUERY_STACK_SIZE];
+	float stackDistance[QUERY_STACK_SIZE];
+	int stackSize = 0;
+	stackDistance[stackSize] = 0.0f;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const uint32_t nodeIndex = stack[--stackSize];
+		const float nodeDistance = stackDistance[stackSize];
+		if (found == k && nodeDistance >= distances[k - 1])
+		{
+			// The bound has tightened since the node was pushed
+			continue;
+		}
+
+		const Node& node = _nodes[nodeIndex];
+		if (node.count == 0)
+		{
+			// Push the further child first so the nearer one is opened first and tightens the bound
+			uint32_t near = node.leftOrFirst;
+			uint32_t far = node.leftOrFirst + 1;
+			float nearDistance = BoxDistanceSquared(_nodes[near], point);
+			float farDistance = BoxDistanceSquared(_nodes[far], point);
+			if (farDistance < nearDistance)
+			{
+				std::swap(near, far);
+				std::swap(nearDistance, farDistance);
+			}
+			if (found < k || farDistance < distances[k - 1])
+			{
+				stackDistance[stackSize] = farDistance;
+				stack[stackSize++] = far;
+			}
+			if (found < k || nearDistance < distances[k - 1])
+			{
+				stackDistance[stackSize] = nearDistance;
+				stack[stackSize++] = near;
+			}
+			continue;
+		}
+
+		for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+		{
+			if ((_category[i] & mask) == 0)
+			{
+				continue;
+			}
+			glm::vec3 offset = glm::vec3(_centre[0][i], _centre[1][i], _centre[2][i]) - point;
+			float distance = glm::dot(offset, offset);
+			if (found == k && distance >= distances[k - 1])
+			{
+				continue;
+			}
+
+			// Insert in order, pushing the furthest out once the buffers are full
+			size_t slot = found < k ? found++ : k - 1;
+			while (slot > 0 && distances[slot - 1] > distance)
+			{
+				distances[slot] = distances[slot - 1];
+				bodies[slot] = bodies[slot - 1];
+				slot--;
+			}
+			distances[slot] = distance;
+			bodies[slot] = _body[i];
+		}
+	}
+
+	for (size_t j = 0; j < found; j++)
+	{
+		distances[j] = std::sqrt(distances[j]);
+	}
+	return found;
+}
+
+template <typename Overlaps>
+size_t QueryTree::FindOverlapping(const glm::vec3& lower, const glm::vec3& upper, uint32_t mask, const Overlaps& overlaps, uint32_t* bodies, size_t capacity) const
+{
+	if (_nodes.empty())
+	{
+		return 0;
+	}
+
+	size_t found = 0;
+	uint32_t stack[QUERY_STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const Node& node = _nodes[stack[--stackSize]];
+		if (node.boundsMin[0] > upper.x || node.boundsMax[0] < lower.x ||
+			node.boundsMin[1] > upper.y || node.boundsMax[1] < lower.y ||
+			node.boundsMin[2] > upper.z || node.boundsMax[2] < lower.z)
+		{
+			continue;
+		}
+
+		if (node.count == 0)
+		{
+			stack[stackSize++] = node.leftOrFirst + 1;
+			stack[stackSize++] = node.leftOrFirst;
+			continue;
+		}
+
+		for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+		{
+			if ((_category[i] & mask) == 0 || !overlaps(glm::vec3(_centre[0][i], _centre[1][i], _centre[2][i]), _radius[i]))
+			{
+				continue;
+			}
+			if (found < capacity)
+			{
+				bodies[found] = _body[i];
+			}
+			found++;
+		}
+	}
+	return found;
+}
+
+size_t QueryTree::FindInRadius(const glm::vec3& point, float radius, uint32_t mask, uint32_t* bodies, size_t capacity) const
+{
+	return FindOverlapping(point - glm::vec3(radius), point + glm::vec3(radius), mask, [&point, radius](const glm::vec3& centre, float sphereRadius)
+	{
+		glm::vec3 offset = centre - point;
+		float reach = radius + sphereRadius;
+		return glm::dot(offset, offset) <= reach * reach;
+	}, bodies, capacity);
+}
+
+size_t QueryTree::FindInBox(const glm::vec3& lower, const glm::vec3& upper, uint32_t mask, uint32_t* bodies, size_t capacity) const
+{
+	return FindOverlapping(lower, upper, mask, [&lower, &upper](const glm::vec3& centre, float sphereRadius)
+	{
+		glm::vec3 offset = centre - glm::clamp(centre, lower, upper);
+		return glm::dot(offset, offset) <= sphereRadius * sphereRadius;
+	}, bodies, capacity);
+}
+
+void QueryTree::FindNearest(const std::vector<glm::vec3>& points, size_t k, uint32_t mask, uint32_t* bodies, float* distances, uint32_t* counts, JobSystem& jobs) const
+{
+	jobs.ParallelFor(points.size(), QUERY_POINT_GRAIN, [this, &points, k, mask, bodies, distances, counts](size_t begin, size_t end)
+	{
+		for (size_t q = begin; q < end; q++)
+		{
+			counts[q] = (uint32_t)FindNearest(points[q], k, mask, bodies + q * k, distances + q * k);
+		}
+	});
+}
+
+void QueryTree::FindInRadius(const std::vector<glm::vec3>& points, float radius, uint32_t mask, uint32_t* bodies, size_t capacity, uint32_t* counts, JobSystem& jobs) const
+{
+	jobs.ParallelFor(points.size(), QUERY_POINT_GRAIN, [this, &points, radius, mask, bodies, capacity, counts](size_t begin, size_t end)
+	{
+		for (size_t q = begin; q < end; q++)
+		{
+			counts[q] = (uint32_t)FindInRadius(points[q], radius, mask, bodies + q * capacity, capacity);
+		}
+	});
+}
+
+void QueryTree::FindInBox(const std::vector<glm::vec3>& lower, const std::vector<glm::vec3>& upper, uint32_t mask, uint32_t* bodies, size_t capacity, uint32_t* counts, JobSystem& jobs) const
+{
+	jobs.ParallelFor(lower.size(), QUERY_POINT_GRAIN, [this, &lower, &upper, mask, bodies, capacity, counts](size_t begin, size_t end)
+	{
+		for (size_t q = begin; q < end; q++)
+		{
+			counts[q] = (uint32_t)FindInBox(lower[q], upper[q], mask, bodies + q * capacity, capacity);
+		}
+	});
+}
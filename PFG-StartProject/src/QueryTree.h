@@ -0,0 +1,165 @@
+#ifndef _QueryTree_H_
+#define _QueryTree_H_
+
+#include "JobSystem.h"
+#include <glm/glm.hpp>
+#include <vector>
+#include <stdint.h>
+
+/*! \brief Brief description.
+*  A ray, or a sphere swept along a ray, to cast into a QueryTree. A ray is a sphere cast with no radius
+*
+*/
+struct QueryCast
+{
+	QueryCast() : origin(0.0f), direction(0.0f, -1.0f, 0.0f), maxDistance(1.0e30f), radius(0.0f), mask(0xffffffffu) {}
+	QueryCast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float radius = 0.0f)
+		: origin(origin), direction(direction), maxDistance(maxDistance), radius(radius), mask(0xffffffffu) {}
+
+	glm::vec3 origin;
+	glm::vec3 direction; /*!< Doesn't need to be unit length, distances are along the unit direction */
+	float maxDistance;
+	float radius; /*!< Zero for a ray */
+	uint32_t mask; /*!< Bodies whose category has none of these bits are passed through */
+};
+
+/*! \brief Brief description.
+*  A body hit by a QueryCast
+*
+*/
+struct QueryHit
+{
+	uint32_t query; /*!< Index of the cast */
+	uint32_t body; /*!< Index of the body in the arrays the tree was built from */
+	float distance; /*!< How far along the cast it first touches the body */
+	glm::vec3 point; /*!< Where it touches, on the body's surface */
+	glm::vec3 normal; /*!< Body's surface normal there */
+};
+
+/*! \brief Brief description.
+*  Hits of a batch of casts, the hits of cast q are hits[start[q]] up to hits[start[q + 1]], nearest first
+*
+*/
+struct QueryResults
+{
+	std::vector<QueryHit> hits;
+	std::vector<uint32_t> start;
+};
+
+/*! \brief Brief description.
+*  QueryTree answers ray casts and sphere casts against a set of spheres, for picking, line of sight and sensing.
+*  The spheres are put in a bounding volume hierarchy with the same 32 byte nodes and median split as
+*  CollisionMesh, and kept in leaf order as flat arrays.
+*
+*  Casts are traversed four at a time as a packet: each node's box is tested against all four with SSE and the
+*  node is opened if any of them hit it, so casts that start near each other and point the same way, like the
+*  pixels of a pick or the rays of a sensor fan, share most of their node visits. The leaves test their spheres
+*  against the four casts together as well. A batch is split into chunks of packets over the job system's threads.
+*
+*  Casts can stop at the nearest hit, which also lets the traversal skip anything further, or collect every hit
+*  along their length sorted by distance.
+*
+*  The same hierarchy answers point queries: the k nearest spheres, found depth first with nearer children first
+*  and skipping any node further than the k-th best so far, and the spheres overlapping a ball or a box. Each
+*  writes into buffers the caller owns, and batches of them are split over the threads the same way as casts.
+*
+*/
+class QueryTree
+{
+public:
+
+	/** QueryTree constructor
+	*/
+	QueryTree();
+
+	/** Build the hierarchy over a set of spheres
+	* @param position x, y and z of each centre
+	* @param std::vector<float> radius of each sphere
+	* @param std::vector<uint32_t> category collision category bits of each sphere, or empty for every bit
+	* @param size_t count number of spheres, the arrays can be longer
+	*/
+	void Build(const std::vector<float> position[3], const std::vector<float>& radius, const std::vector<uint32_t>& category, size_t count);
+
+	/** Cast a batch of rays and swept spheres
+	* @param std::vector<QueryCast> casts the casts
+	* @param bool closestOnly true to keep only the nearest hit of each cast
+	* @param QueryResults results output, replaced
+	* @param JobSystem jobs the packets are split over its threads
+	*/
+	void Cast(const std::vector<QueryCast>& casts, bool closestOnly, QueryResults& results, JobSystem& jobs) const;
+
+	/** The spheres whose centres are nearest a point, nearest first
+	* @param size_t k how many to find
+	* @param uint32_t mask spheres whose category has none of these bits are skipped
+	* @param uint32_t bodies output, room for k
+	* @param float distances output, room for k, from the point to each centre
+	* @return how many were found, fewer than k only if fewer spheres pass the mask
+	*/
+	size_t FindNearest(const glm::vec3& point, size_t k, uint32_t mask, uint32_t* bodies, float* distances) const;
+	/** The spheres that overlap a ball, in no particular order
+	* @param uint32_t bodies output, room for capacity
+	* @return how many overlap it, only the first capacity are written if there are more
+	*/
+	size_t FindInRadius(const glm::vec3& point, float radius, uint32_t mask, uint32_t* bodies, size_t capacity) const;
+	/** The spheres that overlap an axis aligned box, in no particular order
+	* @param uint32_t bodies output, room for capacity
+	* @return how many overlap it, only the first capacity are written if there are more
+	*/
+	size_t FindInBox(const glm::vec3& lower, const glm::vec3& upper, uint32_t mask, uint32_t* bodies, size_t capacity) const;
+
+	/** Batches of the queries above, split over the job system's threads. The results go straight into the caller's
+	* buffers, query q writes its bodies and distances from q * k or q * capacity on, and how many it found to counts[q]
+	*/
+	void FindNearest(const std::vector<glm::vec3>& points, size_t k, uint32_t mask, uint32_t* bodies, float* distances, uint32_t* counts, JobSystem& jobs) const;
+	void FindInRadius(const std::vector<glm::vec3>& points, float radius, uint32_t mask, uint32_t* bodies, size_t capacity, uint32_t* counts, JobSystem& jobs) const;
+	void FindInBox(const std::vector<glm::vec3>& lower, const std::vector<glm::vec3>& upper, uint32_t mask, uint32_t* bodies, size_t capacity, uint32_t* counts, JobSystem& jobs) const;
+
+	/** Number of spheres built into the tree
+	*/
+	size_t Size() const { return _body.size(); }
+
+private:
+
+	/** A node of the bounding volume hierarchy, packed into 32 bytes
+	* Interior nodes have count 0 and their children at leftOrFirst and leftOrFirst + 1.
+	* Leaf nodes hold count spheres starting at leftOrFirst in the leaf order.
+	*/
+	struct Node
+	{
+		float boundsMin[3];
+		uint32_t leftOrFirst;
+		float boundsMax[3];
+		uint32_t count;
+	};
+
+	/** Fit a node's bounds around its spheres and split it if there are too many
+	*/
+	void Subdivide(uint32_t nodeIndex, const std::vector<float> position[3], const std::vector<float>& radius, std::vector<uint32_t>& order);
+	/** Cast up to four casts starting at first, appending their hits to hits in cast order
+	*/
+	void CastPacket(const std::vector<QueryCast>& casts, size_t first, bool closestOnly, std::vector<QueryHit>& hits) const;
+	/** Squared distance from a point to a node's box, zero inside it
+	*/
+	float BoxDistanceSquared(const Node& node, const glm::vec3& point) const;
+	/** Walk the nodes whose boxes overlap a box, writing the spheres that pass overlaps
+	*/
+	template <typename Overlaps>
+	size_t FindOverlapping(const glm::vec3& lower, const glm::vec3& upper, uint32_t mask, const Overlaps& overlaps, uint32_t* bodies, size_t capacity) const;
+
+	std::vector<Node> _nodes;
+	/** Spheres in leaf order, with the index each one had in the arrays handed to Build
+	*/
+	std::vector<float> _centre[3];
+	std::vector<float> _radius;
+	std::vector<uint32_t> _category;
+	std::vector<uint32_t> _body;
+	/** Scratch order of the spheres while building, kept so rebuilding each step doesn't allocate
+	*/
+	std::vector<uint32_t> _order;
+
+	/** Hits of each chunk of a batch, joined in chunk order at the end
+	*/
+	mutable std::vector<std::vector<QueryHit> > _chunkHits;
+};
+
+#endif //!_QueryTree_H_
@@ -1,13 +1,25 @@
 #include "Scene.h"
+#include "Utility.h"
+#include "CollisionDispatch.h"
+#include "Benchmark.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
 
+// A sphere that moves further than this fraction of its radius in one step is swept for continuous collision
+static const float CCD_MOTION_FRACTION = 0.5f;
+// Impacts the continuous collision pass resolves in a step, per dynamic object, before leaving the rest to the next step
+static const size_t CCD_MAX_IMPACTS_PER_OBJECT = 4;
+// Spheres and planes closer than this, after allowing for how far they move in a step, are handed to the constraint solver
+static const float SOLVER_CONTACT_MARGIN = 0.05f;
 
 /*! \brief Brief description.
 *  Scene class is a container for loading all the game objects in your simulation or your game.
 *
 */
-Scene::Scene()
+Scene::Scene(std::string fileName)
 {
-	getFileCode("Input.txt");
+	getFileCode(fileName);
 
 	for (size_t i = 0; i < _fileCode.size(); i++)
 	{
@@ -24,141 +36,1215 @@ Scene::Scene()
 	_lightPosition = glm::vec3(10, 10, 0);
 
 	// Create the material for the planes
-	Material* modelMaterial = new Material();
+	Material* modelMaterial = _materialPool.Get(_materialPool.Create());
 	modelMaterial->LoadShaders("assets/shaders/VertShader.txt", "assets/shaders/FragShader.txt");
 	modelMaterial->SetDiffuseColour(glm::vec3(0.8, 0.8, 0.8));
 	modelMaterial->SetTexture("assets/textures/diffuse.bmp");
 	modelMaterial->SetLightPosition(_lightPosition);
 
 	// Load Mesh of planes
-	Mesh* groundMesh = new Mesh();
+	Mesh* groundMesh = _meshPool.Get(_meshPool.Create());
 	groundMesh->LoadOBJ("assets/models/woodfloor.obj");
 
 	// Create the material for the spheres
-	Material* objectMaterial = new Material();
+	Material* objectMaterial = _materialPool.Get(_materialPool.Create());
 	objectMaterial->LoadShaders("assets/shaders/VertShader.txt", "assets/shaders/FragShader.txt");
 	objectMaterial->SetDiffuseColour(glm::vec3(0.8, 0.1, 0.1));
 	objectMaterial->SetTexture("assets/textures/default.bmp");
 	objectMaterial->SetLightPosition(_lightPosition);
 
 	// Load Mesh of spheres
-	Mesh* modelMesh = new Mesh();
+	Mesh* modelMesh = _meshPool.Get(_meshPool.Create());
 	modelMesh->LoadOBJ("assets/models/sphere.obj");
 
 	// Initialise the amount of objects that will be loaded (read in via file)
 	int spheres = std::stoi(_fileCode.at(0));
 	int planes = 1;
 
-	// For loop to spawn amount of spheres
-	for (int i = 0; i < spheres; i++)
+	// Integrator for the whole scene, the spheres read in from the file can use a different one
+	IntegratorType sceneIntegrator = INTEGRATOR_RUNGE_KUTTA4;
+	std::string integratorName = GetSetting("integrator", PFG::GetIntegratorName(sceneIntegrator));
+	if (!PFG::ParseIntegrator(integratorName, sceneIntegrator))
 	{
-		DynamicObject* newObj = CreateSphere(1, objectMaterial, modelMesh, glm::vec3(0.0f + i, 20.0f, 0.0f), glm::vec3(std::stof(_fileCode.at(2)), std::stof(_fileCode.at(2)), std::stof(_fileCode.at(2))), std::stof(_fileCode.at(1)), std::stof(_fileCode.at(2)));
+		std::cout << "Unknown integrator " << integratorName << ", using " << PFG::GetIntegratorName(sceneIntegrator) << "\n";
+	}
+
+	IntegratorType sphereIntegrator = sceneIntegrator;
+	integratorName = GetSetting("sphereIntegrator", PFG::GetIntegratorName(sceneIntegrator));
+	if (!PFG::ParseIntegrator(integratorName, sphereIntegrator))
+	{
+		std::cout << "Unknown integrator " << integratorName << ", using " << PFG::GetIntegratorName(sphereIntegrator) << "\n";
+	}
+
+	// Event-driven mode for sparse ballistic scenes, or position based dynamics in place of forces and impulses
+	std::string mode = GetSetting("mode", "timeStepped");
+	_eventDriven = mode == "eventDriven";
+	_eventWorldStarted = false;
+	_queryTreeStale = true;
+	_xpbd = mode == "xpbd";
+	_xpbdWorld.SetSubSteps(std::stoi(GetSetting("xpbdSubSteps", "20")));
+	_xpbdWorld.SetContactCompliance(std::stof(GetSetting("xpbdCompliance", "0")));
+	// Same restitution and friction as the impulse response
+	_xpbdWorld.SetRestitution(0.5f);
+	_xpbdWorld.SetFriction(0.5f, 0.5f);
+
+	// Threads for the parallel parts of the step, 0 uses every hardware thread
+	_jobs = new JobSystem(std::stoi(GetSetting("threads", "0")));
+
+	// Mutual gravity for self-gravitating clouds, computed with a Barnes-Hut tree
+	_mutualGravity = GetSetting("gravity", "uniform") == "mutual";
+	_gravityTree.SetGravitationalConstant(std::stof(GetSetting("gravityConstant", "1.0")));
+	_gravityTree.SetOpeningAngle(std::stof(GetSetting("openingAngle", "0.5")));
+	_gravityTree.SetSoftening(std::stof(GetSetting("softening", "0.05")));
+	_gravityTree.SetQuadrupole(GetSetting("multipole", "monopole") == "quadrupole");
+
+	// Extra forces, one 'force' line each
+	std::vector<std::string> forces = GetSettings("force");
+	for (size_t i = 0; i < forces.size(); i++)
+	{
+		// In XPBD mode a spring is a distance constraint with the inverse of its stiffness as compliance
+		std::istringstream spring(forces[i]);
+		std::string kind;
+		size_t a = 0, b = 0;
+		float stiffness = 0.0f, damping = 0.0f, restLength = 0.0f;
+		if (_xpbd && spring >> kind >> a >> b >> stiffness >> damping >> restLength && kind == "spring" && stiffness > 0.0f)
+		{
+			_xpbdWorld.AddDistance(a, b, restLength, 1.0f / stiffness);
+			continue;
+		}
+
+		ForceGenerator* generator = PFG::ParseForceGenerator(forces[i]);
+		if (generator == NULL)
+		{
+			std::cout << "Can't read force " << forces[i] << "\n";
+			continue;
+		}
+		_forceRegistry.Add(generator);
+	}
+
+	// Benchmarks asked for by the scene file
+	std::string benchmark = GetSetting("benchmark", "");
+	if (benchmark == "integrators")
+	{
+		std::ofstream csv("integrator_benchmark.csv");
+		PFG::BenchmarkIntegrators(10000, 1000, csv);
+		std::cout << "Integrator benchmark written to integrator_benchmark.csv\n";
+	}
+	else if (benchmark == "workPrecision")
+	{
+		std::ofstream csv("work_precision.csv");
+		std::ofstream json("work_precision.json");
+		PFG::BenchmarkWorkPrecision(csv, json);
+		std::cout << "Work-precision benchmark written to work_precision.csv and work_precision.json\n";
+	}
+	else if (benchmark == "gravity")
+	{
+		std::ofstream csv("gravity_benchmark.csv");
+		PFG::BenchmarkGravity(*_jobs, csv);
+		std::cout << "Gravity benchmark written to gravity_benchmark.csv\n";
+	}
+	else if (benchmark == "particles")
+	{
+		std::ofstream csv("particle_benchmark.csv");
+		PFG::BenchmarkParticles(*_jobs, csv);
+		std::cout << "Particle benchmark written to particle_benchmark.csv\n";
+	}
+	else if (benchmark == "fluid")
+	{
+		std::ofstream csv("fluid_benchmark.csv");
+		PFG::BenchmarkDamBreak(*_jobs, csv);
+		std::cout << "Fluid benchmark written to fluid_benchmark.csv\n";
+	}
+	else if (benchmark == "queries")
+	{
+		std::ofstream csv("query_benchmark.csv");
+		PFG::BenchmarkQueries(*_jobs, csv);
+		std::cout << "Query benchmark written to query_benchmark.csv\n";
+	}
+
+	// Particles stacked in a block above the floor, 'particles <count> <mass> <radius>'
+	_particleMesh = modelMesh;
+	_particleMaterial = objectMaterial;
+	_particles.SetGravity(glm::vec3(0.0f, -9.8f * 0.1f, 0.0f));
+	_particles.SetRestitution(0.5f);
+	std::vector<std::string> particleSettings = GetSettings("particles");
+	std::istringstream particleSetting(particleSettings.empty() ? "" : particleSettings.front());
+	int particleCount = 0;
+	float particleMass = 0.0f;
+	float particleRadius = 0.0f;
+	if (particleSetting >> particleCount >> particleMass >> particleRadius)
+	{
+		int side = (int)std::ceil(std::cbrt((float)particleCount));
+		float spacing = 3.0f * particleRadius;
+		for (int i = 0; i < particleCount; i++)
+		{
+			glm::vec3 cell((float)(i % side), (float)(i / (side * side)), (float)((i / side) % side));
+			glm::vec3 position = glm::vec3(-0.5f * side * spacing, 12.0f, -0.5f * side * spacing) + cell * spacing;
+			_particles.Add(position, glm::vec3(0.0f, 0.0f, 0.0f), particleMass, particleRadius);
+		}
+	}
+
+	// A block of liquid on the floor, 'fluid <nx> <ny> <nz> <spacing>'
+	_fluidMaterial = NULL;
+	std::vector<std::string> fluidSettings = GetSettings("fluid");
+	std::istringstream fluidSetting(fluidSettings.empty() ? "" : fluidSettings.front());
+	int fluidX = 0, fluidY = 0, fluidZ = 0;
+	float fluidSpacing = 0.0f;
+	if (fluidSetting >> fluidX >> fluidY >> fluidZ >> fluidSpacing)
+	{
+		_fluidMaterial = _materialPool.Get(_materialPool.Create());
+		_fluidMaterial->LoadShaders("assets/shaders/VertShader.txt", "assets/shaders/FragShader.txt");
+		_fluidMaterial->SetDiffuseColour(glm::vec3(0.1, 0.3, 0.9));
+		_fluidMaterial->SetTexture("assets/textures/default.bmp");
+		_fluidMaterial->SetLightPosition(_lightPosition);
+
+		// By default the speed of sound is ten times the speed of water falling the height of the block
+		float height = fluidY * fluidSpacing;
+		_fluid.SetParticleSpacing(fluidSpacing);
+		_fluid.SetRestDensity(std::stof(GetSetting("fluidRestDensity", "1000")));
+		_fluid.SetSoundSpeed(std::stof(GetSetting("fluidSoundSpeed", std::to_string(10.0f * std::sqrt(2.0f * 0.98f * height)))));
+		_fluid.SetViscosity(std::stof(GetSetting("fluidViscosity", "0.1")));
+		_fluid.SetGravity(glm::vec3(0.0f, -9.8f * 0.1f, 0.0f));
+		_fluid.AddBlock(glm::vec3(-0.5f * fluidX * fluidSpacing, 10.0f, -0.5f * fluidZ * fluidSpacing), fluidX, fluidY, fluidZ);
+	}
+
+	// Cloth hanging from two corners, 'cloth <nu> <nv> <size> <mass> <stiffness>', and soft blocks dropped on the
+	// floor, 'softBody <n> <size> <mass> <stiffness>'. Spring damping is 'springDamping' times the stiffness
+	_softBody.SetGravity(glm::vec3(0.0f, -9.8f * 0.1f, 0.0f));
+	_softBody.SetThickness(0.1f);
+	float springDamping = std::stof(GetSetting("springDamping", "0.01"));
+	std::vector<std::string> clothSettings = GetSettings("cloth");
+	for (size_t c = 0; c < clothSettings.size(); c++)
+	{
+		std::istringstream clothSetting(clothSettings[c]);
+		int nu = 0, nv = 0;
+		float size = 0.0f, mass = 0.0f, stiffness = 0.0f;
+		if (clothSetting >> nu >> nv >> size >> mass >> stiffness && nu > 1 && nv > 1)
+		{
+			size_t first = _softBody.AddCloth(glm::vec3(-0.5f * size, 16.0f, -4.0f), glm::vec3(size, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, size), nu, nv, mass, stiffness, springDamping * stiffness);
+			_softBody.Pin(first);
+			_softBody.Pin(first + nu - 1);
+		}
+	}
+	std::vector<std::string> softBodySettings = GetSettings("softBody");
+	for (size_t b = 0; b < softBodySettings.size(); b++)
+	{
+		std::istringstream softBodySetting(softBodySettings[b]);
+		int n = 0;
+		float size = 0.0f, mass = 0.0f, stiffness = 0.0f;
+		if (softBodySetting >> n >> size >> mass >> stiffness && n > 1)
+		{
+			_softBody.AddBlock(glm::vec3(4.0f + 2.0f * size * b, 12.0f, -0.5f * size), size / (n - 1), n, n, n, mass, stiffness, springDamping * stiffness);
+		}
+	}
+
+	// Spawn the spheres from the file in a row along x, as one batch
+	SphereSpawn fileSphere;
+	fileSphere.mass = std::stof(_fileCode.at(1));
+	fileSphere.radius = std::stof(_fileCode.at(2));
+	fileSphere.integrator = sphereIntegrator;
+	fileSphere.uniformGravity = !_mutualGravity;
+	fileSphere.material = objectMaterial;
+	fileSphere.mesh = modelMesh;
+	_spawnPositions.clear();
+	PFG::LatticePattern(glm::vec3(0.0f, 20.0f, 0.0f), glm::vec3(1.0f), spheres, 1, 1, _spawnPositions);
+	_spawnVelocities.clear();
+	SpawnSpheres(fileSphere, _spawnPositions, _spawnVelocities, NULL);
+	// For loop to spawn amount of planes
+	for (int i = 0; i < planes; i++)
+	{
+		CreatePlane(SHAPE_PLANE, modelMaterial, groundMesh, glm::vec3(0.0f + i * 10, 10.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(2.0f, 2.0f, 2.0f));
+	}
+
+	// test object to spawn above the others to simulate a ball dropping on another
+	DynamicObject* newObj = CreateSphere(SHAPE_SPHERE, objectMaterial, modelMesh, glm::vec3(0.2f, 25.0f, 0.0f), glm::vec3(0.3f, 0.3f, 0.3f), 2.0f, 0.3f);
+	newObj->SetIntegrator(sceneIntegrator);
+	newObj->SetUniformGravity(!_mutualGravity);
+
+	// More blocks of the file's spheres, one 'spawn' line each, see PFG::ParseSpawnPattern
+	std::vector<std::string> spawns = GetSettings("spawn");
+	for (size_t i = 0; i < spawns.size(); i++)
+	{
+		_spawnPositions.clear();
+		if (!PFG::ParseSpawnPattern(spawns[i], _spawnPositions))
+		{
+			std::cout << "Can't read spawn " << spawns[i] << "\n";
+			continue;
+		}
+		SpawnSpheres(fileSphere, _spawnPositions, _spawnVelocities, NULL);
+	}
+
+	// Streams of the file's spheres, 'emitter <x> <y> <z> <vx> <vy> <vz> <rate> <lifetime> [spread]' with the rate
+	// in spheres per second, each sphere is removed again after lifetime seconds
+	_emitterSphere = fileSphere;
+	std::vector<std::string> emitters = GetSettings("emitter");
+	for (size_t i = 0; i < emitters.size(); i++)
+	{
+		std::istringstream emitterSetting(emitters[i]);
+		glm::vec3 position, velocity;
+		float rate = 0.0f, lifetime = 0.0f, spread = 0.0f;
+		if (!(emitterSetting >> position.x >> position.y >> position.z >> velocity.x >> velocity.y >> velocity.z >> rate >> lifetime) || rate <= 0.0f)
+		{
+			std::cout << "Can't read emitter " << emitters[i] << "\n";
+			continue;
+		}
+		emitterSetting >> spread;
+		_emitters.push_back(SphereEmitter(position, velocity, rate, lifetime, spread, (unsigned)i + 1));
+	}
+
+	// Scripted spheres, 'kinematic <x> <y> <z> <radius> <vx> <vy> <vz> [period]'. With a period they go out along
+	// the velocity and come back, like a moving platform
+	std::vector<std::string> kinematics = GetSettings("kinematic");
+	for (size_t i = 0; i < kinematics.size(); i++)
+	{
+		std::istringstream kinematicSetting(kinematics[i]);
+		glm::vec3 position, velocity;
+		float radius = 0.0f, period = 0.0f;
+		if (!(kinematicSetting >> position.x >> position.y >> position.z >> radius >> velocity.x >> velocity.y >> velocity.z) || radius <= 0.0f)
+		{
+			std::cout << "Can't read kinematic " << kinematics[i] << "\n";
+			continue;
+		}
+		kinematicSetting >> period;
+		KinematicsObject* kinematic = CreateKinematicSphere(modelMaterial, modelMesh, position, radius);
+		kinematic->SetPath(velocity, period);
+	}
+
+	// Trigger volumes, one 'sensor' line each
+	std::vector<std::string> sensors = GetSettings("sensor");
+	for (size_t i = 0; i < sensors.size(); i++)
+	{
+		if (!PFG::ParseSensor(sensors[i], _sensors))
+		{
+			std::cout << "Can't read sensor " << sensors[i] << "\n";
+		}
+	}
+
+	// Joints between the spheres, one 'joint' line each. Any joint puts the contacts through the same solver
+	std::vector<glm::vec3> startPositions;
+	for (size_t j = 0; j < _sceneDynamicObjects.size(); j++)
+	{
+		startPositions.push_back(_sceneDynamicObjects.at(j)->GetPosition());
+	}
+	std::vector<std::string> joints = GetSettings("joint");
+	for (size_t i = 0; i < joints.size(); i++)
+	{
+		if (!PFG::ParseJoint(joints[i], startPositions, _constraintSolver))
+		{
+			std::cout << "Can't read joint " << joints[i] << "\n";
+		}
+	}
+	_constraintSolver.SetIterations(std::stoi(GetSetting("solverIterations", "10")));
+
+	// Collision filters, 'filter <object> <category> <mask> [group]' where the object is a sphere's index, 'all'
+	// for every sphere or 'planes'. Masks can be written in hex
+	std::vector<std::string> filters = GetSettings("filter");
+	for (size_t i = 0; i < filters.size(); i++)
+	{
+		std::istringstream filterSetting(filters[i]);
+		std::string object, category, mask;
+		int32_t group = 0;
+		if (!(filterSetting >> object >> category >> mask))
+		{
+			std::cout << "Can't read filter " << filters[i] << "\n";
+			continue;
+		}
+		filterSetting >> group;
+		CollisionFilter filter((uint32_t)std::stoul(category, NULL, 0), (uint32_t)std::stoul(mask, NULL, 0), group);
+
+		if (object == "planes")
+		{
+			for (size_t j = 0; j < _sceneGameObjects.size(); j++)
+			{
+				_sceneGameObjects.at(j)->SetCollisionFilter(filter);
+			}
+		}
+		else if (object == "all")
+		{
+			for (size_t j = 0; j < _sceneDynamicObjects.size(); j++)
+			{
+				_sceneDynamicObjects.at(j)->SetCollisionFilter(filter);
+			}
+		}
+		else if (std::stoul(object) < _sceneDynamicObjects.size())
+		{
+			_sceneDynamicObjects.at(std::stoul(object))->SetCollisionFilter(filter);
+		}
+	}
+	_rowSolver = _constraintSolver.GetJointCount() > 0 || GetSetting("solver", "impulses") == "rows";
+}
+
+Scene::~Scene()
+{
+	// You should neatly clean everything up here, the objects, materials and meshes go with their pools
+	delete _camera;
+	delete _jobs;
+}
+
+void Scene::Update(float deltaTs, Input* input)
+{
+
+
+	// Update the game object (this is currently hard-coded motion)
+	if (input->cmd_x)
+	{
+		_simulation_start = true;
+	}
+	if (_simulation_start == true)
+	{
+		EmitSpheres(deltaTs);
+
+		for (int i = 0; i < _sceneDynamicObjects.size(); i++)
+		{
+			_sceneDynamicObjects.at(i)->StartSimulation(_simulation_start);
+		}
+		for (size_t i = 0; i < _sceneKinematicObjects.size(); i++)
+		{
+			_sceneKinematicObjects.at(i)->StartSimulation(_simulation_start);
+		}
+	}
+
+	for (size_t i = 0; i < _sceneGameObjects.size(); i++)
+	{
+		_sceneGameObjects.at(i)->Update(deltaTs);
+	}
+
+	StepPhysics(deltaTs);
+
+	// Update camera
+	_camera->Update(input);
+
+	// Update matrices
+	_viewMatrix = _camera->GetView();
+	_projMatrix = _camera->GetProj();
+														
+}
+
+void Scene::Draw()
+{
+	// Draw objects, giving the camera's position and projection
+
+	for (int i = 0; i < _sceneDynamicObjects.size(); i++)
+	{
+		_sceneDynamicObjects.at(i)->Draw(_viewMatrix, _projMatrix);
+	}
+
+	for (size_t i = 0; i < _sceneKinematicObjects.size(); i++)
+	{
+		_sceneKinematicObjects.at(i)->Draw(_viewMatrix, _projMatrix);
+	}
+
+	for each (GameObject* obj in _sceneGameObjects)
+	{
+		obj->Draw(_viewMatrix, _projMatrix);
+	}
+
+	// Particles have no game object, build their matrices here and draw the sphere mesh at each one
+	if (_particles.Size() > 0)
+	{
+		_particleTransforms.Clear();
+		for (size_t i = 0; i < _particles.Size(); i++)
+		{
+			_particleTransforms.Add(_particles.GetPosition(i), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(_particles.GetRadius(i)));
+		}
+		PFG::ComposeTransforms(_particleTransforms);
+
+		for (size_t i = 0; i < _particleTransforms.Size(); i++)
+		{
+			_particleMaterial->SetMatrices(_particleTransforms.model[i], _particleTransforms.invModel[i], _viewMatrix, _projMatrix);
+			_particleMaterial->Apply();
+			_particleMesh->Draw();
+		}
+	}
+
+	if (_fluid.Size() > 0)
+	{
+		const ParticleSystem& fluid = _fluid.GetParticles();
+		_fluidTransforms.Clear();
+		for (size_t i = 0; i < fluid.Size(); i++)
+		{
+			_fluidTransforms.Add(fluid.GetPosition(i), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(fluid.GetRadius(i)));
+		}
+		PFG::ComposeTransforms(_fluidTransforms);
+
+		for (size_t i = 0; i < _fluidTransforms.Size(); i++)
+		{
+			_fluidMaterial->SetMatrices(_fluidTransforms.model[i], _fluidTransforms.invModel[i], _viewMatrix, _projMatrix);
+			_fluidMaterial->Apply();
+			_particleMesh->Draw();
+		}
+	}
+
+	if (_softBody.GetNodeCount() > 0)
+	{
+		_softBodyTransforms.Clear();
+		for (size_t i = 0; i < _softBody.GetNodeCount(); i++)
+		{
+			_softBodyTransforms.Add(_softBody.GetPosition(i), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(_softBody.GetThickness()));
+		}
+		PFG::ComposeTransforms(_softBodyTransforms);
+
+		for (size_t i = 0; i < _softBodyTransforms.Size(); i++)
+		{
+			_particleMaterial->SetMatrices(_softBodyTransforms.model[i], _softBodyTransforms.invModel[i], _viewMatrix, _projMatrix);
+			_particleMaterial->Apply();
+			_particleMesh->Draw();
+		}
+	}
+
+}
+
+
+void Scene::StepPhysics(float deltaTs)
+{
+	_ccdSubStepped.assign(_sceneDynamicObjects.size(), false);
+	_contactPredicted.assign(_sceneDynamicObjects.size(), false);
+	_queryTreeStale = true;
+	_frameArena.Reset();
+
+	// The kinematic objects' velocities for this step come from their scripts, before anything collides with them
+	const bool moveKinematics = _simulation_start && !_eventDriven;
+	for (size_t i = 0; i < _sceneKinematicObjects.size() && moveKinematics; i++)
+	{
+		_sceneKinematicObjects.at(i)->BeginStep(deltaTs);
+	}
+
+	if (_simulation_start && _eventDriven)
+	{
+		StepEventDriven(deltaTs);
+	}
+	else if (_simulation_start && _xpbd)
+	{
+		StepXPBD(deltaTs);
+	}
+	else if (_simulation_start)
+	{
+		// STEP 1: Clear and compute the forces on every dynamic object
+		for (size_t j = 0; j < _sceneDynamicObjects.size(); j++)
+		{
+			_sceneDynamicObjects.at(j)->ComputeForces();
+		}
+		if (_mutualGravity || _forceRegistry.Size() > 0)
+		{
+			ApplyForceGenerators();
+		}
+
+		// STEP 2: Test all spheres against each static plane in one batched pass
+		_planeColliders.Build(_sceneGameObjects);
+		if (_rowSolver)
+		{
+			FindSpherePairs(deltaTs);
+			SolveConstraints(deltaTs);
+		}
+		else
+		{
+			_sweptSpheres.Clear();
+			for (size_t j = 0; j < _sceneDynamicObjects.size(); j++)
+			{
+				DynamicObject* obj = _sceneDynamicObjects.at(j);
+				_sweptSpheres.Add(obj->GetPosition(), obj->GetPosition() + obj->GetVelocity() * deltaTs, obj->GetBoundingRadius());
+			}
+			_planeColliders.FindContacts(_sweptSpheres, _planeContacts);
+
+			for (size_t i = 0; i < _planeContacts.size(); i++)
+			{
+				const PlaneContact& contact = _planeContacts[i];
+				GameObject* plane = _planeColliders.GetObject(contact.plane);
+				if (!PFG::ShouldCollide(_sceneDynamicObjects.at(contact.sphere)->GetCollisionFilter(), plane->GetCollisionFilter()))
+				{
+					continue;
+				}
+				_contactPredicted[contact.sphere] = true;
+				_sceneDynamicObjects.at(contact.sphere)->PlaneCollisionResponse(_planeColliders.GetNormal(contact.plane), contact.contactPoint, plane->GetInitialVelocity(), deltaTs);
+			}
+
+			// After the plane responses, which can move a sphere onto the plane
+			FindSpherePairs(deltaTs);
+			CollideWithKinematicObjects(deltaTs);
+		}
+
+		// Sort the remaining pairs into buckets by their pair of shapes
+		for (int a = 0; a < SHAPE_COUNT; a++)
+		{
+			for (int b = 0; b < SHAPE_COUNT; b++)
+			{
+				_collisionBuckets[a][b].clear();
+			}
+		}
+
+		for (size_t j = 0; j < _sceneDynamicObjects.size(); j++)
+		{
+			DynamicObject* obj = _sceneDynamicObjects.at(j);
+
+			// For each static object that isn't a plane, pair it with the dynamic object
+			for (size_t i = 0; i < _sceneGameObjects.size(); i++)
+			{
+				GameObject* other = _sceneGameObjects.at(i);
+				if (other->GetType() == SHAPE_PLANE || other->GetType() == SHAPE_HALFSPACE)
+				{
+					// Planes were handled by the batched pass
+					continue;
+				}
+				AddCollisionPair(obj, other);
+			}
+
+			// Pair it with each dynamic object the broadphase found near it.
+			// The constraint solver has already done these
+			for (uint32_t n = _broadphaseStart[j]; n < _broadphaseStart[j + 1] && !_rowSolver; n++)
+			{
+				if (_broadphaseOther[n] < _sceneDynamicObjects.size())
+				{
+					AddCollisionPair(obj, _sceneDynamicObjects.at(_broadphaseOther[n]));
+				}
+			}
+		}
+
+		// Run each bucket through the collision function for its pair of shapes
+		for (int a = 0; a < SHAPE_COUNT; a++)
+		{
+			for (int b = 0; b < SHAPE_COUNT; b++)
+			{
+				if (!_collisionBuckets[a][b].empty())
+				{
+					PFG::GetBucketCollisionFunction((ShapeType)a, (ShapeType)b)(_collisionBuckets[a][b], deltaTs);
+				}
+			}
+		}
+
+		// STEP 3: Sub-step the fast spheres that would pass through another sphere this step
+		ContinuousCollision(deltaTs);
+
+		// STEP 4: Integrate everything that was not already sub-stepped
+		IntegrateDynamicObjects(deltaTs);
+	}
+
+	// The kinematic objects go where their velocity takes them, nothing they hit slows them
+	for (size_t i = 0; i < _sceneKinematicObjects.size() && moveKinematics; i++)
+	{
+		_sceneKinematicObjects.at(i)->Move(deltaTs);
+	}
+
+	// Particles move and collide in one pass, pushing on the spheres they hit
+	if (_simulation_start && !_eventDriven)
+	{
+		_particles.Step(deltaTs, _planeColliders, _sceneDynamicObjects, *_jobs);
+		_fluid.Step(deltaTs, _planeColliders, _sceneDynamicObjects, *_jobs);
+		_softBody.Step(deltaTs, _planeColliders, _sceneDynamicObjects);
+	}
+
+	// Sensors see where everything ended up, whichever mode moved it
+	if (_simulation_start && _sensors.Size() > 0)
+	{
+		UpdateSensors();
+	}
+
+	// STEP 5: Rebuild the model matrices of the objects that moved, all in one batch
+	_transformBatch.Clear();
+	_transformObjects.clear();
+	for (size_t j = 0; j < _sceneDynamicObjects.size(); j++)
+	{
+		DynamicObject* obj = _sceneDynamicObjects.at(j);
+		if (obj->IsTransformDirty())
+		{
+			_transformBatch.Add(obj->GetPosition(), obj->GetRotation(), obj->GetScale());
+			_transformObjects.push_back(obj);
+		}
+	}
+	for (size_t i = 0; i < _sceneKinematicObjects.size(); i++)
+	{
+		KinematicsObject* obj = _sceneKinematicObjects.at(i);
+		if (obj->IsTransformDirty())
+		{
+			_transformBatch.Add(obj->GetPosition(), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), obj->GetScale());
+			_transformObjects.push_back(obj);
+		}
+	}
+
+	PFG::ComposeTransforms(_transformBatch);
+
+	for (size_t i = 0; i < _transformObjects.size(); i++)
+	{
+		_transformObjects[i]->SetModelMatrices(_transformBatch.model[i], _transformBatch.invModel[i]);
+	}
+}
+
+void Scene::AddCollisionPair(GameObject* a, GameObject* b)
+{
+	ShapeType shapeA = a->GetType();
+	ShapeType shapeB = b->GetType();
+
+	// Pairs of shapes without a collision function, or that filter each other out, are dropped here
+	if (PFG::GetCollisionFunction(shapeA, shapeB) == NULL || !PFG::ShouldCollide(a->GetCollisionFilter(), b->GetCollisionFilter()))
+	{
+		return;
+	}
+
+	CollisionPair pair;
+	pair.a = a;
+	pair.b = b;
+	_collisionBuckets[shapeA][shapeB].push_back(pair);
+}
+
+void Scene::FindSpherePairs(float deltaTs)
+{
+	const size_t count = _sceneDynamicObjects.size();
+	const size_t total = count + _sceneKinematicObjects.size();
+	_broadphaseRadius.resize(total);
+	_broadphaseReach.resize(total);
+	for (int k = 0; k < 3; k++)
+	{
+		_broadphasePositions[k].resize(total);
+	}
+
+	// Each sphere can reach its radius plus however far it moves this step, forces included.
+	// The kinematic objects' bounds are refreshed here with the rest, in the same pass
+	float largestReach = 0.0f;
+	for (size_t j = 0; j < total; j++)
+	{
+		glm::vec3 position;
+		float speed;
+		if (j < count)
+		{
+			DynamicObject* obj = _sceneDynamicObjects.at(j);
+			position = obj->GetPosition();
+			speed = glm::length(obj->GetVelocity()) + glm::length(obj->GetForce()) * deltaTs / obj->GetMass();
+			_broadphaseRadius[j] = obj->GetBoundingRadius();
+		}
+		else
+		{
+			KinematicsObject* obj = _sceneKinematicObjects.at(j - count);
+			position = obj->GetPosition();
+			speed = glm::length(obj->GetVelocity());
+			_broadphaseRadius[j] = obj->GetBoundingRadius();
+		}
+		_broadphaseReach[j] = _broadphaseRadius[j] + speed * deltaTs + SOLVER_CONTACT_MARGIN;
+		largestReach = std::max(largestReach, _broadphaseReach[j]);
+		for (int k = 0; k < 3; k++)
+		{
+			_broadphasePositions[k][j] = position[k];
+		}
+	}
+	_broadphase.Build(_broadphasePositions, total, 2.0f * largestReach);
+	const std::vector<uint32_t>& order = _broadphase.GetOrder();
+
+	_broadphaseStart.resize(count + 1);
+	_broadphaseOther.clear();
+	for (uint32_t j = 0; j < (uint32_t)count; j++)
+	{
+		_broadphaseStart[j] = (uint32_t)_broadphaseOther.size();
+		const CollisionFilter& filter = _sceneDynamicObjects.at(j)->GetCollisionFilter();
+
+		uint32_t buckets[27];
+		int bucketCount = _broadphase.GetNeighbourBuckets(_broadphasePositions[0][j], _broadphasePositions[1][j], _broadphasePositions[2][j], buckets);
+		for (int n = 0; n < bucketCount; n++)
+		{
+			uint32_t first, last;
+			_broadphase.GetBucketRange(buckets[n], first, last);
+			for (uint32_t o = first; o < last; o++)
+			{
+				// The filter goes first, it is cheaper than the distance and drops the most pairs
+				const uint32_t k = order[o];
+				GameObject* other = k < count ? (GameObject*)_sceneDynamicObjects.at(k) : _sceneKinematicObjects.at(k - count);
+				if (k == j || !PFG::ShouldCollide(filter, other->GetCollisionFilter()))
+				{
+					continue;
+				}
+				float reach = _broadphaseReach[j] + _broadphaseReach[k];
+				float dx = _broadphasePositions[0][j] - _broadphasePositions[0][k];
+				float dy = _broadphasePositions[1][j] - _broadphasePositions[1][k];
+				float dz = _broadphasePositions[2][j] - _broadphasePositions[2][k];
+				if (dx * dx + dy * dy + dz * dz < reach * reach)
+				{
+					_broadphaseOther.push_back(k);
+					_contactPredicted[j] = true;
+				}
+			}
+		}
+
+		// Keep the pairs in index order so the responses run in the same order whatever the hash does
+		std::sort(_broadphaseOther.begin() + _broadphaseStart[j], _broadphaseOther.end());
+	}
+	_broadphaseStart[count] = (uint32_t)_broadphaseOther.size();
+}
+
+const QueryTree& Scene::GetQueryTree()
+{
+	if (_queryTreeStale)
+	{
+		const size_t count = _sceneDynamicObjects.size();
+		const size_t total = count + _sceneKinematicObjects.size();
+		_broadphaseRadius.resize(total);
+		_queryCategories.resize(total);
+		for (int k = 0; k < 3; k++)
+		{
+			_broadphasePositions[k].resize(total);
+		}
+		for (size_t j = 0; j < total; j++)
+		{
+			glm::vec3 position;
+			if (j < count)
+			{
+				position = _sceneDynamicObjects.at(j)->GetPosition();
+				_broadphaseRadius[j] = _sceneDynamicObjects.at(j)->GetBoundingRadius();
+				_queryCategories[j] = _sceneDynamicObjects.at(j)->GetCollisionFilter().category;
+			}
+			else
+			{
+				position = _sceneKinematicObjects.at(j - count)->GetPosition();
+				_broadphaseRadius[j] = _sceneKinematicObjects.at(j - count)->GetBoundingRadius();
+				_queryCategories[j] = _sceneKinematicObjects.at(j - count)->GetCollisionFilter().category;
+			}
+			for (int k = 0; k < 3; k++)
+			{
+				_broadphasePositions[k][j] = position[k];
+			}
+		}
+		_queryTree.Build(_broadphasePositions, _broadphaseRadius, _queryCategories, total);
+		_queryTreeStale = false;
+	}
+
+	return _queryTree;
+}
+
+void Scene::CastQueries(const std::vector<QueryCast>& casts, bool closestOnly, QueryResults& results)
+{
+	GetQueryTree().Cast(casts, closestOnly, results, *_jobs);
+}
+
+void Scene::UpdateSensors()
+{
+	const size_t count = _sceneDynamicObjects.size();
+	_broadphaseRadius.resize(count);
+	for (int k = 0; k < 3; k++)
+	{
+		_broadphasePositions[k].resize(count);
+	}
+
+	float largestRadius = 0.0f;
+	for (size_t j = 0; j < count; j++)
+	{
+		DynamicObject* obj = _sceneDynamicObjects.at(j);
+		glm::vec3 position = obj->GetPosition();
+		for (int k = 0; k < 3; k++)
+		{
+			_broadphasePositions[k][j] = position[k];
+		}
+		_broadphaseRadius[j] = obj->GetBoundingRadius();
+		largestRadius = std::max(largestRadius, _broadphaseRadius[j]);
+	}
+	_broadphase.Build(_broadphasePositions, count, 2.0f * largestRadius + SOLVER_CONTACT_MARGIN);
+
+	_sensors.Update(_broadphasePositions, _broadphaseRadius, count, _broadphase);
+}
+
+void Scene::CollideWithKinematicObjects(float deltaTs)
+{
+	const size_t count = _sceneDynamicObjects.size();
+	for (size_t j = 0; j < count; j++)
+	{
+		DynamicObject* obj = _sceneDynamicObjects.at(j);
+		for (uint32_t n = _broadphaseStart[j]; n < _broadphaseStart[j + 1]; n++)
+		{
+			if (_broadphaseOther[n] < count)
+			{
+				continue;
+			}
 
-		_sceneDynamicObjects.push_back(newObj);
+			// Touching spheres are put back on the kinematic object's surface, with its velocity as the wall's
+			KinematicsObject* kinematic = _sceneKinematicObjects.at(_broadphaseOther[n] - count);
+			glm::vec3 delta = obj->GetPosition() - kinematic->GetPosition();
+			float distance = glm::length(delta);
+			float contactDistance = obj->GetBoundingRadius() + kinematic->GetBoundingRadius();
+			if (distance < contactDistance && distance > 0.0f)
+			{
+				glm::vec3 normal = delta / distance;
+				obj->PlaneCollisionResponse(normal, kinematic->GetPosition() + normal * contactDistance, kinematic->GetVelocity(), deltaTs);
+			}
+		}
 	}
-	// For loop to spawn amount of planes
-	for (int i = 0; i < planes; i++)
+}
+
+void Scene::ContinuousCollision(float deltaTs)
+{
+	const size_t count = _sceneDynamicObjects.size();
+	_ccdTime.assign(count, 0.0f);
+	_ccdImpacts.resize(count);
+	for (size_t j = 0; j < count; j++)
+	{
+		_ccdImpacts[j] = SweepSphere(j, deltaTs);
+	}
+
+	// Resolve the impacts in the order they happen. An impact changes the pair's velocities, so the pair and every
+	// sphere that could reach them are swept again over the rest of the step before the next earliest is taken
+	for (size_t n = 0; n < count * CCD_MAX_IMPACTS_PER_OBJECT; n++)
 	{
-		GameObject* newObj = CreatePlane(0, modelMaterial, groundMesh, glm::vec3(0.0f + i * 10, 10.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(2.0f, 2.0f, 2.0f));
+		size_t earliest = count;
+		for (size_t j = 0; j < count; j++)
+		{
+			if (_ccdImpacts[j].otherObject != j && (earliest == count || _ccdImpacts[j].time < _ccdImpacts[earliest].time))
+			{
+				earliest = j;
+			}
+		}
+		if (earliest == count)
+		{
+			break;
+		}
+
+		const SphereImpact impact = _ccdImpacts[earliest];
+		DynamicObject* fastObj = _sceneDynamicObjects.at(impact.fastObject);
+		DynamicObject* otherObj = _sceneDynamicObjects.at(impact.otherObject);
+
+		// Advance both spheres from wherever they were left to the time of impact and respond
+		if (impact.time > _ccdTime[impact.fastObject])
+		{
+			fastObj->Integrate((impact.time - _ccdTime[impact.fastObject]) * deltaTs, _ccdBodies);
+		}
+		if (impact.time > _ccdTime[impact.otherObject])
+		{
+			otherObj->Integrate((impact.time - _ccdTime[impact.otherObject]) * deltaTs, _ccdBodies);
+		}
+		fastObj->ImpactResponse(otherObj);
+
+		_ccdTime[impact.fastObject] = impact.time;
+		_ccdTime[impact.otherObject] = impact.time;
+		_ccdSubStepped[impact.fastObject] = true;
+		_ccdSubStepped[impact.otherObject] = true;
 
-		_sceneGameObjects.push_back(newObj);
+		const size_t pair[2] = { impact.fastObject, impact.otherObject };
+		for (int p = 0; p < 2; p++)
+		{
+			_ccdImpacts[pair[p]] = SweepSphere(pair[p], deltaTs);
+			for (uint32_t o = _broadphaseStart[pair[p]]; o < _broadphaseStart[pair[p] + 1]; o++)
+			{
+				if (_broadphaseOther[o] < count)
+				{
+					_ccdImpacts[_broadphaseOther[o]] = SweepSphere(_broadphaseOther[o], deltaTs);
+				}
+			}
+		}
 	}
 
-	// test object to spawn above the others to simulate a ball dropping on another
-	DynamicObject* newObj = CreateSphere(1, objectMaterial, modelMesh, glm::vec3(0.2f, 25.0f, 0.0f), glm::vec3(0.3f, 0.3f, 0.3f), 2.0f, 0.3f);
-	_sceneDynamicObjects.push_back(newObj);
+	// Finish the step with the velocities after the last impact
+	for (size_t j = 0; j < count; j++)
+	{
+		if (_ccdSubStepped[j] && _ccdTime[j] < 1.0f)
+		{
+			_sceneDynamicObjects.at(j)->Integrate((1.0f - _ccdTime[j]) * deltaTs, _ccdBodies);
+		}
+	}
 }
 
-Scene::~Scene()
+Scene::SphereImpact Scene::SweepSphere(size_t j, float deltaTs) const
 {
-	// You should neatly clean everything up here
-	delete _camera;
+	SphereImpact impact;
+	impact.time = 1.0f;
+	impact.fastObject = j;
+	impact.otherObject = j;
 
-	for (size_t i = 0; i < _sceneDynamicObjects.size(); i++)
+	DynamicObject* fastObj = _sceneDynamicObjects.at(j);
+	float radius1 = fastObj->GetBoundingRadius();
+	if (glm::length(fastObj->GetVelocity()) * deltaTs <= CCD_MOTION_FRACTION * radius1)
 	{
-		delete _sceneDynamicObjects.at(i);
+		// Slow enough for the discrete test to catch its collisions
+		return impact;
 	}
 
-	for (size_t i = 0; i < _sceneGameObjects.size(); i++)
+	// Only the spheres the broadphase found it could reach this step, they are already filtered
+	for (uint32_t o = _broadphaseStart[j]; o < _broadphaseStart[j + 1]; o++)
 	{
-		delete _sceneGameObjects.at(i);
+		const size_t k = _broadphaseOther[o];
+		if (k >= _sceneDynamicObjects.size())
+		{
+			continue;
+		}
+		DynamicObject* otherObj = _sceneDynamicObjects.at(k);
+
+		// Sweep both from the later of the times they have reached to the end of the step
+		const float start = std::max(_ccdTime[j], _ccdTime[k]);
+		glm::vec3 a0 = fastObj->GetPosition() + fastObj->GetVelocity() * ((start - _ccdTime[j]) * deltaTs);
+		glm::vec3 a1 = fastObj->GetPosition() + fastObj->GetVelocity() * ((1.0f - _ccdTime[j]) * deltaTs);
+		glm::vec3 b0 = otherObj->GetPosition() + otherObj->GetVelocity() * ((start - _ccdTime[k]) * deltaTs);
+		glm::vec3 b1 = otherObj->GetPosition() + otherObj->GetVelocity() * ((1.0f - _ccdTime[k]) * deltaTs);
+		float t;
+
+		// Spheres already touching are left to the discrete response
+		if (PFG::MovingSphereToSphereCollision(a0, a1, b0, b1, radius1, otherObj->GetBoundingRadius(), t) && t > 0.0f)
+		{
+			float time = start + t * (1.0f - start);
+			if (time < impact.time)
+			{
+				impact.time = time;
+				impact.otherObject = k;
+			}
+		}
 	}
+
+	return impact;
 }
 
-void Scene::Update(float deltaTs, Input* input)
+void Scene::ApplyForceGenerators()
 {
+	const size_t count = _sceneDynamicObjects.size();
+	_forceBodies.Resize(count);
 
+	for (size_t j = 0; j < count; j++)
+	{
+		DynamicObject* obj = _sceneDynamicObjects.at(j);
+		glm::vec3 position = obj->GetPosition();
+		glm::vec3 velocity = obj->GetVelocity();
+		glm::vec3 force = obj->GetForce();
+		for (int k = 0; k < 3; k++)
+		{
+			_forceBodies.position[k][j] = position[k];
+			_forceBodies.velocity[k][j] = velocity[k];
+			_forceBodies.force[k][j] = force[k];
+		}
+		_forceBodies.mass[j] = obj->GetMass();
+		_forceBodies.radius[j] = obj->GetBoundingRadius();
+	}
 
-	// Update the game object (this is currently hard-coded motion)
-	if (input->cmd_x)
+	if (_mutualGravity)
 	{
-		_simulation_start = true;
+		ComputeMutualGravity();
 	}
-	if (_simulation_start == true)
+	_forceRegistry.Apply(_forceBodies);
+
+	for (size_t j = 0; j < count; j++)
 	{
-		for (int i = 0; i < _sceneDynamicObjects.size(); i++)
+		_sceneDynamicObjects.at(j)->SetForce(glm::vec3(_forceBodies.force[0][j], _forceBodies.force[1][j], _forceBodies.force[2][j]));
+	}
+}
+
+void Scene::ComputeMutualGravity()
+{
+	_gravityTree.Build(_forceBodies.position, _forceBodies.mass);
+	_gravityTree.ComputeAccelerations(_gravityAcceleration, *_jobs);
+
+	for (int k = 0; k < 3; k++)
+	{
+		for (size_t j = 0; j < _forceBodies.Size(); j++)
 		{
-			_sceneDynamicObjects.at(i)->StartSimulation(_simulation_start);
+			_forceBodies.force[k][j] += _forceBodies.mass[j] * _gravityAcceleration[k][j];
 		}
 	}
+}
 
-	for (size_t i = 0; i < _sceneGameObjects.size(); i++)
+void Scene::IntegrateDynamicObjects(float deltaTs)
+{
+	// Count the objects for each integrator so each group gets a contiguous range of _bodies
+	size_t counts[INTEGRATOR_COUNT] = {};
+	for (size_t j = 0; j < _sceneDynamicObjects.size(); j++)
 	{
-		_sceneGameObjects.at(i)->Update(deltaTs);
+		if (!_ccdSubStepped[j])
+		{
+			counts[_sceneDynamicObjects.at(j)->GetIntegrator()]++;
+		}
+	}
+
+	size_t next[INTEGRATOR_COUNT];
+	_integratorGroups[0] = 0;
+	for (int t = 0; t < INTEGRATOR_COUNT; t++)
+	{
+		next[t] = _integratorGroups[t];
+		_integratorGroups[t + 1] = _integratorGroups[t] + counts[t];
+	}
+
+	_bodies.Resize(_integratorGroups[INTEGRATOR_COUNT]);
+	_bodyObjects.resize(_integratorGroups[INTEGRATOR_COUNT]);
+
+	for (size_t j = 0; j < _sceneDynamicObjects.size(); j++)
+	{
+		if (!_ccdSubStepped[j])
+		{
+			DynamicObject* obj = _sceneDynamicObjects.at(j);
+			size_t index = next[obj->GetIntegrator()]++;
+			_bodyObjects[index] = obj;
+			obj->StoreLinearState(_bodies, index);
+			_bodies.syncAtEnd[index] = _contactPredicted[j] ? 1 : 0;
+		}
+	}
+
+	// One call per integrator, not per object
+	for (int t = 0; t < INTEGRATOR_COUNT; t++)
+	{
+		if (_integratorGroups[t] < _integratorGroups[t + 1])
+		{
+			PFG::IntegrateBodies((IntegratorType)t, _bodies, AccumulatedForce(), _integratorGroups[t], _integratorGroups[t + 1], deltaTs);
+		}
+	}
+
+	for (size_t i = 0; i < _bodyObjects.size(); i++)
+	{
+		_bodyObjects[i]->LoadLinearState(_bodies, i);
+		_bodyObjects[i]->IntegrateRotation(deltaTs);
 	}
+}
 
-	for (int j = 0; j < _sceneDynamicObjects.size(); j++)
+void Scene::StepEventDriven(float deltaTs)
+{
+	if (!_eventWorldStarted)
 	{
-		// For each game object that exists, pass it into the dyanmic object's update for collision
-		for (size_t i = 0; i < _sceneGameObjects.size(); i++)
+		_eventWorld.Clear();
+		// Same gravity and restitution as the time stepped objects
+		_eventWorld.SetGravity(glm::vec3(0.0f, -9.8f * 0.1f, 0.0f));
+		_eventWorld.SetRestitution(0.5f);
+
+		for (size_t j = 0; j < _sceneDynamicObjects.size(); j++)
 		{
-			_sceneDynamicObjects.at(j)->Update(_sceneGameObjects.at(i), deltaTs /  _sceneGameObjects.size());
+			DynamicObject* obj = _sceneDynamicObjects.at(j);
+			_eventWorld.AddSphere(obj->GetPosition(), obj->GetVelocity(), obj->GetBoundingRadius(), obj->GetMass(), obj->GetCollisionFilter());
 		}
 
-		// For each dynamic object that exists, pass it into the dyanmic object's update for collision, minus if it's itself
-		for (size_t k = 0; k < _sceneDynamicObjects.size(); k++)
+		// Triangle meshes aren't supported in this mode, only planes and half-spaces
+		_planeColliders.Build(_sceneGameObjects);
+		for (size_t p = 0; p < _planeColliders.Size(); p++)
+		{
+			glm::vec3 normal = _planeColliders.GetNormal(p);
+			_eventWorld.AddPlane(normal, glm::dot(normal, _planeColliders.GetObject(p)->GetPosition()), _planeColliders.GetObject(p)->GetCollisionFilter());
+		}
+
+		_eventWorld.Start();
+		_eventWorldStarted = true;
+	}
+
+	_eventWorld.Advance(deltaTs);
+
+	for (size_t j = 0; j < _sceneDynamicObjects.size(); j++)
+	{
+		DynamicObject* obj = _sceneDynamicObjects.at(j);
+		obj->SetPosition(_eventWorld.GetPosition(j));
+		obj->SetVelocity(_eventWorld.GetVelocity(j));
+	}
+}
+
+void Scene::SolveConstraints(float deltaTs)
+{
+	_constraintSolver.ClearBodies();
+	_solverVelocities.resize(_sceneDynamicObjects.size() + _sceneKinematicObjects.size());
+	for (size_t j = 0; j < _sceneDynamicObjects.size(); j++)
+	{
+		DynamicObject* obj = _sceneDynamicObjects.at(j);
+		glm::mat3 invInertia(obj->ApplyInverseInertia(glm::vec3(1.0f, 0.0f, 0.0f)), obj->ApplyInverseInertia(glm::vec3(0.0f, 1.0f, 0.0f)), obj->ApplyInverseInertia(glm::vec3(0.0f, 0.0f, 1.0f)));
+		_solverVelocities[j] = obj->GetVelocity() + obj->GetForce() * (deltaTs / obj->GetMass());
+		_constraintSolver.AddBody(obj->GetPosition(), obj->GetRotation(), _solverVelocities[j], obj->GetAngularVelocity(), 1.0f / obj->GetMass(), invInertia);
+	}
+	// Kinematic objects follow, in the broadphase's order, with no mass so the solver never changes their velocity
+	for (size_t i = 0; i < _sceneKinematicObjects.size(); i++)
+	{
+		KinematicsObject* obj = _sceneKinematicObjects.at(i);
+		_solverVelocities[_sceneDynamicObjects.size() + i] = obj->GetVelocity();
+		_constraintSolver.AddBody(obj->GetPosition(), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), obj->GetVelocity(), glm::vec3(0.0f), 0.0f, glm::mat3(0.0f));
+	}
+
+	// Contacts with anything the spheres could reach this step, a gap only stops them closing past it
+	for (size_t p = 0; p < _planeColliders.Size(); p++)
+	{
+		const glm::vec3 normal = _planeColliders.GetNormal(p);
+		const CollisionFilter& planeFilter = _planeColliders.GetObject(p)->GetCollisionFilter();
+		for (size_t j = 0; j < _sceneDynamicObjects.size(); j++)
 		{
-			if (k == j)
+			DynamicObject* obj = _sceneDynamicObjects.at(j);
+			if (!PFG::ShouldCollide(obj->GetCollisionFilter(), planeFilter))
 			{
 				continue;
 			}
-			else
+			float distance = glm::dot(normal, obj->GetPosition()) - _planeColliders.GetOffset(p);
+			float side = (_planeColliders.IsHalfSpace(p) || distance >= 0.0f) ? 1.0f : -1.0f;
+			float separation = side * distance - obj->GetBoundingRadius();
+			float reach = glm::length(_solverVelocities[j]) * deltaTs + SOLVER_CONTACT_MARGIN;
+			if (separation < reach && side * distance > -reach)
+			{
+				_contactPredicted[j] = true;
+				_constraintSolver.AddContact((uint32_t)j, SOLVER_WORLD, side * normal, obj->GetPosition() - side * normal * obj->GetBoundingRadius(), separation);
+			}
+		}
+	}
+	for (size_t j = 0; j < _sceneDynamicObjects.size(); j++)
+	{
+		DynamicObject* a = _sceneDynamicObjects.at(j);
+		for (uint32_t n = _broadphaseStart[j]; n < _broadphaseStart[j + 1]; n++)
+		{
+			const uint32_t k = _broadphaseOther[n];
+			if (k <= j)
 			{
-				_sceneDynamicObjects.at(j)->Update(_sceneDynamicObjects.at(k), deltaTs / (_sceneDynamicObjects.size() * 3));
+				continue;
+			}
+			glm::vec3 delta = a->GetPosition() - glm::vec3(_broadphasePositions[0][k], _broadphasePositions[1][k], _broadphasePositions[2][k]);
+			float distance = glm::length(delta);
+			float separation = distance - a->GetBoundingRadius() - _broadphaseRadius[k];
+			float reach = glm::length(_solverVelocities[j] - _solverVelocities[k]) * deltaTs + SOLVER_CONTACT_MARGIN;
+			if (separation < reach && distance > 0.0f)
+			{
+				glm::vec3 normal = delta / distance;
+				_constraintSolver.AddContact((uint32_t)j, (uint32_t)k, normal, a->GetPosition() - normal * a->GetBoundingRadius(), separation);
 			}
 		}
 	}
 
-	// Update camera
-	_camera->Update(input);
+	_constraintSolver.Solve(deltaTs, *_jobs, _frameArena);
 
-	// Update matrices
-	_viewMatrix = _camera->GetView();
-	_projMatrix = _camera->GetProj();
-														
+	// Only the solver's change is handed back, the integrators add the forces again
+	for (size_t j = 0; j < _sceneDynamicObjects.size(); j++)
+	{
+		DynamicObject* obj = _sceneDynamicObjects.at(j);
+		obj->SetVelocity(obj->GetVelocity() + _constraintSolver.GetVelocity(j) - _solverVelocities[j]);
+		glm::vec3 spin = _constraintSolver.GetAngularVelocity(j) - obj->GetAngularVelocity();
+		glm::mat3 invInertia(obj->ApplyInverseInertia(glm::vec3(1.0f, 0.0f, 0.0f)), obj->ApplyInverseInertia(glm::vec3(0.0f, 1.0f, 0.0f)), obj->ApplyInverseInertia(glm::vec3(0.0f, 0.0f, 1.0f)));
+		obj->SetAngularMomentum(obj->GetAngularMomentum() + glm::inverse(invInertia) * spin);
+	}
 }
 
-void Scene::Draw()
+void Scene::StepXPBD(float deltaTs)
 {
-	// Draw objects, giving the camera's position and projection
+	// Forces are worked out once and held over the sub-steps
+	for (size_t j = 0; j < _sceneDynamicObjects.size(); j++)
+	{
+		_sceneDynamicObjects.at(j)->ComputeForces();
+	}
+	if (_mutualGravity || _forceRegistry.Size() > 0)
+	{
+		ApplyForceGenerators();
+	}
 
-	for (int i = 0; i < _sceneDynamicObjects.size(); i++)
+	_xpbdWorld.ClearBodies();
+	for (size_t j = 0; j < _sceneDynamicObjects.size(); j++)
 	{
-		_sceneDynamicObjects.at(i)->Draw(_viewMatrix, _projMatrix);
+		DynamicObject* obj = _sceneDynamicObjects.at(j);
+		_xpbdWorld.AddBody(obj->GetPosition(), obj->GetVelocity(), obj->GetRotation(), obj->GetAngularVelocity(), obj->GetBoundingRadius(), obj->GetMass());
+		_xpbdWorld.SetExternalForce(j, obj->GetForce());
+		_xpbdWorld.SetCollisionFilter(j, obj->GetCollisionFilter());
+	}
+	// Kinematic objects have no mass, the solver moves them along their velocity and nothing else
+	for (size_t i = 0; i < _sceneKinematicObjects.size(); i++)
+	{
+		KinematicsObject* obj = _sceneKinematicObjects.at(i);
+		size_t body = _xpbdWorld.AddBody(obj->GetPosition(), obj->GetVelocity(), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.0f), obj->GetBoundingRadius(), 0.0f);
+		_xpbdWorld.SetCollisionFilter(body, obj->GetCollisionFilter());
 	}
 
-	for each (GameObject* obj in _sceneGameObjects)
+	_planeColliders.Build(_sceneGameObjects);
+	for (size_t p = 0; p < _planeColliders.Size(); p++)
 	{
-		obj->Draw(_viewMatrix, _projMatrix);
+		_xpbdWorld.AddPlane(_planeColliders.GetNormal(p), _planeColliders.GetOffset(p), _planeColliders.IsHalfSpace(p), _planeColliders.GetObject(p)->GetCollisionFilter());
 	}
 
-}
+	_xpbdWorld.Step(deltaTs);
 
+	for (size_t j = 0; j < _sceneDynamicObjects.size(); j++)
+	{
+		DynamicObject* obj = _sceneDynamicObjects.at(j);
+		obj->SetPosition(_xpbdWorld.GetPosition(j));
+		obj->SetVelocity(_xpbdWorld.GetVelocity(j));
+		obj->SetRotationalState(_xpbdWorld.GetRotation(j), _xpbdWorld.GetAngularVelocity(j));
+	}
+}
 
 // Create a dynamic object with parameters
-DynamicObject* Scene::CreateSphere(int objectType, Material* material, Mesh* modelMesh, glm::vec3 position, glm::vec3 scale, float mass, float boundingRad)
+DynamicObject* Scene::CreateSphere(ShapeType objectType, Material* material, Mesh* modelMesh, glm::vec3 position, glm::vec3 scale, float mass, float boundingRad)
 {
-	DynamicObject* object = new DynamicObject();
+	Handle<DynamicObject> handle = _dynamicPool.Create();
+	DynamicObject* object = _dynamicPool.Get(handle);
 	object->SetMaterial(material);
 	object->SetMesh(modelMesh);
 	object->SetPosition(position);
@@ -167,23 +1253,243 @@ DynamicObject* Scene::CreateSphere(int objectType, Material* material, Mesh* mod
 	object->SetBoundingRadius(boundingRad);
 	object->SetType(objectType);
 
+	if (handle.index >= _dynamicSlotIndex.size())
+	{
+		_dynamicSlotIndex.resize(_dynamicPool.Capacity());
+	}
+	_dynamicSlotIndex[handle.index] = (uint32_t)_sceneDynamicObjects.size();
+	_sceneDynamicObjects.push_back(object);
+	_dynamicHandles.push_back(handle);
+	_queryTreeStale = true;
+
+	return object;
+}
+
+bool Scene::DestroyDynamicObject(Handle<DynamicObject> handle)
+{
+	if (!_dynamicPool.IsValid(handle) || _eventWorldStarted)
+	{
+		return false;
+	}
+
+	// Move the last object into the hole so the others keep their places
+	const uint32_t index = _dynamicSlotIndex[handle.index];
+	const uint32_t last = (uint32_t)_sceneDynamicObjects.size() - 1;
+	_bodyRemap.resize(last + 1);
+	for (uint32_t i = 0; i < last; i++)
+	{
+		_bodyRemap[i] = i;
+	}
+	_bodyRemap[index] = BODY_REMOVED;
+	if (index != last)
+	{
+		_bodyRemap[last] = index;
+	}
+
+	_sceneDynamicObjects[index] = _sceneDynamicObjects[last];
+	_dynamicHandles[index] = _dynamicHandles[last];
+	_dynamicSlotIndex[_dynamicHandles[index].index] = index;
+	_sceneDynamicObjects.pop_back();
+	_dynamicHandles.pop_back();
+
+	_dynamicPool.Destroy(handle);
+	RemapBodies();
+	_queryTreeStale = true;
+	return true;
+}
+
+KinematicsObject* Scene::CreateKinematicSphere(Material* material, Mesh* modelMesh, glm::vec3 position, float boundingRad)
+{
+	KinematicsObject* object = _kinematicPool.Get(_kinematicPool.Create());
+	object->SetMaterial(material);
+	object->SetMesh(modelMesh);
+	object->SetPosition(position);
+	object->SetScale(boundingRad, boundingRad, boundingRad);
+	object->SetBoundingRadius(boundingRad);
+	_sceneKinematicObjects.push_back(object);
+	_queryTreeStale = true;
+
 	return object;
 }
 
 // Create a dynamic object with parameters
-GameObject* Scene::CreatePlane(int objectType, Material* material, Mesh* modelMesh, glm::vec3 position, glm::vec3 rotation, glm::vec3 scale)
+GameObject* Scene::CreatePlane(ShapeType objectType, Material* material, Mesh* modelMesh, glm::vec3 position, glm::vec3 rotation, glm::vec3 scale)
 {
-	GameObject* object = new GameObject();
+	GameObject* object = _planePool.Get(_planePool.Create());
 	object->SetMaterial(material);
 	object->SetMesh(modelMesh);
 	object->SetPosition(position);
 	object->SetRotation(rotation.x, rotation.y, rotation.z);
 	object->SetType(objectType);
 	object->SetScale(scale.x, scale.y, scale.z);
+	_sceneGameObjects.push_back(object);
+
+	// Only meshes that are collided with need their hierarchy
+	if (objectType == SHAPE_TRIANGLE_MESH && modelMesh != NULL)
+	{
+		modelMesh->BuildCollisionMesh();
+	}
 
 	return object;
 }
 
+size_t Scene::SpawnSpheres(const SphereSpawn& sphere, const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& velocities, std::vector<Handle<DynamicObject> >* handles)
+{
+	if (_eventWorldStarted || positions.empty())
+	{
+		return 0;
+	}
+
+	// Grow the pool and the lists once for the whole batch
+	const size_t count = positions.size();
+	const size_t total = _sceneDynamicObjects.size() + count;
+	_dynamicPool.Reserve(_dynamicPool.Size() + count);
+	_dynamicSlotIndex.resize(_dynamicPool.Capacity());
+	if (_sceneDynamicObjects.capacity() < total)
+	{
+		_sceneDynamicObjects.reserve(std::max(total, _sceneDynamicObjects.capacity() * 2));
+		_dynamicHandles.reserve(_sceneDynamicObjects.capacity());
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		Handle<DynamicObject> handle = _dynamicPool.Create();
+		DynamicObject* object = _dynamicPool.Get(handle);
+		object->SetMaterial(sphere.material);
+		object->SetMesh(sphere.mesh);
+		object->SetPosition(positions[i]);
+		object->SetScale(glm::vec3(sphere.radius));
+		object->SetMass(sphere.mass);
+		object->SetBoundingRadius(sphere.radius);
+		object->SetType(SHAPE_SPHERE);
+		object->SetIntegrator(sphere.integrator);
+		object->SetUniformGravity(sphere.uniformGravity);
+		object->SetCollisionFilter(sphere.filter);
+		if (!velocities.empty())
+		{
+			object->SetVelocity(velocities[i]);
+		}
+
+		_dynamicSlotIndex[handle.index] = (uint32_t)_sceneDynamicObjects.size();
+		_sceneDynamicObjects.push_back(object);
+		_dynamicHandles.push_back(handle);
+		if (handles != NULL)
+		{
+			handles->push_back(handle);
+		}
+	}
+	_queryTreeStale = true;
+	return count;
+}
+
+size_t Scene::DespawnObjects(const std::vector<Handle<DynamicObject> >& handles)
+{
+	if (_eventWorldStarted)
+	{
+		return 0;
+	}
+
+	_despawnFlags.assign(_sceneDynamicObjects.size(), 0);
+	for (size_t i = 0; i < handles.size(); i++)
+	{
+		if (_dynamicPool.IsValid(handles[i]))
+		{
+			_despawnFlags[_dynamicSlotIndex[handles[i].index]] = 1;
+		}
+	}
+	return RemoveFlaggedObjects();
+}
+
+size_t Scene::DespawnObjectsIf(const std::function<bool(const DynamicObject&)>& predicate)
+{
+	if (_eventWorldStarted)
+	{
+		return 0;
+	}
+
+	_despawnFlags.resize(_sceneDynamicObjects.size());
+	for (size_t i = 0; i < _sceneDynamicObjects.size(); i++)
+	{
+		_despawnFlags[i] = predicate(*_sceneDynamicObjects[i]) ? 1 : 0;
+	}
+	return RemoveFlaggedObjects();
+}
+
+size_t Scene::RemoveFlaggedObjects()
+{
+	// One pass that frees the flagged objects and slides the rest down over them, keeping their order
+	const size_t count = _sceneDynamicObjects.size();
+	_bodyRemap.resize(count);
+	size_t kept = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (_despawnFlags[i])
+		{
+			_dynamicPool.Destroy(_dynamicHandles[i]);
+			_bodyRemap[i] = BODY_REMOVED;
+			continue;
+		}
+		_bodyRemap[i] = (uint32_t)kept;
+		_sceneDynamicObjects[kept] = _sceneDynamicObjects[i];
+		_dynamicHandles[kept] = _dynamicHandles[i];
+		_dynamicSlotIndex[_dynamicHandles[kept].index] = (uint32_t)kept;
+		kept++;
+	}
+	_sceneDynamicObjects.resize(kept);
+	_dynamicHandles.resize(kept);
+
+	if (kept < count)
+	{
+		RemapBodies();
+		_queryTreeStale = true;
+	}
+	return count - kept;
+}
+
+void Scene::RemapBodies()
+{
+	_sensors.RemapBodies(_bodyRemap);
+	_constraintSolver.RemapBodies(_bodyRemap);
+	_forceRegistry.RemapBodies(_bodyRemap);
+	_xpbdWorld.RemapBodies(_bodyRemap);
+}
+
+void Scene::EmitSpheres(float deltaTs)
+{
+	if (_emitters.empty() || _eventDriven)
+	{
+		return;
+	}
+
+	// Recycle what every emitter has let expire in one pass, then spawn what they let out in one batch
+	_spawnHandles.clear();
+	for (size_t e = 0; e < _emitters.size(); e++)
+	{
+		_emitters[e].Expire(_spawnHandles);
+	}
+	if (!_spawnHandles.empty())
+	{
+		DespawnObjects(_spawnHandles);
+	}
+
+	_spawnPositions.clear();
+	_spawnVelocities.clear();
+	_emittedCounts.resize(_emitters.size());
+	for (size_t e = 0; e < _emitters.size(); e++)
+	{
+		_emittedCounts[e] = _emitters[e].Emit(deltaTs, _spawnPositions, _spawnVelocities);
+	}
+	_spawnHandles.clear();
+	SpawnSpheres(_emitterSphere, _spawnPositions, _spawnVelocities, &_spawnHandles);
+
+	size_t first = 0;
+	for (size_t e = 0; e < _emitters.size() && first < _spawnHandles.size(); e++)
+	{
+		_emitters[e].Track(_spawnHandles.data() + first, _emittedCounts[e]);
+		first += _emittedCounts[e];
+	}
+}
+
 void Scene::getFileCode(std::string fileName)
 {
 	std::string line;
@@ -199,4 +1505,37 @@ void Scene::getFileCode(std::string fileName)
 
 		myfile.close();
 	}
+}
+
+std::string Scene::GetSetting(const std::string& key, const std::string& fallback) const
+{
+	// Settings come after the sphere count, mass and radius
+	for (size_t i = 3; i < _fileCode.size(); i++)
+	{
+		std::istringstream line(_fileCode.at(i));
+		std::string name;
+		std::string value;
+		if (line >> name >> value && name == key)
+		{
+			return value;
+		}
+	}
+	return fallback;
+}
+
+std::vector<std::string> Scene::GetSettings(const std::string& key) const
+{
+	std::vector<std::string> values;
+	for (size_t i = 3; i < _fileCode.size(); i++)
+	{
+		std::istringstream line(_fileCode.at(i));
+		std::string name;
+		if (line >> name && name == key)
+		{
+			std::string value;
+			std::getline(line >> std::ws, value);
+			values.push_back(value);
+		}
+	}
+	return values;
 }
\ No newline at end of file
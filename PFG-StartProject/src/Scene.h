@@ -6,6 +6,26 @@
 #include "Camera.h"
 #include "KinematicsObject.h"
 #include "DynamicObject.h"
+#include "PlaneColliders.h"
+#include "SpatialHash.h"
+#include "CollisionDispatch.h"
+#include "Transforms.h"
+#include "Integrators.h"
+#include "EventDriven.h"
+#include "XPBD.h"
+#include "ConstraintSolver.h"
+#include "Gravity.h"
+#include "JobSystem.h"
+#include "ForceGenerators.h"
+#include "Particles.h"
+#include "Fluid.h"
+#include "SoftBody.h"
+#include "Sensors.h"
+#include "QueryTree.h"
+#include "Pool.h"
+#include "Arena.h"
+#include "Spawning.h"
+#include <functional>
 #include <fstream>
 #include <string>
 
@@ -21,8 +41,9 @@ public:
 	/** Scene constructor
 	* Currently the scene is set up in the constructor
 	* This means the object(s) are loaded, given materials and positions as well as the camera and light
+	* @param std::string fileName the scene file, read from the working directory
 	*/
-	Scene();
+	explicit Scene(std::string fileName = "Input.txt");
 	/** Scene distructor
 	*/
 	~Scene();
@@ -47,18 +68,179 @@ public:
 
 	void getFileCode(std::string fileName);
 
+	/** Get a setting from the scene file
+	* The first three lines of the file are the number of spheres, their mass and their radius.
+	* Any lines after that are settings written as 'key value', for example 'integrator Euler'
+	* @param std::string key the name of the setting
+	* @param std::string fallback returned if the file doesn't have the setting
+	*/
+	std::string GetSetting(const std::string& key, const std::string& fallback) const;
+
+	/** Get every line of the scene file that starts with a key, for settings that can be given more than once
+	* @param std::string key the name of the setting
+	* @return the rest of each line after the key, in file order
+	*/
+	std::vector<std::string> GetSettings(const std::string& key) const;
+
 	/** Create object
-	*
+	* The object is made in the scene's pool and added to the scene
 	*/
-	DynamicObject* CreateSphere(int objectType, Material* material, Mesh* modelMesh, glm::vec3 position, glm::vec3 scale, float mass, float boundingRad);
+	DynamicObject* CreateSphere(ShapeType objectType, Material* material, Mesh* modelMesh, glm::vec3 position, glm::vec3 scale, float mass, float boundingRad);
 
 	/** Create object
-	*
+	* The object is made in the scene's pool and added to the scene
+	*/
+	GameObject* Scene::CreatePlane(ShapeType objectType, Material* material, Mesh* modelMesh, glm::vec3 position, glm::vec3 rotation, glm::vec3 scale);
+
+	/** Create a kinematic sphere
+	* The object is made in the scene's pool and added to the scene
 	*/
-	GameObject* Scene::CreatePlane(int objectType, Material* material, Mesh* modelMesh, glm::vec3 position, glm::vec3 rotation, glm::vec3 scale);
+	KinematicsObject* CreateKinematicSphere(Material* material, Mesh* modelMesh, glm::vec3 position, float boundingRad);
+
+	/** Handle of the dynamic object at an index, it keeps referring to that object when others are destroyed
+	*/
+	Handle<DynamicObject> GetDynamicObjectHandle(size_t index) const { return _dynamicHandles.at(index); }
+	/** The dynamic object a handle refers to, or NULL if it has been destroyed
+	*/
+	DynamicObject* GetDynamicObject(Handle<DynamicObject> handle) const { return _dynamicPool.Get(handle); }
+	/** Remove a dynamic object from the scene and free its slot, making its handles stale
+	* The last object takes its index. Joints, springs and sensors given by index are renumbered to follow it, and
+	* the ones on the removed object are dropped. Renumbering goes over every object, so use DespawnObjects to
+	* remove many at once. Objects can't be removed once the event-driven world has taken them
+	* @return false if the handle was stale or the object can't be removed
+	*/
+	bool DestroyDynamicObject(Handle<DynamicObject> handle);
+
+	/** Add a batch of spheres that share everything but their positions and velocities
+	* The pool and the object lists grow once for the whole batch, and the spheres go on the end in order
+	* @param velocities one for each position, or empty for spheres at rest
+	* @param handles if not NULL, the new spheres' handles are appended to it
+	* @return how many were added, none once the event-driven world has taken the objects
+	*/
+	size_t SpawnSpheres(const SphereSpawn& sphere, const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& velocities, std::vector<Handle<DynamicObject> >* handles);
+	/** Remove a batch of dynamic objects in one pass over the list, the rest keep their order but close up
+	* Stale handles are skipped. As with DestroyDynamicObject, joints, springs and sensors given by index are
+	* renumbered to follow their objects, and the ones on removed objects are dropped
+	* @return how many were removed
+	*/
+	size_t DespawnObjects(const std::vector<Handle<DynamicObject> >& handles);
+	/** Remove every dynamic object the predicate picks, in one pass like DespawnObjects
+	*/
+	size_t DespawnObjectsIf(const std::function<bool(const DynamicObject&)>& predicate);
+
+	/** The trigger volumes, sensors can be added or moved between steps
+	*/
+	SensorSet& GetSensors() { return _sensors; }
+	/** Every dynamic object entering, staying in or leaving a sensor in the last step, in one buffer
+	* The body in each event is the object's index in the order the scene made them
+	*/
+	const std::vector<SensorEvent>& GetSensorEvents() const { return _sensors.GetEvents(); }
+
+	/** Cast a batch of rays and swept spheres against the dynamic and kinematic objects where they are now
+	* The hierarchy is rebuilt on the first batch after each step, large batches are split over the threads.
+	* Bodies are numbered with the dynamic objects first, in the order the scene made them, then the kinematic ones
+	* @param bool closestOnly true for the nearest hit of each cast, false for every hit nearest first
+	*/
+	void CastQueries(const std::vector<QueryCast>& casts, bool closestOnly, QueryResults& results);
+	/** The hierarchy over the dynamic and kinematic objects where they are now, for nearest, radius and box queries
+	* It is rebuilt here if anything has moved since the last call, numbered as for CastQueries
+	*/
+	const QueryTree& GetQueryTree();
+	/** Threads for the batched queries
+	*/
+	JobSystem& GetJobSystem() { return *_jobs; }
 
 private:
 
+	/** Advance every dynamic object by one simulation step
+	* Forces are computed for all objects, then collisions are responded to, then the objects are integrated
+	* and the model matrices of the ones that moved are rebuilt
+	*/
+	void StepPhysics(float deltaTs);
+
+	/** Continuous collision pass between moving spheres
+	* Only objects that move further than a fraction of their radius in the step are swept, against the spheres
+	* FindSpherePairs found they could reach. The earliest impact is resolved by sub-stepping the pair to it, then
+	* the pair and their neighbours are swept again over the rest of the step, until no impact is left.
+	* Returns through _ccdSubStepped which objects have already been integrated
+	*/
+	void ContinuousCollision(float deltaTs);
+
+	/** Add the forces that aren't built into the objects, from the force generators and mutual gravity
+	* The dynamic objects are copied into _forceBodies, the forces are added there, and the totals are copied back
+	*/
+	void ApplyForceGenerators();
+	/** Resolve the sphere contacts and the joints together with _constraintSolver
+	* Replaces the plane and sphere collision responses when the scene has joints or asks for 'solver rows'.
+	* The solver works on the velocities with this step's forces added, and the change it makes is added to each
+	* object's velocity and angular momentum before the integrators run
+	*/
+	void SolveConstraints(float deltaTs);
+
+	/** Add the pull of every body in _forceBodies on every other one, with a Barnes-Hut tree built each step
+	*/
+	void ComputeMutualGravity();
+
+	/** Integrate the dynamic objects that weren't sub-stepped
+	* The objects are copied into _bodies grouped by integrator, and each group is integrated as one batch
+	*/
+	void IntegrateDynamicObjects(float deltaTs);
+
+	/** Advance the scene in event-driven mode
+	* On the first step the spheres and planes are handed over to _eventWorld, which then moves them from one
+	* collision to the next. Their positions and velocities are copied back after every step for drawing
+	*/
+	void StepEventDriven(float deltaTs);
+	/** Step the dynamic objects with position based dynamics instead of forces and impulses
+	* Every step the spheres and planes are handed to _xpbdWorld with the forces on them, which moves them in
+	* sub-steps and hands them back. Triangle meshes aren't supported in this mode
+	*/
+	void StepXPBD(float deltaTs);
+
+	/** Find the pairs of dynamic objects that could touch this step and whose collision filters let them
+	* The dynamic and kinematic spheres are put in _broadphase together, with cells as wide as the furthest any
+	* of them can reach, so only neighbouring cells are searched. Fills _broadphaseStart and _broadphaseOther
+	*/
+	void FindSpherePairs(float deltaTs);
+	/** Push the dynamic objects out of the kinematic objects they touch, as off a moving wall
+	* Used in place of the constraint solver, from the pairs FindSpherePairs found
+	*/
+	void CollideWithKinematicObjects(float deltaTs);
+	/** Check the sensors against the dynamic objects where they ended the step
+	* The objects are put back in _broadphase at their new positions for the sensors to search
+	*/
+	void UpdateSensors();
+	/** Recycle the emitters' expired spheres and spawn the ones due this step, one batch each
+	*/
+	void EmitSpheres(float deltaTs);
+	/** Free the dynamic objects flagged in _despawnFlags and close up the lists
+	*/
+	size_t RemoveFlaggedObjects();
+	/** Renumber everything that holds dynamic objects by index after some were removed, from _bodyRemap
+	*/
+	void RemapBodies();
+
+	/** Put a pair of objects in the bucket for their pair of shapes, if those shapes can collide and their
+	* collision filters let them
+	* @param GameObject* a the dynamic object
+	* @param GameObject* b the object it may hit
+	*/
+	void AddCollisionPair(GameObject* a, GameObject* b);
+
+	/** A predicted impact between a fast sphere and another sphere during the step
+	*/
+	struct SphereImpact
+	{
+		float time;			/*!< Time of impact as a fraction of the step */
+		size_t fastObject;	/*!< Index of the fast sphere in _sceneDynamicObjects */
+		size_t otherObject;	/*!< Index of the sphere it hits */
+	};
+
+	/** The earliest impact of a fast sphere over what is left of the step, with each sphere moving on from the
+	* time in _ccdTime it has reached. The impact's other object is the sphere itself if there is none
+	*/
+	SphereImpact SweepSphere(size_t j, float deltaTs) const;
+
 	/** An example game level in the scene
 
 
@@ -81,10 +263,177 @@ private:
 	*/
 	bool _simulation_start;
 
+	/** True if the scene file asked for 'mode eventDriven' instead of stepping every object each frame
+	*/
+	bool _eventDriven;
+
+	/** The spheres and planes while in event-driven mode
+	*/
+	EventDrivenWorld _eventWorld;
+	bool _eventWorldStarted;
+
+	/** True if the scene file asked for 'mode xpbd', the same objects are then stepped by _xpbdWorld
+	*/
+	bool _xpbd;
+	XPBDWorld _xpbdWorld;
+
+	/** Joints from the 'joint' lines, solved with the contacts in the time-stepped mode
+	*/
+	ConstraintSolver _constraintSolver;
+	bool _rowSolver;
+	/** Each object's velocity with this step's forces added, as handed to the solver
+	*/
+	std::vector<glm::vec3> _solverVelocities;
+
+	/** True if the scene file asked for 'gravity mutual', the dynamic objects then attract each other
+	* instead of falling under constant gravity
+	*/
+	bool _mutualGravity;
+	GravityTree _gravityTree;
+
+	std::vector<float> _gravityAcceleration[3];
+
+	/** Drag, wind, springs and the other forces given in the scene file
+	*/
+	ForceRegistry _forceRegistry;
+
+	/** The dynamic objects as flat arrays for the force generators and the gravity tree
+	*/
+	ForceBodies _forceBodies;
+
+	/** Worker threads shared by the parallel parts of the step
+	*/
+	JobSystem* _jobs;
+
+	/** Bodies without rotation, from the 'particles' setting, drawn with the sphere mesh
+	*/
+	ParticleSystem _particles;
+	TransformBatch _particleTransforms;
+	Mesh* _particleMesh;
+	Material* _particleMaterial;
+
+	/** SPH liquid from the 'fluid' setting, drawn with the sphere mesh in its own colour
+	*/
+	FluidSystem _fluid;
+	TransformBatch _fluidTransforms;
+	Material* _fluidMaterial;
+
+	/** Cloth and soft blocks from the 'cloth' and 'softBody' settings, their nodes drawn with the sphere mesh
+	*/
+	SoftBody _softBody;
+	TransformBatch _softBodyTransforms;
+
+	/** Trigger volumes from the 'sensor' lines, they never touch anything
+	*/
+	SensorSet _sensors;
+
+	/** Hierarchy over the spheres for ray and shape casts, stale once anything has moved
+	*/
+	QueryTree _queryTree;
+	bool _queryTreeStale;
+	std::vector<uint32_t> _queryCategories;
+
+	/** Storage for the objects, materials and meshes, the lists of objects point into these
+	*/
+	ObjectPool<DynamicObject> _dynamicPool;
+	ObjectPool<KinematicsObject> _kinematicPool;
+	ObjectPool<GameObject> _planePool;
+	ObjectPool<Material> _materialPool;
+	ObjectPool<Mesh> _meshPool;
+
 	std::vector<DynamicObject*> _sceneDynamicObjects;
+	/** Handle of each dynamic object in the same order, and the index in that order of each pool slot
+	*/
+	std::vector<Handle<DynamicObject> > _dynamicHandles;
+	std::vector<uint32_t> _dynamicSlotIndex;
+
+	/** Streams of spheres from the 'emitter' lines, all made like the file's spheres
+	*/
+	std::vector<SphereEmitter> _emitters;
+	SphereSpawn _emitterSphere;
+	std::vector<size_t> _emittedCounts;
+	/** Batches being spawned or despawned, kept to avoid reallocating
+	*/
+	std::vector<glm::vec3> _spawnPositions;
+	std::vector<glm::vec3> _spawnVelocities;
+	std::vector<Handle<DynamicObject> > _spawnHandles;
+	std::vector<uint8_t> _despawnFlags;
+	/** New index of each dynamic object after a removal, or BODY_REMOVED
+	*/
+	std::vector<uint32_t> _bodyRemap;
+	/** Scripted spheres that push the dynamic objects, from the 'kinematic' lines
+	*/
+	std::vector<KinematicsObject*> _sceneKinematicObjects;
+
+	/** The static planes and half-spaces, rebuilt from _sceneGameObjects each step
+	*/
+	PlaneColliderSet _planeColliders;
+
+	/** The dynamic spheres swept over the current step, in the same order as _sceneDynamicObjects
+	*/
+	SweptSphereBatch _sweptSpheres;
+
+	/** Sphere to plane contacts found this step
+	*/
+	std::vector<PlaneContact> _planeContacts;
+
+	/** Sphere pairs from FindSpherePairs, dynamic object j may touch _broadphaseOther[_broadphaseStart[j]] up to
+	* _broadphaseStart[j + 1] in increasing order. Each pair of dynamic objects is listed from both sides.
+	* The kinematic objects come after the dynamic ones in the broadphase arrays, and are only listed as others
+	*/
+	SpatialHash _broadphase;
+	std::vector<float> _broadphasePositions[3];
+	std::vector<float> _broadphaseRadius;
+	std::vector<float> _broadphaseReach;
+	std::vector<uint32_t> _broadphaseStart;
+	std::vector<uint32_t> _broadphaseOther;
+
+	/** Pairs to collide this step, bucketed by the shape of each object so each bucket runs one collision function
+	*/
+	std::vector<CollisionPair> _collisionBuckets[SHAPE_COUNT][SHAPE_COUNT];
+
+	/** Earliest impact of each dynamic object found by the continuous collision pass, and how far through the
+	* step, as a fraction, each one has been sub-stepped. Kept between steps to avoid reallocating
+	*/
+	std::vector<SphereImpact> _ccdImpacts;
+	std::vector<float> _ccdTime;
+
+	/** Which dynamic objects the continuous collision pass has already integrated this step
+	*/
+	std::vector<bool> _ccdSubStepped;
+	/** Which dynamic objects have a contact coming this step, so adaptive ones end their step with it
+	*/
+	std::vector<bool> _contactPredicted;
+	/** One body batch for integrating the sub-stepped objects
+	*/
+	BodyArrays _ccdBodies;
+
+	/** Position, orientation and scale of the dynamic objects that moved this step, for the batched matrix rebuild
+	*/
+	TransformBatch _transformBatch;
+
+	/** Linear state of the dynamic objects being integrated this step, grouped by integrator
+	*/
+	BodyArrays _bodies;
+
+	/** The dynamic object for each body in _bodies
+	*/
+	std::vector<DynamicObject*> _bodyObjects;
+
+	/** Group t of _bodies runs from _integratorGroups[t] to _integratorGroups[t + 1]
+	*/
+	size_t _integratorGroups[INTEGRATOR_COUNT + 1];
+
+	/** The dynamic and kinematic objects in _transformBatch, in the same order
+	*/
+	std::vector<GameObject*> _transformObjects;
 
 	std::vector<GameObject*> _sceneGameObjects;
 
+	/** Memory for data that only lasts one step, reset at the start of each
+	*/
+	FrameArena _frameArena;
+
 	std::vector<std::string> _fileCode;
 };
 
@@ -0,0 +1,296 @@
+#include "Sensors.h"
+#include "Simd.h"
+#include <algorithm>
+#include <sstream>
+
+/*! \brief Brief description.
+*  SensorSet finds the bodies overlapping each sensor and turns the change since the last step into events.
+*
+*/
+SensorSet::SensorSet()
+{
+	_largestRadius = 0.0f;
+}
+
+size_t SensorSet::AddSphere(const glm::vec3& centre, float radius)
+{
+	Sensor sensor;
+	sensor.shape = SENSOR_SPHERE;
+	sensor.centre = centre;
+	sensor.halfExtent = glm::vec3(radius);
+	sensor.radius = radius;
+	sensor.normal = glm::vec3(0.0f);
+	sensor.offset = 0.0f;
+	_sensors.push_back(sensor);
+	_overlaps.push_back(std::vector<uint32_t>());
+	return _sensors.size() - 1;
+}
+
+size_t SensorSet::AddBox(const glm::vec3& lower, const glm::vec3& upper)
+{
+	Sensor sensor;
+	sensor.shape = SENSOR_BOX;
+	sensor.centre = 0.5f * (lower + upper);
+	sensor.halfExtent = 0.5f * glm::abs(upper - lower);
+	sensor.radius = 0.0f;
+	sensor.normal = glm::vec3(0.0f);
+	sensor.offset = 0.0f;
+	_sensors.push_back(sensor);
+	_overlaps.push_back(std::vector<uint32_t>());
+	return _sensors.size() - 1;
+}
+
+size_t SensorSet::AddHalfSpace(const glm::vec3& normal, float offset)
+{
+	Sensor sensor;
+	sensor.shape = SENSOR_HALFSPACE;
+	sensor.centre = glm::vec3(0.0f);
+	sensor.halfExtent = glm::vec3(0.0f);
+	sensor.radius = 0.0f;
+	sensor.normal = normal;
+	sensor.offset = offset;
+	_sensors.push_back(sensor);
+	_overlaps.push_back(std::vector<uint32_t>());
+	return _sensors.size() - 1;
+}
+
+void SensorSet::Translate(size_t sensor, const glm::vec3& offset)
+{
+	_sensors[sensor].centre += offset;
+	_sensors[sensor].offset += glm::dot(_sensors[sensor].normal, offset);
+}
+
+void SensorSet::Clear()
+{
+	_sensors.clear();
+	_overlaps.clear();
+	_events.clear();
+}
+
+void SensorSet::Update(const std::vector<float> position[3], const std::vector<float>& radius, size_t count, const SpatialHash& hash)
+{
+	_events.clear();
+
+	_largestRadius = 0.0f;
+	for (size_t i = 0; i < count; i++)
+	{
+		_largestRadius = std::max(_largestRadius, radius[i]);
+	}
+
+	for (size_t s = 0; s < _sensors.size(); s++)
+	{
+		_found.clear();
+		if (count > 0)
+		{
+			if (_sensors[s].shape == SENSOR_HALFSPACE)
+			{
+				FindBehindPlane(s, position, radius, count);
+			}
+			else
+			{
+				FindInBounds(s, position, radius, hash);
+				std::sort(_found.begin(), _found.end());
+			}
+		}
+
+		// Both lists are in index order, so one merge gives every event
+		const std::vector<uint32_t>& previous = _overlaps[s];
+		SensorEvent event;
+		event.sensor = (uint32_t)s;
+		size_t p = 0, f = 0;
+		while (p < previous.size() || f < _found.size())
+		{
+			if (f == _found.size() || (p < previous.size() && previous[p] < _found[f]))
+			{
+				event.body = previous[p++];
+				event.type = SENSOR_EXIT;
+			}
+			else if (p == previous.size() || _found[f] < previous[p])
+			{
+				event.body = _found[f++];
+				event.type = SENSOR_ENTER;
+			}
+			else
+			{
+				event.body = _found[f++];
+				event.type = SENSOR_STAY;
+				p++;
+			}
+			_events.push_back(event);
+		}
+		_overlaps[s].swap(_found);
+	}
+}
+
+void SensorSet::RemapBodies(const std::vector<uint32_t>& remap)
+{
+	for (size_t s = 0; s < _overlaps.size(); s++)
+	{
+		std::vector<uint32_t>& overlaps = _overlaps[s];
+		size_t kept = 0;
+		for (size_t i = 0; i < overlaps.size(); i++)
+		{
+			uint32_t body = PFG::RemapBody(remap, overlaps[i]);
+			if (body != BODY_REMOVED)
+			{
+				overlaps[kept++] = body;
+			}
+		}
+		overlaps.resize(kept);
+		// A body moved into a hole can land in front of ones it came after, and Update merges in index order
+		std::sort(overlaps.begin(), overlaps.end());
+	}
+
+	size_t kept = 0;
+	for (size_t i = 0; i < _events.size(); i++)
+	{
+		SensorEvent event = _events[i];
+		event.body = PFG::RemapBody(remap, event.body);
+		if (event.body != BODY_REMOVED)
+		{
+			_events[kept++] = event;
+		}
+	}
+	_events.resize(kept);
+	std::sort(_events.begin(), _events.end(), [](const SensorEvent& a, const SensorEvent& b) { return a.sensor < b.sensor || (a.sensor == b.sensor && a.body < b.body); });
+}
+
+void SensorSet::FindInBounds(size_t sensor, const std::vector<float> position[3], const std::vector<float>& radius, const SpatialHash& hash)
+{
+	const Sensor& volume = _sensors[sensor];
+	const glm::vec3 reach = volume.halfExtent + glm::vec3(_largestRadius);
+	hash.GetBoxBuckets(volume.centre - reach, volume.centre + reach, _buckets);
+	const std::vector<uint32_t>& order = hash.GetOrder();
+
+	for (size_t n = 0; n < _buckets.size(); n++)
+	{
+		uint32_t first, last;
+		hash.GetBucketRange(_buckets[n], first, last);
+		for (uint32_t o = first; o < last; o++)
+		{
+			const uint32_t i = order[o];
+			glm::vec3 delta(position[0][i] - volume.centre.x, position[1][i] - volume.centre.y, position[2][i] - volume.centre.z);
+			if (volume.shape == SENSOR_BOX)
+			{
+				// Distance from the centre to the nearest point of the box
+				delta = glm::max(glm::abs(delta) - volume.halfExtent, glm::vec3(0.0f));
+				if (glm::dot(delta, delta) < radius[i] * radius[i])
+				{
+					_found.push_back(i);
+				}
+			}
+			else
+			{
+				float reachSphere = volume.radius + radius[i];
+				if (glm::dot(delta, delta) < reachSphere * reachSphere)
+				{
+					_found.push_back(i);
+				}
+			}
+		}
+	}
+}
+
+void SensorSet::FindBehindPlane(size_t sensor, const std::vector<float> position[3], const std::vector<float>& radius, size_t count)
+{
+	const Sensor& volume = _sensors[sensor];
+	const __m128 nx = _mm_set1_ps(volume.normal.x);
+	const __m128 ny = _mm_set1_ps(volume.normal.y);
+	const __m128 nz = _mm_set1_ps(volume.normal.z);
+	const __m128 offset = _mm_set1_ps(volume.offset);
+
+	for (size_t i = 0; i < count; i += 4)
+	{
+		const size_t remaining = count - i;
+		__m128 x, y, z, r;
+		if (remaining >= 4)
+		{
+			x = _mm_loadu_ps(&position[0][i]);
+			y = _mm_loadu_ps(&position[1][i]);
+			z = _mm_loadu_ps(&position[2][i]);
+			r = _mm_loadu_ps(&radius[i]);
+		}
+		else
+		{
+			// The last few bodies are loaded one at a time so nothing past the end is read
+			float lanes[4][4] = {};
+			for (size_t lane = 0; lane < remaining; lane++)
+			{
+				lanes[0][lane] = position[0][i + lane];
+				lanes[1][lane] = position[1][i + lane];
+				lanes[2][lane] = position[2][i + lane];
+				lanes[3][lane] = radius[i + lane];
+			}
+			x = _mm_loadu_ps(lanes[0]);
+			y = _mm_loadu_ps(lanes[1]);
+			z = _mm_loadu_ps(lanes[2]);
+			r = _mm_loadu_ps(lanes[3]);
+		}
+
+		__m128 distance = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, x), _mm_mul_ps(ny, y)), _mm_mul_ps(nz, z)), offset);
+		__m128 inside = _mm_and_ps(_mm_cmplt_ps(distance, r), PFG::ValidLanes(remaining));
+		int mask = _mm_movemask_ps(inside);
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if (mask & (1 << lane))
+			{
+				_found.push_back((uint32_t)(i + lane));
+			}
+		}
+	}
+}
+
+bool PFG::ParseSensor(const std::string& line, SensorSet& sensors)
+{
+	std::istringstream stream(line);
+	std::string kind;
+	if (!(stream >> kind))
+	{
+		return false;
+	}
+
+	if (kind == "sphere")
+	{
+		glm::vec3 centre;
+		float radius = 0.0f;
+		if (!(stream >> centre.x >> centre.y >> centre.z >> radius) || radius <= 0.0f)
+		{
+			return false;
+		}
+		sensors.AddSphere(centre, radius);
+		return true;
+	}
+	if (kind == "box")
+	{
+		glm::vec3 lower, upper;
+		if (!(stream >> lower.x >> lower.y >> lower.z >> upper.x >> upper.y >> upper.z))
+		{
+			return false;
+		}
+		sensors.AddBox(glm::min(lower, upper), glm::max(lower, upper));
+		return true;
+	}
+	if (kind == "halfSpace")
+	{
+		glm::vec3 normal;
+		float offset = 0.0f;
+		if (!(stream >> normal.x >> normal.y >> normal.z >> offset) || glm::length(normal) == 0.0f)
+		{
+			return false;
+		}
+		sensors.AddHalfSpace(glm::normalize(normal), offset / glm::length(normal));
+		return true;
+	}
+	return false;
+}
+
+const char* PFG::GetSensorEventName(SensorEventType type)
+{
+	switch (type)
+	{
+	case SENSOR_ENTER: return "enter";
+	case SENSOR_STAY: return "stay";
+	case SENSOR_EXIT: return "exit";
+	}
+	return "unknown";
+}
@@ -0,0 +1,145 @@
+#ifndef _Sensors_H_
+#define _Sensors_H_
+
+#include "BodyRemap.h"
+#include "SpatialHash.h"
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/** Shape of a sensor volume
+*/
+enum SensorShape
+{
+	SENSOR_SPHERE = 0, /*!< Ball around a centre */
+	SENSOR_BOX = 1, /*!< Axis aligned box between two corners */
+	SENSOR_HALFSPACE = 2 /*!< Everything behind a plane */
+};
+
+/** What happened between a sensor and a body this step
+*/
+enum SensorEventType
+{
+	SENSOR_ENTER = 0, /*!< Started overlapping this step */
+	SENSOR_STAY = 1, /*!< Overlapping last step and this step */
+	SENSOR_EXIT = 2 /*!< Overlapped last step and no longer does */
+};
+
+struct SensorEvent
+{
+	uint32_t sensor; /*!< Index of the sensor in the SensorSet */
+	uint32_t body; /*!< Index of the body in the arrays handed to Update */
+	SensorEventType type;
+};
+
+/*! \brief Brief description.
+*  SensorSet holds trigger volumes that notice bodies without touching them. A sensor never makes a contact or
+*  changes a body, it only keeps track of which bodies overlap it.
+*
+*  Each step the sensors are checked against the bodies through the caller's SpatialHash, so a sphere or box
+*  sensor only reads the buckets it covers. A half-space has no bounds and is checked against every body, four at
+*  a time. The bodies overlapping each sensor are kept in index order from one step to the next, and the two
+*  lists are merged to give the enter, stay and exit events. All of a step's events go into one buffer, sorted by
+*  sensor and then by body.
+*
+*/
+class SensorSet
+{
+public:
+
+	/** SensorSet constructor
+	*/
+	SensorSet();
+
+	/** Add a sensor, the return value is its index in the events
+	*/
+	size_t AddSphere(const glm::vec3& centre, float radius);
+	size_t AddBox(const glm::vec3& lower, const glm::vec3& upper);
+	/** A half-space sensor
+	* @param glm::vec3 normal unit normal pointing out of the volume
+	* @param float offset dot(normal, x) for any point x on the plane
+	*/
+	size_t AddHalfSpace(const glm::vec3& normal, float offset);
+	/** Move a sensor, a sphere or box by its centre, a half-space along its normal
+	*/
+	void Translate(size_t sensor, const glm::vec3& offset);
+	/** Remove every sensor
+	*/
+	void Clear();
+	size_t Size() const { return _sensors.size(); }
+
+	/** Find the bodies overlapping each sensor and write this step's events
+	* @param position x, y and z of each body's centre
+	* @param std::vector<float> radius of each body
+	* @param size_t count number of bodies, the arrays can be longer
+	* @param SpatialHash hash built from the same positions this step
+	*/
+	void Update(const std::vector<float> position[3], const std::vector<float>& radius, size_t count, const SpatialHash& hash);
+
+	/** Renumber the bodies in the overlaps and events after the scene removed some
+	* Removed bodies are dropped without an exit event, the next Update carries on from the rest
+	* @param std::vector<uint32_t> remap new index of each old body, or BODY_REMOVED
+	*/
+	void RemapBodies(const std::vector<uint32_t>& remap);
+
+	/** Events from the last Update
+	*/
+	const std::vector<SensorEvent>& GetEvents() const { return _events; }
+	/** Bodies overlapping a sensor after the last Update, in index order
+	*/
+	const std::vector<uint32_t>& GetOverlaps(size_t sensor) const { return _overlaps[sensor]; }
+
+private:
+
+	/** Add the bodies in the hash buckets that overlap a sensor's bounds to _found
+	*/
+	void FindInBounds(size_t sensor, const std::vector<float> position[3], const std::vector<float>& radius, const SpatialHash& hash);
+	/** Add every body behind a half-space to _found
+	*/
+	void FindBehindPlane(size_t sensor, const std::vector<float> position[3], const std::vector<float>& radius, size_t count);
+
+	struct Sensor
+	{
+		SensorShape shape;
+		glm::vec3 centre; /*!< Sphere or box centre */
+		glm::vec3 halfExtent; /*!< Box half widths */
+		float radius; /*!< Sphere radius */
+		glm::vec3 normal; /*!< Half-space normal */
+		float offset; /*!< Half-space offset along the normal */
+	};
+
+	std::vector<Sensor> _sensors;
+
+	/** Bodies each sensor overlapped at the last Update, in index order
+	*/
+	std::vector<std::vector<uint32_t> > _overlaps;
+	std::vector<SensorEvent> _events;
+
+	/** Working space for one sensor's bodies this step
+	*/
+	std::vector<uint32_t> _found;
+	std::vector<uint32_t> _buckets;
+	/** Largest body radius at the last Update, to grow the sensors' bounds by
+	*/
+	float _largestRadius;
+};
+
+namespace PFG
+{
+	/*
+	Add a sensor from a line of the scene file, the part after 'sensor'. One of
+	  sphere <x> <y> <z> <radius>
+	  box <x0> <y0> <z0> <x1> <y1> <z1>
+	  halfSpace <nx> <ny> <nz> <offset>
+	Returns false if the line can't be read
+	*/
+	bool ParseSensor(const std::string& line, SensorSet& sensors);
+
+	/*
+	Name of an event type, for printing
+	*/
+	const char* GetSensorEventName(SensorEventType type);
+}
+
+#endif //!_Sensors_H_
@@ -0,0 +1,50 @@
+#ifndef _Simd_H_
+#define _Simd_H_
+
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#include <stddef.h>
+
+/*! \brief Brief description.
+*  Small SSE helpers shared by the kernels that run over flat arrays four bodies at a time.
+*
+*/
+
+namespace PFG
+{
+	/*
+	Pick a where the mask is set and b elsewhere
+	*/
+	inline __m128 Select(__m128 mask, __m128 a, __m128 b)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+
+	/*
+	Sum of the four lanes
+	*/
+	inline float HorizontalSum(__m128 v)
+	{
+		__m128 pairs = _mm_add_ps(v, _mm_movehl_ps(v, v));
+		return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+	}
+
+	/*
+	Mask of the lanes that hold a body when only remaining of the four do
+	*/
+	inline __m128 ValidLanes(size_t remaining)
+	{
+		return _mm_castsi128_ps(_mm_set_epi32(remaining > 3 ? -1 : 0, remaining > 2 ? -1 : 0, remaining > 1 ? -1 : 0, -1));
+	}
+
+	/*
+	Number of lanes set in a mask
+	*/
+	inline int CountLanes(__m128 mask)
+	{
+		int bits = _mm_movemask_ps(mask);
+		return (bits & 1) + ((bits >> 1) & 1) + ((bits >> 2) & 1) + ((bits >> 3) & 1);
+	}
+}
+
+#endif //!_Simd_H_
@@ -0,0 +1,436 @@
+#include "SoftBody.h"
+#include <algorithm>
+#include <cmath>
+
+// Shear springs across a cloth quad and bend springs skipping a node, as a fraction of the stretch stiffness
+static const float CLOTH_SHEAR_STIFFNESS = 0.5f;
+static const float CLOTH_BEND_STIFFNESS = 0.1f;
+
+SoftBody::SoftBody()
+{
+	_gravity = glm::vec3(0.0f, -9.8f, 0.0f);
+	_thickness = 0.05f;
+	_friction = 0.2f;
+	_tolerance = 1.0e-5f;
+	_maxIterations = 500;
+	_lastResidual = 0.0f;
+	_patternDirty = true;
+}
+
+void SoftBody::Clear()
+{
+	_position.clear();
+	_velocity.clear();
+	_mass.clear();
+	_pinned.clear();
+	_springs.clear();
+	_deltaV.clear();
+	_patternDirty = true;
+}
+
+size_t SoftBody::AddNode(const glm::vec3& position, float mass)
+{
+	_position.push_back(position);
+	_velocity.push_back(glm::vec3(0.0f));
+	_mass.push_back(mass);
+	_pinned.push_back(0);
+	_patternDirty = true;
+	return _position.size() - 1;
+}
+
+void SoftBody::AddSpring(size_t a, size_t b, float stiffness, float damping)
+{
+	Spring spring;
+	spring.a = (uint32_t)a;
+	spring.b = (uint32_t)b;
+	spring.restLength = glm::length(_position[b] - _position[a]);
+	spring.stiffness = stiffness;
+	spring.damping = damping;
+	spring.blockAB = 0;
+	spring.blockBA = 0;
+	_springs.push_back(spring);
+	_patternDirty = true;
+}
+
+void SoftBody::Pin(size_t node, bool pinned)
+{
+	_pinned[node] = pinned ? 1 : 0;
+	if (pinned)
+	{
+		_velocity[node] = glm::vec3(0.0f);
+	}
+}
+
+size_t SoftBody::AddCloth(const glm::vec3& corner, const glm::vec3& edgeU, const glm::vec3& edgeV, int nu, int nv, float mass, float stiffness, float damping)
+{
+	const size_t first = _position.size();
+	const float nodeMass = mass / (nu * nv);
+	for (int v = 0; v < nv; v++)
+	{
+		for (int u = 0; u < nu; u++)
+		{
+			AddNode(corner + edgeU * ((float)u / (nu - 1)) + edgeV * ((float)v / (nv - 1)), nodeMass);
+		}
+	}
+
+	for (int v = 0; v < nv; v++)
+	{
+		for (int u = 0; u < nu; u++)
+		{
+			size_t node = first + v * nu + u;
+			// Stretch along both edges
+			if (u + 1 < nu) AddSpring(node, node + 1, stiffness, damping);
+			if (v + 1 < nv) AddSpring(node, node + nu, stiffness, damping);
+			// Shear across each quad
+			if (u + 1 < nu && v + 1 < nv)
+			{
+				AddSpring(node, node + nu + 1, CLOTH_SHEAR_STIFFNESS * stiffness, damping);
+				AddSpring(node + 1, node + nu, CLOTH_SHEAR_STIFFNESS * stiffness, damping);
+			}
+			// Bending, resisting folds along either edge
+			if (u + 2 < nu) AddSpring(node, node + 2, CLOTH_BEND_STIFFNESS * stiffness, damping);
+			if (v + 2 < nv) AddSpring(node, node + 2 * nu, CLOTH_BEND_STIFFNESS * stiffness, damping);
+		}
+	}
+	return first;
+}
+
+size_t SoftBody::AddBlock(const glm::vec3& lower, float spacing, int nx, int ny, int nz, float mass, float stiffness, float damping)
+{
+	const size_t first = _position.size();
+	const float nodeMass = mass / (nx * ny * nz);
+	for (int z = 0; z < nz; z++)
+	{
+		for (int y = 0; y < ny; y++)
+		{
+			for (int x = 0; x < nx; x++)
+			{
+				AddNode(lower + spacing * glm::vec3((float)x, (float)y, (float)z), nodeMass);
+			}
+		}
+	}
+
+	// Join each node to the 13 of its 26 neighbours that come after it, so every pair is joined once
+	for (int z = 0; z < nz; z++)
+	{
+		for (int y = 0; y < ny; y++)
+		{
+			for (int x = 0; x < nx; x++)
+			{
+				for (int dz = 0; dz <= 1; dz++)
+				{
+					for (int dy = (dz == 0 ? 0 : -1); dy <= 1; dy++)
+					{
+						for (int dx = (dz == 0 && dy == 0 ? 1 : -1); dx <= 1; dx++)
+						{
+							int ox = x + dx, oy = y + dy, oz = z + dz;
+							if (ox < 0 || ox >= nx || oy < 0 || oy >= ny || oz >= nz)
+							{
+								continue;
+							}
+							AddSpring(first + (z * ny + y) * nx + x, first + (oz * ny + oy) * nx + ox, stiffness, damping);
+						}
+					}
+				}
+			}
+		}
+	}
+	return first;
+}
+
+void SoftBody::BuildPattern()
+{
+	const size_t nodes = _position.size();
+
+	// Every node couples to itself and to each node it shares a spring with
+	std::vector<std::vector<uint32_t> > neighbours(nodes);
+	for (size_t i = 0; i < nodes; i++)
+	{
+		neighbours[i].push_back((uint32_t)i);
+	}
+	for (size_t s = 0; s < _springs.size(); s++)
+	{
+		neighbours[_springs[s].a].push_back(_springs[s].b);
+		neighbours[_springs[s].b].push_back(_springs[s].a);
+	}
+
+	_rowStart.assign(nodes + 1, 0);
+	_columns.clear();
+	_diagonal.resize(nodes);
+	for (size_t i = 0; i < nodes; i++)
+	{
+		std::vector<uint32_t>& row = neighbours[i];
+		std::sort(row.begin(), row.end());
+		row.erase(std::unique(row.begin(), row.end()), row.end());
+
+		_rowStart[i] = (uint32_t)_columns.size();
+		_diagonal[i] = _rowStart[i] + (uint32_t)(std::lower_bound(row.begin(), row.end(), (uint32_t)i) - row.begin());
+		_columns.insert(_columns.end(), row.begin(), row.end());
+	}
+	_rowStart[nodes] = (uint32_t)_columns.size();
+	_blocks.resize(_columns.size());
+
+	// Each spring writes straight to its two off-diagonal blocks
+	for (size_t s = 0; s < _springs.size(); s++)
+	{
+		Spring& spring = _springs[s];
+		spring.blockAB = (uint32_t)(std::lower_bound(_columns.begin() + _rowStart[spring.a], _columns.begin() + _rowStart[spring.a + 1], spring.b) - _columns.begin());
+		spring.blockBA = (uint32_t)(std::lower_bound(_columns.begin() + _rowStart[spring.b], _columns.begin() + _rowStart[spring.b + 1], spring.a) - _columns.begin());
+	}
+
+	_rhs.resize(nodes);
+	_deltaV.resize(nodes, glm::vec3(0.0f));
+	_residual.resize(nodes);
+	_direction.resize(nodes);
+	_product.resize(nodes);
+	_preconditioned.resize(nodes);
+	_inverseDiagonal.resize(nodes);
+	_patternDirty = false;
+}
+
+void SoftBody::Assemble(float deltaTs)
+{
+	const size_t nodes = _position.size();
+	const float dt2 = deltaTs * deltaTs;
+
+	std::fill(_blocks.begin(), _blocks.end(), glm::mat3(0.0f));
+	for (size_t i = 0; i < nodes; i++)
+	{
+		_blocks[_diagonal[i]] = glm::mat3(_mass[i]);
+		_rhs[i] = deltaTs * _mass[i] * _gravity;
+	}
+
+	for (size_t s = 0; s < _springs.size(); s++)
+	{
+		const Spring& spring = _springs[s];
+		glm::vec3 delta = _position[spring.b] - _position[spring.a];
+		float length = glm::length(delta);
+		if (length < 1.0e-6f)
+		{
+			continue;
+		}
+		glm::vec3 n = delta / length;
+		glm::vec3 relativeVelocity = _velocity[spring.b] - _velocity[spring.a];
+
+		// Force on a, b takes the opposite
+		glm::vec3 force = (spring.stiffness * (length - spring.restLength) + spring.damping * glm::dot(relativeVelocity, n)) * n;
+
+		// Stiffness -df_a/dx_a. The sideways part is dropped when the spring is compressed, it would make the
+		// matrix indefinite and the conjugate gradient solve could fail
+		glm::mat3 nn = glm::outerProduct(n, n);
+		glm::mat3 stiffness = spring.stiffness * (nn + std::max(1.0f - spring.restLength / length, 0.0f) * (glm::mat3(1.0f) - nn));
+		glm::mat3 block = (deltaTs * spring.damping) * nn + dt2 * stiffness;
+
+		_blocks[_diagonal[spring.a]] += block;
+		_blocks[_diagonal[spring.b]] += block;
+		_blocks[spring.blockAB] -= block;
+		_blocks[spring.blockBA] -= block;
+
+		// dt (f + dt df/dx v)
+		glm::vec3 stiffnessVelocity = dt2 * (stiffness * relativeVelocity);
+		_rhs[spring.a] += deltaTs * force + stiffnessVelocity;
+		_rhs[spring.b] -= deltaTs * force + stiffnessVelocity;
+	}
+
+	for (size_t i = 0; i < nodes; i++)
+	{
+		_inverseDiagonal[i] = glm::inverse(_blocks[_diagonal[i]]);
+	}
+}
+
+void SoftBody::Multiply(const std::vector<glm::vec3>& x, std::vector<glm::vec3>& y) const
+{
+	for (size_t i = 0; i < x.size(); i++)
+	{
+		glm::vec3 sum(0.0f);
+		for (uint32_t k = _rowStart[i]; k < _rowStart[i + 1]; k++)
+		{
+			sum += _blocks[k] * x[_columns[k]];
+		}
+		y[i] = sum;
+	}
+}
+
+void SoftBody::Filter(std::vector<glm::vec3>& x) const
+{
+	for (size_t i = 0; i < x.size(); i++)
+	{
+		if (_pinned[i])
+		{
+			x[i] = glm::vec3(0.0f);
+		}
+	}
+}
+
+int SoftBody::Solve()
+{
+	const size_t nodes = _position.size();
+
+	// Start from the last step's change, the forces rarely change much between steps
+	Filter(_rhs);
+	Filter(_deltaV);
+	Multiply(_deltaV, _product);
+	float rhsNorm = 0.0f;
+	for (size_t i = 0; i < nodes; i++)
+	{
+		_residual[i] = _rhs[i] - _product[i];
+		rhsNorm += glm::dot(_rhs[i], _rhs[i]);
+	}
+	Filter(_residual);
+
+	float delta = 0.0f;
+	float residualNorm = 0.0f;
+	for (size_t i = 0; i < nodes; i++)
+	{
+		_preconditioned[i] = _inverseDiagonal[i] * _residual[i];
+		_direction[i] = _preconditioned[i];
+		delta += glm::dot(_residual[i], _preconditioned[i]);
+		residualNorm += glm::dot(_residual[i], _residual[i]);
+	}
+	Filter(_direction);
+
+	const float target = _tolerance * _tolerance * rhsNorm;
+	int iteration = 0;
+	while (iteration < _maxIterations && residualNorm > target)
+	{
+		Multiply(_direction, _product);
+		Filter(_product);
+
+		float curvature = 0.0f;
+		for (size_t i = 0; i < nodes; i++)
+		{
+			curvature += glm::dot(_direction[i], _product[i]);
+		}
+		if (curvature <= 0.0f)
+		{
+			break;
+		}
+		float alpha = delta / curvature;
+
+		float nextDelta = 0.0f;
+		residualNorm = 0.0f;
+		for (size_t i = 0; i < nodes; i++)
+		{
+			_deltaV[i] += alpha * _direction[i];
+			_residual[i] -= alpha * _product[i];
+			_preconditioned[i] = _inverseDiagonal[i] * _residual[i];
+			nextDelta += glm::dot(_residual[i], _preconditioned[i]);
+			residualNorm += glm::dot(_residual[i], _residual[i]);
+		}
+
+		float beta = nextDelta / delta;
+		delta = nextDelta;
+		for (size_t i = 0; i < nodes; i++)
+		{
+			_direction[i] = _preconditioned[i] + beta * _direction[i];
+		}
+		Filter(_direction);
+		iteration++;
+	}
+
+	_lastResidual = rhsNorm > 0.0f ? std::sqrt(residualNorm / rhsNorm) : 0.0f;
+	return iteration;
+}
+
+int SoftBody::Step(float deltaTs, const PlaneColliderSet& planes, const std::vector<DynamicObject*>& spheres)
+{
+	if (_position.empty())
+	{
+		return 0;
+	}
+	if (_patternDirty)
+	{
+		BuildPattern();
+	}
+
+	Assemble(deltaTs);
+	int iterations = Solve();
+
+	for (size_t i = 0; i < _position.size(); i++)
+	{
+		_velocity[i] += _deltaV[i];
+		_position[i] += deltaTs * _velocity[i];
+	}
+
+	Collide(deltaTs, planes, spheres);
+	return iterations;
+}
+
+void SoftBody::Collide(float deltaTs, const PlaneColliderSet& planes, const std::vector<DynamicObject*>& spheres)
+{
+	for (size_t p = 0; p < planes.Size(); p++)
+	{
+		const glm::vec3 normal = planes.GetNormal(p);
+		const float offset = planes.GetOffset(p);
+		const bool halfSpace = planes.IsHalfSpace(p);
+
+		for (size_t i = 0; i < _position.size(); i++)
+		{
+			if (_pinned[i])
+			{
+				continue;
+			}
+
+			float distance = glm::dot(normal, _position[i]) - offset;
+			float normalSpeed = glm::dot(normal, _velocity[i]);
+			// A thin plane only stops nodes that started the step in front of it
+			if (distance >= _thickness || (!halfSpace && distance - normalSpeed * deltaTs < -_thickness))
+			{
+				continue;
+			}
+
+			_position[i] += (_thickness - distance) * normal;
+			if (normalSpeed < 0.0f)
+			{
+				_velocity[i] -= normalSpeed * normal;
+				normalSpeed = 0.0f;
+			}
+			_velocity[i] -= _friction * (_velocity[i] - normalSpeed * normal);
+		}
+	}
+
+	for (size_t s = 0; s < spheres.size(); s++)
+	{
+		DynamicObject* sphere = spheres[s];
+		glm::vec3 centre = sphere->GetPosition();
+		glm::vec3 sphereVelocity = sphere->GetVelocity();
+		const float sphereInvMass = 1.0f / sphere->GetMass();
+		const float reach = sphere->GetBoundingRadius() + _thickness;
+		bool touched = false;
+
+		// One node at a time, each contact sees the sphere as the last one left it
+		for (size_t i = 0; i < _position.size(); i++)
+		{
+			glm::vec3 delta = _position[i] - centre;
+			float distanceSq = glm::dot(delta, delta);
+			if (distanceSq >= reach * reach || distanceSq == 0.0f)
+			{
+				continue;
+			}
+			touched = true;
+
+			float distance = std::sqrt(distanceSq);
+			glm::vec3 n = delta / distance;
+			float nodeInvMass = _pinned[i] ? 0.0f : 1.0f / _mass[i];
+			float invSum = nodeInvMass + sphereInvMass;
+			float depth = reach - distance;
+
+			_position[i] += (depth * nodeInvMass / invSum) * n;
+			centre -= (depth * sphereInvMass / invSum) * n;
+
+			float closing = glm::dot(_velocity[i] - sphereVelocity, n);
+			if (closing < 0.0f)
+			{
+				float impulse = -closing / invSum;
+				_velocity[i] += impulse * nodeInvMass * n;
+				sphereVelocity -= impulse * sphereInvMass * n;
+			}
+		}
+
+		if (touched)
+		{
+			sphere->SetPosition(centre);
+			sphere->SetVelocity(sphereVelocity);
+		}
+	}
+}
@@ -0,0 +1,161 @@
+#ifndef _SoftBody_H_
+#define _SoftBody_H_
+
+#include "DynamicObject.h"
+#include "PlaneColliders.h"
+#include <glm/glm.hpp>
+#include <vector>
+#include <stdint.h>
+
+/*! \brief Brief description.
+*  SoftBody is a mass-spring model for cloth and deformable solids. Nodes are point masses joined by damped
+*  springs, stepped with implicit (backward) Euler so stiff springs stay stable at frame rate time steps where
+*  the explicit integrators would need a tiny step (Baraff and Witkin 1998).
+*
+*  Each step linearises the spring forces about the current state and solves
+*  (M - dt df/dv - dt^2 df/dx) dv = dt (f + dt df/dx v) for the change in velocity. The matrix has a 3x3 block
+*  for every node and for every pair of nodes joined by a spring, so it is kept in block compressed sparse row
+*  form. The sparsity pattern only depends on which nodes are joined, so it is built once and only the block
+*  values are refilled each step. The system is solved with conjugate gradients, preconditioned by the inverse
+*  of each node's diagonal block, starting from the last step's answer.
+*
+*  Pinned nodes are held still by filtering their rows out of the solve. After the solve the nodes are moved and
+*  pushed out of the static planes and the dynamic spheres, with the spheres taking the opposite impulse.
+*
+*/
+class SoftBody
+{
+public:
+
+	/** SoftBody constructor
+	*/
+	SoftBody();
+
+	/** Remove every node and spring
+	*/
+	void Clear();
+	/** Add a node
+	* @return its index
+	*/
+	size_t AddNode(const glm::vec3& position, float mass);
+	/** Join two nodes with a spring whose rest length is their current distance
+	* @param float stiffness spring constant
+	* @param float damping damping along the spring
+	*/
+	void AddSpring(size_t a, size_t b, float stiffness, float damping);
+	/** Hold a node where it is
+	*/
+	void Pin(size_t node, bool pinned = true);
+
+	/** A rectangular sheet of cloth
+	* @param glm::vec3 corner position of the first node
+	* @param glm::vec3 edgeU, edgeV the two sides of the sheet
+	* @param int nu, nv number of nodes along each side
+	* @param float mass total mass of the sheet
+	* @param float stiffness of the stretch springs, the shear and bend springs are weaker
+	* @return index of the first node, nodes are numbered along edgeU first
+	*/
+	size_t AddCloth(const glm::vec3& corner, const glm::vec3& edgeU, const glm::vec3& edgeV, int nu, int nv, float mass, float stiffness, float damping);
+	/** A solid box of nodes joined to all 26 neighbours
+	* @param glm::vec3 lower corner of the box
+	* @param float spacing distance between nodes
+	* @param int nx, ny, nz number of nodes along each side
+	* @param float mass total mass of the block
+	* @return index of the first node
+	*/
+	size_t AddBlock(const glm::vec3& lower, float spacing, int nx, int ny, int nz, float mass, float stiffness, float damping);
+
+	void SetGravity(const glm::vec3& gravity) { _gravity = gravity; }
+	/** Collision radius of each node
+	*/
+	void SetThickness(float thickness) { _thickness = thickness; }
+	/** Fraction of the sliding velocity lost in each contact
+	*/
+	void SetFriction(float friction) { _friction = friction; }
+	/** Conjugate gradient stopping point, relative to the size of the right hand side, and iteration limit
+	*/
+	void SetSolverTolerance(float tolerance, int maxIterations) { _tolerance = tolerance; _maxIterations = maxIterations; }
+
+	/** Advance the body by one implicit step and collide it with the spheres and planes
+	* @param float deltaTs step length
+	* @param PlaneColliderSet planes the static planes, already built for this step
+	* @param spheres the dynamic spheres, each node that hits one pushes it back
+	* @return conjugate gradient iterations taken
+	*/
+	int Step(float deltaTs, const PlaneColliderSet& planes, const std::vector<DynamicObject*>& spheres);
+
+	size_t GetNodeCount() const { return _position.size(); }
+	size_t GetSpringCount() const { return _springs.size(); }
+	const glm::vec3& GetPosition(size_t node) const { return _position[node]; }
+	const glm::vec3& GetVelocity(size_t node) const { return _velocity[node]; }
+	float GetThickness() const { return _thickness; }
+	/** Residual left by the last solve, relative to the right hand side
+	*/
+	float GetLastResidual() const { return _lastResidual; }
+
+private:
+
+	struct Spring
+	{
+		uint32_t a, b;
+		float restLength;
+		float stiffness;
+		float damping;
+		/** Where the off-diagonal blocks (a, b) and (b, a) sit in the block array
+		*/
+		uint32_t blockAB, blockBA;
+	};
+
+	/** Build the block sparsity pattern from the springs
+	*/
+	void BuildPattern();
+	/** Fill the blocks of the system matrix and the right hand side for this step
+	*/
+	void Assemble(float deltaTs);
+	/** Solve the system for _deltaV with preconditioned conjugate gradients
+	* @return iterations taken
+	*/
+	int Solve();
+	/** y = A x over the block rows
+	*/
+	void Multiply(const std::vector<glm::vec3>& x, std::vector<glm::vec3>& y) const;
+	/** Zero the parts of a vector that pinned nodes can't move along
+	*/
+	void Filter(std::vector<glm::vec3>& x) const;
+	void Collide(float deltaTs, const PlaneColliderSet& planes, const std::vector<DynamicObject*>& spheres);
+
+	std::vector<glm::vec3> _position;
+	std::vector<glm::vec3> _velocity;
+	std::vector<float> _mass;
+	std::vector<uint8_t> _pinned;
+	std::vector<Spring> _springs;
+
+	/** Block CSR matrix, row i has blocks _rowStart[i] to _rowStart[i + 1], each with the node it couples to
+	*/
+	std::vector<uint32_t> _rowStart;
+	std::vector<uint32_t> _columns;
+	std::vector<glm::mat3> _blocks;
+	/** Block index of each row's diagonal
+	*/
+	std::vector<uint32_t> _diagonal;
+	bool _patternDirty;
+
+	/** Solver vectors, kept between steps so they are only allocated once
+	*/
+	std::vector<glm::vec3> _rhs;
+	std::vector<glm::vec3> _deltaV;
+	std::vector<glm::vec3> _residual;
+	std::vector<glm::vec3> _direction;
+	std::vector<glm::vec3> _product;
+	std::vector<glm::vec3> _preconditioned;
+	std::vector<glm::mat3> _inverseDiagonal;
+
+	glm::vec3 _gravity;
+	float _thickness;
+	float _friction;
+	float _tolerance;
+	int _maxIterations;
+	float _lastResidual;
+};
+
+#endif //!_SoftBody_H_
@@ -0,0 +1,140 @@
+#include "SpatialHash.h"
+#include <algorithm>
+#include <cmath>
+
+// Smallest hash table, so a handful of points doesn't pile into a few buckets
+static const uint32_t HASH_MIN_BUCKETS = 64;
+
+SpatialHash::SpatialHash()
+{
+	_cellSize = 1.0f;
+	_invCellSize = 1.0f;
+	_mask = 0;
+}
+
+int32_t SpatialHash::CellCoordinate(float v) const
+{
+	return (int32_t)std::floor(v * _invCellSize);
+}
+
+uint32_t SpatialHash::HashCell(int32_t x, int32_t y, int32_t z) const
+{
+	// Large primes spread neighbouring cells over the whole table
+	return ((uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u ^ (uint32_t)z * 83492791u) & _mask;
+}
+
+uint32_t SpatialHash::GetBucket(float x, float y, float z) const
+{
+	return HashCell(CellCoordinate(x), CellCoordinate(y), CellCoordinate(z));
+}
+
+void SpatialHash::Build(const std::vector<float> position[3], size_t count, float cellSize)
+{
+	_cellSize = cellSize;
+	_invCellSize = 1.0f / cellSize;
+
+	uint32_t buckets = HASH_MIN_BUCKETS;
+	while (buckets < 2 * count)
+	{
+		buckets *= 2;
+	}
+	_mask = buckets - 1;
+
+	// Counting sort by bucket
+	_bucketStart.assign(buckets + 1, 0);
+	_pointBucket.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		uint32_t bucket = GetBucket(position[0][i], position[1][i], position[2][i]);
+		_pointBucket[i] = bucket;
+		_bucketStart[bucket + 1]++;
+	}
+	for (uint32_t b = 0; b < buckets; b++)
+	{
+		_bucketStart[b + 1] += _bucketStart[b];
+	}
+
+	// Scatter using the starts as cursors, then shift them back
+	_order.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		_order[_bucketStart[_pointBucket[i]]++] = (uint32_t)i;
+	}
+	for (uint32_t b = buckets; b > 0; b--)
+	{
+		_bucketStart[b] = _bucketStart[b - 1];
+	}
+	_bucketStart[0] = 0;
+}
+
+int SpatialHash::GetNeighbourBuckets(float x, float y, float z, uint32_t buckets[27]) const
+{
+	const int32_t cx = CellCoordinate(x);
+	const int32_t cy = CellCoordinate(y);
+	const int32_t cz = CellCoordinate(z);
+
+	int count = 0;
+	for (int32_t dz = -1; dz <= 1; dz++)
+	{
+		for (int32_t dy = -1; dy <= 1; dy++)
+		{
+			for (int32_t dx = -1; dx <= 1; dx++)
+			{
+				uint32_t bucket = HashCell(cx + dx, cy + dy, cz + dz);
+				// Skip empty buckets and ones already listed, so no point is visited twice
+				if (_bucketStart[bucket] == _bucketStart[bucket + 1] || std::find(buckets, buckets + count, bucket) != buckets + count)
+				{
+					continue;
+				}
+				buckets[count++] = bucket;
+			}
+		}
+	}
+	return count;
+}
+
+void SpatialHash::GetBoxBuckets(const glm::vec3& lower, const glm::vec3& upper, std::vector<uint32_t>& buckets) const
+{
+	buckets.clear();
+	if (_order.empty())
+	{
+		return;
+	}
+
+	const int32_t x0 = CellCoordinate(lower.x), x1 = CellCoordinate(upper.x);
+	const int32_t y0 = CellCoordinate(lower.y), y1 = CellCoordinate(upper.y);
+	const int32_t z0 = CellCoordinate(lower.z), z1 = CellCoordinate(upper.z);
+
+	// A box with more cells than the table has buckets may as well read every bucket
+	int64_t cells = (int64_t)(x1 - x0 + 1) * (y1 - y0 + 1) * (z1 - z0 + 1);
+	if (cells > (int64_t)_mask + 1)
+	{
+		for (uint32_t bucket = 0; bucket <= _mask; bucket++)
+		{
+			if (_bucketStart[bucket] != _bucketStart[bucket + 1])
+			{
+				buckets.push_back(bucket);
+			}
+		}
+		return;
+	}
+
+	for (int32_t z = z0; z <= z1; z++)
+	{
+		for (int32_t y = y0; y <= y1; y++)
+		{
+			for (int32_t x = x0; x <= x1; x++)
+			{
+				uint32_t bucket = HashCell(x, y, z);
+				if (_bucketStart[bucket] != _bucketStart[bucket + 1])
+				{
+					buckets.push_back(bucket);
+				}
+			}
+		}
+	}
+
+	// A big box wraps round the table, list each bucket once
+	std::sort(buckets.begin(), buckets.end());
+	buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+}
@@ -0,0 +1,80 @@
+#ifndef _SpatialHash_H_
+#define _SpatialHash_H_
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <stdint.h>
+
+/*! \brief Brief description.
+*  SpatialHash sorts points into a uniform grid of cubic cells for neighbour searches.
+*  The grid is unbounded: each cell's integer coordinates are hashed into a table about twice the size of the
+*  number of points, and the points are counting-sorted by bucket. Every bucket is then a contiguous range of the
+*  sorted order, so a search only reads the few ranges around a point.
+*
+*  Different cells can share a bucket, so the points in a bucket still have to be checked for distance.
+*  Callers that keep their own arrays in the sorted order get cache friendly neighbour loops.
+*
+*/
+class SpatialHash
+{
+public:
+
+	/** SpatialHash constructor
+	*/
+	SpatialHash();
+
+	/** Sort a set of points into cells
+	* @param position x, y and z of each point
+	* @param size_t count number of points, the arrays can be longer
+	* @param float cellSize width of a cell, usually the search radius
+	*/
+	void Build(const std::vector<float> position[3], size_t count, float cellSize);
+
+	/** Sorted order, the index of the point at each position
+	*/
+	const std::vector<uint32_t>& GetOrder() const { return _order; }
+
+	/** The bucket that holds a point
+	*/
+	uint32_t GetBucket(float x, float y, float z) const;
+	/** Points in a bucket, as a range of the sorted order
+	*/
+	void GetBucketRange(uint32_t bucket, uint32_t& begin, uint32_t& end) const { begin = _bucketStart[bucket]; end = _bucketStart[bucket + 1]; }
+
+	/** The buckets of the 3x3x3 cells around a point, each listed once even if cells share a bucket
+	* @param uint32_t buckets output
+	* @return the number of buckets written
+	*/
+	int GetNeighbourBuckets(float x, float y, float z, uint32_t buckets[27]) const;
+
+	/** The buckets of every cell that overlaps a box, each listed once
+	* @param std::vector<uint32_t> buckets output, cleared first
+	*/
+	void GetBoxBuckets(const glm::vec3& lower, const glm::vec3& upper, std::vector<uint32_t>& buckets) const;
+
+	float GetCellSize() const { return _cellSize; }
+	/** Number of points built into the hash
+	*/
+	size_t Size() const { return _order.size(); }
+
+private:
+
+	uint32_t HashCell(int32_t x, int32_t y, int32_t z) const;
+	int32_t CellCoordinate(float v) const;
+
+	float _cellSize;
+	float _invCellSize;
+	/** Table size minus one, the table is a power of two
+	*/
+	uint32_t _mask;
+
+	/** Bucket b holds sorted positions _bucketStart[b] to _bucketStart[b + 1]
+	*/
+	std::vector<uint32_t> _bucketStart;
+	std::vector<uint32_t> _order;
+	/** Bucket of each point, in the original order
+	*/
+	std::vector<uint32_t> _pointBucket;
+};
+
+#endif //!_SpatialHash_H_
@@ -0,0 +1,129 @@
+#include "Spawning.h"
+#include <algorithm>
+#include <sstream>
+
+/*! \brief Brief description.
+*  SphereEmitter streams spheres out at a rate and hands back the ones that have outlived their lifetime.
+*
+*/
+SphereEmitter::SphereEmitter(const glm::vec3& position, const glm::vec3& velocity, float rate, float lifetime, float spread, unsigned seed)
+	: _random(seed)
+{
+	_position = position;
+	_velocity = velocity;
+	_rate = rate;
+	_lifetime = lifetime;
+	_spread = spread;
+	_time = 0.0f;
+	_owed = 0.0f;
+	_head = 0;
+}
+
+size_t SphereEmitter::Emit(float deltaTs, std::vector<glm::vec3>& positions, std::vector<glm::vec3>& velocities)
+{
+	std::uniform_real_distribution<float> jitter(-_spread, _spread);
+
+	// Sphere k of this step came out (k + 1 - owed) / rate into it, and has been travelling for the rest of it
+	float due = _owed + _rate * deltaTs;
+	size_t count = (size_t)due;
+	for (size_t k = 0; k < count; k++)
+	{
+		float age = deltaTs - (k + 1.0f - _owed) / _rate;
+		glm::vec3 velocity = _velocity + glm::vec3(jitter(_random), jitter(_random), jitter(_random));
+		positions.push_back(_position + velocity * age);
+		velocities.push_back(velocity);
+	}
+	_owed = due - count;
+	_time += deltaTs;
+	return count;
+}
+
+void SphereEmitter::Track(const Handle<DynamicObject>* handles, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		_live.push_back(handles[i]);
+		_born.push_back(_time);
+	}
+}
+
+void SphereEmitter::Expire(std::vector<Handle<DynamicObject> >& expired)
+{
+	while (_head < _live.size() && _time - _born[_head] > _lifetime)
+	{
+		expired.push_back(_live[_head]);
+		_head++;
+	}
+
+	// Drop the gone ones from the front once they are half the list, erasing keeps the capacity
+	if (_head > 0 && _head * 2 >= _live.size())
+	{
+		_live.erase(_live.begin(), _live.begin() + _head);
+		_born.erase(_born.begin(), _born.begin() + _head);
+		_head = 0;
+	}
+}
+
+void PFG::LatticePattern(const glm::vec3& corner, const glm::vec3& spacing, int nx, int ny, int nz, std::vector<glm::vec3>& positions)
+{
+	positions.reserve(positions.size() + (size_t)std::max(nx, 0) * std::max(ny, 0) * std::max(nz, 0));
+	for (int z = 0; z < nz; z++)
+	{
+		for (int y = 0; y < ny; y++)
+		{
+			for (int x = 0; x < nx; x++)
+			{
+				positions.push_back(corner + glm::vec3((float)x, (float)y, (float)z) * spacing);
+			}
+		}
+	}
+}
+
+void PFG::RandomPattern(const glm::vec3& lower, const glm::vec3& upper, size_t count, unsigned seed, std::vector<glm::vec3>& positions)
+{
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	positions.reserve(positions.size() + count);
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::vec3 t(uniform(random), uniform(random), uniform(random));
+		positions.push_back(lower + t * (upper - lower));
+	}
+}
+
+bool PFG::ParseSpawnPattern(const std::string& line, std::vector<glm::vec3>& positions)
+{
+	std::istringstream stream(line);
+	std::string kind;
+	if (!(stream >> kind))
+	{
+		return false;
+	}
+
+	if (kind == "lattice")
+	{
+		glm::vec3 corner;
+		int nx = 0, ny = 0, nz = 0;
+		float spacing = 0.0f;
+		if (!(stream >> corner.x >> corner.y >> corner.z >> nx >> ny >> nz >> spacing) || nx < 1 || ny < 1 || nz < 1 || spacing <= 0.0f)
+		{
+			return false;
+		}
+		LatticePattern(corner, glm::vec3(spacing), nx, ny, nz, positions);
+		return true;
+	}
+	if (kind == "random")
+	{
+		glm::vec3 lower, upper;
+		int count = 0;
+		unsigned seed = 1;
+		if (!(stream >> lower.x >> lower.y >> lower.z >> upper.x >> upper.y >> upper.z >> count) || count < 1)
+		{
+			return false;
+		}
+		stream >> seed;
+		RandomPattern(glm::min(lower, upper), glm::max(lower, upper), (size_t)count, seed, positions);
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,107 @@
+#ifndef _Spawning_H_
+#define _Spawning_H_
+
+#include "DynamicObject.h"
+#include "Pool.h"
+#include <glm/glm.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+/*! \brief Brief description.
+*  What every sphere in a spawned batch shares, only the positions and velocities differ between them
+*
+*/
+struct SphereSpawn
+{
+	SphereSpawn() : mass(1.0f), radius(0.5f), integrator(INTEGRATOR_RUNGE_KUTTA4), uniformGravity(true), material(NULL), mesh(NULL) {}
+
+	float mass;
+	float radius;
+	IntegratorType integrator;
+	bool uniformGravity; /*!< False when the spheres only feel each other's pull */
+	CollisionFilter filter;
+	Material* material;
+	Mesh* mesh;
+};
+
+/*! \brief Brief description.
+*  SphereEmitter streams spheres out of a point at a steady rate, like a gun or a hose, and recycles them once
+*  they are older than their lifetime.
+*
+*  Each step it works out how many spheres came out during the step, at their own times within it, and places
+*  each one as far along the stream as it has travelled since, so a fast stream comes out spaced along its path
+*  instead of piled up at the nozzle. The scene spawns them in one batch and hands their handles back, and the
+*  emitter keeps the handles in the order they were made, so the expired ones are always at the front.
+*
+*/
+class SphereEmitter
+{
+public:
+
+	/** SphereEmitter constructor
+	* @param float rate spheres per second
+	* @param float lifetime seconds before a sphere is recycled
+	* @param float spread largest random change to each component of the velocity
+	*/
+	SphereEmitter(const glm::vec3& position, const glm::vec3& velocity, float rate, float lifetime, float spread, unsigned seed);
+
+	/** Advance the emitter's clock by a step and append the spheres due in it
+	* @param std::vector<glm::vec3> positions output, appended to
+	* @param std::vector<glm::vec3> velocities output, appended to
+	* @return how many were appended
+	*/
+	size_t Emit(float deltaTs, std::vector<glm::vec3>& positions, std::vector<glm::vec3>& velocities);
+	/** Start the clock on spheres made from the last Emit
+	*/
+	void Track(const Handle<DynamicObject>* handles, size_t count);
+	/** Append the handles of the spheres older than the lifetime to expired and forget them
+	*/
+	void Expire(std::vector<Handle<DynamicObject> >& expired);
+
+	/** Number of spheres out of the emitter and not yet expired
+	*/
+	size_t Size() const { return _live.size() - _head; }
+
+private:
+
+	glm::vec3 _position;
+	glm::vec3 _velocity;
+	float _rate;
+	float _lifetime;
+	float _spread;
+	float _time;
+	/** Fraction of a sphere carried over to the next step
+	*/
+	float _owed;
+	std::mt19937 _random;
+
+	/** Spheres in the order they were made with their time of birth, the ones before _head are gone
+	*/
+	std::vector<Handle<DynamicObject> > _live;
+	std::vector<float> _born;
+	size_t _head;
+};
+
+namespace PFG
+{
+	/*
+	Append the centres of a block of nx by ny by nz spheres, the first one at corner
+	*/
+	void LatticePattern(const glm::vec3& corner, const glm::vec3& spacing, int nx, int ny, int nz, std::vector<glm::vec3>& positions);
+
+	/*
+	Append count centres scattered evenly through the box between lower and upper
+	*/
+	void RandomPattern(const glm::vec3& lower, const glm::vec3& upper, size_t count, unsigned seed, std::vector<glm::vec3>& positions);
+
+	/*
+	Append the centres from a line of the scene file, the part after 'spawn'. One of
+	  lattice <x> <y> <z> <nx> <ny> <nz> <spacing>
+	  random <x0> <y0> <z0> <x1> <y1> <z1> <count> [seed]
+	Returns false if the line can't be read
+	*/
+	bool ParseSpawnPattern(const std::string& line, std::vector<glm::vec3>& positions);
+}
+
+#endif //!_Spawning_H_
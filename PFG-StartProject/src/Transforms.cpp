@@ -0,0 +1,142 @@
+#include "Transforms.h"
+#include <xmmintrin.h>
+
+/*! \brief Brief description.
+*  Model matrices are built as T * S * R from the position, the orientation quaternion and the scale.
+*  Because each part is trivial to invert on its own, the inverse is R^T * S^-1 * T^-1 and never needs glm::inverse.
+*
+*/
+
+void TransformBatch::Clear()
+{
+	px.clear(); py.clear(); pz.clear();
+	qx.clear(); qy.clear(); qz.clear(); qw.clear();
+	sx.clear(); sy.clear(); sz.clear();
+}
+
+void TransformBatch::Add(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+{
+	px.push_back(position.x); py.push_back(position.y); pz.push_back(position.z);
+	qx.push_back(rotation.x); qy.push_back(rotation.y); qz.push_back(rotation.z); qw.push_back(rotation.w);
+	sx.push_back(scale.x); sy.push_back(scale.y); sz.push_back(scale.z);
+}
+
+namespace
+{
+	// Transpose four columns held across the SIMD lanes and store the column of each lane's matrix
+	inline void StoreColumn(__m128 row0, __m128 row1, __m128 row2, __m128 row3, glm::mat4* matrices, int column)
+	{
+		_MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+		_mm_storeu_ps(&matrices[0][column].x, row0);
+		_mm_storeu_ps(&matrices[1][column].x, row1);
+		_mm_storeu_ps(&matrices[2][column].x, row2);
+		_mm_storeu_ps(&matrices[3][column].x, row3);
+	}
+}
+
+namespace PFG
+{
+	void ComposeTransform(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale, glm::mat4& model, glm::mat4& invModel)
+	{
+		glm::mat3 r = glm::mat3_cast(rotation);
+		glm::vec3 invScale = 1.0f / scale;
+
+		// Model: each column of R scaled by the scale, then the translation
+		model = glm::mat4(
+			glm::vec4(r[0] * scale, 0.0f),
+			glm::vec4(r[1] * scale, 0.0f),
+			glm::vec4(r[2] * scale, 0.0f),
+			glm::vec4(position, 1.0f));
+
+		// Inverse: the columns of R^T are the rows of R, divided by the scale of that column
+		glm::mat3 inv = glm::transpose(r);
+		inv[0] *= invScale.x;
+		inv[1] *= invScale.y;
+		inv[2] *= invScale.z;
+
+		invModel = glm::mat4(
+			glm::vec4(inv[0], 0.0f),
+			glm::vec4(inv[1], 0.0f),
+			glm::vec4(inv[2], 0.0f),
+			glm::vec4(-(inv * position), 1.0f));
+	}
+
+	void ComposeTransforms(TransformBatch& batch)
+	{
+		const size_t count = batch.Size();
+		const size_t simdCount = count & ~(size_t)3;
+
+		batch.model.resize(count);
+		batch.invModel.resize(count);
+
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 two = _mm_set1_ps(2.0f);
+
+		for (size_t i = 0; i < simdCount; i += 4)
+		{
+			const __m128 x = _mm_loadu_ps(&batch.qx[i]);
+			const __m128 y = _mm_loadu_ps(&batch.qy[i]);
+			const __m128 z = _mm_loadu_ps(&batch.qz[i]);
+			const __m128 w = _mm_loadu_ps(&batch.qw[i]);
+
+			const __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+			const __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+			const __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+			// Rotation matrix from the quaternion, rRC is row R column C
+			const __m128 r00 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+			const __m128 r01 = _mm_mul_ps(two, _mm_sub_ps(xy, wz));
+			const __m128 r02 = _mm_mul_ps(two, _mm_add_ps(xz, wy));
+			const __m128 r10 = _mm_mul_ps(two, _mm_add_ps(xy, wz));
+			const __m128 r11 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+			const __m128 r12 = _mm_mul_ps(two, _mm_sub_ps(yz, wx));
+			const __m128 r20 = _mm_mul_ps(two, _mm_sub_ps(xz, wy));
+			const __m128 r21 = _mm_mul_ps(two, _mm_add_ps(yz, wx));
+			const __m128 r22 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+
+			const __m128 sx = _mm_loadu_ps(&batch.sx[i]);
+			const __m128 sy = _mm_loadu_ps(&batch.sy[i]);
+			const __m128 sz = _mm_loadu_ps(&batch.sz[i]);
+			const __m128 px = _mm_loadu_ps(&batch.px[i]);
+			const __m128 py = _mm_loadu_ps(&batch.py[i]);
+			const __m128 pz = _mm_loadu_ps(&batch.pz[i]);
+
+			// Model = T * S * R
+			glm::mat4* model = &batch.model[i];
+			StoreColumn(_mm_mul_ps(sx, r00), _mm_mul_ps(sy, r10), _mm_mul_ps(sz, r20), zero, model, 0);
+			StoreColumn(_mm_mul_ps(sx, r01), _mm_mul_ps(sy, r11), _mm_mul_ps(sz, r21), zero, model, 1);
+			StoreColumn(_mm_mul_ps(sx, r02), _mm_mul_ps(sy, r12), _mm_mul_ps(sz, r22), zero, model, 2);
+			StoreColumn(px, py, pz, one, model, 3);
+
+			// Inverse = R^T * S^-1 * T^-1, column C is row C of R divided by the scale along C
+			const __m128 isx = _mm_div_ps(one, sx);
+			const __m128 isy = _mm_div_ps(one, sy);
+			const __m128 isz = _mm_div_ps(one, sz);
+
+			const __m128 i00 = _mm_mul_ps(r00, isx), i01 = _mm_mul_ps(r01, isx), i02 = _mm_mul_ps(r02, isx);
+			const __m128 i10 = _mm_mul_ps(r10, isy), i11 = _mm_mul_ps(r11, isy), i12 = _mm_mul_ps(r12, isy);
+			const __m128 i20 = _mm_mul_ps(r20, isz), i21 = _mm_mul_ps(r21, isz), i22 = _mm_mul_ps(r22, isz);
+
+			// Translation is -(R^T * S^-1) * p
+			__m128 tx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(i00, px), _mm_mul_ps(i10, py)), _mm_mul_ps(i20, pz));
+			__m128 ty = _mm_add_ps(_mm_add_ps(_mm_mul_ps(i01, px), _mm_mul_ps(i11, py)), _mm_mul_ps(i21, pz));
+			__m128 tz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(i02, px), _mm_mul_ps(i12, py)), _mm_mul_ps(i22, pz));
+
+			glm::mat4* invModel = &batch.invModel[i];
+			StoreColumn(i00, i01, i02, zero, invModel, 0);
+			StoreColumn(i10, i11, i12, zero, invModel, 1);
+			StoreColumn(i20, i21, i22, zero, invModel, 2);
+			StoreColumn(_mm_sub_ps(zero, tx), _mm_sub_ps(zero, ty), _mm_sub_ps(zero, tz), one, invModel, 3);
+		}
+
+		// Remaining objects that don't fill a SIMD lane
+		for (size_t i = simdCount; i < count; i++)
+		{
+			ComposeTransform(glm::vec3(batch.px[i], batch.py[i], batch.pz[i]),
+				glm::quat(batch.qw[i], batch.qx[i], batch.qy[i], batch.qz[i]),
+				glm::vec3(batch.sx[i], batch.sy[i], batch.sz[i]),
+				batch.model[i], batch.invModel[i]);
+		}
+	}
+}
@@ -0,0 +1,52 @@
+#ifndef _Transforms_H_
+#define _Transforms_H_
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+
+/*! \brief Brief description.
+*  TransformBatch keeps the position, orientation and scale of every object whose model matrix needs rebuilding
+*  as plain float arrays, so the matrices can be built four objects at a time.
+*  The model and inverse model matrices are written back into the batch in the same order the objects were added.
+*
+*/
+struct TransformBatch
+{
+	/** Remove all objects from the batch, keeping the memory
+	*/
+	void Clear();
+	/** Add an object to the batch
+	* @param glm::vec3 position the translation of the object
+	* @param glm::quat rotation a unit quaternion for the orientation of the object
+	* @param glm::vec3 scale the scale of the object, no component can be zero
+	*/
+	void Add(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale);
+	/** Number of objects in the batch
+	*/
+	size_t Size() const { return sx.size(); }
+
+	std::vector<float> px, py, pz; /*!< Positions */
+	std::vector<float> qx, qy, qz, qw; /*!< Unit quaternions */
+	std::vector<float> sx, sy, sz; /*!< Scales */
+
+	std::vector<glm::mat4> model; /*!< Output, model space to world space */
+	std::vector<glm::mat4> invModel; /*!< Output, world space to model space */
+};
+
+namespace PFG
+{
+	/*
+	Build the model matrix T * S * R for one object and its inverse R^T * S^-1 * T^-1.
+	The inverse comes straight from the parts (transposed rotation, reciprocal scale, negated translation)
+	instead of a general 4x4 inverse
+	*/
+	void ComposeTransform(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale, glm::mat4& model, glm::mat4& invModel);
+
+	/*
+	Build the model and inverse model matrices of every object in the batch, four at a time with SSE
+	*/
+	void ComposeTransforms(TransformBatch& batch);
+}
+
+#endif //!_Transforms_H_
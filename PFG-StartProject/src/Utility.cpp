@@ -30,6 +30,25 @@ namespace PFG
 		return false;
 	}
 
+	bool MovingSphereToHalfSpaceCollision(const glm::vec3& n, const glm::vec3& c0, const glm::vec3& c1, const glm::vec3& q, float r, glm::vec3& ci)
+	{
+		float d0 = DistanceToPlane(n, c0, q);
+		float d1 = DistanceToPlane(n, c1, q);
+
+		if (d0 <= r)
+		{
+			// Touching or inside the solid, push the centre back out to the surface
+			ci = c0 + (r - d0) * n;
+			return true;
+		}
+		if (d1 < r)
+		{
+			float t = (d0 - r) / (d0 - d1);
+			ci = (1 - t) * c0 + t * c1;
+			return true;
+		}
+		return false;
+	}
 
 	bool SphereToSphereCollision(const glm::vec3& c0, const glm::vec3 c1, float r1, float r2, glm::vec3& cp)
 	{
@@ -44,4 +63,152 @@ namespace PFG
 		}
 		return false;
 	}
+
+	bool MovingSphereToSphereCollision(const glm::vec3& a0, const glm::vec3& a1, const glm::vec3& b0, const glm::vec3& b1, float r1, float r2, float& t)
+	{
+		glm::vec3 s = a0 - b0;					// Separation at the start of the step
+		glm::vec3 v = (a1 - a0) - (b1 - b0);	// Relative motion over the step
+		float r = r1 + r2;
+
+		float c = glm::dot(s, s) - r * r;
+		if (c <= 0.0f)
+		{
+			// Already touching at the start of the step
+			t = 0.0f;
+			return true;
+		}
+
+		float a = glm::dot(v, v);
+		float b = glm::dot(s, v);
+		if (a <= 0.0f || b >= 0.0f)
+		{
+			// Not moving relative to each other, or moving apart
+			return false;
+		}
+
+		float discriminant = b * b - a * c;
+		if (discriminant < 0.0f)
+		{
+			// The spheres pass each other without touching
+			return false;
+		}
+
+		t = (-b - glm::sqrt(discriminant)) / a;
+		return t <= 1.0f;
+	}
+
+	glm::vec3 ClosestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+	{
+		glm::vec3 ab = b - a;
+		glm::vec3 ac = c - a;
+		glm::vec3 ap = p - a;
+
+		// Vertex region a
+		float d1 = glm::dot(ab, ap);
+		float d2 = glm::dot(ac, ap);
+		if (d1 <= 0.0f && d2 <= 0.0f)
+		{
+			return a;
+		}
+
+		// Vertex region b
+		glm::vec3 bp = p - b;
+		float d3 = glm::dot(ab, bp);
+		float d4 = glm::dot(ac, bp);
+		if (d3 >= 0.0f && d4 <= d3)
+		{
+			return b;
+		}
+
+		// Edge region ab
+		float vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+		{
+			return a + (d1 / (d1 - d3)) * ab;
+		}
+
+		// Vertex region c
+		glm::vec3 cp = p - c;
+		float d5 = glm::dot(ab, cp);
+		float d6 = glm::dot(ac, cp);
+		if (d6 >= 0.0f && d5 <= d6)
+		{
+			return c;
+		}
+
+		// Edge region ac
+		float vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+		{
+			return a + (d2 / (d2 - d6)) * ac;
+		}
+
+		// Edge region bc
+		float va = d3 * d6 - d5 * d4;
+		if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+		{
+			return b + ((d4 - d3) / ((d4 - d3) + (d5 - d6))) * (c - b);
+		}
+
+		// Face region, use the barycentric coordinates
+		float denom = 1.0f / (va + vb + vc);
+		return a + ab * (vb * denom) + ac * (vc * denom);
+	}
+
+	bool RayToTriangle(const glm::vec3& o, const glm::vec3& d, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, float tMax, float& t)
+	{
+		const float epsilon = 1e-8f;
+
+		glm::vec3 e1 = b - a;
+		glm::vec3 e2 = c - a;
+		glm::vec3 pvec = glm::cross(d, e2);
+		float det = glm::dot(e1, pvec);
+		if (glm::abs(det) < epsilon)
+		{
+			// Ray is parallel to the triangle
+			return false;
+		}
+
+		float invDet = 1.0f / det;
+		glm::vec3 tvec = o - a;
+		float u = glm::dot(tvec, pvec) * invDet;
+		if (u < 0.0f || u > 1.0f)
+		{
+			return false;
+		}
+
+		glm::vec3 qvec = glm::cross(tvec, e1);
+		float v = glm::dot(d, qvec) * invDet;
+		if (v < 0.0f || u + v > 1.0f)
+		{
+			return false;
+		}
+
+		float hit = glm::dot(e2, qvec) * invDet;
+		if (hit < 0.0f || hit > tMax)
+		{
+			return false;
+		}
+
+		t = hit;
+		return true;
+	}
+
+	bool RayToAABB(const glm::vec3& o, const glm::vec3& invD, const glm::vec3& boxMin, const glm::vec3& boxMax, float tMax, float& t)
+	{
+		glm::vec3 t0 = (boxMin - o) * invD;
+		glm::vec3 t1 = (boxMax - o) * invD;
+		glm::vec3 tNear = glm::min(t0, t1);
+		glm::vec3 tFar = glm::max(t0, t1);
+
+		float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+		float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, tMax));
+		if (enter > exit)
+		{
+			return false;
+		}
+
+		t = enter;
+		return true;
+	}
 }
\ No newline at end of file
@@ -17,10 +17,42 @@ namespace PFG
 	*/
 	bool MovingSphereToPlaneCollision(const glm::vec3& n, const glm::vec3& c0, const glm::vec3& c1, const glm::vec3& q, float r, glm::vec3& ci);
 
+	/*
+	A sphere to a half-space collision detection works like the moving sphere to plane test, except that everything
+	behind the plane is solid. A sphere that starts less than 'r' in front of the plane, even deep behind it,
+	is pushed back out along the normal so it can never tunnel out of the solid side
+	*/
+	bool MovingSphereToHalfSpaceCollision(const glm::vec3& n, const glm::vec3& c0, const glm::vec3& c1, const glm::vec3& q, float r, glm::vec3& ci);
+
 
 	/*
 	Sphere to sphere collision detection is calculated by finding the distance between the centre of the sphere c0
 	and the centre of the sphere c1. This function also finds the contact point cp on the sphere
 	*/
 	bool SphereToSphereCollision(const glm::vec3& c0, const glm::vec3 c1, float r1, float r2, glm::vec3& cp);
+
+	/*
+	A moving sphere to moving sphere collision detection is calculated by sweeping both spheres linearly over the step,
+	sphere 1 from a0 to a1 and sphere 2 from b0 to b1. The time of impact 't' is the first root in [0, 1] of
+	|(a0 - b0) + t * (va - vb)| = r1 + r2, returned as a fraction of the step
+	*/
+	bool MovingSphereToSphereCollision(const glm::vec3& a0, const glm::vec3& a1, const glm::vec3& b0, const glm::vec3& b1, float r1, float r2, float& t);
+
+	/*
+	The closest point on a triangle 'abc' to a point 'p' is found by working out which Voronoi region
+	(a vertex, an edge or the face) of the triangle the point lies in, and projecting onto that feature
+	*/
+	glm::vec3 ClosestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+
+	/*
+	A ray to triangle intersection is calculated with the Moller-Trumbore test, solving for the barycentric
+	coordinates of the hit and the distance 't' along the ray 'o + t * d'. Only hits with 0 <= t <= tMax count
+	*/
+	bool RayToTriangle(const glm::vec3& o, const glm::vec3& d, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, float tMax, float& t);
+
+	/*
+	A ray to axis aligned box intersection is calculated with the slab test, using the reciprocal of the ray
+	direction 'invD'. Returns the entry distance 't' along the ray if it enters the box before tMax
+	*/
+	bool RayToAABB(const glm::vec3& o, const glm::vec3& invD, const glm::vec3& boxMin, const glm::vec3& boxMax, float tMax, float& t);
 }
\ No newline at end of file
@@ -0,0 +1,438 @@
+#include "XPBD.h"
+#include <algorithm>
+#include <cmath>
+
+/*! \brief Brief description.
+*  XPBDWorld moves the bodies onto their constraints in many short sub-steps and takes the velocities from the motion.
+*
+*/
+
+// Pairs further apart than their radii plus this, after allowing for their speed, aren't contacts this step
+static const float XPBD_CONTACT_MARGIN = 0.01f;
+// A bounce slower than this many sub-steps of the body's acceleration gets no restitution, so resting
+// bodies don't jitter (Muller et al. 2020)
+static const float XPBD_REST_SUB_STEPS = 2.0f;
+
+XPBDWorld::XPBDWorld()
+{
+	_subSteps = 20;
+	_contactCompliance = 0.0f;
+	_staticFriction = 0.5f;
+	_dynamicFriction = 0.5f;
+	_restitution = 0.5f;
+	_solveCount = 0;
+}
+
+void XPBDWorld::ClearBodies()
+{
+	_bodies.clear();
+	_planeNormals.clear();
+	_planeOffsets.clear();
+	_planeHalfSpace.clear();
+	_planeFilters.clear();
+	_contacts.clear();
+}
+
+size_t XPBDWorld::AddBody(const glm::vec3& position, const glm::vec3& velocity, const glm::quat& rotation, const glm::vec3& angularVelocity, float radius, float mass)
+{
+	Body body;
+	body.position = glm::dvec3(position);
+	body.velocity = velocity;
+	body.rotation = glm::dquat(rotation);
+	body.angularVelocity = angularVelocity;
+	body.force = glm::vec3(0.0f);
+	body.previousPosition = body.position;
+	body.previousRotation = body.rotation;
+	body.radius = radius;
+	body.invMass = mass > 0.0f ? 1.0f / mass : 0.0f;
+	body.invInertia = mass > 0.0f ? 1.0f / (0.4f * mass * radius * radius) : 0.0f;
+	_bodies.push_back(body);
+	return _bodies.size() - 1;
+}
+
+void XPBDWorld::AddPlane(const glm::vec3& normal, float offset, bool halfSpace, const CollisionFilter& filter)
+{
+	_planeNormals.push_back(normal);
+	_planeOffsets.push_back(offset);
+	_planeHalfSpace.push_back(halfSpace);
+	_planeFilters.push_back(filter);
+}
+
+void XPBDWorld::AddDistance(size_t a, size_t b, float restLength, float compliance)
+{
+	Distance distance;
+	distance.a = (uint32_t)a;
+	distance.b = (uint32_t)b;
+	distance.restLength = restLength;
+	distance.compliance = compliance;
+	_distances.push_back(distance);
+}
+
+void XPBDWorld::RemapBodies(const std::vector<uint32_t>& remap)
+{
+	size_t kept = 0;
+	for (size_t i = 0; i < _distances.size(); i++)
+	{
+		Distance distance = _distances[i];
+		distance.a = PFG::RemapBody(remap, distance.a);
+		distance.b = PFG::RemapBody(remap, distance.b);
+		if (distance.a != BODY_REMOVED && distance.b != BODY_REMOVED)
+		{
+			_distances[kept++] = distance;
+		}
+	}
+	_distances.resize(kept);
+}
+
+void XPBDWorld::Step(float deltaTs)
+{
+	_solveCount = 0;
+	if (_bodies.empty() || deltaTs <= 0.0f)
+	{
+		return;
+	}
+
+	FindContacts(deltaTs);
+
+	const int subSteps = std::max(_subSteps, 1);
+	const float h = deltaTs / subSteps;
+	for (int s = 0; s < subSteps; s++)
+	{
+		SubStep(h);
+	}
+}
+
+void XPBDWorld::FindContacts(float deltaTs)
+{
+	_contacts.clear();
+
+	// Each body can reach its radius plus however far it moves this step
+	float largestReach = 0.0f;
+	for (size_t i = 0; i < _bodies.size(); i++)
+	{
+		const Body& body = _bodies[i];
+		float travel = glm::length(body.velocity) * deltaTs + 0.5f * glm::length(body.force) * body.invMass * deltaTs * deltaTs;
+		largestReach = std::max(largestReach, body.radius + travel);
+	}
+
+	Contact contact;
+	contact.plane = false;
+	contact.side = 1.0f;
+	contact.normal = glm::vec3(0.0f);
+	contact.lambdaNormal = 0.0f;
+	contact.lambdaTangent = 0.0f;
+	contact.normalSpeed = 0.0f;
+
+	// Sphere pairs, from a hash with cells wide enough that a pair that can touch is in neighbouring cells
+	for (int k = 0; k < 3; k++)
+	{
+		_hashPositions[k].resize(_bodies.size());
+	}
+	for (size_t i = 0; i < _bodies.size(); i++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			_hashPositions[k][i] = (float)_bodies[i].position[k];
+		}
+	}
+	_hash.Build(_hashPositions, _bodies.size(), 2.0f * largestReach + XPBD_CONTACT_MARGIN);
+	const std::vector<uint32_t>& order = _hash.GetOrder();
+
+	for (uint32_t i = 0; i < (uint32_t)_bodies.size(); i++)
+	{
+		const Body& a = _bodies[i];
+		float reachA = a.radius + glm::length(a.velocity) * deltaTs;
+
+		uint32_t buckets[27];
+		int bucketCount = _hash.GetNeighbourBuckets(a.position.x, a.position.y, a.position.z, buckets);
+		for (int n = 0; n < bucketCount; n++)
+		{
+			uint32_t first, last;
+			_hash.GetBucketRange(buckets[n], first, last);
+			for (uint32_t o = first; o < last; o++)
+			{
+				uint32_t j = order[o];
+				if (j <= i || (a.invMass == 0.0f && _bodies[j].invMass == 0.0f) || !PFG::ShouldCollide(a.filter, _bodies[j].filter))
+				{
+					continue;
+				}
+				const Body& b = _bodies[j];
+				float reach = reachA + b.radius + glm::length(b.velocity) * deltaTs + XPBD_CONTACT_MARGIN;
+				glm::vec3 delta = glm::vec3(a.position - b.position);
+				if (glm::dot(delta, delta) < reach * reach)
+				{
+					contact.a = i;
+					contact.b = j;
+					_contacts.push_back(contact);
+				}
+			}
+		}
+	}
+
+	// Sphere and plane pairs
+	contact.plane = true;
+	for (uint32_t i = 0; i < (uint32_t)_bodies.size(); i++)
+	{
+		const Body& body = _bodies[i];
+		if (body.invMass == 0.0f)
+		{
+			continue;
+		}
+		float reach = body.radius + glm::length(body.velocity) * deltaTs + XPBD_CONTACT_MARGIN;
+		for (uint32_t p = 0; p < (uint32_t)_planeNormals.size(); p++)
+		{
+			if (!PFG::ShouldCollide(body.filter, _planeFilters[p]))
+			{
+				continue;
+			}
+			float distance = glm::dot(_planeNormals[p], glm::vec3(body.position)) - _planeOffsets[p];
+			if (distance >= reach || (_planeHalfSpace[p] == false && distance <= -reach))
+			{
+				continue;
+			}
+			contact.a = i;
+			contact.b = p;
+			contact.side = (_planeHalfSpace[p] || distance >= 0.0f) ? 1.0f : -1.0f;
+			contact.normal = contact.side * _planeNormals[p];
+			_contacts.push_back(contact);
+		}
+	}
+}
+
+void XPBDWorld::SubStep(float h)
+{
+	// Move every body as if nothing were in its way
+	for (size_t i = 0; i < _bodies.size(); i++)
+	{
+		Body& body = _bodies[i];
+		body.previousPosition = body.position;
+		body.previousRotation = body.rotation;
+		if (body.invMass == 0.0f)
+		{
+			// Nothing pushes a body without mass, a kinematic one still follows its velocity
+			body.position += glm::dvec3(h * body.velocity);
+			continue;
+		}
+		body.velocity += h * body.force * body.invMass;
+		body.position += glm::dvec3(h * body.velocity);
+
+		const glm::dvec3 w = glm::dvec3(body.angularVelocity);
+		body.rotation = glm::normalize(body.rotation + glm::dquat(0.0, w.x, w.y, w.z) * body.rotation * (0.5 * h));
+	}
+
+	// Project every constraint once
+	for (size_t c = 0; c < _distances.size(); c++)
+	{
+		SolveDistance(_distances[c], h);
+	}
+	for (size_t c = 0; c < _contacts.size(); c++)
+	{
+		SolveContact(_contacts[c], h);
+	}
+	_solveCount += _distances.size() + _contacts.size();
+
+	// The velocities are however far the bodies actually moved
+	for (size_t i = 0; i < _bodies.size(); i++)
+	{
+		Body& body = _bodies[i];
+		if (body.invMass == 0.0f)
+		{
+			continue;
+		}
+		body.velocity = glm::vec3((body.position - body.previousPosition) / (double)h);
+
+		glm::dquat turn = body.rotation * glm::inverse(body.previousRotation);
+		body.angularVelocity = glm::vec3((2.0 / h) * glm::dvec3(turn.x, turn.y, turn.z));
+		if (turn.w < 0.0f)
+		{
+			body.angularVelocity = -body.angularVelocity;
+		}
+	}
+
+	for (size_t c = 0; c < _contacts.size(); c++)
+	{
+		SolveContactVelocity(_contacts[c], h);
+	}
+}
+
+void XPBDWorld::SolveDistance(const Distance& distance, float h)
+{
+	if (distance.a >= _bodies.size() || distance.b >= _bodies.size())
+	{
+		return;
+	}
+	Body& a = _bodies[distance.a];
+	Body& b = _bodies[distance.b];
+	const float w = a.invMass + b.invMass;
+	glm::vec3 delta = glm::vec3(a.position - b.position);
+	float length = glm::length(delta);
+	if (w == 0.0f || length == 0.0f)
+	{
+		return;
+	}
+
+	// One projection per sub-step, so the multiplier starts from zero each time
+	const float alpha = distance.compliance / (h * h);
+	glm::vec3 n = delta / length;
+	float lambda = -(length - distance.restLength) / (w + alpha);
+	a.position += glm::dvec3(lambda * a.invMass * n);
+	b.position -= glm::dvec3(lambda * b.invMass * n);
+}
+
+void XPBDWorld::SolveContact(Contact& contact, float h)
+{
+	contact.lambdaNormal = 0.0f;
+	contact.lambdaTangent = 0.0f;
+
+	Body& a = _bodies[contact.a];
+	Body* b = contact.plane ? NULL : &_bodies[contact.b];
+
+	// Gap along the normal, negative when the sphere is inside
+	float gap;
+	if (contact.plane)
+	{
+		gap = contact.side * (float)(glm::dot(glm::dvec3(_planeNormals[contact.b]), a.position) - _planeOffsets[contact.b]) - a.radius;
+	}
+	else
+	{
+		glm::vec3 delta = glm::vec3(a.position - b->position);
+		float length = glm::length(delta);
+		if (length == 0.0f)
+		{
+			return;
+		}
+		contact.normal = delta / length;
+		gap = length - a.radius - b->radius;
+	}
+
+	const glm::vec3 n = contact.normal;
+	const glm::vec3 rA = -a.radius * n;
+	const glm::vec3 rB = b ? b->radius * n : glm::vec3(0.0f);
+
+	glm::vec3 relativeVelocity = a.velocity + glm::cross(a.angularVelocity, rA);
+	if (b)
+	{
+		relativeVelocity -= b->velocity + glm::cross(b->angularVelocity, rB);
+	}
+	contact.normalSpeed = glm::dot(n, relativeVelocity);
+
+	if (gap >= 0.0f)
+	{
+		return;
+	}
+
+	// The contact point is on the line through the centres, so the push along it doesn't turn either sphere
+	const float alpha = _contactCompliance / (h * h);
+	const float w = a.invMass + (b ? b->invMass : 0.0f);
+	float lambda = -gap / (w + alpha);
+	contact.lambdaNormal = lambda;
+	a.position += glm::dvec3(lambda * a.invMass * n);
+	if (b)
+	{
+		b->position -= glm::dvec3(lambda * b->invMass * n);
+	}
+
+	// Static friction: pull the contact points back together sideways, if the normal push allows it
+	glm::dvec3 localA = glm::inverse(a.rotation) * glm::dvec3(rA);
+	glm::dvec3 drift = (a.position - a.previousPosition) + (a.rotation * localA - a.previousRotation * localA);
+	if (b)
+	{
+		glm::dvec3 localB = glm::inverse(b->rotation) * glm::dvec3(rB);
+		drift -= (b->position - b->previousPosition) + (b->rotation * localB - b->previousRotation * localB);
+	}
+	glm::vec3 tangentDrift = glm::vec3(drift) - glm::dot(glm::vec3(drift), n) * n;
+	float slide = glm::length(tangentDrift);
+	if (slide == 0.0f)
+	{
+		return;
+	}
+
+	// |r x t| is the radius for any tangent t, since r is along the normal
+	float wTangent = a.invMass + a.invInertia * a.radius * a.radius;
+	if (b)
+	{
+		wTangent += b->invMass + b->invInertia * b->radius * b->radius;
+	}
+	float lambdaTangent = slide / wTangent;
+	if (lambdaTangent > _staticFriction * lambda)
+	{
+		return;
+	}
+	contact.lambdaTangent = lambdaTangent;
+
+	glm::vec3 p = -lambdaTangent * (tangentDrift / slide);
+	ApplyCorrection(a, p, rA);
+	if (b)
+	{
+		ApplyCorrection(*b, -p, rB);
+	}
+}
+
+void XPBDWorld::SolveContactVelocity(const Contact& contact, float h)
+{
+	if (contact.lambdaNormal == 0.0f)
+	{
+		return;
+	}
+
+	Body& a = _bodies[contact.a];
+	Body* b = contact.plane ? NULL : &_bodies[contact.b];
+	const glm::vec3 n = contact.normal;
+	const glm::vec3 rA = -a.radius * n;
+	const glm::vec3 rB = b ? b->radius * n : glm::vec3(0.0f);
+
+	glm::vec3 relativeVelocity = a.velocity + glm::cross(a.angularVelocity, rA);
+	if (b)
+	{
+		relativeVelocity -= b->velocity + glm::cross(b->angularVelocity, rB);
+	}
+	float normalSpeed = glm::dot(n, relativeVelocity);
+	glm::vec3 tangentVelocity = relativeVelocity - normalSpeed * n;
+	float tangentSpeed = glm::length(tangentVelocity);
+
+	// Dynamic friction, up to the friction coefficient times the normal force, lambda / h^2
+	if (tangentSpeed > 0.0f)
+	{
+		float change = std::min(_dynamicFriction * contact.lambdaNormal / h, tangentSpeed);
+		float wTangent = a.invMass + a.invInertia * a.radius * a.radius;
+		if (b)
+		{
+			wTangent += b->invMass + b->invInertia * b->radius * b->radius;
+		}
+		glm::vec3 p = (-change / wTangent) * (tangentVelocity / tangentSpeed);
+		ApplyImpulse(a, p, rA);
+		if (b)
+		{
+			ApplyImpulse(*b, -p, rB);
+		}
+	}
+
+	// Restitution: replace the normal speed the position pass produced with a bounce off the speed before it
+	float acceleration = glm::length(a.force) * a.invMass;
+	if (b)
+	{
+		acceleration = std::max(acceleration, glm::length(b->force) * b->invMass);
+	}
+	float restitution = std::abs(normalSpeed) <= XPBD_REST_SUB_STEPS * acceleration * h ? 0.0f : _restitution;
+	float target = std::max(-restitution * contact.normalSpeed, 0.0f);
+	float w = a.invMass + (b ? b->invMass : 0.0f);
+	glm::vec3 p = ((target - normalSpeed) / w) * n;
+	ApplyImpulse(a, p, rA);
+	if (b)
+	{
+		ApplyImpulse(*b, -p, rB);
+	}
+}
+
+void XPBDWorld::ApplyCorrection(Body& body, const glm::vec3& p, const glm::vec3& r)
+{
+	body.position += glm::dvec3(body.invMass * p);
+	glm::dvec3 turn = glm::dvec3(body.invInertia * glm::cross(r, p));
+	body.rotation = glm::normalize(body.rotation + glm::dquat(0.0, turn.x, turn.y, turn.z) * body.rotation * 0.5);
+}
+
+void XPBDWorld::ApplyImpulse(Body& body, const glm::vec3& p, const glm::vec3& r)
+{
+	body.velocity += body.invMass * p;
+	body.angularVelocity += body.invInertia * glm::cross(r, p);
+}
@@ -0,0 +1,181 @@
+#ifndef _XPBD_H_
+#define _XPBD_H_
+
+#include "BodyRemap.h"
+#include "SpatialHash.h"
+#include "CollisionFilter.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+#include <stdint.h>
+
+/*! \brief Brief description.
+*  XPBDWorld steps rigid spheres with extended position based dynamics (Macklin et al. 2016, Muller et al. 2020)
+*  instead of forces and impulses. Each step is split into many short sub-steps with one pass over the constraints
+*  in each (Macklin et al. 2019). A sub-step moves every body ballistically, then moves the positions and
+*  orientations straight onto the contact and distance constraints, and takes the velocities from how far the
+*  bodies actually moved. A last velocity pass adds restitution and sliding friction.
+*
+*  Each constraint has a compliance, the inverse of its stiffness. Zero is perfectly rigid, and since the
+*  correction is a position rather than a force, even a rigid constraint can't make the step blow up.
+*  Static friction is a position constraint too: the contact points are held together until that would need
+*  more than the friction coefficient times the normal push.
+*
+*  Contacts are found once per step with a SpatialHash, for every pair that could touch within the step, and
+*  then tested again in each sub-step. Planes are static, a thin plane stops spheres on the side they started on.
+*
+*/
+class XPBDWorld
+{
+public:
+
+	/** XPBDWorld constructor
+	*/
+	XPBDWorld();
+
+	/** Remove the bodies and planes, the distance constraints are kept
+	* The scene hands the bodies over again every step
+	*/
+	void ClearBodies();
+	/** Add a solid sphere
+	* @param glm::quat rotation orientation
+	* @param glm::vec3 angularVelocity in world space
+	* @param float mass zero for a body that nothing pushes, it keeps moving at its velocity
+	* @return index of the body
+	*/
+	size_t AddBody(const glm::vec3& position, const glm::vec3& velocity, const glm::quat& rotation, const glm::vec3& angularVelocity, float radius, float mass);
+	/** Force on a body, held constant over the step
+	*/
+	void SetExternalForce(size_t body, const glm::vec3& force) { _bodies[body].force = force; }
+	/** Which bodies and planes a body collides with, pairs that fail are never made into contacts
+	*/
+	void SetCollisionFilter(size_t body, const CollisionFilter& filter) { _bodies[body].filter = filter; }
+	/** Add a static plane
+	* @param glm::vec3 normal unit normal
+	* @param float offset dot(normal, x) for any point x on the plane
+	* @param bool halfSpace true if everything behind the plane is solid
+	*/
+	void AddPlane(const glm::vec3& normal, float offset, bool halfSpace, const CollisionFilter& filter = CollisionFilter());
+	/** Hold the centres of two bodies at a fixed distance
+	* @param float compliance inverse stiffness, zero for a rigid rod
+	*/
+	void AddDistance(size_t a, size_t b, float restLength, float compliance);
+	void ClearDistances() { _distances.clear(); }
+	/** Renumber the distance constraints' bodies after the scene removed some, those on a removed body are dropped
+	* @param std::vector<uint32_t> remap new index of each old body, or BODY_REMOVED
+	*/
+	void RemapBodies(const std::vector<uint32_t>& remap);
+
+	/** Sub-steps in each Step, more gives stiffer constraints and less damping
+	*/
+	void SetSubSteps(int subSteps) { _subSteps = subSteps; }
+	/** Compliance of every contact, zero for hard contacts
+	*/
+	void SetContactCompliance(float compliance) { _contactCompliance = compliance; }
+	void SetFriction(float staticFriction, float dynamicFriction) { _staticFriction = staticFriction; _dynamicFriction = dynamicFriction; }
+	void SetRestitution(float restitution) { _restitution = restitution; }
+
+	/** Advance every body by deltaTs in the set number of sub-steps
+	*/
+	void Step(float deltaTs);
+
+	size_t Size() const { return _bodies.size(); }
+	glm::vec3 GetPosition(size_t body) const { return glm::vec3(_bodies[body].position); }
+	glm::vec3 GetVelocity(size_t body) const { return _bodies[body].velocity; }
+	glm::quat GetRotation(size_t body) const { return glm::quat(_bodies[body].rotation); }
+	glm::vec3 GetAngularVelocity(size_t body) const { return _bodies[body].angularVelocity; }
+	/** Contacts that could touch during the last step
+	*/
+	size_t GetContactCount() const { return _contacts.size(); }
+	/** Constraint projections in the last step, contacts and distances times sub-steps
+	*/
+	uint64_t GetSolveCount() const { return _solveCount; }
+
+private:
+
+	/** Positions and orientations are doubles, a sub-step moves a slow body less than a float can resolve
+	* a few units from the origin, and the velocities are taken from that motion
+	*/
+	struct Body
+	{
+		glm::dvec3 position;
+		glm::vec3 velocity;
+		glm::dquat rotation;
+		glm::vec3 angularVelocity;
+		glm::vec3 force;
+		/** Position and orientation at the start of the sub-step
+		*/
+		glm::dvec3 previousPosition;
+		glm::dquat previousRotation;
+		float radius;
+		float invMass;
+		/** Solid sphere, the same about every axis
+		*/
+		float invInertia;
+		CollisionFilter filter;
+	};
+
+	/** A sphere against another sphere, or against a plane when plane is set
+	*/
+	struct Contact
+	{
+		uint32_t a;
+		uint32_t b; /*!< Other sphere, or the plane */
+		bool plane;
+		/** Which side of a thin plane the sphere started on, +1 or -1
+		*/
+		float side;
+		/** From b to a, set by the position pass
+		*/
+		glm::vec3 normal;
+		float lambdaNormal;
+		float lambdaTangent;
+		/** Normal velocity at the start of the sub-step, for restitution
+		*/
+		float normalSpeed;
+	};
+
+	struct Distance
+	{
+		uint32_t a;
+		uint32_t b;
+		float restLength;
+		float compliance;
+	};
+
+	/** Find every sphere-sphere and sphere-plane pair that could touch within deltaTs
+	*/
+	void FindContacts(float deltaTs);
+	void SubStep(float h);
+	void SolveDistance(const Distance& distance, float h);
+	void SolveContact(Contact& contact, float h);
+	/** Restitution and dynamic friction on the contacts that pushed in the last position pass
+	*/
+	void SolveContactVelocity(const Contact& contact, float h);
+	/** Move a body by a positional impulse p applied at r from its centre
+	*/
+	void ApplyCorrection(Body& body, const glm::vec3& p, const glm::vec3& r);
+	/** Change a body's velocities by an impulse p applied at r from its centre
+	*/
+	void ApplyImpulse(Body& body, const glm::vec3& p, const glm::vec3& r);
+
+	std::vector<Body> _bodies;
+	std::vector<glm::vec3> _planeNormals;
+	std::vector<float> _planeOffsets;
+	std::vector<bool> _planeHalfSpace;
+	std::vector<CollisionFilter> _planeFilters;
+	std::vector<Distance> _distances;
+	std::vector<Contact> _contacts;
+
+	SpatialHash _hash;
+	std::vector<float> _hashPositions[3];
+
+	int _subSteps;
+	float _contactCompliance;
+	float _staticFriction;
+	float _dynamicFriction;
+	float _restitution;
+	uint64_t _solveCount;
+};
+
+#endif //!_XPBD_H_
@@ -0,0 +1,147 @@
+#include "glew.h"
+#include "Scene.h"
+#include <SDL.h>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+/**
+* Steps each test scene until its working arrays have grown to what it needs, then counts every heap allocation
+* over more steps and fails if there were any. Each step also queries the scene the way a game would each frame,
+* which rebuilds the query hierarchy. Every operator new in the program goes through the replacement below,
+* including the worker threads and the standard containers.
+* Run it from the project directory like the game, so it finds the scene files and the assets.
+* @file: AllocationTest.cpp
+*/
+
+// Steps before counting, long enough for the spheres to settle and the arrays to reach their largest
+static const int ALLOCATION_WARM_STEPS = 1000;
+// Steps counted
+static const int ALLOCATION_COUNTED_STEPS = 1000;
+// A frame at 60 frames per second
+static const float ALLOCATION_STEP = 1.0f / 60.0f;
+// Scenes stepped, the game's own and ones that turn on the other parts of the step. The emitters keep removing
+// spheres and adding new ones in their slots, so reusing the pools is counted too
+static const char* ALLOCATION_SCENES[] =
+{
+	"Input.txt",
+	"tests/AllocationScene.txt",
+	"tests/AllocationSceneXPBD.txt",
+	"tests/AllocationSceneEventDriven.txt"
+};
+// Bodies each query can return
+static const size_t ALLOCATION_QUERY_CAPACITY = 16;
+// Reach of the radius query around the origin
+static const float ALLOCATION_QUERY_RADIUS = 10.0f;
+
+static std::atomic<bool> counting(false);
+static std::atomic<long> allocations(0);
+
+/**
+* Stands in for the queries a game makes each frame, against buffers it owns
+*/
+static void QueryScene(Scene* scene, uint32_t* bodies, float* distances)
+{
+	const QueryTree& tree = scene->GetQueryTree();
+	tree.FindInRadius(glm::vec3(0.0f), ALLOCATION_QUERY_RADIUS, 0xffffffffu, bodies, ALLOCATION_QUERY_CAPACITY);
+	tree.FindNearest(glm::vec3(0.0f), ALLOCATION_QUERY_CAPACITY, 0xffffffffu, bodies, distances);
+}
+
+void* operator new(size_t size)
+{
+	if (counting)
+	{
+		allocations++;
+	}
+	void* memory = std::malloc(size > 0 ? size : 1);
+	if (memory == NULL)
+	{
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+	std::free(memory);
+}
+
+int main(int argc, char* argv[])
+{
+	// Nothing is drawn, but the scene loads its shaders and meshes so it still needs a GL context
+	if (SDL_Init(SDL_INIT_VIDEO) != 0)
+	{
+		std::cerr << "Failed to init SDL!\n";
+		return -1;
+	}
+	SDL_Window* window = SDL_CreateWindow("Allocation Test", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 320, 240, SDL_WINDOW_HIDDEN | SDL_WINDOW_OPENGL);
+	if (window == NULL)
+	{
+		std::cerr << "Failed to create SDL window!\n";
+		return -1;
+	}
+	SDL_GLContext glcontext = SDL_GL_CreateContext(window);
+	glewExperimental = GL_TRUE;
+	if (glewInit() != GLEW_OK)
+	{
+		std::cerr << "Failed to init GLEW!\n";
+		return -1;
+	}
+
+	Input* input = new Input();
+	input->cmd_x = true;
+	uint32_t bodies[ALLOCATION_QUERY_CAPACITY];
+	float distances[ALLOCATION_QUERY_CAPACITY];
+
+	bool passed = true;
+	for (size_t s = 0; s < sizeof(ALLOCATION_SCENES) / sizeof(ALLOCATION_SCENES[0]); s++)
+	{
+		Scene* scene = new Scene(ALLOCATION_SCENES[s]);
+		for (int i = 0; i < ALLOCATION_WARM_STEPS; i++)
+		{
+			scene->Update(ALLOCATION_STEP, input);
+			QueryScene(scene, bodies, distances);
+		}
+
+		allocations = 0;
+		counting = true;
+		for (int i = 0; i < ALLOCATION_COUNTED_STEPS; i++)
+		{
+			scene->Update(ALLOCATION_STEP, input);
+			QueryScene(scene, bodies, distances);
+		}
+		counting = false;
+		delete scene;
+
+		const long counted = allocations;
+		std::cout << ALLOCATION_SCENES[s] << ": " << counted << " allocations in " << ALLOCATION_COUNTED_STEPS << " steps after " << ALLOCATION_WARM_STEPS << " to warm up\n";
+		if (counted > 0)
+		{
+			std::cerr << "FAILED: stepping " << ALLOCATION_SCENES[s] << " allocated\n";
+			passed = false;
+		}
+	}
+
+	delete input;
+	SDL_GL_DeleteContext(glcontext);
+	SDL_DestroyWindow(window);
+	SDL_Quit();
+
+	if (!passed)
+	{
+		return 1;
+	}
+	std::cout << "PASSED\n";
+	return 0;
+}